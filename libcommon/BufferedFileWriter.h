@@ -0,0 +1,284 @@
+#pragma once
+// BufferedFileWriter
+//  append buffer in front of a file handle, for writers that emit many small records
+//  records accumulate in memory and go to the end of the file in one write per batch, when the
+//  buffer fills, when the flush interval has elapsed (checked on append and by FlushIfDue), or on
+//  an explicit Flush
+//  the writer has no timer or thread of its own: an owner that may stop appending must call FlushIfDue
+//  periodically (CSVEmitter does from its flush timer), or buffered records wait for the next append
+//
+//  optionally each flush is written as one LZ4 frame (see LZ4Frame.h), so the file is a sequence of
+//  complete frames that a reader can follow, with at most the last one partially written
+//
+//  Win32 backend uses HANDLE/WriteFile, other platforms use a POSIX file descriptor
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include "LZ4Frame.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+class BufferedFileWriter
+{
+public:
+#ifdef _WIN32
+	typedef HANDLE FileHandle;
+	typedef wchar_t PathChar;
+	static FileHandle InvalidHandle()
+	{
+		return INVALID_HANDLE_VALUE;
+	}
+#else
+	typedef int FileHandle;
+	typedef char PathChar;
+	static FileHandle InvalidHandle()
+	{
+		return -1;
+	}
+#endif
+	static constexpr size_t DEFAULT_BUFFER_SIZE = 64 * 1024;
+	static constexpr unsigned int DEFAULT_FLUSH_INTERVAL_MS = 1000;
+	static constexpr size_t MAX_PENDING_BUFFERS = 16;	// buffered data is dropped past this many failed buffers' worth
+
+private:
+	FileHandle hFile = InvalidHandle();
+	bool ownsHandle = false;
+	std::string buffer;
+	size_t bufferSize = DEFAULT_BUFFER_SIZE;
+	std::chrono::milliseconds flushInterval{ DEFAULT_FLUSH_INTERVAL_MS };
+	std::chrono::steady_clock::time_point timeLastFlush = std::chrono::steady_clock::now();
+	unsigned long long writeCount = 0;
+	unsigned long long bytesWritten = 0;
+	bool isCompressed = false;
+	std::string frame;	// compressed form of buffer, capacity reused
+
+	bool WriteToEnd(const char* data, const size_t length)
+	{
+#ifdef _WIN32
+		LARGE_INTEGER liZero = {};
+		if (!SetFilePointerEx(hFile, liZero, nullptr, FILE_END))
+		{
+			return false;
+		}
+		size_t offset = 0;
+		while (offset < length)
+		{
+			DWORD chunk = static_cast<DWORD>(length - offset > 0x40000000 ? 0x40000000 : length - offset);
+			DWORD dwBytesWrote = 0;
+			if (!WriteFile(hFile, data + offset, chunk, &dwBytesWrote, nullptr) || !dwBytesWrote)
+			{
+				return false;
+			}
+			offset += dwBytesWrote;
+		}
+		return true;
+#else
+		// descriptors this class opens are O_APPEND, attached ones are positioned at the end
+		if (lseek(hFile, 0, SEEK_END) == -1)
+		{
+			return false;
+		}
+		size_t offset = 0;
+		while (offset < length)
+		{
+			ssize_t wrote = write(hFile, data + offset, length - offset);
+			if (wrote <= 0)
+			{
+				return false;
+			}
+			offset += static_cast<size_t>(wrote);
+		}
+		return true;
+#endif
+	}
+	void CloseIfOwned()
+	{
+		if (ownsHandle && hFile != InvalidHandle())
+		{
+#ifdef _WIN32
+			CloseHandle(hFile);
+#else
+			close(hFile);
+#endif
+		}
+		hFile = InvalidHandle();
+		ownsHandle = false;
+	}
+
+public:
+	BufferedFileWriter() {}
+	BufferedFileWriter(const BufferedFileWriter&) = delete;
+	BufferedFileWriter& operator = (const BufferedFileWriter&) = delete;
+	~BufferedFileWriter()
+	{
+		Close();
+	}
+
+	// buffered bytes that trigger a write, and max age of buffered data (0 to flush only when full)
+	void SetBufferSize(const size_t size)
+	{
+		bufferSize = size ? size : 1;
+	}
+	void SetFlushInterval(const unsigned int milliseconds)
+	{
+		flushInterval = std::chrono::milliseconds(milliseconds);
+	}
+	// write each flush as an LZ4 frame. Anything buffered is flushed in the previous mode first.
+	bool SetCompression(const bool enabled)
+	{
+		if (enabled == isCompressed)
+		{
+			return true;
+		}
+		const bool isFlushed = Flush();
+		isCompressed = enabled;
+		return isFlushed;
+	}
+	bool IsCompressed() const
+	{
+		return isCompressed;
+	}
+
+	// write through an existing handle. Pending data for a previously attached handle is flushed first.
+	void Attach(const FileHandle handle, const bool takeOwnership = false)
+	{
+		if (handle == hFile)
+		{
+			ownsHandle = ownsHandle || takeOwnership;
+			return;
+		}
+		Close();
+		hFile = handle;
+		ownsHandle = takeOwnership;
+		timeLastFlush = std::chrono::steady_clock::now();
+	}
+	// flush and release the handle without closing it (unless owned)
+	FileHandle Detach()
+	{
+		Flush();
+		FileHandle handle = hFile;
+		hFile = InvalidHandle();
+		ownsHandle = false;
+		return handle;
+	}
+	// open (creating if needed) for appending, owned by the writer. Optionally emptied first.
+	bool Open(const PathChar* path, const bool truncate = false)
+	{
+		Close();
+#ifdef _WIN32
+		FileHandle handle = CreateFile(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+#else
+		FileHandle handle = open(path, O_WRONLY | O_CREAT | O_APPEND | (truncate ? O_TRUNC : 0), 0644);
+#endif
+		if (handle == InvalidHandle())
+		{
+			return false;
+		}
+		Attach(handle, true);
+		return true;
+	}
+	void Close()
+	{
+		Flush();
+		CloseIfOwned();
+	}
+	// cut the file to length (after writing anything buffered), e.g. to drop a partially written record
+	bool Truncate(const uint64_t length)
+	{
+		if (!Flush())
+		{
+			return false;
+		}
+#ifdef _WIN32
+		LARGE_INTEGER liLength;
+		liLength.QuadPart = static_cast<LONGLONG>(length);
+		return SetFilePointerEx(hFile, liLength, nullptr, FILE_BEGIN) && SetEndOfFile(hFile);
+#else
+		return ftruncate(hFile, static_cast<off_t>(length)) == 0;
+#endif
+	}
+	FileHandle GetHandle() const
+	{
+		return hFile;
+	}
+	bool IsAttached() const
+	{
+		return hFile != InvalidHandle();
+	}
+
+	bool Append(const char* data, const size_t length)
+	{
+		buffer.append(data, length);
+		if (buffer.size() >= bufferSize)
+		{
+			return Flush();
+		}
+		return FlushIfDue();
+	}
+	bool Append(const std::string& data)
+	{
+		return Append(data.data(), data.size());
+	}
+
+	// flush if the buffered data is older than the flush interval. Owners call it on a timer, since
+	// nothing else flushes data left buffered once appends stop
+	bool FlushIfDue()
+	{
+		if (!buffer.empty()
+			&& std::chrono::steady_clock::now() - timeLastFlush >= flushInterval)
+		{
+			return Flush();
+		}
+		return true;
+	}
+	// write everything buffered in a single write. On failure the data is kept for the next attempt (within limits).
+	bool Flush()
+	{
+		timeLastFlush = std::chrono::steady_clock::now();
+		if (buffer.empty())
+		{
+			return true;
+		}
+		const std::string* pOut = &buffer;
+		if (isCompressed)
+		{
+			frame.clear();
+			LZ4Frame::AppendFrame(frame, buffer.data(), buffer.size());
+			pOut = &frame;
+		}
+		if (hFile == InvalidHandle() || !WriteToEnd(pOut->data(), pOut->size()))
+		{
+			// don't grow without bound if the file stays unwritable
+			if (buffer.size() > bufferSize * MAX_PENDING_BUFFERS)
+			{
+				buffer.clear();
+			}
+			return false;
+		}
+		writeCount++;
+		bytesWritten += pOut->size();
+		buffer.clear();
+		return true;
+	}
+
+	size_t GetBufferedSize() const
+	{
+		return buffer.size();
+	}
+	// number of batched writes issued, and their total size (compressed size when compressing)
+	unsigned long long GetWriteCount() const
+	{
+		return writeCount;
+	}
+	unsigned long long GetBytesWritten() const
+	{
+		return bytesWritten;
+	}
+};
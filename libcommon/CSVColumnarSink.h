@@ -0,0 +1,150 @@
+#pragma once
+// CSVColumnarSink
+//  row visitor for CSVReader::VisitRows (or CSVTailReader) that appends selected fields of each row
+//  straight into typed columns. Numbers are parsed from the UTF-8 field bytes with from_chars and
+//  strings are appended to one arena per column, so a row costs no allocation beyond amortized
+//  column growth.
+//
+//  portable (no Windows dependencies)
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <functional>
+#include "CSVTokenizer.h"
+#include "CSVProjection.h"
+
+class CSVColumnarSink
+{
+public:
+	enum ColumnType
+	{
+		COLUMN_INT64,
+		COLUMN_DOUBLE,
+		COLUMN_STRING
+	};
+
+private:
+	struct Column
+	{
+		size_t fieldIndex = 0;
+		ColumnType type = COLUMN_STRING;
+		std::vector<int64_t> ints;
+		std::vector<double> doubles;
+		std::string stringArena;			// all string values of the column back to back
+		std::vector<size_t> stringEnds;		// end offset of each value in stringArena
+	};
+	std::vector<Column> columns;
+	size_t rowCount = 0;
+	size_t parseErrorCount = 0;
+	std::string scratch;
+
+public:
+	// add a column that takes its values from the given field index of each row
+	// returns the column index
+	size_t AddColumn(const size_t fieldIndex, const ColumnType type)
+	{
+		Column column;
+		column.fieldIndex = fieldIndex;
+		column.type = type;
+		columns.push_back(std::move(column));
+		return columns.size() - 1;
+	}
+
+	// append one row. Missing or unparseable numeric fields are stored as 0 (int64) or NaN (double)
+	// and counted in GetParseErrorCount
+	bool Append(const CSVRowView& row)
+	{
+		for (auto& column : columns)
+		{
+			std::string_view value;
+			if (column.fieldIndex < row.size())
+			{
+				value = row[column.fieldIndex].Value(scratch);
+			}
+			switch (column.type)
+			{
+			case COLUMN_INT64:
+			{
+				int64_t n = 0;
+				if (!CSVProjection::ParseInt64(value, n))
+				{
+					n = 0;
+					parseErrorCount++;
+				}
+				column.ints.push_back(n);
+				break;
+			}
+			case COLUMN_DOUBLE:
+			{
+				double d = 0;
+				if (!CSVProjection::ParseDouble(value, d))
+				{
+					d = std::numeric_limits<double>::quiet_NaN();
+					parseErrorCount++;
+				}
+				column.doubles.push_back(d);
+				break;
+			}
+			case COLUMN_STRING:
+				column.stringArena.append(value.data(), value.size());
+				column.stringEnds.push_back(column.stringArena.size());
+				break;
+			}
+		}
+		rowCount++;
+		return true;
+	}
+	// visitor bound to this sink, e.g. reader.VisitRows(sink.AsVisitor())
+	std::function<bool(const CSVRowView&)> AsVisitor()
+	{
+		return [this](const CSVRowView& row) { return Append(row); };
+	}
+
+	size_t GetRowCount() const
+	{
+		return rowCount;
+	}
+	size_t GetParseErrorCount() const
+	{
+		return parseErrorCount;
+	}
+	size_t GetColumnCount() const
+	{
+		return columns.size();
+	}
+	ColumnType GetColumnType(const size_t column) const
+	{
+		return columns[column].type;
+	}
+	const std::vector<int64_t>& GetInt64Column(const size_t column) const
+	{
+		return columns[column].ints;
+	}
+	const std::vector<double>& GetDoubleColumn(const size_t column) const
+	{
+		return columns[column].doubles;
+	}
+	std::string_view GetString(const size_t column, const size_t row) const
+	{
+		const Column& c = columns[column];
+		const size_t begin = row ? c.stringEnds[row - 1] : 0;
+		return std::string_view(c.stringArena.data() + begin, c.stringEnds[row] - begin);
+	}
+
+	// drop all values but keep the column definitions and their capacity
+	void Clear()
+	{
+		for (auto& column : columns)
+		{
+			column.ints.clear();
+			column.doubles.clear();
+			column.stringArena.clear();
+			column.stringEnds.clear();
+		}
+		rowCount = 0;
+		parseErrorCount = 0;
+	}
+};
@@ -1,9 +1,22 @@
 #pragma once
 #include<atlstr.h>
 #include<map>
+#include<algorithm>
 #include<vector>
 #include<mutex>
+#include<string>
+#include<charconv>
+#include<cstdio>
+#include<climits>
+#include<cwctype>
+#include<atomic>
+#include<thread>
+#include<condition_variable>
+#include<memory>
 #include "CSVUtil.h"
+#include "BufferedFileWriter.h"
+#include "MPSCRingBuffer.h"
+#include "LZ4Frame.h"
 #include "DebugOutToggles.h"
 
 using namespace std;
@@ -12,28 +25,562 @@ using namespace std;
 
 class CSVEmitter
 {
+public:
+	// values of one row in per-column slots that keep their capacity, so building a row costs no
+	// allocations once warmed up. Columns are the handles returned by CSVEmitter::AddField.
+	// the emitter has one for its current line; sampling threads each keep their own (CreateRowBuilder)
+	// and Submit completed rows to the async writer without taking any lock.
+	class RowBuilder
+	{
+		CSVEmitter* emitter = nullptr;
+		vector<string> values;	// UTF-8 value of each column
+		string row;				// escaped row, exchanged with the async queue on Submit
+		CSVUtil csvUtil;
+
+	public:
+		RowBuilder() {}
+		RowBuilder(CSVEmitter* emitter, const size_t fieldCount) : emitter(emitter), values(fieldCount) {}
+
+		void SetFieldCount(const size_t fieldCount)
+		{
+			values.resize(fieldCount);
+		}
+		void AddValue(const size_t field, const WCHAR* value)
+		{
+			_ASSERT(field < values.size());
+			string& slot = values[field];
+			slot.clear();
+			csvUtil.AppendUTF16AsUTF8(slot, value, wcslen(value));
+		}
+		// value already UTF-8
+		void AddValue(const size_t field, const std::string_view value)
+		{
+			_ASSERT(field < values.size());
+			values[field].assign(value.data(), value.size());
+		}
+		void AddValue(const size_t field, const DWORD value)
+		{
+			AddValue(field, static_cast<unsigned long long>(value));
+		}
+		void AddValue(const size_t field, const unsigned long long value)
+		{
+			char buffer[24];
+			auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+			AddValue(field, std::string_view(buffer, result.ptr - buffer));
+		}
+		void AddValue(const size_t field, const long long value)
+		{
+			char buffer[24];
+			auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+			AddValue(field, std::string_view(buffer, result.ptr - buffer));
+		}
+		// escape the values into out as a CRLF terminated row, and clear them for the next row
+		void BuildRow(string& out)
+		{
+			out.clear();
+			for (auto& i : values)
+			{
+				if (!out.empty())
+				{
+					out += ',';
+				}
+				out += '"';
+				csvUtil.AppendEscapedField(out, i, true);
+				out += '"';
+				i.clear();
+			}
+			out += "\r\n";
+		}
+		// hand the row to the emitter's async writer (see StartAsyncWriter). Never blocks; returns false
+		// if the row was dropped because the queue was full or the async writer isn't running
+		bool Submit()
+		{
+			BuildRow(row);
+			return emitter->SubmitRow(row);
+		}
+	};
+
+private:
 	ATL::CString outFilepath;
 	mutex mutexFields;
-	vector<ATL::CString> vectorOrderedFields;				  // ordered field list so we know field column positions
-	map<ATL::CString, ATL::CString> mapCurrentLineValues; // fieldname -> value
+	vector<string> vectorOrderedFields;					  // ordered UTF-8 field list so we know field column positions
+	map<string, size_t, less<>> mapFieldIndexes;		  // fieldname -> column, for the name based AddValue
+	RowBuilder currentLine{ this, 0 };					  // values for WriteCurrentLine
+	string rowBuffer;									  // escaped row being built, capacity reused
+
+	// async writer: rows submitted by RowBuilders are queued and written by a single writer thread
+	// producers read the queue through asyncQueue and count themselves in asyncSubmitters, so
+	// StopAsyncWriter can unpublish it and wait for submits in flight before freeing it
+	unique_ptr<MPSCRingBuffer<string>> asyncQueueOwner;
+	atomic<MPSCRingBuffer<string>*> asyncQueue{ nullptr };
+	atomic<unsigned int> asyncSubmitters{ 0 };
+	thread asyncWriterThread;
+	mutex mutexAsyncWake;
+	condition_variable asyncWake;
+	atomic<bool> isAsyncStopping{ false };
+	atomic<unsigned long long> droppedRowCount{ 0 };
+	static constexpr unsigned int ASYNC_POLL_INTERVAL_MS = 50;
+
+	bool SubmitRow(string& row)
+	{
+		// seq_cst on both sides: either StopAsyncWriter sees this submitter, or this sees the null queue
+		asyncSubmitters++;
+		MPSCRingBuffer<string>* queue = asyncQueue.load();
+		const bool isQueued = queue && queue->TryPush(row);
+		asyncSubmitters--;
+		if (!isQueued)
+		{
+			droppedRowCount++;
+			return false;
+		}
+		asyncWake.notify_one();
+		return true;
+	}
+	// write everything queued so far, on the async writer thread (or after it has stopped)
+	void DrainAsyncQueue(string& row)
+	{
+		lock_guard<mutex> lock(mutexFields);
+		while (asyncQueueOwner->TryPop(row))
+		{
+			RollOutputFileIfDue();
+			if (!writer.Append(row))
+			{
+				SAMPLING_DEBUG_PRINT(L"ERROR: Sampling can't write to %s", outFilepath);
+			}
+		}
+		writer.FlushIfDue();
+	}
+	void AsyncWriterLoop()
+	{
+		string row;
+		while (!isAsyncStopping)
+		{
+			DrainAsyncQueue(row);
+			unique_lock<mutex> lock(mutexAsyncWake);
+			asyncWake.wait_for(lock, chrono::milliseconds(ASYNC_POLL_INTERVAL_MS));
+		}
+	}
 	CSVUtil csvUtil;
+	BufferedFileWriter writer;	// rows are batched and appended in one write per flush
+
+	// rows buffered by the synchronous write path are flushed by a timer thread once they are a flush
+	// interval old, so they reach the file even if sampling stops (the async writer's loop does this itself)
+	unsigned int flushIntervalMs = BufferedFileWriter::DEFAULT_FLUSH_INTERVAL_MS;
+	thread flushTimerThread;
+	mutex mutexFlushTimer;
+	condition_variable flushTimerWake;
+	bool isFlushTimerStopping = false;
+
+	void FlushTimerLoop()
+	{
+		unique_lock<mutex> timerLock(mutexFlushTimer);
+		while (!isFlushTimerStopping)
+		{
+			flushTimerWake.wait_for(timerLock, chrono::milliseconds(ASYNC_POLL_INTERVAL_MS));
+			timerLock.unlock();
+			{
+				lock_guard<mutex> lock(mutexFields);
+				writer.FlushIfDue();
+			}
+			timerLock.lock();
+		}
+	}
+	// called with mutexFields held
+	void StartFlushTimer()
+	{
+		if (flushIntervalMs && !flushTimerThread.joinable())
+		{
+			isFlushTimerStopping = false;
+			flushTimerThread = thread(&CSVEmitter::FlushTimerLoop, this);
+		}
+	}
+	void StopFlushTimer()
+	{
+		{
+			lock_guard<mutex> timerLock(mutexFlushTimer);
+			isFlushTimerStopping = true;
+		}
+		flushTimerWake.notify_one();
+		if (flushTimerThread.joinable())
+		{
+			flushTimerThread.join();
+		}
+	}
 
 	const unsigned char bom[3] = { 0xEF,0xBB,0xBF };
 	const int bomSize = _countof(bom);
 
-	CString BuildHeaderString()
+	// compressed output: the file is a sequence of LZ4 frames, the first holding the BOM and header
+	bool isCompressedOutput = false;
+	static const size_t COMPRESSED_READ_CHUNK_SIZE = 1024 * 1024;
+
+	// walk the frames of an existing compressed file, returning the length up to the end of the last
+	// complete one (a frame cut short by a crash is dropped). The first frame's text is returned in firstFrameText.
+	unsigned long long ScanCompressedFile(const HANDLE hFile, string& firstFrameText)
+	{
+		firstFrameText.clear();
+		unsigned long long validLength = 0;
+		string bytes;
+		size_t bytesCarried = 0;
+		SetFilePointer(hFile, 0, nullptr, FILE_BEGIN);
+		for (;;)
+		{
+			bytes.resize(bytesCarried + COMPRESSED_READ_CHUNK_SIZE);
+			DWORD bytesRead = 0;
+			if (!ReadFile(hFile, &bytes[bytesCarried], static_cast<DWORD>(COMPRESSED_READ_CHUNK_SIZE), &bytesRead, nullptr) || !bytesRead)
+			{
+				return validLength;
+			}
+			const size_t bytesValid = bytesCarried + bytesRead;
+			size_t position = 0;
+			size_t frameSize = 0;
+			LZ4Frame::FrameStatus status;
+			while ((status = LZ4Frame::ReadFrame(bytes.data() + position, bytesValid - position, frameSize, validLength ? nullptr : &firstFrameText)) == LZ4Frame::FRAME_COMPLETE)
+			{
+				position += frameSize;
+				validLength += frameSize;
+			}
+			if (status == LZ4Frame::FRAME_INVALID)
+			{
+				return validLength;
+			}
+			bytesCarried = bytesValid - position;
+			memmove(&bytes[0], &bytes[position], bytesCarried);
+		}
+	}
+	// as ScanCompressedFile, for a file the sidecar vouches for: only the last COMPRESSED_READ_CHUNK_SIZE bytes
+	// are read, from the first frame starting in them (a frame holds at most a flush, well under that)
+	unsigned long long ScanCompressedTail(const HANDLE hFile)
+	{
+		LARGE_INTEGER liSize = {};
+		GetFileSizeEx(hFile, &liSize);
+		const unsigned long long fileSize = static_cast<unsigned long long>(liSize.QuadPart);
+		if (fileSize <= COMPRESSED_READ_CHUNK_SIZE)
+		{
+			string firstFrameText;
+			return ScanCompressedFile(hFile, firstFrameText);
+		}
+		const unsigned long long tailStart = fileSize - COMPRESSED_READ_CHUNK_SIZE;
+		LARGE_INTEGER liTailStart;
+		liTailStart.QuadPart = static_cast<LONGLONG>(tailStart);
+		string bytes(COMPRESSED_READ_CHUNK_SIZE, '\0');
+		DWORD bytesRead = 0;
+		if (!SetFilePointerEx(hFile, liTailStart, nullptr, FILE_BEGIN)
+			|| !ReadFile(hFile, &bytes[0], static_cast<DWORD>(bytes.size()), &bytesRead, nullptr))
+		{
+			return fileSize;
+		}
+		bytes.resize(bytesRead);
+		// the magic can turn up inside compressed data too, so a start only counts right after the end mark
+		// of the frame before it, and if the frame there parses
+		for (size_t start = 4; start + 4 <= bytes.size(); start++)
+		{
+			static const char endMark[4] = {};
+			if (!LZ4Frame::IsFrameStart(&bytes[start], bytes.size() - start)
+				|| memcmp(&bytes[start - 4], endMark, sizeof(endMark)) != 0)
+			{
+				continue;
+			}
+			size_t position = start;
+			size_t frameSize = 0;
+			LZ4Frame::FrameStatus status;
+			while ((status = LZ4Frame::ReadFrame(bytes.data() + position, bytes.size() - position, frameSize, nullptr)) == LZ4Frame::FRAME_COMPLETE)
+			{
+				position += frameSize;
+			}
+			if (position > start || status == LZ4Frame::FRAME_INCOMPLETE)
+			{
+				return tailStart + position;
+			}
+		}
+		// no frame starts near the end (e.g. written with a huge buffer), read it all
+		string firstFrameText;
+		return ScanCompressedFile(hFile, firstFrameText);
+	}
+	// compressed counterpart of CompareHeaderString, also dropping any partially written trailing frame
+	bool PrepareCompressedFile(const HANDLE hFile)
+	{
+		string firstFrameText;
+		const unsigned long long validLength = ScanCompressedFile(hFile, firstFrameText);
+		string sNewHeaderString = BuildHeaderString();
+		if (!validLength
+			|| firstFrameText.length() < static_cast<size_t>(bomSize) + sNewHeaderString.length()
+			|| !iequals(sNewHeaderString, firstFrameText.substr(bomSize, sNewHeaderString.length())))
+		{
+			return false;
+		}
+		TruncateTo(hFile, validLength);
+		return true;
+	}
+
+	// rotation: the output file is rolled to a numbered file (samples.csv -> samples.1.csv, samples.2.csv, ...)
+	// once it reaches maxOutputFileSize bytes or maxOutputFileAge seconds, and whenever the schema changes
+	unsigned long long maxOutputFileSize = 0;			// 0 for no size limit
+	unsigned long long maxOutputFileAge = 0;			// seconds, 0 for no age limit
+	unsigned int maxRolledFiles = 0;					// oldest rolled files beyond this are deleted, 0 to keep all
+	unsigned int nextRollIndex = 0;						// 0 until found
+	unsigned long long outputFileSizeAtOpen = 0;
+	unsigned long long outputBytesWrittenAtOpen = 0;
+	unsigned long long outputFileStarted = 0;			// FILETIME the open output file was started, kept in the sidecar
+	bool isOwnedOutputFile = false;						// the writer's file was opened by the emitter, so it can be rolled
+	ULONGLONG rollRetryTime = 0;						// GetTickCount64 before which a failed roll isn't retried
+	static const ULONGLONG ROLL_RETRY_INTERVAL_MS = 60 * 1000;
+
+	static unsigned long long FileTimeToULL(const FILETIME& ft)
+	{
+		return (static_cast<unsigned long long>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+	}
+	// samples.csv.lz4 -> samples.<index>.csv.lz4 (index as a string, so * gives the search pattern)
+	CString GetRolledFilePath(const CString& csIndex)
+	{
+		int nameStart = max(outFilepath.ReverseFind(L'\\'), outFilepath.ReverseFind(L'/')) + 1;
+		int extension = outFilepath.Find(L'.', nameStart);
+		if (extension == -1)
+		{
+			return outFilepath + L"." + csIndex;
+		}
+		return outFilepath.Left(extension) + L"." + csIndex + outFilepath.Mid(extension);
+	}
+	CString GetRolledFilePath(const unsigned int index)
+	{
+		CString csIndex;
+		csIndex.Format(L"%u", index);
+		return GetRolledFilePath(csIndex);
+	}
+	// numbers of the existing rolled files, ascending (so oldest first)
+	vector<unsigned int> FindRolledIndexes()
+	{
+		vector<unsigned int> indexes;
+		WIN32_FIND_DATA findData;
+		HANDLE hFind = FindFirstFile(GetRolledFilePath(CString(L"*")), &findData);
+		if (hFind == INVALID_HANDLE_VALUE)
+		{
+			return indexes;
+		}
+		do
+		{
+			// samples.<digits>.csv: the number follows the first dot
+			const WCHAR* pIndex = wcschr(findData.cFileName, L'.');
+			if (pIndex && iswdigit(pIndex[1]))
+			{
+				WCHAR* pEnd = nullptr;
+				const unsigned long index = wcstoul(pIndex + 1, &pEnd, 10);
+				if ((*pEnd == L'.' || *pEnd == L'\0') && index && index <= UINT_MAX)
+				{
+					indexes.push_back(static_cast<unsigned int>(index));
+				}
+			}
+		} while (FindNextFile(hFind, &findData));
+		FindClose(hFind);
+		sort(indexes.begin(), indexes.end());
+		return indexes;
+	}
+	// delete the oldest rolled files beyond maxRolledFiles, including any left by earlier runs or other settings
+	void DeleteExpiredRolledFiles()
+	{
+		vector<unsigned int> indexes = FindRolledIndexes();
+		for (size_t i = 0; i + maxRolledFiles < indexes.size(); i++)
+		{
+			DeleteFile(GetRolledFilePath(indexes[i]));
+		}
+	}
+	// move the (closed) output file to the next rolled file number
+	bool RollOutputFile()
+	{
+		if (!nextRollIndex)
+		{
+			// numbers only grow, so rolled files sort by age. Continue after the newest one.
+			vector<unsigned int> indexes = FindRolledIndexes();
+			nextRollIndex = (indexes.empty() ? 0 : indexes.back()) + 1;
+		}
+		CString csRolledPath = GetRolledFilePath(nextRollIndex);
+		if (!MoveFileEx(outFilepath, csRolledPath, 0))
+		{
+			SAMPLING_DEBUG_PRINT(L"ERROR: Sampling can't roll %s to %s", outFilepath, csRolledPath);
+			return false;
+		}
+		SAMPLING_DEBUG_PRINT(L"Sampling output rolled to %s", csRolledPath);
+		DeleteFile(GetSidecarPath());
+		nextRollIndex++;
+		if (maxRolledFiles)
+		{
+			DeleteExpiredRolledFiles();
+		}
+		return true;
+	}
+	// outputFileStarted is set by then (sidecar or fresh file)
+	void NoteOutputFileOpened(const HANDLE hFile)
+	{
+		LARGE_INTEGER liSize = {};
+		GetFileSizeEx(hFile, &liSize);
+		outputFileSizeAtOpen = static_cast<unsigned long long>(liSize.QuadPart);
+		outputBytesWrittenAtOpen = writer.GetBytesWritten();
+	}
+	bool IsRotationDue()
+	{
+		if (maxOutputFileSize
+			&& outputFileSizeAtOpen + (writer.GetBytesWritten() - outputBytesWrittenAtOpen) + writer.GetBufferedSize() >= maxOutputFileSize)
+		{
+			return true;
+		}
+		if (maxOutputFileAge)
+		{
+			FILETIME now;
+			GetSystemTimeAsFileTime(&now);
+			const unsigned long long age = (FileTimeToULL(now) - outputFileStarted) / 10000000ULL;	// 100ns units
+			return FileTimeToULL(now) > outputFileStarted && age >= maxOutputFileAge;
+		}
+		return false;
+	}
+	// roll the emitter's own output file once it's due and continue in a fresh one, called with mutexFields
+	// held by every path that writes rows (sync, async and RowBuilder rows all end up here)
+	void RollOutputFileIfDue()
+	{
+		if (!isOwnedOutputFile || !writer.IsAttached() || !IsRotationDue()
+			|| (rollRetryTime && GetTickCount64() < rollRetryTime))
+		{
+			return;
+		}
+		writer.Close();
+		// after a failure (e.g. a reader holding the file without FILE_SHARE_DELETE) keep appending for a
+		// while, rather than reopening the file for every row
+		rollRetryTime = RollOutputFile() ? 0 : GetTickCount64() + ROLL_RETRY_INTERVAL_MS;
+		HANDLE hFile = OpenOutputFile(false);
+		if (hFile == INVALID_HANDLE_VALUE)
+		{
+			isOwnedOutputFile = false;
+			return;
+		}
+		writer.Attach(hFile, true);
+	}
+	// open the output file for the writer unless it already has one, called with mutexFields held
+	bool OpenOwnedOutputFile()
+	{
+		if (writer.IsAttached())
+		{
+			return true;
+		}
+		HANDLE hFile = OpenOutputFile(false);
+		if (hFile == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+		writer.Attach(hFile, true);
+		isOwnedOutputFile = true;
+		return true;
+	}
+
+	// the sidecar records a hash of the header the output file was written with, and when the emitter started
+	// the file, so reopening compares a few bytes instead of reading the header back from the file.
+	// The start time is recorded rather than read from the file system, since NTFS tunneling gives a file
+	// created right after a rename the old file's creation time.
+	CString GetSidecarPath()
+	{
+		return outFilepath + L".hdr";
+	}
+	unsigned long long HashHeader()
+	{
+		// FNV-1a
+		string sHeader = BuildHeaderString();
+		unsigned long long hash = 14695981039346656037ULL;
+		for (auto c : sHeader)
+		{
+			hash = (hash ^ static_cast<unsigned char>(tolower(static_cast<unsigned char>(c)))) * 1099511628211ULL;
+		}
+		return hash;
+	}
+	// a current sidecar has our header's hash, and a start time no later than the file's last write
+	// (a file written before then isn't the one the sidecar describes). Sets outputFileStarted from it.
+	bool CompareSidecar(const HANDLE hFile)
+	{
+		HANDLE hSidecar = CreateFile(GetSidecarPath(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (hSidecar == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+		char existing[40] = {};
+		DWORD dwBytesRead = 0;
+		bool bMatch = ReadFile(hSidecar, existing, sizeof(existing), &dwBytesRead, nullptr) && dwBytesRead == 35;
+		CloseHandle(hSidecar);
+		// "<hash> <started>\r\n", both as 16 hex digits
+		unsigned long long hash = 0, started = 0;
+		bMatch = bMatch
+			&& from_chars(existing, existing + 16, hash, 16).ptr == existing + 16
+			&& from_chars(existing + 17, existing + 33, started, 16).ptr == existing + 33
+			&& hash == HashHeader();
+		if (bMatch)
+		{
+			FILETIME timeCreated, timeLastAccess, timeLastWrite = {};
+			GetFileTime(hFile, &timeCreated, &timeLastAccess, &timeLastWrite);
+			bMatch = FileTimeToULL(timeLastWrite) >= started;
+		}
+		if (bMatch)
+		{
+			outputFileStarted = started;
+		}
+		return bMatch;
+	}
+	void WriteSidecar()
+	{
+		HANDLE hSidecar = CreateFile(GetSidecarPath(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (hSidecar == INVALID_HANDLE_VALUE)
+		{
+			return;
+		}
+		char text[40];
+		snprintf(text, sizeof(text), "%016llx %016llx\r\n", HashHeader(), outputFileStarted);
+		string sText = text;
+		DWORD dwBytesWrote;
+		WriteFile(hSidecar, sText.data(), static_cast<DWORD>(sText.length()), &dwBytesWrote, nullptr);
+		CloseHandle(hSidecar);
+	}
+	// whether the existing output file was written with our header, checked through the sidecar when it's current
+	bool HeaderMatches(const HANDLE hFile)
+	{
+		if (CompareSidecar(hFile))
+		{
+			if (isCompressedOutput)
+			{
+				// still drop a partially written trailing frame
+				TruncateTo(hFile, ScanCompressedTail(hFile));
+			}
+			return true;
+		}
+		bool bMatch = isCompressedOutput ? PrepareCompressedFile(hFile) : CompareHeaderString(hFile);
+		if (bMatch)
+		{
+			// no record of when it was started, the creation time is the best guess
+			FILETIME timeCreated = {}, timeLastAccess, timeLastWrite;
+			GetFileTime(hFile, &timeCreated, &timeLastAccess, &timeLastWrite);
+			outputFileStarted = FileTimeToULL(timeCreated);
+			WriteSidecar();
+		}
+		return bMatch;
+	}
+	void TruncateTo(const HANDLE hFile, const unsigned long long length)
+	{
+		LARGE_INTEGER liLength;
+		liLength.QuadPart = static_cast<LONGLONG>(length);
+		SetFilePointerEx(hFile, liLength, nullptr, FILE_BEGIN);
+		SetEndOfFile(hFile);
+	}
+
+	// UTF-8 header row, without line terminator
+	string BuildHeaderString()
 	{
 		_ASSERT(vectorOrderedFields.size());
-		CString csRet;
-		for (auto i : vectorOrderedFields)
+		string sRet;
+		for (auto& i : vectorOrderedFields)
 		{
-			if (!csRet.IsEmpty())
+			if (!sRet.empty())
 			{
-				csRet += L",";
+				sRet += ',';
 			}
-			csRet += L"\"" + i + L"\"";
+			sRet += '"';
+			sRet += i;
+			sRet += '"';
 		}
-		return csRet;
+		return sRet;
 	}
 
 	// case insensitive std::string compare
@@ -55,7 +602,7 @@ class CSVEmitter
 			return bHeaderWouldMatch;
 		}
 		// NOTE: never use a BOM since Excel doesn't like it
-		string sNewHeaderString = csvUtil.ConvertUTF16ToUTF8(BuildHeaderString());
+		string sNewHeaderString = BuildHeaderString();
 		string sOldHeaderString;
 		if (sNewHeaderString.length())
 		{
@@ -79,7 +626,7 @@ class CSVEmitter
 							bHeaderWouldMatch = true;
 						}
 					}
-					delete pszExistingHeader;
+					delete[] pszExistingHeader;
 				}
 			}
 		}
@@ -98,6 +645,130 @@ public:
 	{
 		AddFields(fields);
 	}
+	~CSVEmitter()
+	{
+		StopAsyncWriter();
+		StopFlushTimer();
+	}
+	// rows are buffered until bufferSize bytes are pending or the oldest is flushIntervalMs old (flushed
+	// by a timer, whether or not more rows are written). bufferSize of 0 writes every row immediately,
+	// flushIntervalMs of 0 only writes when the buffer is full (or on Flush).
+	void SetWriteBuffering(const size_t bufferSize, const unsigned int intervalMs = BufferedFileWriter::DEFAULT_FLUSH_INTERVAL_MS)
+	{
+		lock_guard<mutex> lock(mutexFields);
+		writer.SetBufferSize(bufferSize);
+		writer.SetFlushInterval(intervalMs);
+		flushIntervalMs = intervalMs;
+	}
+	// write the output as LZ4 frames (one per flush) instead of plain text, to be set before OpenOutputFile
+	// CSVReader reads either form. Use a name like "samples.csv.lz4" so lz4 tools recognize it.
+	void SetCompressedOutput(const bool enabled)
+	{
+		lock_guard<mutex> lock(mutexFields);
+		isCompressedOutput = enabled;
+		writer.SetCompression(enabled);
+	}
+	bool IsCompressedOutput() const
+	{
+		return isCompressedOutput;
+	}
+	// roll the output file to a numbered file once it reaches maxBytes or is maxAgeSeconds old (0 for no limit),
+	// keeping at most maxRolled rolled files (0 to keep all). Applies whenever rows go to the output file the
+	// emitter opened itself (handle-less WriteCurrentLine and StartAsyncWriter, and their RowBuilders);
+	// files written through a caller's handle are never rolled.
+	void SetRotation(const unsigned long long maxBytes, const unsigned long long maxAgeSeconds = 0, const unsigned int maxRolled = 0)
+	{
+		lock_guard<mutex> lock(mutexFields);
+		maxOutputFileSize = maxBytes;
+		maxOutputFileAge = maxAgeSeconds;
+		maxRolledFiles = maxRolled;
+	}
+	// write out any buffered rows, e.g. at shutdown or before handing the file to a reader
+	bool Flush()
+	{
+		lock_guard<mutex> lock(mutexFields);
+		return writer.Flush();
+	}
+	// flush buffered rows if the flush interval has passed (the flush timer already does this)
+	bool FlushIfDue()
+	{
+		lock_guard<mutex> lock(mutexFields);
+		return writer.FlushIfDue();
+	}
+	// row builder for a sampling thread, sized for the fields defined so far
+	// fields must not change while the async writer runs
+	RowBuilder CreateRowBuilder()
+	{
+		lock_guard<mutex> lock(mutexFields);
+		return RowBuilder(this, vectorOrderedFields.size());
+	}
+	// as below, writing to the output file opened, rolled (see SetRotation) and closed by the emitter
+	bool StartAsyncWriter(const size_t queueCapacity = 4096)
+	{
+		HANDLE hFile;
+		{
+			lock_guard<mutex> lock(mutexFields);
+			if (asyncQueueOwner || !OpenOwnedOutputFile())
+			{
+				return false;
+			}
+			hFile = writer.GetHandle();
+		}
+		return StartAsyncWriter(hFile, queueCapacity);
+	}
+	// start a writer thread that drains rows submitted by RowBuilders (and WriteCurrentLine) to hFile
+	// producers never block on the file; rows submitted while queueCapacity rows are pending are dropped
+	// start and stop from one controlling thread; sampling threads may submit at any time
+	bool StartAsyncWriter(const HANDLE hFile, const size_t queueCapacity = 4096)
+	{
+		if (asyncQueueOwner || hFile == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+		{
+			lock_guard<mutex> lock(mutexFields);
+			AttachOutputFile(hFile, false);
+		}
+		isAsyncStopping = false;
+		asyncQueueOwner = make_unique<MPSCRingBuffer<string>>(queueCapacity);
+		asyncWriterThread = thread(&CSVEmitter::AsyncWriterLoop, this);
+		asyncQueue = asyncQueueOwner.get();
+		return true;
+	}
+	// stop the writer thread after writing everything already submitted
+	// rows submitted concurrently are either written or counted as dropped
+	void StopAsyncWriter()
+	{
+		if (!asyncQueueOwner)
+		{
+			return;
+		}
+		// rows submitted from here on are counted as dropped; wait out pushes already in flight
+		asyncQueue = nullptr;
+		while (asyncSubmitters)
+		{
+			this_thread::yield();
+		}
+		isAsyncStopping = true;
+		asyncWake.notify_one();
+		if (asyncWriterThread.joinable())
+		{
+			asyncWriterThread.join();
+		}
+		string row;
+		DrainAsyncQueue(row);
+		Flush();
+		asyncQueueOwner.reset();
+	}
+	bool IsAsyncWriterRunning() const
+	{
+		return asyncQueue.load() != nullptr;
+	}
+	// rows dropped because the async queue was full (or no async writer was running)
+	unsigned long long GetDroppedRowCount() const
+	{
+		return droppedRowCount;
+	}
 	// add a field, orders as received - only needs to be done once
 	void AddFields(const vector<ATL::CString>& fields)
 	{
@@ -107,98 +778,201 @@ public:
 			AddField(i);
 		}
 	}
+	void AddFields(const vector<string>& fields)
+	{
+		lock_guard<mutex> lock(mutexFields);
+		for (auto& i : fields)
+		{
+			AddField(string_view(i));
+		}
+	}
 	void ClearFields()
 	{
 		vectorOrderedFields.clear();
+		mapFieldIndexes.clear();
+		currentLine.SetFieldCount(0);
 	}
-	void AddField(const WCHAR* fieldname)
+	// returns the column handle to pass to AddValue, stable until ClearFields
+	size_t AddField(const WCHAR* fieldname)
 	{
-		vectorOrderedFields.push_back(fieldname);
+		return AddField(string_view(UTFConvert::ToUTF8(fieldname)));
+	}
+	// field name already UTF-8
+	size_t AddField(const string_view fieldname)
+	{
+		vectorOrderedFields.emplace_back(fieldname);
+		currentLine.SetFieldCount(vectorOrderedFields.size());
+		mapFieldIndexes[vectorOrderedFields.back()] = vectorOrderedFields.size() - 1;
+		return vectorOrderedFields.size() - 1;
 	}
 	// add value to current line (add all values for each line, then output with WriteCurrentLine)
+	void AddValue(const size_t field, const WCHAR* value)
+	{
+		currentLine.AddValue(field, value);
+	}
+	// value already UTF-8
+	void AddValue(const size_t field, const std::string_view value)
+	{
+		currentLine.AddValue(field, value);
+	}
+	void AddValue(const size_t field, const DWORD value)
+	{
+		currentLine.AddValue(field, value);
+	}
+	void AddValue(const size_t field, const unsigned long long value)
+	{
+		currentLine.AddValue(field, value);
+	}
+	void AddValue(const size_t field, const long long value)
+	{
+		currentLine.AddValue(field, value);
+	}
+	// by field name, adapters over the column handle overloads
+	// a name that wasn't defined is logged and its value ignored, as it never reached the output before handles
 	void AddValue(const WCHAR* fieldname, const WCHAR* value)
 	{
-#ifdef DEBUG
-		bool bFoundField = false;
-		for (auto& i : vectorOrderedFields)
-		{
-			if (i.Compare(fieldname) == 0)
-			{
-				bFoundField = true;
-			}
-		}
-		_ASSERT(bFoundField);
-		if (!bFoundField)
+		size_t field = FindField(fieldname);
+		if (field != SIZE_MAX)
 		{
-			SAMPLING_DEBUG_PRINT(L"WARNING: Sampling field %s not defined", fieldname);
+			AddValue(field, value);
 		}
-#endif
-		mapCurrentLineValues[fieldname] = value;
 	}
 	void AddValue(const WCHAR* fieldname, const DWORD value)
 	{
-		CString csTemp;
-		csTemp.Format(L"%lu", value);
-		mapCurrentLineValues[fieldname] = csTemp;
+		size_t field = FindField(fieldname);
+		if (field != SIZE_MAX)
+		{
+			AddValue(field, value);
+		}
 	}
 	void AddValue(const WCHAR* fieldname, const unsigned long long value)
 	{
-		CString csTemp;
-		csTemp.Format(L"%llu", value);
-		mapCurrentLineValues[fieldname] = csTemp;
+		size_t field = FindField(fieldname);
+		if (field != SIZE_MAX)
+		{
+			AddValue(field, value);
+		}
+	}
+	// by UTF-8 field name
+	void AddValue(const string_view fieldname, const string_view value)
+	{
+		size_t field = FindField(fieldname);
+		if (field != SIZE_MAX)
+		{
+			AddValue(field, value);
+		}
+	}
+	void AddValue(const string_view fieldname, const DWORD value)
+	{
+		size_t field = FindField(fieldname);
+		if (field != SIZE_MAX)
+		{
+			AddValue(field, value);
+		}
+	}
+	void AddValue(const string_view fieldname, const unsigned long long value)
+	{
+		size_t field = FindField(fieldname);
+		if (field != SIZE_MAX)
+		{
+			AddValue(field, value);
+		}
+	}
+	// column handle of a field by name, SIZE_MAX if not defined
+	size_t FindField(const WCHAR* fieldname)
+	{
+		return FindField(string_view(UTFConvert::ToUTF8(fieldname)));
+	}
+	size_t FindField(const string_view fieldname)
+	{
+		auto i = mapFieldIndexes.find(fieldname);
+		if (i == mapFieldIndexes.end())
+		{
+			SAMPLING_DEBUG_PRINT(L"WARNING: Sampling field %s not defined", UTFConvert::ToWide(fieldname).c_str());
+			return SIZE_MAX;
+		}
+		return i->second;
+	}
+
+private:
+	// handles the emitter opens (isOwnedHandle) are its output file and can be rolled, a caller's can't
+	void AttachOutputFile(const HANDLE hOutFile, const bool isOwnedHandle)
+	{
+		if (hOutFile != writer.GetHandle())
+		{
+			isOwnedOutputFile = isOwnedHandle;
+		}
+		writer.Attach(hOutFile, isOwnedHandle);
 	}
+	bool WriteRow(const HANDLE hOutFile, const bool isOwnedHandle)
+	{
+		// build up row with field values
+		currentLine.BuildRow(rowBuffer);
+		if (asyncQueue.load())
+		{
+			if (isOwnedHandle)
+			{
+				// reopened after an error: the async writer switches to it and closes it when done
+				AttachOutputFile(hOutFile, true);
+			}
+			// keep ordering with rows from RowBuilders
+			return SubmitRow(rowBuffer);
+		}
+		// buffered, goes to the end of the file with the rest of its batch
+		AttachOutputFile(hOutFile, isOwnedHandle);
+		RollOutputFileIfDue();
+		if (!writer.Append(rowBuffer))
+		{
+			SAMPLING_DEBUG_PRINT(L"ERROR: Sampling can't write to %s", outFilepath);
+		}
+		if (writer.GetBufferedSize())
+		{
+			StartFlushTimer();
+		}
+
+		return true;
+	}
+
+public:
 	bool WriteCurrentLine(const HANDLE hFile)
 	{
 		lock_guard<mutex> lock(mutexFields);
-		DWORD dwBytesWrote;
-		if (hFile == INVALID_HANDLE_VALUE)
+		HANDLE hOutFile = hFile;
+		bool isOwnedHandle = false;
+		if (hOutFile == INVALID_HANDLE_VALUE && writer.IsAttached())
+		{
+			// reopened after an earlier error, keep using it
+			hOutFile = writer.GetHandle();
+		}
+		if (hOutFile == INVALID_HANDLE_VALUE)
 		{
 			SAMPLING_DEBUG_PRINT(L"ERROR: Sampling can't write to %s (no handle)", outFilepath);
 			// try ReadyOutputFile in case the error is due to OPEN_EXISTING disposition above (file was deleted)
-			HANDLE hFile = OpenOutputFile(false);
-			if (hFile == INVALID_HANDLE_VALUE)
+			hOutFile = OpenOutputFile(false);
+			if (hOutFile == INVALID_HANDLE_VALUE)
 			{
 				SAMPLING_DEBUG_PRINT(L"ERROR: Sampling can't write to %s (no handle after retry)", outFilepath);
 				return false;
 			}
 			SAMPLING_DEBUG_PRINT(L"Sampling error resolved by ReadyOutputFile");
-			// fall-through with valid handle to now fixed file
+			// fall-through with valid handle to now fixed file, which the writer now owns
+			isOwnedHandle = true;
 		}
-		SetFilePointer(hFile, 0, nullptr, FILE_END);
-		// build up row with field values
-		CString csRow;
-		for (auto i : vectorOrderedFields)
-		{
-			auto value = mapCurrentLineValues.find(i);
-			CString csValue = L"";
-			if (value == mapCurrentLineValues.end())
-			{
-				//SAMPLING_DEBUG_PRINT(L"WARNING: No value for field %s", i.GetBuffer());
-			}
-			else
-			{
-				csValue = mapCurrentLineValues[i];
-			}
-			if (!csRow.IsEmpty())
-			{
-				csRow += L",";
-			}
-			csRow += L"\"" + csvUtil.EscapeField(csValue.GetString(), true) + L"\"";
-		}
-		string sOut = csvUtil.ConvertUTF16ToUTF8(csRow);
-		if (!WriteFile(hFile, &sOut[0], static_cast<DWORD>(sOut.length()), &dwBytesWrote, nullptr))
+		return WriteRow(hOutFile, isOwnedHandle);
+	}
+	// as above, with the output file opened, rolled (see SetRotation) and closed by the emitter
+	bool WriteCurrentLine()
+	{
+		lock_guard<mutex> lock(mutexFields);
+		if (!OpenOwnedOutputFile())
 		{
-			SAMPLING_DEBUG_PRINT(L"ERROR: Sampling can't write to %s", outFilepath);
+			return false;
 		}
-		WriteLineFeed(hFile);
-
-		mapCurrentLineValues.clear();
-
-		return true;
+		return WriteRow(writer.GetHandle(), true);
 	}
 
-	// if header doesn't match, then wipe and start fresh
-	// if it does, then start appending
+	// if header doesn't match, then roll the existing file (see SetRotation) and start fresh, failing if it
+	// can't be rolled. If it does, then start appending
 	// should be called only *after* defining fields with AddField
 	HANDLE OpenOutputFile(bool bEmptyFile = false)
 	{
@@ -207,40 +981,97 @@ public:
 
 		_ASSERT(vectorOrderedFields.size());
 		DWORD dwBytesWrote;
-		HANDLE hFile = CreateFile(outFilepath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		HANDLE hFile = CreateFile(outFilepath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
 		if (hFile == INVALID_HANDLE_VALUE)
 		{
 			SAMPLING_DEBUG_PRINT(L"ERROR: Sampling can't open %s", outFilepath);
 			return INVALID_HANDLE_VALUE;
 		}
+		LARGE_INTEGER liSize = {};
+		GetFileSizeEx(hFile, &liSize);
+		if (false == bEmptyFile
+			&& liSize.QuadPart
+			&& !HeaderMatches(hFile))
+		{
+			// schema changed, keep the existing data in a rolled file rather than overwriting it
+			CloseHandle(hFile);
+			if (!RollOutputFile())
+			{
+				// never overwrite the history, the rows have nowhere to go until the file can be rolled
+				return INVALID_HANDLE_VALUE;
+			}
+			hFile = CreateFile(outFilepath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (hFile == INVALID_HANDLE_VALUE)
+			{
+				SAMPLING_DEBUG_PRINT(L"ERROR: Sampling can't open %s", outFilepath);
+				return INVALID_HANDLE_VALUE;
+			}
+			bEmptyFile = true;
+		}
 		if (true == bEmptyFile
-			|| !CompareHeaderString(hFile))
+			|| !liSize.QuadPart)
 		{
 			SAMPLING_DEBUG_PRINT(L"WARNING: Sampling output file header didn't match or empty requested, starting fresh");
 
 			SetFilePointer(hFile, 0, nullptr, FILE_BEGIN);
 
-			WriteFile(hFile, bom, _countof(bom), &dwBytesWrote, nullptr);
-
-			CString csHeader = BuildHeaderString();
-			if (!csHeader.IsEmpty())
+			if (isCompressedOutput)
 			{
-				string sOut = csvUtil.ConvertUTF16ToUTF8(csHeader);
-				WriteFile(hFile, &sOut[0], static_cast<DWORD>(sOut.length()), &dwBytesWrote, nullptr);
-				WriteLineFeed(hFile);
+				string sOut(reinterpret_cast<const char*>(bom), _countof(bom));
+				sOut += BuildHeaderString();
+				sOut += "\r\n";
+				string sFrame;
+				LZ4Frame::AppendFrame(sFrame, sOut.data(), sOut.size());
+				WriteFile(hFile, sFrame.data(), static_cast<DWORD>(sFrame.length()), &dwBytesWrote, nullptr);
+			}
+			else
+			{
+				WriteFile(hFile, bom, _countof(bom), &dwBytesWrote, nullptr);
+
+				string sOut = BuildHeaderString();
+				if (!sOut.empty())
+				{
+					WriteFile(hFile, &sOut[0], static_cast<DWORD>(sOut.length()), &dwBytesWrote, nullptr);
+					WriteLineFeed(hFile);
+				}
 			}
 
 			SetEndOfFile(hFile);
+			FILETIME now;
+			GetSystemTimeAsFileTime(&now);
+			outputFileStarted = FileTimeToULL(now);
+			WriteSidecar();
 		}
 		else
 		{
 			SAMPLING_DEBUG_PRINT(L"Sampling CSV out file header matches, appending");
 		}
+		NoteOutputFileOpened(hFile);
 		return hFile;
 	}
+	// close the output file opened by the handle-less WriteCurrentLine
+	void CloseOutputFile()
+	{
+		StopAsyncWriter();
+		lock_guard<mutex> lock(mutexFields);
+		writer.Close();
+		isOwnedOutputFile = false;
+	}
+	// stop writing to a handle from OpenOutputFile and close it
 	void CloseOutputFile(const HANDLE hFile)
 	{
 		_ASSERT(hFile && hFile != INVALID_HANDLE_VALUE);
+		StopAsyncWriter();
+		lock_guard<mutex> lock(mutexFields);
+		if (writer.GetHandle() == hFile)
+		{
+			writer.Detach();
+		}
+		else
+		{
+			// rows buffered for a handle the emitter opened itself after an error
+			writer.Close();
+		}
 		CloseHandle(hFile);
 	}
 
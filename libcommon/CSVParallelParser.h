@@ -0,0 +1,396 @@
+#pragma once
+// CSVParallelParser
+//  multi-threaded parse of a large CSV file that isn't being appended to (e.g. offline analysis)
+//  the file is mapped in windows, and each window is split into one byte range per thread. Ranges
+//  rarely start on a row boundary, and whether a boundary is inside a quoted field depends on every
+//  quote before it, so the split is resolved speculatively in two passes:
+//   1. in parallel, count the quotes in each range and find where its first row would start both if
+//      the range begins outside and inside quotes. The quote parity of the preceding ranges then picks
+//      the candidate (all quotes toggle state, "" pairs cancel out). Each search stops at the end of its
+//      range, so the wrong guess (every line end looks quoted in all-quoted CSVEmitter output) costs at
+//      most the range; a range whose first row doesn't start in it is left to the range before.
+//   2. in parallel, tokenize each range from its row start up to the next range's.
+//  Rows are visited in file order on the calling thread. The speculation only holds if every range
+//  tokenizes exactly up to where the next one starts (a stray quote in an unquoted field breaks
+//  parity). When one doesn't, the rest of the window is tokenized on the calling thread, so results
+//  always match a sequential CSVTokenizer read.
+//
+//  portable (MappedFile provides Win32 and POSIX backends)
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "MappedFile.h"
+#include "CSVTokenizer.h"
+#include "LZ4Frame.h"
+
+class CSVParallelParser
+{
+public:
+	typedef std::function<bool(const CSVRowView& row)> RowVisitor;
+
+private:
+	// bytes per thread in each window, and the smallest range worth handing to another thread
+	static const size_t CHUNK_SIZE = 4 * 1024 * 1024;
+	static const size_t MIN_CHUNK_SIZE = 64 * 1024;
+	static const size_t MAX_WINDOW_SIZE = 1024 * 1024 * 1024;
+	static const size_t BOM_SIZE = 3;
+
+	// workers run one task per index. The caller waits on each index in turn, so it can visit the rows
+	// of the first ranges while later ones are still being tokenized.
+	class WorkerPool
+	{
+		std::vector<std::thread> threads;
+		std::mutex mutexTasks;
+		std::condition_variable cvWork;
+		std::condition_variable cvDone;
+		std::function<void(size_t)> task;
+		size_t taskCount = 0;
+		size_t nextTask = 0;
+		std::vector<char> isTaskDone;
+		bool isStopping = false;
+
+		void WorkerLoop()
+		{
+			std::unique_lock<std::mutex> lock(mutexTasks);
+			for (;;)
+			{
+				cvWork.wait(lock, [this] { return isStopping || nextTask < taskCount; });
+				if (isStopping)
+				{
+					return;
+				}
+				const size_t index = nextTask++;
+				lock.unlock();
+				task(index);
+				lock.lock();
+				isTaskDone[index] = 1;
+				cvDone.notify_all();
+			}
+		}
+
+	public:
+		explicit WorkerPool(const unsigned int threadCount)
+		{
+			for (unsigned int i = 0; i < threadCount; i++)
+			{
+				threads.emplace_back(&WorkerPool::WorkerLoop, this);
+			}
+		}
+		~WorkerPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutexTasks);
+				isStopping = true;
+			}
+			cvWork.notify_all();
+			for (auto& i : threads)
+			{
+				i.join();
+			}
+		}
+		// previous tasks must all have been waited for
+		void Run(const size_t count, std::function<void(size_t)> taskToRun)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutexTasks);
+				task = std::move(taskToRun);
+				taskCount = count;
+				nextTask = 0;
+				isTaskDone.assign(count, 0);
+			}
+			cvWork.notify_all();
+		}
+		void WaitFor(const size_t index)
+		{
+			std::unique_lock<std::mutex> lock(mutexTasks);
+			cvDone.wait(lock, [&] { return isTaskDone[index] != 0; });
+		}
+		void WaitAll()
+		{
+			for (size_t i = 0; i < taskCount; i++)
+			{
+				WaitFor(i);
+			}
+		}
+	};
+
+	// one thread's byte range of a window. Offsets are relative to the window.
+	struct Chunk
+	{
+		size_t begin = 0;
+		size_t end = 0;
+		bool hasOddQuotes = false;
+		size_t rowStartOutsideQuotes = 0;
+		size_t rowStartInsideQuotes = 0;
+		size_t rowStart = 0;		// resolved from the quote parity of the ranges before it, NO_ROW_START if none
+		size_t rowStartScanned = 0;	// bytes both searches read
+		size_t consumed = 0;		// bytes from rowStart tokenized into complete rows
+		std::vector<CSVField> fields;
+		std::vector<size_t> rowFieldEnds;	// per row, end index into fields
+		std::vector<size_t> rowByteEnds;	// per row, window offset just past the row
+	};
+
+	static const size_t NO_ROW_START = SIZE_MAX;
+
+	unsigned int threadCount;
+	WorkerPool pool;
+	std::vector<Chunk> chunks;		// reused between windows
+	uint64_t rowStartScanned = 0;	// by the last Parse
+
+	static size_t CountQuotes(const char* data, const size_t length)
+	{
+		size_t count = 0;
+		const char* p = data;
+		const char* end = data + length;
+		while ((p = static_cast<const char*>(memchr(p, '"', end - p))) != nullptr)
+		{
+			count++;
+			p++;
+		}
+		return count;
+	}
+	// offset just past the first line end in [from, limit), given the quote state at from, or NO_ROW_START
+	// if there is none. scanned is increased by the bytes read.
+	static size_t FindRowStart(const char* data, const size_t length, const size_t from, const size_t limit, bool isInQuotes, size_t& scanned)
+	{
+		CSVScanner::Cursor cursor(data, limit);
+		for (size_t i = cursor.Next(from); i < limit; i = cursor.Next(i + 1))
+		{
+			const char c = data[i];
+			if (c == '"')
+			{
+				isInQuotes = !isInQuotes;
+			}
+			else if (!isInQuotes && (c == '\r' || c == '\n'))
+			{
+				scanned += i + 1 - from;
+				return (c == '\r' && i + 1 < length && data[i + 1] == '\n') ? i + 2 : i + 1;
+			}
+		}
+		scanned += limit - from;
+		return NO_ROW_START;
+	}
+	// tokenize complete rows of [chunk.rowStart, limit)
+	static void TokenizeChunk(const char* data, const size_t limit, const size_t maxFields, Chunk& chunk)
+	{
+		chunk.fields.clear();
+		chunk.rowFieldEnds.clear();
+		chunk.rowByteEnds.clear();
+		chunk.consumed = 0;
+		if (chunk.rowStart == NO_ROW_START || chunk.rowStart >= limit)
+		{
+			return;
+		}
+		CSVTokenizer tokenizer(data + chunk.rowStart, limit - chunk.rowStart);
+		std::vector<CSVField> rowFields;
+		while (tokenizer.NextRow(rowFields, false, maxFields))
+		{
+			chunk.fields.insert(chunk.fields.end(), rowFields.begin(), rowFields.end());
+			chunk.rowFieldEnds.push_back(chunk.fields.size());
+			chunk.rowByteEnds.push_back(chunk.rowStart + tokenizer.GetPosition());
+		}
+		chunk.consumed = tokenizer.GetPosition();
+	}
+
+	// parse the rows of one window on the workers, visiting them in order. Returns the window offset to
+	// resume at (just past the last row visited), and sets isStopped if the visitor stopped.
+	size_t ParseWindow(const char* data, const size_t length, const size_t base, const RowVisitor& visitor, const size_t maxFields, long long& rowCount, bool& isStopped)
+	{
+		size_t chunkCount = (length - base) / MIN_CHUNK_SIZE;
+		chunkCount = chunkCount < threadCount ? chunkCount : threadCount;
+		chunkCount = chunkCount ? chunkCount : 1;
+		const size_t chunkSize = (length - base) / chunkCount;
+		chunks.resize(chunkCount);
+		for (size_t i = 0; i < chunkCount; i++)
+		{
+			chunks[i].begin = base + i * chunkSize;
+			chunks[i].end = (i + 1 == chunkCount) ? length : base + (i + 1) * chunkSize;
+		}
+
+		// pass 1: quote parity and both candidate row starts of each range
+		pool.Run(chunkCount, [&](const size_t index)
+			{
+				Chunk& chunk = chunks[index];
+				chunk.hasOddQuotes = (CountQuotes(data + chunk.begin, chunk.end - chunk.begin) & 1) != 0;
+				chunk.rowStartScanned = 0;
+				if (index)
+				{
+					chunk.rowStartOutsideQuotes = FindRowStart(data, length, chunk.begin, chunk.end, false, chunk.rowStartScanned);
+					chunk.rowStartInsideQuotes = FindRowStart(data, length, chunk.begin, chunk.end, true, chunk.rowStartScanned);
+				}
+			});
+		pool.WaitAll();
+		bool isInQuotes = false;
+		for (size_t i = 0; i < chunkCount; i++)
+		{
+			chunks[i].rowStart = !i ? base : isInQuotes ? chunks[i].rowStartInsideQuotes : chunks[i].rowStartOutsideQuotes;
+			isInQuotes ^= chunks[i].hasOddQuotes;
+			rowStartScanned += chunks[i].rowStartScanned;
+		}
+
+		// pass 2: tokenize each range up to the next row start (a range without one is part of the range
+		// before it, the sequential stitch below skips it)
+		pool.Run(chunkCount, [&](const size_t index)
+			{
+				size_t next = index + 1;
+				while (next < chunkCount && chunks[next].rowStart == NO_ROW_START)
+				{
+					next++;
+				}
+				const size_t limit = (next == chunkCount) ? length : chunks[next].rowStart;
+				TokenizeChunk(data, limit, maxFields, chunks[index]);
+			});
+
+		size_t position = base;
+		bool isSpeculationValid = true;
+		for (size_t i = 0; i < chunkCount; i++)
+		{
+			pool.WaitFor(i);
+			if (isStopped || !isSpeculationValid)
+			{
+				continue;
+			}
+			Chunk& chunk = chunks[i];
+			if (chunk.rowStart == NO_ROW_START)
+			{
+				continue;
+			}
+			if (chunk.rowStart != position)
+			{
+				// the previous range didn't end where this one starts, finish the window here
+				isSpeculationValid = false;
+				continue;
+			}
+			size_t fieldBegin = 0;
+			for (size_t row = 0; row < chunk.rowFieldEnds.size(); row++)
+			{
+				rowCount++;
+				position = chunk.rowByteEnds[row];
+				if (!visitor(CSVRowView(chunk.fields.data() + fieldBegin, chunk.rowFieldEnds[row] - fieldBegin)))
+				{
+					isStopped = true;
+					break;
+				}
+				fieldBegin = chunk.rowFieldEnds[row];
+			}
+			if (!isStopped)
+			{
+				position = chunk.rowStart + chunk.consumed;
+			}
+		}
+		if (!isSpeculationValid && !isStopped)
+		{
+			CSVTokenizer tokenizer(data + position, length - position);
+			std::vector<CSVField> fields;
+			while (tokenizer.NextRow(fields, false, maxFields))
+			{
+				rowCount++;
+				if (!visitor(CSVRowView(fields)))
+				{
+					isStopped = true;
+					break;
+				}
+			}
+			position += tokenizer.GetPosition();
+		}
+		return position;
+	}
+
+public:
+	// threadCount 0 is one per logical processor
+	explicit CSVParallelParser(const unsigned int threads = 0)
+		: threadCount(threads ? threads : (std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1)),
+		pool(threadCount)
+	{
+	}
+	CSVParallelParser(const CSVParallelParser&) = delete;
+	CSVParallelParser& operator = (const CSVParallelParser&) = delete;
+
+	unsigned int GetThreadCount() const
+	{
+		return threadCount;
+	}
+	// bytes the last Parse read looking for where ranges' first rows start, for tuning
+	uint64_t GetRowStartScanSize() const
+	{
+		return rowStartScanned;
+	}
+
+	// visit the rows of path from position to EOF, in order, as CSVReader::VisitRows does
+	// the header row is passed to headerVisitor if position is at the start of the file (before or after
+	// the BOM). A partial trailing row is left for a later read. position is advanced past the last row
+	// visited, and the visitor returns false to stop.
+	// returns the number of rows visited, or -1 if the file can't be read or is LZ4 compressed
+	// (frames have to be decoded in order, see CSVReader)
+	long long Parse(const MappedFile::PathChar* path, uint64_t& position, const RowVisitor& visitor, const RowVisitor& headerVisitor, const size_t maxFields = SIZE_MAX)
+	{
+		MappedFile file;
+		uint64_t fileSize = 0;
+		if (!file.Open(path) || !file.GetSize(fileSize))
+		{
+			return -1;
+		}
+		bool isHeaderPending = position <= BOM_SIZE;
+		if (position < BOM_SIZE && fileSize >= 4)
+		{
+			const char* pStart = file.Map(0, 4);
+			if (!pStart || LZ4Frame::IsFrameStart(pStart, 4))
+			{
+				return -1;
+			}
+			if (!position && memcmp(pStart, "\xEF\xBB\xBF", BOM_SIZE) == 0)
+			{
+				position = BOM_SIZE;
+			}
+		}
+
+		rowStartScanned = 0;
+		long long rowCount = 0;
+		bool isStopped = false;
+		size_t windowSize = threadCount * CHUNK_SIZE;
+		std::vector<CSVField> fields;
+		while (position < fileSize && !isStopped)
+		{
+			const bool isLastWindow = fileSize - position <= windowSize;
+			const size_t length = isLastWindow ? static_cast<size_t>(fileSize - position) : windowSize;
+			const char* data = file.Map(position, length);
+			if (!data)
+			{
+				break;
+			}
+			size_t base = 0;
+			if (isHeaderPending)
+			{
+				CSVTokenizer tokenizer(data, length);
+				if (tokenizer.NextRow(fields))
+				{
+					isHeaderPending = false;
+					base = tokenizer.GetPosition();
+					headerVisitor(CSVRowView(fields));
+				}
+			}
+			const size_t consumed = isHeaderPending ? 0 : ParseWindow(data, length, base, visitor, maxFields, rowCount, isStopped);
+			position += consumed;
+			if (isLastWindow)
+			{
+				break;
+			}
+			if (!consumed)
+			{
+				// a single row larger than the window
+				if (windowSize * 2 > MAX_WINDOW_SIZE)
+				{
+					break;
+				}
+				windowSize *= 2;
+			}
+		}
+		return rowCount;
+	}
+};
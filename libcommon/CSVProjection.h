@@ -0,0 +1,294 @@
+#pragma once
+// CSVProjection
+//  typed projection of a subset of CSV columns, bound by name to the header row
+//  callers select the columns they need and their types; after binding to a header, each row's
+//  selected fields are parsed straight from the UTF-8 bytes (from_chars) with no intermediate strings.
+//  Fields past the last selected column aren't recorded at all (see CSVTokenizer::NextRow maxFields).
+//
+//  portable (no Windows dependencies)
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <charconv>
+#include "CSVTokenizer.h"
+
+class CSVProjection
+{
+public:
+	enum ValueType
+	{
+		VALUE_INT64,
+		VALUE_DOUBLE,
+		VALUE_STRING,
+		VALUE_TIMESTAMP		// milliseconds since the Unix epoch, from "YYYY-MM-DD[ T]hh:mm:ss[.fff]" or a plain integer
+	};
+	static const size_t NO_FIELD = SIZE_MAX;
+
+private:
+	struct Column
+	{
+		std::string name;
+		ValueType type = VALUE_STRING;
+		size_t fieldIndex = NO_FIELD;
+		bool isValid = false;
+		int64_t intValue = 0;
+		double doubleValue = 0;
+		std::string_view stringValue;
+		std::string scratch;	// backs stringValue when the field had to be unescaped
+	};
+	std::vector<Column> columns;
+	size_t fieldCountNeeded = 0;
+	unsigned int boundGeneration = 0;
+	bool isBound = false;
+
+	static bool IEquals(const std::string_view a, const std::string_view b)
+	{
+		if (a.size() != b.size())
+		{
+			return false;
+		}
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			char ca = a[i], cb = b[i];
+			if (ca >= 'A' && ca <= 'Z') ca += 'a' - 'A';
+			if (cb >= 'A' && cb <= 'Z') cb += 'a' - 'A';
+			if (ca != cb)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	static bool ParseDigits(const char*& p, const char* end, const int count, int& value)
+	{
+		value = 0;
+		for (int i = 0; i < count; i++, p++)
+		{
+			if (p >= end || *p < '0' || *p > '9')
+			{
+				return false;
+			}
+			value = value * 10 + (*p - '0');
+		}
+		return true;
+	}
+	// days since 1970-01-01 of a proleptic Gregorian date (H. Hinnant's days_from_civil)
+	static int64_t DaysFromCivil(int64_t y, const unsigned m, const unsigned d)
+	{
+		y -= m <= 2;
+		const int64_t era = (y >= 0 ? y : y - 399) / 400;
+		const unsigned yoe = static_cast<unsigned>(y - era * 400);
+		const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+		const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+		return era * 146097 + static_cast<int64_t>(doe) - 719468;
+	}
+
+	static int DaysInMonth(const int year, const int month)
+	{
+		static const int days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+		const bool isLeapYear = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+		return month == 2 && isLeapYear ? 29 : days[month - 1];
+	}
+
+public:
+	// select a column by header name (case insensitive), returns the slot to read its value from
+	size_t Select(const std::string_view columnName, const ValueType type)
+	{
+		Column column;
+		column.name = columnName;
+		column.type = type;
+		columns.push_back(std::move(column));
+		isBound = false;
+		return columns.size() - 1;
+	}
+
+	// resolve selected names against header field names. Returns false if any selected column is missing
+	// (those slots are never valid). generation lets a reader tell whether it must rebind.
+	template <typename HeaderFields>
+	bool Bind(const HeaderFields& headerNames, const unsigned int generation = 0)
+	{
+		bool allFound = true;
+		fieldCountNeeded = 0;
+		for (auto& column : columns)
+		{
+			column.fieldIndex = NO_FIELD;
+			size_t index = 0;
+			for (auto& name : headerNames)
+			{
+				if (IEquals(column.name, name))
+				{
+					column.fieldIndex = index;
+					if (index + 1 > fieldCountNeeded)
+					{
+						fieldCountNeeded = index + 1;
+					}
+					break;
+				}
+				index++;
+			}
+			if (column.fieldIndex == NO_FIELD)
+			{
+				allFound = false;
+			}
+		}
+		boundGeneration = generation;
+		isBound = true;
+		return allFound;
+	}
+	bool IsBound() const
+	{
+		return isBound;
+	}
+	unsigned int GetBoundGeneration() const
+	{
+		return boundGeneration;
+	}
+	// number of leading fields of a row needed to satisfy the projection
+	size_t GetFieldCountNeeded() const
+	{
+		return isBound ? fieldCountNeeded : SIZE_MAX;
+	}
+
+	// the whole of text as a number. value is only written on success.
+	static bool ParseInt64(std::string_view text, int64_t& value)
+	{
+		if (!text.empty() && text[0] == '+')
+		{
+			text.remove_prefix(1);
+		}
+		int64_t parsed = 0;
+		auto result = std::from_chars(text.data(), text.data() + text.size(), parsed);
+		if (result.ec != std::errc() || result.ptr != text.data() + text.size())
+		{
+			return false;
+		}
+		value = parsed;
+		return true;
+	}
+	static bool ParseDouble(std::string_view text, double& value)
+	{
+		if (!text.empty() && text[0] == '+')
+		{
+			text.remove_prefix(1);
+		}
+		double parsed = 0;
+		auto result = std::from_chars(text.data(), text.data() + text.size(), parsed);
+		if (result.ec != std::errc() || result.ptr != text.data() + text.size())
+		{
+			return false;
+		}
+		value = parsed;
+		return true;
+	}
+	// "YYYY-MM-DD", optionally followed by " hh:mm:ss" (or 'T') and fractional seconds, taken as UTC
+	// a plain integer is taken as already being milliseconds since the epoch
+	// dates and times that don't exist (Feb 30, 24:00) are rejected. milliseconds is only written on success.
+	static bool ParseTimestamp(const std::string_view text, int64_t& milliseconds)
+	{
+		if (ParseInt64(text, milliseconds))
+		{
+			return true;
+		}
+		const char* p = text.data();
+		const char* end = p + text.size();
+		int year, month, day, hour = 0, minute = 0, second = 0, millis = 0;
+		if (!ParseDigits(p, end, 4, year) || p >= end || *p++ != '-'
+			|| !ParseDigits(p, end, 2, month) || p >= end || *p++ != '-'
+			|| !ParseDigits(p, end, 2, day)
+			|| month < 1 || month > 12 || day < 1 || day > DaysInMonth(year, month))
+		{
+			return false;
+		}
+		if (p < end)
+		{
+			if ((*p != ' ' && *p != 'T') || !ParseDigits(++p, end, 2, hour) || p >= end || *p++ != ':'
+				|| !ParseDigits(p, end, 2, minute) || p >= end || *p++ != ':'
+				|| !ParseDigits(p, end, 2, second)
+				|| hour > 23 || minute > 59 || second > 59)
+			{
+				return false;
+			}
+			if (p < end && *p == '.')
+			{
+				// up to millisecond precision, further digits are ignored
+				p++;
+				int scale = 100;
+				for (; p < end && *p >= '0' && *p <= '9'; p++, scale /= 10)
+				{
+					millis += (*p - '0') * scale;
+				}
+			}
+			if (p < end && *p == 'Z')
+			{
+				p++;
+			}
+			if (p != end)
+			{
+				return false;
+			}
+		}
+		milliseconds = ((DaysFromCivil(year, month, day) * 24 + hour) * 60 + minute) * 60 * 1000
+			+ static_cast<int64_t>(second) * 1000 + millis;
+		return true;
+	}
+
+	// parse the selected fields of a row. Returns false if the projection isn't bound
+	bool Project(const CSVRowView& row)
+	{
+		if (!isBound)
+		{
+			return false;
+		}
+		for (auto& column : columns)
+		{
+			column.isValid = false;
+			if (column.fieldIndex >= row.size())
+			{
+				continue;
+			}
+			std::string_view value = row[column.fieldIndex].Value(column.scratch);
+			switch (column.type)
+			{
+			case VALUE_INT64:
+				column.isValid = ParseInt64(value, column.intValue);
+				break;
+			case VALUE_DOUBLE:
+				column.isValid = ParseDouble(value, column.doubleValue);
+				break;
+			case VALUE_TIMESTAMP:
+				column.isValid = ParseTimestamp(value, column.intValue);
+				break;
+			case VALUE_STRING:
+				column.stringValue = value;
+				column.isValid = true;
+				break;
+			}
+		}
+		return true;
+	}
+
+	// values of the most recently projected row. String views may point into the reader's buffer, so they
+	// are only valid while the row is being visited.
+	bool IsValid(const size_t slot) const
+	{
+		return columns[slot].isValid;
+	}
+	int64_t GetInt64(const size_t slot) const
+	{
+		return columns[slot].isValid ? columns[slot].intValue : 0;
+	}
+	double GetDouble(const size_t slot) const
+	{
+		return columns[slot].isValid ? columns[slot].doubleValue : 0;
+	}
+	int64_t GetTimestamp(const size_t slot) const
+	{
+		return GetInt64(slot);
+	}
+	std::string_view GetString(const size_t slot) const
+	{
+		return columns[slot].isValid ? columns[slot].stringValue : std::string_view();
+	}
+};
@@ -6,9 +6,15 @@
 #include <map>
 #include <vector>
 #include <mutex>
-#include <sstream>
+#include <functional>
+#include <memory>
 #include "CSVUtil.h"
-#include "CSVReader.h"
+#include "UTFConvert.h"
+#include "CSVTokenizer.h"
+#include "CSVTailReader.h"
+#include "CSVProjection.h"
+#include "CSVParallelParser.h"
+#include "LZ4Frame.h"
 #include "DebugOutToggles.h"
 
 using namespace std;
@@ -16,32 +22,253 @@ using namespace ATL;
 
 class CSVReader
 {
+public:
+	typedef std::function<bool(const CSVRowView& row)> RowVisitor;
+	typedef std::function<bool(const CSVProjection& values)> ProjectedRowVisitor;
+
+private:
 	wstring sourceFilePath;
 
 	// to know if the source file is still the same one (or has been rotated/deleted)
 	mutex mutexBookmark;
 	FILETIME timeCreatedLastAccessedFile = { 0, 0 };
-	DWORD positionBookmark = 0;
+	unsigned long long positionBookmark = 0;
+
+	// reads are done in chunks through a bounded buffer, so files of any size take constant memory
+	// the buffer only grows (up to the max) when a single row doesn't fit in it
+	size_t readChunkSize = 1024 * 1024;
+	size_t maxReadBufferSize = 64 * 1024 * 1024;
+
+	// a row (or LZ4 frame) too large for the max buffer, or an invalid frame, is skipped rather than
+	// retried on every read: reading resumes after the next line break (or frame start) past it
+	bool isSkippingRow = false;
+	bool isSkippingFrame = false;
+	unsigned long long skippedCount = 0;
+
+	// tail mode keeps the file mapped and parses only what was appended since the last read
+	bool isTailMode = false;
+	CSVTailReader tailReader;
+
+	// compressed sources (written by CSVEmitter::SetCompressedOutput) are LZ4 frames. The bookmark is then
+	// the end of the last complete frame read, and decompressed text not yet visited is kept in pendingText
+	bool isCompressedSource = false;
+	bool isCompressedHeaderPending = false;
+	string pendingText;
+
+	// created on first use of VisitRowsParallel, its worker threads are kept for later reads
+	unique_ptr<CSVParallelParser> parallelParser;
+
+	// header of the current source, captured whenever it is (re)read so projections can bind to it
+	vector<string> headerNames;
+	unsigned int headerGeneration = 0;
+
+	void CaptureHeader(const CSVRowView& header)
+	{
+		headerNames.clear();
+		string scratch;
+		for (auto& i : header)
+		{
+			headerNames.push_back(string(i.Value(scratch)));
+		}
+		headerGeneration++;
+	}
+	int VisitRowsInternal(const RowVisitor& visitor, const RowVisitor& headerVisitor, const size_t& maxFields)
+	{
+		if (isTailMode)
+		{
+			int rowCount = static_cast<int>(tailReader.ReadNewRows(visitor, headerVisitor, maxFields));
+			if (!tailReader.IsCompressedSource())
+			{
+				LOG_DEBUG_PRINT(L"Tail read visited %d rows, bookmark now %llu", rowCount, tailReader.GetBookmark());
+				return rowCount;
+			}
+			// LZ4 frames are read by the chunked path, which also resumes at the last complete frame
+		}
+		return VisitRowsChunked(visitor, headerVisitor, maxFields);
+	}
 
 public:
 	void SetSourceFilePath(const WCHAR* sourcePath)
 	{
+		lock_guard<mutex> lock(mutexBookmark);
 		timeCreatedLastAccessedFile = { 0, 0 };
 		positionBookmark = 0;
+		isCompressedSource = false;
+		isSkippingRow = false;
+		isSkippingFrame = false;
+		pendingText.clear();
 		sourceFilePath = sourcePath;
+		tailReader.SetSourceFilePath(sourcePath);
+	}
+	// when enabled, the source stays memory-mapped between reads (see CSVTailReader)
+	void SetTailMode(const bool enabled)
+	{
+		lock_guard<mutex> lock(mutexBookmark);
+		isTailMode = enabled;
+		if (!enabled)
+		{
+			// release the mapping, next tail read starts over
+			tailReader.SetSourceFilePath(sourceFilePath.c_str());
+		}
+	}
+	bool IsTailMode()
+	{
+		return isTailMode;
+	}
+	// chunk size and the most the read buffer may grow to for a single row (or LZ4 frame)
+	void SetReadBufferSize(const size_t chunkSize, const size_t maxBufferSize)
+	{
+		lock_guard<mutex> lock(mutexBookmark);
+		readChunkSize = chunkSize;
+		maxReadBufferSize = maxBufferSize < chunkSize ? chunkSize : maxBufferSize;
+	}
+	// rows and LZ4 frames skipped because they didn't fit in the max read buffer (or map window in
+	// tail mode), or were invalid frames
+	unsigned long long GetSkippedCount()
+	{
+		lock_guard<mutex> lock(mutexBookmark);
+		return skippedCount + tailReader.GetOversizedRowCount();
 	}
 	wstring GetSourceFilePath()
 	{
 		return sourceFilePath;
 	}
+	// start or continue a read from the last read index to EOF, pushing each row to the visitor
+	// field views are only valid for the duration of the call, so nothing is allocated per row
+	// the visitor returns false to stop, leaving the bookmark after the row it stopped at
+	// returns the number of rows visited
+	int VisitRows(const RowVisitor& visitor)
+	{
+		lock_guard<mutex> lock(mutexBookmark);
+		const size_t allFields = SIZE_MAX;
+		return VisitRowsInternal(visitor, [this](const CSVRowView& header)
+			{
+				CaptureHeader(header);
+				return true;
+			}, allFields);
+	}
+	// as VisitRows, but the rows are tokenized on threadCount threads (0 for one per logical processor) and
+	// still visited in order on this thread. For large files that aren't being written to, e.g. offline analysis.
+	// tail mode and LZ4 compressed sources are read as VisitRows does.
+	int VisitRowsParallel(const RowVisitor& visitor, const unsigned int threadCount = 0)
+	{
+		lock_guard<mutex> lock(mutexBookmark);
+		const RowVisitor headerVisitor = [this](const CSVRowView& header)
+			{
+				CaptureHeader(header);
+				return true;
+			};
+		if (isTailMode || isCompressedSource)
+		{
+			return VisitRowsInternal(visitor, headerVisitor, SIZE_MAX);
+		}
+		WIN32_FILE_ATTRIBUTE_DATA attributes;
+		if (!GetFileAttributesEx(sourceFilePath.c_str(), GetFileExInfoStandard, &attributes))
+		{
+			LOG_DEBUG_PRINT(L"ERROR opening %s", sourceFilePath.c_str());
+			return 0;
+		}
+		// same file and bookmark checks as the chunked read
+		const unsigned long long fileSize = (static_cast<unsigned long long>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+		const bool isSameFile = 0 == CompareFileTime(&attributes.ftCreationTime, &timeCreatedLastAccessedFile)
+			&& fileSize >= positionBookmark;
+		if (!parallelParser || (threadCount && parallelParser->GetThreadCount() != threadCount))
+		{
+			parallelParser = make_unique<CSVParallelParser>(threadCount);
+		}
+		uint64_t position = isSameFile ? positionBookmark : 0;
+		const long long rowCount = parallelParser->Parse(sourceFilePath.c_str(), position, visitor, headerVisitor);
+		if (rowCount < 0)
+		{
+			// compressed (or unreadable), the chunked read detects which
+			return VisitRowsInternal(visitor, headerVisitor, SIZE_MAX);
+		}
+		if (!isSameFile)
+		{
+			timeCreatedLastAccessedFile = attributes.ftCreationTime;
+			isCompressedSource = false;
+			pendingText.clear();
+		}
+		positionBookmark = position;
+		LOG_DEBUG_PRINT(L"Parallel read visited %lld rows, bookmark now %llu", rowCount, positionBookmark);
+		return static_cast<int>(rowCount);
+	}
+	// as VisitRows, but only the projection's columns are decoded. The projection is (re)bound by name
+	// whenever the source's header is read, and fields past its last column are never recorded.
+	// the visitor reads typed values from the projection. Rows are skipped until it is bound.
+	int VisitProjected(CSVProjection& projection, const ProjectedRowVisitor& visitor)
+	{
+		lock_guard<mutex> lock(mutexBookmark);
+		if (!headerNames.empty()
+			&& (!projection.IsBound() || projection.GetBoundGeneration() != headerGeneration))
+		{
+			projection.Bind(headerNames, headerGeneration);
+		}
+		size_t maxFields = projection.GetFieldCountNeeded();
+		return VisitRowsInternal([&](const CSVRowView& row)
+			{
+				if (!projection.Project(row))
+				{
+					return true;
+				}
+				return visitor(projection);
+			}, [&](const CSVRowView& header)
+			{
+				CaptureHeader(header);
+				projection.Bind(headerNames, headerGeneration);
+				maxFields = projection.GetFieldCountNeeded();
+				return true;
+			}, maxFields);
+	}
+	// field names of the source's header row, empty until it has been read
+	vector<string> GetHeaderNames()
+	{
+		lock_guard<mutex> lock(mutexBookmark);
+		return headerNames;
+	}
 	// start or continue a read from the last read index to EOF
 	// returns vector of vectors of fields to values, e.g. { row1 { Val1 , Val2 }, row2 { Val1 , Val2 } }
+	// values are UTF-8 as in the file
+	int ReadRows(_Out_ vector<vector<string>>& rows)
+	{
+		string scratch;
+		VisitRows([&](const CSVRowView& fields)
+			{
+				vector<string> row;
+				row.reserve(fields.size());
+				for (auto& i : fields)
+				{
+					row.emplace_back(i.Value(scratch));
+				}
+				rows.push_back(std::move(row));
+				return true;
+			});
+		return static_cast<int>(rows.size());
+	}
+	// as above, converted to UTF-16 for display
 	int ReadRows(_Out_ vector<vector<wstring>>& rows)
 	{
-		lock_guard<mutex> lock(mutexBookmark);
+		string scratch;
+		VisitRows([&](const CSVRowView& fields)
+			{
+				vector<wstring> row;
+				row.reserve(fields.size());
+				for (auto& i : fields)
+				{
+					row.push_back(UTFConvert::ToWide(i.Value(scratch)));
+				}
+				rows.push_back(std::move(row));
+				return true;
+			});
+		return static_cast<int>(rows.size());
+	}
 
-		LOG_DEBUG_PRINT(L"ReadSourceToEOF at index %d", positionBookmark);
-		HANDLE hFile = CreateFile(sourceFilePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, 0, NULL);
+private:
+	int VisitRowsChunked(const RowVisitor& visitor, const RowVisitor& headerVisitor, const size_t& maxFields)
+	{
+		LOG_DEBUG_PRINT(L"ReadSourceToEOF at index %llu", positionBookmark);
+		// the writer has the file open, and may roll it while we read
+		HANDLE hFile = CreateFile(sourceFilePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, 0, NULL);
 		if (hFile == INVALID_HANDLE_VALUE)
 		{
 			LOG_DEBUG_PRINT(L"ERROR opening %s", sourceFilePath.c_str());
@@ -50,7 +277,7 @@ public:
 		// check to ensure same file we have a bookmark to
 		bool isSameFile = true;
 		FILETIME timeCreated, timeLastAccess, timeLastWrite;
-		DWORD sizeHigh = 0, sizeLow = 0;
+		LARGE_INTEGER liFileSize = {};
 		if (!GetFileTime(hFile, &timeCreated, &timeLastAccess, &timeLastWrite))
 		{
 			// abort here to prevent undefined behavior
@@ -66,20 +293,20 @@ public:
 				isSameFile = false;
 			}
 			// also check file size to ensure it isn't < our index				
-			sizeLow = GetFileSize(hFile, &sizeHigh);
-			if (sizeLow == INVALID_FILE_SIZE)
+			if (!GetFileSizeEx(hFile, &liFileSize))
 			{
 				// abort here to prevent undefined behavior
 				LOG_DEBUG_PRINT(L"Error getting file size");
 				CloseHandle(hFile);
 				return 0;
 			}
-			if (sizeLow < positionBookmark)
+			if (static_cast<unsigned long long>(liFileSize.QuadPart) < positionBookmark)
 			{
 				LOG_DEBUG_PRINT(L"File size < bookmark, tossing bookmark");
 				isSameFile = false;
 			}
 		}
+		const unsigned long long fileSize = static_cast<unsigned long long>(liFileSize.QuadPart);
 
 		if (false == isSameFile)
 		{
@@ -87,58 +314,240 @@ public:
 			positionBookmark = 3;	// BOM size
 			timeCreatedLastAccessedFile.dwHighDateTime = timeCreated.dwHighDateTime;
 			timeCreatedLastAccessedFile.dwLowDateTime = timeCreated.dwLowDateTime;
+
+			char magic[4] = {};
+			DWORD bytesRead = 0;
+			isCompressedSource = ReadFile(hFile, magic, sizeof(magic), &bytesRead, nullptr)
+				&& LZ4Frame::IsFrameStart(magic, bytesRead);
+			isCompressedHeaderPending = isCompressedSource;
+			isSkippingRow = false;
+			isSkippingFrame = false;
+			pendingText.clear();
+			if (isCompressedSource)
+			{
+				positionBookmark = 0;
+			}
+		}
+		if (isCompressedSource)
+		{
+			int rowCount = VisitFrames(hFile, fileSize, visitor, headerVisitor, maxFields);
+			CloseHandle(hFile);
+			return rowCount;
 		}
 
 		// read to EOF
 
-		// if file size high is non-zero, this file is too big for us to handle, so abort
-		if (sizeHigh
-			|| sizeLow < positionBookmark)
+		if (fileSize <= positionBookmark)
 		{
-			LOG_DEBUG_PRINT(L"WARNING: file size out of bounds or nothing to read. Aborting");
+			LOG_DEBUG_PRINT(L"Nothing to read");
 			CloseHandle(hFile);
 			return 0;
 		}
-		int bytesToRead = sizeLow - positionBookmark;
-		if (bytesToRead > 0)
+		unsigned long long bytesRemaining = fileSize - positionBookmark;
+		LOG_DEBUG_PRINT(L"Bytes to read is %llu", bytesRemaining);
+		LARGE_INTEGER liBookmark;
+		liBookmark.QuadPart = static_cast<LONGLONG>(positionBookmark);
+		SetFilePointerEx(hFile, liBookmark, nullptr, FILE_BEGIN);
+
+		int rowCount = 0;
+		bool isStopped = false;
+		size_t bufferSize = static_cast<size_t>(min<unsigned long long>(readChunkSize, bytesRemaining));
+		std::string bytes(bufferSize, '\0');
+		size_t bytesCarried = 0;	// partial row at the start of the buffer, carried over from the previous chunk
+		vector<CSVField> fields;
+		// if header, skip
+		bool isHeader = positionBookmark <= 3;
+		while (bytesRemaining && !isStopped)
 		{
-			LOG_DEBUG_PRINT(L"Bytes to read is %d", bytesToRead);
-			SetFilePointer(hFile, positionBookmark, nullptr, FILE_BEGIN);
-			std::string bytes(bytesToRead + 1, '\0');
+			DWORD bytesToRead = static_cast<DWORD>(min<unsigned long long>(bufferSize - bytesCarried, bytesRemaining));
 			DWORD bytesRead = 0;
-			if (!ReadFile(hFile, (LPVOID)bytes.c_str(), bytesToRead, &bytesRead, nullptr) || bytesRead != bytesToRead)
+			if (!ReadFile(hFile, &bytes[bytesCarried], bytesToRead, &bytesRead, nullptr) || !bytesRead)
 			{
 				LOG_DEBUG_PRINT(L"ReadFile failure. Aborting");
-				CloseHandle(hFile);
-				return 0;
+				break;
 			}
-			static CSVUtil csvUtil;
-			wistringstream datastream(csvUtil.ConvertUTF8ToWSTR(bytes));
-			int numRows = 0;
-			for (wstring line;
-				std::getline(datastream, line);
-				)
+			bytesRemaining -= bytesRead;
+
+			const size_t bytesValid = bytesCarried + bytesRead;
+			size_t rowsStart = 0;
+			if (isSkippingRow)
 			{
-				if (datastream.bad() || datastream.fail() || datastream.eof())
+				const char* pLineEnd = static_cast<const char*>(memchr(bytes.c_str(), '\n', bytesValid));
+				if (!pLineEnd)
 				{
-					break;
+					positionBookmark += bytesValid;
+					bytesCarried = 0;
+					continue;
 				}
-				LOG_DEBUG_PRINT(L"Read line: %s", line.c_str());
-				// if header, skip
-				if (positionBookmark > 3 || numRows > 0)
+				rowsStart = pLineEnd - bytes.c_str() + 1;
+				positionBookmark += rowsStart;
+				isSkippingRow = false;
+			}
+
+			// tokenize the UTF-8 bytes in place, the visitor gets views into the buffer
+			CSVTokenizer tokenizer(bytes.c_str() + rowsStart, bytesValid - rowsStart);
+			while (tokenizer.NextRow(fields, false, isHeader ? SIZE_MAX : maxFields))
+			{
+				if (isHeader)
 				{
-					vector<wstring> fields;
-					csvUtil.ParseCSVRow(line, fields);
-					rows.push_back(fields);
+					isHeader = false;
+					headerVisitor(CSVRowView(fields));
+					continue;
+				}
+				rowCount++;
+				if (!visitor(CSVRowView(fields)))
+				{
+					isStopped = true;
+					break;
 				}
-				numRows++;
 			}
 
-			positionBookmark = sizeLow;
-			LOG_DEBUG_PRINT(L"Returned %u rows", rows.size());
+			// a partial trailing row is carried into the next chunk, or left for the next read at EOF
+			const size_t bytesConsumed = rowsStart + tokenizer.GetPosition();
+			positionBookmark += tokenizer.GetPosition();
+			bytesCarried = bytesValid - bytesConsumed;
+			if (bytesCarried && bytesConsumed)
+			{
+				memmove(&bytes[0], &bytes[bytesConsumed], bytesCarried);
+			}
+			if (bytesCarried == bufferSize && bytesRemaining)
+			{
+				// a single row larger than the buffer
+				if (bufferSize * 2 > maxReadBufferSize)
+				{
+					// its line break is past the buffer (any in it were quoted), skip to it
+					LOG_DEBUG_PRINT(L"WARNING: row at %llu exceeds max buffer size. Skipping it", positionBookmark);
+					positionBookmark += bytesCarried;
+					bytesCarried = 0;
+					isSkippingRow = true;
+					skippedCount++;
+					continue;
+				}
+				bufferSize *= 2;
+				bytes.resize(bufferSize);
+			}
 		}
+		LOG_DEBUG_PRINT(L"Visited %d rows", rowCount);
 
 		CloseHandle(hFile);
-		return static_cast<int>(rows.size());
+		return rowCount;
+	}
+	// visit the complete rows in pendingText, keeping a partial trailing row. false if the visitor stopped.
+	bool VisitPendingText(const RowVisitor& visitor, const RowVisitor& headerVisitor, const size_t& maxFields, vector<CSVField>& fields, int& rowCount)
+	{
+		size_t start = 0;
+		if (isCompressedHeaderPending && pendingText.compare(0, 3, "\xEF\xBB\xBF") == 0)
+		{
+			start = 3;
+		}
+		CSVTokenizer tokenizer(pendingText.c_str() + start, pendingText.size() - start);
+		bool isStopped = false;
+		while (tokenizer.NextRow(fields, false, isCompressedHeaderPending ? SIZE_MAX : maxFields))
+		{
+			if (isCompressedHeaderPending)
+			{
+				isCompressedHeaderPending = false;
+				headerVisitor(CSVRowView(fields));
+				continue;
+			}
+			rowCount++;
+			if (!visitor(CSVRowView(fields)))
+			{
+				isStopped = true;
+				break;
+			}
+		}
+		pendingText.erase(0, start + tokenizer.GetPosition());
+		return !isStopped;
+	}
+	// offset of the first frame magic in data[from, length), or of the last bytes that could still start one
+	static size_t FindFrameStart(const char* data, const size_t from, const size_t length)
+	{
+		size_t i = from;
+		for (; i + 4 <= length; i++)
+		{
+			if (LZ4Frame::IsFrameStart(data + i, 4))
+			{
+				return i;
+			}
+		}
+		return i;
+	}
+	// compressed source: decode each complete frame from the bookmark on, leaving a frame still being
+	// written for the next read
+	int VisitFrames(const HANDLE hFile, const unsigned long long fileSize, const RowVisitor& visitor, const RowVisitor& headerVisitor, const size_t& maxFields)
+	{
+		int rowCount = 0;
+		vector<CSVField> fields;
+		// rows decoded by an earlier read that stopped early
+		if (!VisitPendingText(visitor, headerVisitor, maxFields, fields, rowCount) || fileSize <= positionBookmark)
+		{
+			return rowCount;
+		}
+		LARGE_INTEGER liBookmark;
+		liBookmark.QuadPart = static_cast<LONGLONG>(positionBookmark);
+		SetFilePointerEx(hFile, liBookmark, nullptr, FILE_BEGIN);
+
+		unsigned long long bytesRemaining = fileSize - positionBookmark;
+		size_t bufferSize = static_cast<size_t>(min<unsigned long long>(readChunkSize, bytesRemaining));
+		std::string bytes(bufferSize, '\0');
+		size_t bytesCarried = 0;	// partial frame carried over from the previous chunk
+		while (bytesRemaining)
+		{
+			DWORD bytesToRead = static_cast<DWORD>(min<unsigned long long>(bufferSize - bytesCarried, bytesRemaining));
+			DWORD bytesRead = 0;
+			if (!ReadFile(hFile, &bytes[bytesCarried], bytesToRead, &bytesRead, nullptr) || !bytesRead)
+			{
+				LOG_DEBUG_PRINT(L"ReadFile failure. Aborting");
+				break;
+			}
+			bytesRemaining -= bytesRead;
+			const size_t bytesValid = bytesCarried + bytesRead;
+			size_t position = 0;
+			for (;;)
+			{
+				size_t frameSize = 0;
+				const LZ4Frame::FrameStatus status = LZ4Frame::ReadFrame(bytes.data() + position, bytesValid - position, frameSize, &pendingText);
+				if (status == LZ4Frame::FRAME_COMPLETE)
+				{
+					isSkippingFrame = false;
+					position += frameSize;
+					positionBookmark += frameSize;
+					if (!VisitPendingText(visitor, headerVisitor, maxFields, fields, rowCount))
+					{
+						return rowCount;
+					}
+					continue;
+				}
+				const bool isTooLarge = bytesValid - position == bufferSize && bytesRemaining && bufferSize * 2 > maxReadBufferSize;
+				if (status == LZ4Frame::FRAME_INCOMPLETE && !isTooLarge)
+				{
+					break;
+				}
+				// invalid, or a frame larger than the max buffer: resume at the next frame start
+				if (!isSkippingFrame)
+				{
+					LOG_DEBUG_PRINT(L"WARNING: invalid or oversized frame at %llu. Skipping it", positionBookmark);
+					isSkippingFrame = true;
+					skippedCount++;
+				}
+				const size_t next = FindFrameStart(bytes.data(), position + 1, bytesValid);
+				positionBookmark += next - position;
+				position = next;
+			}
+			bytesCarried = bytesValid - position;
+			if (bytesCarried && position)
+			{
+				memmove(&bytes[0], &bytes[position], bytesCarried);
+			}
+			if (bytesCarried == bufferSize && bytesRemaining)
+			{
+				// a single frame larger than the buffer
+				bufferSize *= 2;
+				bytes.resize(bufferSize);
+			}
+		}
+		LOG_DEBUG_PRINT(L"Visited %d rows", rowCount);
+		return rowCount;
 	}
 };
\ No newline at end of file
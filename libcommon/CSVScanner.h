@@ -0,0 +1,273 @@
+#pragma once
+// CSVScanner
+//  finds CSV structural characters ( , " \r \n and the escape leads \ ' ) in UTF-8 bytes
+//  input is classified 64 bytes at a time into a bitmask (simdjson style), using AVX2 or SSE2 when
+//  the CPU has them (picked once at runtime). The scalar classifier defines the expected results;
+//  tests/CSVScannerTests.cpp fuzzes every available implementation against it.
+//
+//  portable (no Windows dependencies)
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CSVSCANNER_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#define CSVSCANNER_TARGET_AVX2
+#else
+#include <cpuid.h>
+#include <immintrin.h>
+#define CSVSCANNER_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+class CSVScanner
+{
+public:
+	static const size_t BLOCK_SIZE = 64;
+	typedef uint64_t(*BlockMaskFn)(const char* block);
+
+	enum Implementation
+	{
+		IMPL_SCALAR = 0,
+		IMPL_SSE2,
+		IMPL_AVX2
+	};
+
+	static bool IsStructural(const char c)
+	{
+		return c == ',' || c == '"' || c == '\r' || c == '\n' || c == '\\' || c == '\'';
+	}
+
+	// mask must be non-zero
+	static unsigned int CountTrailingZeros(const uint64_t mask)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long index;
+		_BitScanForward64(&index, mask);
+		return index;
+#elif defined(_MSC_VER)
+		unsigned long index;
+		if (_BitScanForward(&index, static_cast<unsigned long>(mask)))
+		{
+			return index;
+		}
+		_BitScanForward(&index, static_cast<unsigned long>(mask >> 32));
+		return index + 32;
+#else
+		return static_cast<unsigned int>(__builtin_ctzll(mask));
+#endif
+	}
+
+	// bit n set if block[n] is structural
+	static uint64_t BlockMaskScalar(const char* block)
+	{
+		uint64_t mask = 0;
+		for (size_t i = 0; i < BLOCK_SIZE; i++)
+		{
+			if (IsStructural(block[i]))
+			{
+				mask |= (1ULL << i);
+			}
+		}
+		return mask;
+	}
+
+#ifdef CSVSCANNER_X86
+	static uint64_t BlockMaskSSE2(const char* block)
+	{
+		const __m128i comma = _mm_set1_epi8(',');
+		const __m128i quote = _mm_set1_epi8('"');
+		const __m128i cr = _mm_set1_epi8('\r');
+		const __m128i lf = _mm_set1_epi8('\n');
+		const __m128i backslash = _mm_set1_epi8('\\');
+		const __m128i apostrophe = _mm_set1_epi8('\'');
+		uint64_t mask = 0;
+		for (size_t i = 0; i < BLOCK_SIZE; i += 16)
+		{
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+			__m128i hits = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(v, comma), _mm_cmpeq_epi8(v, quote)),
+				_mm_or_si128(
+					_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)),
+					_mm_or_si128(_mm_cmpeq_epi8(v, backslash), _mm_cmpeq_epi8(v, apostrophe))));
+			mask |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(hits))) << i;
+		}
+		return mask;
+	}
+
+	CSVSCANNER_TARGET_AVX2 static uint64_t BlockMaskAVX2(const char* block)
+	{
+		const __m256i comma = _mm256_set1_epi8(',');
+		const __m256i quote = _mm256_set1_epi8('"');
+		const __m256i cr = _mm256_set1_epi8('\r');
+		const __m256i lf = _mm256_set1_epi8('\n');
+		const __m256i backslash = _mm256_set1_epi8('\\');
+		const __m256i apostrophe = _mm256_set1_epi8('\'');
+		uint64_t mask = 0;
+		for (size_t i = 0; i < BLOCK_SIZE; i += 32)
+		{
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i));
+			__m256i hits = _mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, comma), _mm256_cmpeq_epi8(v, quote)),
+				_mm256_or_si256(
+					_mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)),
+					_mm256_or_si256(_mm256_cmpeq_epi8(v, backslash), _mm256_cmpeq_epi8(v, apostrophe))));
+			mask |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(hits))) << i;
+		}
+		return mask;
+	}
+
+	static bool IsAVX2Supported()
+	{
+#ifdef _MSC_VER
+		int regs[4] = { 0 };
+		__cpuid(regs, 0);
+		if (regs[0] < 7)
+		{
+			return false;
+		}
+		__cpuid(regs, 1);
+		// OS must save YMM state (OSXSAVE, then XCR0 bits 1 and 2)
+		const int OSXSAVE_AVX = (1 << 27) | (1 << 28);
+		if ((regs[2] & OSXSAVE_AVX) != OSXSAVE_AVX
+			|| (_xgetbv(0) & 6) != 6)
+		{
+			return false;
+		}
+		__cpuidex(regs, 7, 0);
+		return (regs[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+
+	static bool IsImplementationAvailable(const Implementation impl)
+	{
+		switch (impl)
+		{
+		case IMPL_SCALAR:
+			return true;
+#ifdef CSVSCANNER_X86
+		case IMPL_SSE2:
+			return true;	// baseline for every x64 target and the default for MSVC x86
+		case IMPL_AVX2:
+			return IsAVX2Supported();
+#endif
+		default:
+			return false;
+		}
+	}
+
+	static BlockMaskFn GetBlockMaskFn(const Implementation impl)
+	{
+		switch (impl)
+		{
+#ifdef CSVSCANNER_X86
+		case IMPL_SSE2:
+			return BlockMaskSSE2;
+		case IMPL_AVX2:
+			return BlockMaskAVX2;
+#endif
+		default:
+			return BlockMaskScalar;
+		}
+	}
+
+	// best implementation for this CPU, selected on first use
+	static BlockMaskFn GetBlockMaskFn()
+	{
+		static const BlockMaskFn fnBest = IsImplementationAvailable(IMPL_AVX2) ? GetBlockMaskFn(IMPL_AVX2)
+			: IsImplementationAvailable(IMPL_SSE2) ? GetBlockMaskFn(IMPL_SSE2) : GetBlockMaskFn(IMPL_SCALAR);
+		return fnBest;
+	}
+
+	// forward iterator over structural positions of a buffer, classifying each 64 byte block once
+	class Cursor
+	{
+		const char* data = nullptr;
+		size_t size = 0;
+		size_t blockStart = 0;
+		uint64_t blockMask = 0;
+		bool blockLoaded = false;
+		BlockMaskFn fnBlockMask = nullptr;
+
+		void LoadBlock(const size_t offset)
+		{
+			blockStart = offset;
+			blockLoaded = true;
+			if (blockStart + BLOCK_SIZE <= size)
+			{
+				blockMask = fnBlockMask(data + blockStart);
+			}
+			else
+			{
+				// final partial block, pad with non-structural bytes so the loads stay in bounds
+				char padded[BLOCK_SIZE] = { 0 };
+				memcpy(padded, data + blockStart, size - blockStart);
+				blockMask = fnBlockMask(padded);
+			}
+		}
+	public:
+		Cursor() {}
+		Cursor(const char* source, const size_t length, const BlockMaskFn fn = GetBlockMaskFn())
+		{
+			Reset(source, length, fn);
+		}
+		void Reset(const char* source, const size_t length, const BlockMaskFn fn = GetBlockMaskFn())
+		{
+			data = source;
+			size = length;
+			blockStart = 0;
+			blockMask = 0;
+			blockLoaded = false;
+			fnBlockMask = fn;
+		}
+		// offset of the first structural character at or after from, or size if there is none
+		size_t Next(const size_t from)
+		{
+			if (from >= size)
+			{
+				return size;
+			}
+			const size_t alignedFrom = from - (from % BLOCK_SIZE);
+			if (!blockLoaded || alignedFrom != blockStart)
+			{
+				LoadBlock(alignedFrom);
+			}
+			uint64_t mask = blockMask & (~0ULL << (from - blockStart));
+			while (!mask)
+			{
+				if (blockStart + BLOCK_SIZE >= size)
+				{
+					return size;
+				}
+				LoadBlock(blockStart + BLOCK_SIZE);
+				mask = blockMask;
+			}
+			return blockStart + CountTrailingZeros(mask);
+		}
+	};
+
+	// offset of the first structural character in data, or length if there is none
+	static size_t FindStructural(const char* data, const size_t length)
+	{
+		Cursor cursor(data, length);
+		return cursor.Next(0);
+	}
+	static size_t FindStructuralScalar(const char* data, const size_t length)
+	{
+		for (size_t i = 0; i < length; i++)
+		{
+			if (IsStructural(data[i]))
+			{
+				return i;
+			}
+		}
+		return length;
+	}
+};
@@ -0,0 +1,251 @@
+#pragma once
+// CSVTailReader
+//  incremental reader for a CSV file that is being appended to
+//  the file stays memory-mapped between polls and is only remapped when it has grown. Each poll
+//  tokenizes just the bytes appended since the last one, and a partially written trailing row is
+//  left pending until its line terminator arrives, so poll cost scales with bytes appended.
+//  A file replaced at the same path (different identity) or truncated below the bookmark is
+//  treated as rotated and read again from the start.
+//  A row too large to map (over the maximum map window) is skipped: reading resumes after the next line
+//  break past it, and GetOversizedRowCount counts the rows lost that way.
+//
+//  portable (MappedFile provides Win32 and POSIX backends)
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include "MappedFile.h"
+#include "CSVTokenizer.h"
+#include "LZ4Frame.h"
+
+class CSVTailReader
+{
+	std::basic_string<MappedFile::PathChar> sourceFilePath;
+	MappedFile file;
+	MappedFile::FileIdentity identity;
+	uint64_t positionBookmark = 0;
+	bool isHeaderPending = true;
+	bool isCompressedSource = false;	// LZ4 frames, which this reader leaves to CSVReader's chunked path
+	bool isSkippingRow = false;		// in an oversized row, looking for the line break that ends it
+	uint64_t oversizedRowCount = 0;
+	std::vector<CSVField> fields;	// reused between rows and polls
+
+	// the appended range is mapped in windows of at most mapWindowSize, so address space use stays
+	// bounded however large the file (or backlog) is. Only grows (to maxMapWindowSize) if a single row doesn't fit.
+	size_t mapWindowSize = 64 * 1024 * 1024;
+	size_t maxMapWindowSize = 256 * 1024 * 1024;
+
+	static const unsigned char* GetBOM()
+	{
+		static const unsigned char bom[3] = { 0xEF,0xBB,0xBF };
+		return bom;
+	}
+	static const size_t BOM_SIZE = 3;
+
+	// (re)open if needed, returns false if the file isn't available
+	bool EnsureOpen()
+	{
+		MappedFile::FileIdentity currentIdentity;
+		if (!MappedFile::QueryIdentity(sourceFilePath.c_str(), currentIdentity))
+		{
+			file.Close();
+			return false;
+		}
+		if (!file.IsOpen() || currentIdentity != identity)
+		{
+			if (!file.Open(sourceFilePath.c_str()))
+			{
+				return false;
+			}
+			identity = currentIdentity;
+			Rewind();
+		}
+		return true;
+	}
+	void Rewind()
+	{
+		file.Unmap();
+		positionBookmark = 0;
+		isHeaderPending = true;
+		isCompressedSource = false;
+		isSkippingRow = false;
+	}
+	// advance the bookmark past the next line break, or to size if none has been written yet
+	// returns false if the row is still being skipped
+	bool SkipToNextLine(const uint64_t size)
+	{
+		while (positionBookmark < size)
+		{
+			const uint64_t bytesRemaining = size - positionBookmark;
+			const size_t length = bytesRemaining < mapWindowSize ? static_cast<size_t>(bytesRemaining) : mapWindowSize;
+			const char* pData = file.Map(positionBookmark, length);
+			if (!pData)
+			{
+				return false;
+			}
+			const char* pLineEnd = static_cast<const char*>(memchr(pData, '\n', length));
+			if (pLineEnd)
+			{
+				positionBookmark += (pLineEnd - pData) + 1;
+				isSkippingRow = false;
+				return true;
+			}
+			positionBookmark += length;
+		}
+		return false;
+	}
+
+public:
+	void SetSourceFilePath(const MappedFile::PathChar* sourcePath)
+	{
+		file.Close();
+		sourceFilePath = sourcePath;
+		identity = MappedFile::FileIdentity();
+		Rewind();
+	}
+	const std::basic_string<MappedFile::PathChar>& GetSourceFilePath() const
+	{
+		return sourceFilePath;
+	}
+	// map window sizes, see mapWindowSize
+	void SetMapWindowSize(const size_t windowSize, const size_t maxWindowSize)
+	{
+		mapWindowSize = windowSize;
+		maxMapWindowSize = maxWindowSize < windowSize ? windowSize : maxWindowSize;
+	}
+	uint64_t GetBookmark() const
+	{
+		return positionBookmark;
+	}
+	// rows skipped because they didn't fit in the largest map window
+	uint64_t GetOversizedRowCount() const
+	{
+		return oversizedRowCount;
+	}
+	// the source is a compressed (LZ4 frame) file, no rows are read from it
+	bool IsCompressedSource() const
+	{
+		return isCompressedSource;
+	}
+
+	// tokenize rows appended since the last call, calling handler(const CSVRowView&) for each complete
+	// row. The header row is skipped. Field views are only valid during the handler call.
+	// the handler returns false to stop early, in which case the bookmark is left after that row
+	// returns the number of rows handled
+	template <typename RowHandler>
+	size_t ReadNewRows(RowHandler&& handler)
+	{
+		return ReadNewRows(handler, [](const CSVRowView&) {}, SIZE_MAX);
+	}
+	// as above, also calling headerHandler(const CSVRowView&) when the header row is read, and
+	// recording only the first maxFields fields of each data row (it may change during the call,
+	// e.g. when the header handler binds a projection)
+	template <typename RowHandler, typename HeaderHandler>
+	size_t ReadNewRows(RowHandler&& handler, HeaderHandler&& headerHandler, const size_t& maxFields)
+	{
+		if (sourceFilePath.empty() || !EnsureOpen())
+		{
+			return 0;
+		}
+		uint64_t size = 0;
+		if (!file.GetSize(size))
+		{
+			return 0;
+		}
+		if (size < positionBookmark)
+		{
+			// truncated in place
+			Rewind();
+		}
+		if (size == positionBookmark)
+		{
+			return 0;
+		}
+
+		if (positionBookmark == 0)
+		{
+			if (size < BOM_SIZE + 1)
+			{
+				// wait for enough to know whether there is a BOM, or an LZ4 frame magic
+				return 0;
+			}
+			const char* pStart = file.Map(0, BOM_SIZE + 1);
+			if (pStart && LZ4Frame::IsFrameStart(pStart, BOM_SIZE + 1))
+			{
+				isCompressedSource = true;
+			}
+			if (isCompressedSource)
+			{
+				return 0;
+			}
+			if (pStart && memcmp(pStart, GetBOM(), BOM_SIZE) == 0)
+			{
+				positionBookmark = BOM_SIZE;
+			}
+		}
+
+		size_t rowCount = 0;
+		bool isStopped = false;
+		size_t windowSize = mapWindowSize;
+		while (positionBookmark < size)
+		{
+			if (isSkippingRow)
+			{
+				if (!SkipToNextLine(size))
+				{
+					break;
+				}
+				continue;
+			}
+			const uint64_t bytesRemaining = size - positionBookmark;
+			const size_t length = bytesRemaining < windowSize ? static_cast<size_t>(bytesRemaining) : windowSize;
+			const char* pData = file.Map(positionBookmark, length);
+			if (!pData)
+			{
+				break;
+			}
+			CSVTokenizer tokenizer(pData, length);
+			while (tokenizer.NextRow(fields, false, isHeaderPending ? SIZE_MAX : maxFields))
+			{
+				if (isHeaderPending)
+				{
+					isHeaderPending = false;
+					headerHandler(CSVRowView(fields));
+					continue;
+				}
+				rowCount++;
+				if (!handler(CSVRowView(fields)))
+				{
+					isStopped = true;
+					break;
+				}
+			}
+			positionBookmark += tokenizer.GetPosition();
+			if (isStopped)
+			{
+				break;
+			}
+			if (!tokenizer.GetPosition())
+			{
+				if (length < windowSize)
+				{
+					// partial row pending, wait for more
+					break;
+				}
+				if (windowSize * 2 > maxMapWindowSize)
+				{
+					// too large to ever map, skip it rather than stall on it every poll
+					// its line break is past this window (any inside it were quoted)
+					positionBookmark += length;
+					isSkippingRow = true;
+					oversizedRowCount++;
+					windowSize = mapWindowSize;
+					continue;
+				}
+				windowSize *= 2;
+			}
+		}
+		return rowCount;
+	}
+};
@@ -0,0 +1,337 @@
+#pragma once
+// CSVTokenizer
+//  single-pass RFC 4180 state machine tokenizer working directly on UTF-8 bytes
+//  fields are returned as views into the source buffer; only fields that actually contain
+//  escape sequences ("" '' \,) need to be unescaped, and that is done into caller-supplied scratch
+//
+//  runs of ordinary bytes inside fields are skipped with CSVScanner (SIMD where available)
+//
+//  portable (no Windows dependencies) so it can be exercised on any platform
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "CSVScanner.h"
+
+struct CSVField
+{
+	std::string_view raw;		// field contents with surrounding quotes and whitespace stripped, escapes intact
+	bool hasEscapes = false;	// raw may contain escape sequences and must go through Unescape
+
+	// unescaped value of the field. Returns a view of raw when nothing needs unescaping, otherwise of scratch.
+	std::string_view Value(std::string& scratch) const;
+	std::string ToString() const
+	{
+		std::string scratch;
+		return std::string(Value(scratch));
+	}
+};
+
+// non-owning view of a tokenized row (a span of field views), valid only as long as the fields it was made from
+class CSVRowView
+{
+	const CSVField* pFields = nullptr;
+	size_t count = 0;
+public:
+	CSVRowView() {}
+	CSVRowView(const CSVField* fields, const size_t fieldCount) : pFields(fields), count(fieldCount) {}
+	CSVRowView(const std::vector<CSVField>& fields) : pFields(fields.data()), count(fields.size()) {}
+
+	size_t size() const
+	{
+		return count;
+	}
+	bool empty() const
+	{
+		return count == 0;
+	}
+	const CSVField& operator[] (const size_t index) const
+	{
+		return pFields[index];
+	}
+	const CSVField* begin() const
+	{
+		return pFields;
+	}
+	const CSVField* end() const
+	{
+		return pFields + count;
+	}
+};
+
+class CSVTokenizer
+{
+	const char* data = nullptr;
+	size_t size = 0;
+	size_t pos = 0;		// offset just past the last complete row returned
+	CSVScanner::Cursor scanner;
+	size_t fieldLimit = SIZE_MAX;	// fields past this are scanned over but not recorded
+
+	static bool IsBlank(const char c)
+	{
+		return c == ' ' || c == '\t';
+	}
+	static bool IsLineEnd(const char c)
+	{
+		return c == '\r' || c == '\n';
+	}
+	void AddField(std::vector<CSVField>& fields, const size_t begin, size_t end, const bool hasEscapes, const bool quoted)
+	{
+		if (fields.size() >= fieldLimit)
+		{
+			return;
+		}
+		if (!quoted)
+		{
+			// trailing whitespace on unquoted fields isn't significant, leading was already skipped
+			while (end > begin && IsBlank(data[end - 1]))
+			{
+				end--;
+			}
+		}
+		CSVField field;
+		field.raw = std::string_view(data + begin, end - begin);
+		field.hasEscapes = hasEscapes;
+		fields.push_back(field);
+	}
+
+public:
+	CSVTokenizer() {}
+	CSVTokenizer(const char* source, const size_t length) : data(source), size(length), scanner(source, length) {}
+	explicit CSVTokenizer(const std::string_view source) : CSVTokenizer(source.data(), source.size()) {}
+
+	void Reset(const char* source, const size_t length)
+	{
+		data = source;
+		size = length;
+		pos = 0;
+		scanner.Reset(source, length);
+	}
+	// offset just past the last complete row, i.e. where a subsequent read should resume
+	size_t GetPosition() const
+	{
+		return pos;
+	}
+	bool IsAtEnd() const
+	{
+		return pos >= size;
+	}
+
+	// tokenize the next row into fields (cleared first, capacity reused). Blank lines are skipped.
+	// returns false if there is no complete row left. A trailing row with no line terminator is
+	//  only returned if isFinal is set, otherwise it is left pending (position is not advanced past it)
+	// only the first maxFields fields are recorded, the rest of the row just goes through the delimiter scan
+	bool NextRow(std::vector<CSVField>& fields, const bool isFinal = false, const size_t maxFields = SIZE_MAX)
+	{
+		enum class State { FieldStart, Unquoted, Quoted, AfterQuoted };
+
+		fields.clear();
+		fieldLimit = maxFields;
+		State state = State::FieldStart;
+		size_t i = pos;
+		size_t fieldBegin = i;
+		size_t fieldEnd = i;
+		bool hasEscapes = false;
+		bool rowHasContent = false;
+
+		while (i < size)
+		{
+			const char c = data[i];
+			if ((state == State::Unquoted || state == State::Quoted)
+				&& !CSVScanner::IsStructural(c))
+			{
+				// nothing in the rest of this run can change state
+				i = scanner.Next(i);
+				continue;
+			}
+			switch (state)
+			{
+			case State::FieldStart:
+				if (IsBlank(c))
+				{
+					i++;
+				}
+				else if (IsLineEnd(c))
+				{
+					if (rowHasContent)
+					{
+						// row ended right after a delimiter, so there is one more (empty) field
+						AddField(fields, i, i, false, false);
+						pos = (c == '\r' && i + 1 < size && data[i + 1] == '\n') ? i + 2 : i + 1;
+						return true;
+					}
+					// blank line
+					i++;
+					pos = i;
+				}
+				else if (c == '"')
+				{
+					rowHasContent = true;
+					state = State::Quoted;
+					hasEscapes = false;
+					fieldBegin = ++i;
+				}
+				else
+				{
+					rowHasContent = true;
+					state = State::Unquoted;
+					hasEscapes = false;
+					fieldBegin = i;
+				}
+				break;
+			case State::Unquoted:
+				if (c == ',')
+				{
+					AddField(fields, fieldBegin, i, hasEscapes, false);
+					state = State::FieldStart;
+					i++;
+				}
+				else if (IsLineEnd(c))
+				{
+					AddField(fields, fieldBegin, i, hasEscapes, false);
+					pos = (c == '\r' && i + 1 < size && data[i + 1] == '\n') ? i + 2 : i + 1;
+					return true;
+				}
+				else if (c == '\\' && i + 1 < size && data[i + 1] == ',')
+				{
+					// escaped comma is part of the field
+					hasEscapes = true;
+					i += 2;
+				}
+				else
+				{
+					if (c == '"' || c == '\'')
+					{
+						hasEscapes = true;
+					}
+					i++;
+				}
+				break;
+			case State::Quoted:
+				if (c == '"')
+				{
+					if (i + 1 < size && data[i + 1] == '"')
+					{
+						hasEscapes = true;
+						i += 2;
+					}
+					else if (i + 1 >= size && !isFinal)
+					{
+						// can't yet tell if this is a doubled quote or the closing one
+						return false;
+					}
+					else
+					{
+						fieldEnd = i;
+						state = State::AfterQuoted;
+						i++;
+					}
+				}
+				else
+				{
+					// embedded delimiters and line breaks are literal here
+					if (c == '\\' || c == '\'')
+					{
+						hasEscapes = true;
+					}
+					i++;
+				}
+				break;
+			case State::AfterQuoted:
+				if (c == ',')
+				{
+					AddField(fields, fieldBegin, fieldEnd, hasEscapes, true);
+					state = State::FieldStart;
+				}
+				else if (IsLineEnd(c))
+				{
+					AddField(fields, fieldBegin, fieldEnd, hasEscapes, true);
+					pos = (c == '\r' && i + 1 < size && data[i + 1] == '\n') ? i + 2 : i + 1;
+					return true;
+				}
+				// anything else between the closing quote and the delimiter is malformed, ignore it
+				i++;
+				break;
+			}
+		}
+
+		// out of data without a row terminator
+		if (!isFinal || !rowHasContent)
+		{
+			if (!rowHasContent)
+			{
+				pos = i;
+			}
+			return false;
+		}
+		switch (state)
+		{
+		case State::FieldStart:
+			AddField(fields, i, i, false, false);
+			break;
+		case State::Unquoted:
+			AddField(fields, fieldBegin, i, hasEscapes, false);
+			break;
+		case State::Quoted:
+			// unterminated quote, take what is there
+			AddField(fields, fieldBegin, i, hasEscapes, true);
+			break;
+		case State::AfterQuoted:
+			AddField(fields, fieldBegin, fieldEnd, hasEscapes, true);
+			break;
+		}
+		pos = i;
+		return true;
+	}
+
+	// escaping done by CSVUtil::EscapeField (quotes doubled, optionally commas backslash escaped), appended to out
+	static void AppendEscaped(std::string& out, const std::string_view value, const bool escapeCommas = false)
+	{
+		size_t runStart = 0;
+		for (size_t i = 0; i < value.size(); i++)
+		{
+			const char c = value[i];
+			if (c == '\'' || c == '"' || (c == ',' && escapeCommas))
+			{
+				out.append(value.data() + runStart, i - runStart);
+				out += (c == ',') ? '\\' : c;
+				runStart = i;	// the character itself goes out with the next run
+			}
+		}
+		out.append(value.data() + runStart, value.size() - runStart);
+	}
+	// reverse the escaping done by CSVUtil::EscapeField, and RFC 4180 quote doubling
+	static void Unescape(const std::string_view raw, std::string& out)
+	{
+		out.clear();
+		for (size_t i = 0; i < raw.size(); i++)
+		{
+			const char c = raw[i];
+			if (i + 1 < raw.size())
+			{
+				const char next = raw[i + 1];
+				if ((c == '\\' && next == ',')
+					|| (c == '"' && next == '"')
+					|| (c == '\'' && next == '\''))
+				{
+					out += next;
+					i++;
+					continue;
+				}
+			}
+			out += c;
+		}
+	}
+};
+
+inline std::string_view CSVField::Value(std::string& scratch) const
+{
+	if (!hasEscapes)
+	{
+		return raw;
+	}
+	CSVTokenizer::Unescape(raw, scratch);
+	return scratch;
+}
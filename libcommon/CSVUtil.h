@@ -1,59 +1,52 @@
 #pragma once
 #include <string>
-#include <locale>
-#include <codecvt>
+#include <string_view>
 #include <vector>
+#include "CSVTokenizer.h"
+#include "UTFConvert.h"
 #include "DebugOutToggles.h"
 
 class CSVUtil
 {
 public:
 	std::wstring ConvertUTF8ToWSTR(const std::string& source)
-	{		                
-        int size = MultiByteToWideChar(CP_UTF8, 0, source.c_str(),
-            static_cast<int>(source.length()), nullptr, 0);
-        std::wstring utf16_str(size, '\0');
-        MultiByteToWideChar(CP_UTF8, 0, source.c_str(),
-			static_cast<int>(source.length()), &utf16_str[0], size);
-        return utf16_str;
-        /*		
-		try {
-        std::u16string u16_conv = std::wstring_convert<
-            std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(source);
-        std::wstring retStr(u16_conv.begin(), u16_conv.end());        
-		}
-		catch (const std::range_error&) {
-			LIBCOMMON_DEBUG_PRINT(L"utf range error");
-		}
-		return strRet;*/
+	{
+		return ConvertUTF8ToWSTR(source.c_str(), source.length());
+	}
+	std::wstring ConvertUTF8ToWSTR(const char* source, const size_t length)
+	{
+		return UTFConvert::ToWide(std::string_view(source, length));
 	}
 	std::string ConvertUTF16ToUTF8(const std::wstring& source)
+	{
+		return ConvertUTF16ToUTF8(source.c_str(), source.length());
+	}
+	std::string ConvertUTF16ToUTF8(const ATL::CString& source)
+	{
+		return ConvertUTF16ToUTF8(source.GetString(), static_cast<size_t>(source.GetLength()));
+	}
+	std::string ConvertUTF16ToUTF8(const wchar_t* source, const size_t length)
 	{
 		std::string strRet;
-		try	{
-			std::u16string u16str(source.begin(), source.end());
-			std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> convert;
-			strRet=convert.to_bytes(u16str);
-		}
-		catch (const std::range_error&) {
-			LIBCOMMON_DEBUG_PRINT(L"ERROR: utf range error");
-		}
+		AppendUTF16AsUTF8(strRet, source, length);
 		return strRet;
-	}	
-    std::string ConvertUTF16ToUTF8(const ATL::CString& source)
-    {
-		std::string strRet;
-		try {
-			std::wstring wsource(source);
-			std::u16string u16str(wsource.begin(), wsource.end());
-			std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> convert;
-			strRet=convert.to_bytes(u16str);
-		}
-		catch (const std::range_error&) {
+	}
+	// append UTF-16 text to a UTF-8 string, reusing its capacity
+	// returns false if it wasn't valid UTF-16 (unpaired surrogates are written as U+FFFD)
+	bool AppendUTF16AsUTF8(std::string& dest, const wchar_t* source, const size_t length)
+	{
+		if (!UTFConvert::AppendUTF16ToUTF8(dest, source, length))
+		{
 			LIBCOMMON_DEBUG_PRINT(L"ERROR: utf range error");
+			return false;
 		}
-		return strRet;
-    }
+		return true;
+	}
+	// UTF-8 counterpart of EscapeField, appending the escaped field to dest
+	void AppendEscapedField(std::string& dest, const std::string_view original, bool bEscapeCommas = false)
+	{
+		CSVTokenizer::AppendEscaped(dest, original, bEscapeCommas);
+	}
 	ATL::CString EscapeField(const WCHAR* pwszOriginal, bool bEscapeCommas = false)
 	{
 		CString csRet = pwszOriginal;
@@ -67,6 +60,11 @@ public:
 		}
 		return csRet;
 	}
+	// UTF-8 counterpart of UnescapeField, into dest
+	void UnescapeField(const std::string_view original, std::string& dest)
+	{
+		CSVTokenizer::Unescape(original, dest);
+	}
 	ATL::CString UnescapeField(const WCHAR* pwszOriginal)
 	{
 		CString csRet = pwszOriginal;
@@ -75,33 +73,32 @@ public:
 		csRet.Replace(L"''", L"'");		
 		return csRet;
 	}
-    size_t ParseCSVRow(_In_ const std::wstring& row, _Out_ std::vector<std::wstring>& fields) 
-    {
-		const wchar_t *SpecialCharForEmbeddedCommas = L"\xffff";
-		ATL::CString rowCopy(row.c_str());
-        rowCopy.Replace(L"\\,", SpecialCharForEmbeddedCommas);
-		rowCopy.Replace(L"\r", L"");
-		rowCopy.Replace(L"\n", L"");
-        int pos = 0;
-        ATL::CString token = rowCopy.Tokenize(L",", pos);
-        while (!token.IsEmpty())
-        {
-            token.Replace(SpecialCharForEmbeddedCommas, L",");
-			token.TrimRight();
-			token.TrimLeft();
-			UnescapeField(token);
-			// strip leading and trailing quotes, if both present
-			int len = token.GetLength();
-			if (token[0] == '"' && token[len - 1] == '"')
+	// unescaped UTF-8 fields of a single row (see CSVTokenizer, which CSVReader uses directly on file bytes)
+	size_t ParseCSVRow(_In_ const std::string_view row, _Out_ std::vector<std::string>& fields)
+	{
+		CSVTokenizer tokenizer(row);
+		std::vector<CSVField> fieldViews;
+		std::string scratch;
+		if (tokenizer.NextRow(fieldViews, true))
+		{
+			for (auto& i : fieldViews)
 			{
-				token.Truncate(len - 1);
-				token.Delete(0, 1);
+				fields.emplace_back(i.Value(scratch));
 			}
-            fields.push_back(std::wstring(token));
-            token = rowCopy.Tokenize(L",", pos);			
-        }        
-        return fields.size();
-    }
+		}
+		return fields.size();
+	}
+	// legacy wide string row parser, an adapter over the UTF-8 one
+	size_t ParseCSVRow(_In_ const std::wstring& row, _Out_ std::vector<std::wstring>& fields)
+	{
+		std::vector<std::string> utf8Fields;
+		ParseCSVRow(ConvertUTF16ToUTF8(row), utf8Fields);
+		for (auto& i : utf8Fields)
+		{
+			fields.push_back(UTFConvert::ToWide(i));
+		}
+		return fields.size();
+	}
 
 
 };
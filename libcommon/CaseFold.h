@@ -0,0 +1,144 @@
+#pragma once
+// CaseFold
+//  simple (one unit to one unit) case folding of UTF-16 code units through a table built once
+//  the table maps every BMP unit to its lowercase form as the OS does for file names (CharLowerBuff on
+//  Windows, towlower elsewhere), so folding a character is one load instead of a locale aware call.
+//  Surrogates and units beyond the BMP (UTF-32 wchar_t) fold to themselves.
+//
+//  Win32 backend uses CharLowerBuff, other platforms towlower
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cwctype>
+#endif
+
+class CaseFold
+{
+	static const size_t TABLE_SIZE = 0x10000;
+
+	static const uint16_t* BuildTable()
+	{
+		static uint16_t table[TABLE_SIZE];
+		for (size_t i = 0; i < TABLE_SIZE; i++)
+		{
+			table[i] = static_cast<uint16_t>(i);
+		}
+#ifdef _WIN32
+		// surrogate halves aren't characters, leave them out of the conversion
+		std::wstring units(TABLE_SIZE, L' ');
+		for (size_t i = 0; i < TABLE_SIZE; i++)
+		{
+			units[i] = (i >= 0xD800 && i <= 0xDFFF) ? L' ' : static_cast<WCHAR>(i);
+		}
+		CharLowerBuffW(&units[0], static_cast<DWORD>(TABLE_SIZE));
+		for (size_t i = 0; i < TABLE_SIZE; i++)
+		{
+			if (i < 0xD800 || i > 0xDFFF)
+			{
+				table[i] = static_cast<uint16_t>(units[i]);
+			}
+		}
+#else
+		for (size_t i = 0; i < TABLE_SIZE; i++)
+		{
+			if (i < 0xD800 || i > 0xDFFF)
+			{
+				const wint_t lower = towlower(static_cast<wint_t>(i));
+				if (lower < TABLE_SIZE)
+				{
+					table[i] = static_cast<uint16_t>(lower);
+				}
+			}
+		}
+#endif
+		return table;
+	}
+	// (folded, unit) for every unit that doesn't fold to itself, sorted
+	static const std::vector<std::pair<uint16_t, uint16_t>>& BuildReverse()
+	{
+		static std::vector<std::pair<uint16_t, uint16_t>> reverse;
+		const uint16_t* table = GetTable();
+		for (size_t i = 0; i < TABLE_SIZE; i++)
+		{
+			if (table[i] != i)
+			{
+				reverse.emplace_back(table[i], static_cast<uint16_t>(i));
+			}
+		}
+		std::sort(reverse.begin(), reverse.end());
+		return reverse;
+	}
+
+public:
+	// the folding table, built on first use (thread safe)
+	static const uint16_t* GetTable()
+	{
+		static const uint16_t* pTable = BuildTable();
+		return pTable;
+	}
+
+	static wchar_t Fold(const wchar_t c)
+	{
+		return static_cast<size_t>(c) < TABLE_SIZE ? static_cast<wchar_t>(GetTable()[static_cast<size_t>(c)]) : c;
+	}
+	// every unit that folds to c (c itself first, when it folds to itself)
+	static void GetUnfolded(const wchar_t c, std::vector<wchar_t>& units)
+	{
+		units.clear();
+		if (Fold(c) == c)
+		{
+			units.push_back(c);
+		}
+		if (static_cast<size_t>(c) >= TABLE_SIZE)
+		{
+			return;
+		}
+		static const std::vector<std::pair<uint16_t, uint16_t>>& reverse = BuildReverse();
+		auto i = std::lower_bound(reverse.begin(), reverse.end(), std::make_pair(static_cast<uint16_t>(c), static_cast<uint16_t>(0)));
+		for (; i != reverse.end() && i->first == static_cast<uint16_t>(c); ++i)
+		{
+			units.push_back(static_cast<wchar_t>(i->second));
+		}
+	}
+	static void FoldInPlace(std::wstring& text)
+	{
+		const uint16_t* table = GetTable();
+		for (auto& c : text)
+		{
+			if (static_cast<size_t>(c) < TABLE_SIZE)
+			{
+				c = static_cast<wchar_t>(table[static_cast<size_t>(c)]);
+			}
+		}
+	}
+	static std::wstring Folded(const std::wstring_view text)
+	{
+		std::wstring folded(text);
+		FoldInPlace(folded);
+		return folded;
+	}
+	static bool Equals(const std::wstring_view a, const std::wstring_view b)
+	{
+		if (a.size() != b.size())
+		{
+			return false;
+		}
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			if (a[i] != b[i] && Fold(a[i]) != Fold(b[i]))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+};
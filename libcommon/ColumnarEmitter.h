@@ -0,0 +1,489 @@
+#pragma once
+// ColumnarEmitter
+//  sampling emitter with the field definition API of CSVEmitter that writes the compact columnar
+//  binary format in ColumnarFormat.h instead of CSV text. Rows are collected into blocks; each block
+//  stores integer columns as zigzag varint deltas and text columns as a dictionary plus indexes, so
+//  repeated values (process names, paths) are stored once per block.
+//  a block is written when it reaches the row limit, when the block interval has passed (from a timer
+//  thread, so rows aren't held back when sampling stops), or on Flush.
+//  ColumnarReader reads the files back, and ColumnarReader::ConvertToCSV converts them for Excel.
+
+#include <atlstr.h>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <string>
+#include <charconv>
+#include <chrono>
+#include "CSVUtil.h"
+#include "BufferedFileWriter.h"
+#include "ColumnarFormat.h"
+#include "ColumnarReader.h"
+#include "DebugOutToggles.h"
+
+using namespace std;
+
+#define SAMPLING_DEBUG_PRINT LIBCOMMON_DEBUG_PRINT
+
+class ColumnarEmitter
+{
+public:
+	static constexpr size_t DEFAULT_BLOCK_ROWS = 4096;
+	static constexpr unsigned int DEFAULT_BLOCK_INTERVAL_MS = 60 * 1000;
+
+private:
+	enum CellKind : uint8_t
+	{
+		CELL_MISSING,
+		CELL_INT,
+		CELL_STRING
+	};
+	struct Cell
+	{
+		CellKind kind = CELL_MISSING;
+		int64_t intValue = 0;
+		uint32_t stringIndex = 0;	// dictionary entry for CELL_STRING
+	};
+	struct Column
+	{
+		Cell current;						// value for the line being built
+		vector<Cell> cells;					// rows of the current block
+		unordered_map<string, uint32_t> dictionaryIndexes;
+		vector<const string*> dictionary;	// entries in index order (keys of dictionaryIndexes)
+	};
+
+	ATL::CString outFilepath;
+	mutex mutexFields;
+	vector<ATL::CString> vectorOrderedFields;	// ordered field list so we know field column positions
+	map<ATL::CString, size_t> mapFieldIndexes;	// fieldname -> column, for the name based AddValue
+	vector<Column> columns;
+	CSVUtil csvUtil;
+	BufferedFileWriter writer;
+
+	size_t blockRowCount = 0;
+	size_t maxBlockRows = DEFAULT_BLOCK_ROWS;
+	chrono::milliseconds blockInterval{ DEFAULT_BLOCK_INTERVAL_MS };
+	chrono::steady_clock::time_point timeBlockStarted = chrono::steady_clock::now();
+
+	// rows collected for a block are written by a timer thread once the block interval has passed, so they
+	// reach the file even if sampling stops (as CSVEmitter's flush timer does for buffered rows)
+	thread blockTimerThread;
+	mutex mutexBlockTimer;
+	condition_variable blockTimerWake;
+	bool isBlockTimerStopping = false;
+
+	void BlockTimerLoop()
+	{
+		unique_lock<mutex> timerLock(mutexBlockTimer);
+		while (!isBlockTimerStopping)
+		{
+			chrono::steady_clock::duration wait;
+			timerLock.unlock();
+			{
+				lock_guard<mutex> lock(mutexFields);
+				if (blockRowCount && writer.IsAttached() && chrono::steady_clock::now() - timeBlockStarted >= blockInterval)
+				{
+					WriteBlock();
+				}
+				wait = timeBlockStarted + blockInterval - chrono::steady_clock::now();
+			}
+			timerLock.lock();
+			if (!isBlockTimerStopping)
+			{
+				blockTimerWake.wait_for(timerLock, wait > chrono::milliseconds(1) ? wait : chrono::milliseconds(1));
+			}
+		}
+	}
+	// called with mutexFields held
+	void StartBlockTimer()
+	{
+		if (!blockTimerThread.joinable())
+		{
+			isBlockTimerStopping = false;
+			blockTimerThread = thread(&ColumnarEmitter::BlockTimerLoop, this);
+		}
+	}
+	void StopBlockTimer()
+	{
+		{
+			lock_guard<mutex> timerLock(mutexBlockTimer);
+			isBlockTimerStopping = true;
+		}
+		blockTimerWake.notify_one();
+		if (blockTimerThread.joinable())
+		{
+			blockTimerThread.join();
+		}
+	}
+
+	// reused between values and blocks
+	string scratchKey;
+	string scratchValue;
+	string blockBuffer;
+	string payloadBuffer;
+
+	uint32_t Intern(Column& column, const string_view value)
+	{
+		scratchKey.assign(value.data(), value.size());
+		auto i = column.dictionaryIndexes.find(scratchKey);
+		if (i != column.dictionaryIndexes.end())
+		{
+			return i->second;
+		}
+		const uint32_t index = static_cast<uint32_t>(column.dictionary.size());
+		auto inserted = column.dictionaryIndexes.emplace(scratchKey, index);
+		column.dictionary.push_back(&inserted.first->first);
+		return index;
+	}
+	void SetString(const size_t field, const string_view value)
+	{
+		_ASSERT(field < columns.size());
+		Column& column = columns[field];
+		column.current.kind = CELL_STRING;
+		column.current.stringIndex = Intern(column, value);
+	}
+	void SetInt(const size_t field, const int64_t value)
+	{
+		_ASSERT(field < columns.size());
+		columns[field].current.kind = CELL_INT;
+		columns[field].current.intValue = value;
+	}
+
+	void EncodeColumn(Column& column, string& out)
+	{
+		bool hasInt = false, hasString = false, hasMissing = false;
+		for (auto& i : column.cells)
+		{
+			hasInt |= i.kind == CELL_INT;
+			hasString |= i.kind == CELL_STRING;
+			hasMissing |= i.kind == CELL_MISSING;
+		}
+		if (!hasInt && !hasString)
+		{
+			out += static_cast<char>(ColumnarFormat::ENCODING_EMPTY);
+		}
+		else if (!hasString)
+		{
+			if (hasMissing)
+			{
+				out += static_cast<char>(ColumnarFormat::ENCODING_INT_DELTA_SPARSE);
+				const size_t bitmapStart = out.size();
+				out.append((column.cells.size() + 7) / 8, '\0');
+				for (size_t row = 0; row < column.cells.size(); row++)
+				{
+					if (column.cells[row].kind == CELL_INT)
+					{
+						out[bitmapStart + row / 8] |= static_cast<char>(1 << (row % 8));
+					}
+				}
+			}
+			else
+			{
+				out += static_cast<char>(ColumnarFormat::ENCODING_INT_DELTA);
+			}
+			int64_t previous = 0;
+			for (auto& i : column.cells)
+			{
+				if (i.kind == CELL_INT)
+				{
+					ColumnarFormat::AppendVarint(out, ColumnarFormat::ZigZagEncode(static_cast<int64_t>(static_cast<uint64_t>(i.intValue) - static_cast<uint64_t>(previous))));
+					previous = i.intValue;
+				}
+			}
+		}
+		else
+		{
+			// mixed or text, integers and missing values go in the dictionary as text
+			for (auto& i : column.cells)
+			{
+				if (i.kind == CELL_INT)
+				{
+					char buffer[24];
+					auto result = to_chars(buffer, buffer + sizeof(buffer), i.intValue);
+					i.stringIndex = Intern(column, string_view(buffer, result.ptr - buffer));
+				}
+				else if (i.kind == CELL_MISSING)
+				{
+					i.stringIndex = Intern(column, string_view());
+				}
+			}
+			out += static_cast<char>(ColumnarFormat::ENCODING_DICTIONARY);
+			ColumnarFormat::AppendVarint(out, column.dictionary.size());
+			for (auto& i : column.dictionary)
+			{
+				ColumnarFormat::AppendString(out, *i);
+			}
+			for (auto& i : column.cells)
+			{
+				ColumnarFormat::AppendVarint(out, i.stringIndex);
+			}
+		}
+	}
+	// encode and write the rows collected so far as one block
+	bool WriteBlock()
+	{
+		timeBlockStarted = chrono::steady_clock::now();
+		if (!blockRowCount)
+		{
+			return true;
+		}
+		payloadBuffer.clear();
+		for (auto& column : columns)
+		{
+			EncodeColumn(column, payloadBuffer);
+			// a line being built may refer to a dictionary entry of the finished block, carry it over
+			if (column.current.kind == CELL_STRING)
+			{
+				scratchValue = *column.dictionary[column.current.stringIndex];
+			}
+			column.cells.clear();
+			column.dictionaryIndexes.clear();
+			column.dictionary.clear();
+			if (column.current.kind == CELL_STRING)
+			{
+				column.current.stringIndex = Intern(column, scratchValue);
+			}
+		}
+		blockBuffer.clear();
+		blockBuffer += static_cast<char>(ColumnarFormat::BLOCK_MARKER);
+		ColumnarFormat::AppendVarint(blockBuffer, blockRowCount);
+		ColumnarFormat::AppendVarint(blockBuffer, payloadBuffer.size());
+		blockBuffer += payloadBuffer;
+		blockRowCount = 0;
+		// a block goes out whole, readers ignore a trailing partial one
+		if (!writer.Append(blockBuffer) || !writer.Flush())
+		{
+			SAMPLING_DEBUG_PRINT(L"ERROR: Sampling can't write to %s", outFilepath);
+			return false;
+		}
+		return true;
+	}
+	string BuildHeader()
+	{
+		string header(ColumnarFormat::MAGIC, ColumnarFormat::MAGIC_SIZE);
+		ColumnarFormat::AppendVarint(header, vectorOrderedFields.size());
+		for (auto& i : vectorOrderedFields)
+		{
+			ColumnarFormat::AppendString(header, csvUtil.ConvertUTF16ToUTF8(i));
+		}
+		return header;
+	}
+	// check to see if the schema of an existing file matches ours (same fields in the same order)
+	bool CompareSchema(const vector<string>& existingNames)
+	{
+		if (existingNames.size() != vectorOrderedFields.size())
+		{
+			return false;
+		}
+		for (size_t i = 0; i < existingNames.size(); i++)
+		{
+			string name = csvUtil.ConvertUTF16ToUTF8(vectorOrderedFields[i]);
+			if (name.size() != existingNames[i].size()
+				|| !std::equal(name.begin(), name.end(), existingNames[i].begin(),
+					[](char a, char b) {
+						return tolower(a) == tolower(b);
+					}))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	bool OpenOutputFileInternal(const bool bEmptyFile)
+	{
+		_ASSERT(vectorOrderedFields.size());
+		if (!bEmptyFile)
+		{
+			ColumnarReader reader;
+			if (reader.Open(outFilepath.GetString()) && CompareSchema(reader.GetFieldNames()))
+			{
+				const uint64_t validLength = reader.GetValidLength();
+				reader.Close();
+				if (writer.Open(outFilepath.GetString()))
+				{
+					// cut off a block that was being written when the last writer stopped
+					writer.Truncate(validLength);
+					SAMPLING_DEBUG_PRINT(L"Sampling columnar out file schema matches, appending");
+					return true;
+				}
+				SAMPLING_DEBUG_PRINT(L"ERROR: Sampling can't open %s", outFilepath);
+				return false;
+			}
+		}
+		SAMPLING_DEBUG_PRINT(L"WARNING: Sampling output file schema didn't match or empty requested, starting fresh");
+		if (!writer.Open(outFilepath.GetString(), true))
+		{
+			SAMPLING_DEBUG_PRINT(L"ERROR: Sampling can't open %s", outFilepath);
+			return false;
+		}
+		return writer.Append(BuildHeader()) && writer.Flush();
+	}
+
+public:
+	ColumnarEmitter(const WCHAR* outFilepath, const vector<ATL::CString>& fields) : outFilepath(outFilepath)
+	{
+		AddFields(fields);
+	}
+	~ColumnarEmitter()
+	{
+		StopBlockTimer();
+		CloseOutputFile();
+	}
+	// rows per block, and max time rows are held before their block is written (by a timer, whether or not
+	// more rows are written)
+	void SetBlockLimits(const size_t maxRows, const unsigned int intervalMs = DEFAULT_BLOCK_INTERVAL_MS)
+	{
+		{
+			lock_guard<mutex> lock(mutexFields);
+			maxBlockRows = maxRows ? (maxRows < ColumnarFormat::MAX_BLOCK_ROWS ? maxRows : ColumnarFormat::MAX_BLOCK_ROWS) : 1;
+			blockInterval = chrono::milliseconds(intervalMs);
+		}
+		// a shorter interval applies to the rows already waiting
+		blockTimerWake.notify_one();
+	}
+	// add a field, orders as received - only needs to be done once
+	void AddFields(const vector<ATL::CString>& fields)
+	{
+		lock_guard<mutex> lock(mutexFields);
+		for (auto& i : fields)
+		{
+			AddField(i);
+		}
+	}
+	void ClearFields()
+	{
+		vectorOrderedFields.clear();
+		mapFieldIndexes.clear();
+		columns.clear();
+		blockRowCount = 0;
+	}
+	// returns the column handle to pass to AddValue, stable until ClearFields
+	size_t AddField(const WCHAR* fieldname)
+	{
+		_ASSERT(!blockRowCount);
+		vectorOrderedFields.push_back(fieldname);
+		columns.emplace_back();
+		mapFieldIndexes[fieldname] = vectorOrderedFields.size() - 1;
+		return vectorOrderedFields.size() - 1;
+	}
+	// column handle of a field by name, SIZE_MAX if not defined
+	size_t FindField(const WCHAR* fieldname)
+	{
+		auto i = mapFieldIndexes.find(fieldname);
+		if (i == mapFieldIndexes.end())
+		{
+			_ASSERT(0);
+			SAMPLING_DEBUG_PRINT(L"WARNING: Sampling field %s not defined", fieldname);
+			return SIZE_MAX;
+		}
+		return i->second;
+	}
+	// add value to current line (add all values for each line, then output with WriteCurrentLine)
+	void AddValue(const size_t field, const WCHAR* value)
+	{
+		scratchValue.clear();
+		csvUtil.AppendUTF16AsUTF8(scratchValue, value, wcslen(value));
+		SetString(field, scratchValue);
+	}
+	// value already UTF-8
+	void AddValue(const size_t field, const std::string_view value)
+	{
+		SetString(field, value);
+	}
+	void AddValue(const size_t field, const DWORD value)
+	{
+		SetInt(field, value);
+	}
+	void AddValue(const size_t field, const unsigned long long value)
+	{
+		if (value > static_cast<unsigned long long>(INT64_MAX))
+		{
+			char buffer[24];
+			auto result = to_chars(buffer, buffer + sizeof(buffer), value);
+			SetString(field, string_view(buffer, result.ptr - buffer));
+			return;
+		}
+		SetInt(field, static_cast<int64_t>(value));
+	}
+	void AddValue(const size_t field, const long long value)
+	{
+		SetInt(field, value);
+	}
+	// by field name, adapters over the column handle overloads
+	void AddValue(const WCHAR* fieldname, const WCHAR* value)
+	{
+		size_t field = FindField(fieldname);
+		if (field != SIZE_MAX)
+		{
+			AddValue(field, value);
+		}
+	}
+	void AddValue(const WCHAR* fieldname, const DWORD value)
+	{
+		size_t field = FindField(fieldname);
+		if (field != SIZE_MAX)
+		{
+			AddValue(field, value);
+		}
+	}
+	void AddValue(const WCHAR* fieldname, const unsigned long long value)
+	{
+		size_t field = FindField(fieldname);
+		if (field != SIZE_MAX)
+		{
+			AddValue(field, value);
+		}
+	}
+	bool WriteCurrentLine()
+	{
+		lock_guard<mutex> lock(mutexFields);
+		if (!writer.IsAttached())
+		{
+			SAMPLING_DEBUG_PRINT(L"ERROR: Sampling can't write to %s (no handle)", outFilepath);
+			if (!OpenOutputFileInternal(false))
+			{
+				return false;
+			}
+		}
+		for (auto& column : columns)
+		{
+			column.cells.push_back(column.current);
+			column.current = Cell();
+		}
+		blockRowCount++;
+		if (blockRowCount >= maxBlockRows
+			|| chrono::steady_clock::now() - timeBlockStarted >= blockInterval)
+		{
+			return WriteBlock();
+		}
+		StartBlockTimer();
+		return true;
+	}
+	// write the rows collected so far as a block, e.g. before handing the file to a reader
+	bool Flush()
+	{
+		lock_guard<mutex> lock(mutexFields);
+		return WriteBlock();
+	}
+
+	// if the schema doesn't match, then wipe and start fresh
+	// if it does, then start appending
+	// should be called only *after* defining fields with AddField
+	bool OpenOutputFile(bool bEmptyFile = false)
+	{
+		lock_guard<mutex> lock(mutexFields);
+		return OpenOutputFileInternal(bEmptyFile);
+	}
+	void CloseOutputFile()
+	{
+		lock_guard<mutex> lock(mutexFields);
+		if (writer.IsAttached())
+		{
+			WriteBlock();
+			writer.Close();
+		}
+	}
+};
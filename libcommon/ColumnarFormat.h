@@ -0,0 +1,135 @@
+#pragma once
+// ColumnarFormat
+//  compact binary sampling file written by ColumnarEmitter and read by ColumnarReader
+//
+//  file:   MAGIC, varint field count, then each field name (varint length + UTF-8 bytes), then blocks
+//  block:  BLOCK_MARKER, varint row count, varint payload length, payload
+//  payload: for each column, an encoding byte followed by its data
+//    ENCODING_EMPTY          no values in the block (read back as empty strings)
+//    ENCODING_INT_DELTA      every row has an integer: zigzag varint deltas from the previous row (from 0)
+//    ENCODING_INT_DELTA_SPARSE  presence bitmap ((rows + 7) / 8 bytes, LSB first), then deltas of present rows
+//    ENCODING_DICTIONARY     varint entry count, entries (varint length + UTF-8 bytes), varint entry index per row
+//  blocks are self-contained (dictionaries and deltas restart), so a reader can stop at a partially written
+//  trailing block and a writer can cut it off before appending.
+//
+//  portable (no Windows dependencies)
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace ColumnarFormat
+{
+	static const char MAGIC[8] = { 'L','C','S','A','M','P','0','1' };
+	static const size_t MAGIC_SIZE = sizeof(MAGIC);
+	static const uint8_t BLOCK_MARKER = 0xB7;
+	static const size_t MAX_BLOCK_ROWS = 1024 * 1024;
+
+	enum Encoding : uint8_t
+	{
+		ENCODING_EMPTY = 0,
+		ENCODING_INT_DELTA = 1,
+		ENCODING_INT_DELTA_SPARSE = 2,
+		ENCODING_DICTIONARY = 3
+	};
+
+	inline void AppendVarint(std::string& out, uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			out += static_cast<char>((value & 0x7F) | 0x80);
+			value >>= 7;
+		}
+		out += static_cast<char>(value);
+	}
+	inline uint64_t ZigZagEncode(const int64_t value)
+	{
+		return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+	}
+	inline int64_t ZigZagDecode(const uint64_t value)
+	{
+		return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+	}
+	inline void AppendString(std::string& out, const std::string_view value)
+	{
+		AppendVarint(out, value.size());
+		out.append(value.data(), value.size());
+	}
+
+	// bounds checked cursor over encoded bytes. Reads fail (and keep failing) once past the end.
+	class Decoder
+	{
+		const uint8_t* p = nullptr;
+		const uint8_t* end = nullptr;
+		bool isValid = true;
+
+	public:
+		Decoder(const char* data, const size_t length)
+			: p(reinterpret_cast<const uint8_t*>(data)), end(reinterpret_cast<const uint8_t*>(data) + length) {}
+
+		bool IsValid() const
+		{
+			return isValid;
+		}
+		size_t GetRemaining() const
+		{
+			return static_cast<size_t>(end - p);
+		}
+		const char* GetPosition() const
+		{
+			return reinterpret_cast<const char*>(p);
+		}
+		bool ReadByte(uint8_t& value)
+		{
+			if (!isValid || p >= end)
+			{
+				isValid = false;
+				return false;
+			}
+			value = *p++;
+			return true;
+		}
+		bool ReadVarint(uint64_t& value)
+		{
+			value = 0;
+			for (int shift = 0; isValid && p < end && shift < 64; shift += 7)
+			{
+				const uint8_t b = *p++;
+				value |= static_cast<uint64_t>(b & 0x7F) << shift;
+				if (!(b & 0x80))
+				{
+					return true;
+				}
+			}
+			isValid = false;
+			return false;
+		}
+		bool ReadBytes(const size_t length, std::string_view& value)
+		{
+			if (!isValid || GetRemaining() < length)
+			{
+				isValid = false;
+				return false;
+			}
+			value = std::string_view(reinterpret_cast<const char*>(p), length);
+			p += length;
+			return true;
+		}
+		bool ReadString(std::string_view& value)
+		{
+			uint64_t length = 0;
+			if (!ReadVarint(length))
+			{
+				return false;
+			}
+			if (length > GetRemaining())
+			{
+				isValid = false;
+				return false;
+			}
+			return ReadBytes(static_cast<size_t>(length), value);
+		}
+	};
+}
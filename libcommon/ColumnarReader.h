@@ -0,0 +1,366 @@
+#pragma once
+// ColumnarReader
+//  reader for files written by ColumnarEmitter (see ColumnarFormat.h)
+//  blocks are decoded a whole column at a time into reused arrays: integer columns come back as int64
+//  arrays with no text parsing, and strings as views into the mapped file. ConvertToCSV writes the same
+//  CSV that CSVEmitter would have written, for Excel and other CSV tooling.
+//
+//  portable (MappedFile and BufferedFileWriter provide Win32 and POSIX backends)
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <charconv>
+#include "ColumnarFormat.h"
+#include "MappedFile.h"
+#include "BufferedFileWriter.h"
+#include "CSVTokenizer.h"
+
+class ColumnarReader
+{
+public:
+	// one decoded block. Views into it are valid until the next block is decoded.
+	class Block
+	{
+		friend class ColumnarReader;
+		struct Column
+		{
+			ColumnarFormat::Encoding encoding = ColumnarFormat::ENCODING_EMPTY;
+			std::vector<int64_t> ints;			// per row for integer encodings (0 where not present)
+			std::vector<uint8_t> present;		// per row for integer encodings
+			std::vector<std::string_view> dictionary;
+			std::vector<uint32_t> indexes;		// per row for dictionary encoding
+		};
+		std::vector<Column> columns;
+		size_t rowCount = 0;
+
+	public:
+		size_t GetRowCount() const
+		{
+			return rowCount;
+		}
+		size_t GetColumnCount() const
+		{
+			return columns.size();
+		}
+		bool IsIntColumn(const size_t column) const
+		{
+			return columns[column].encoding == ColumnarFormat::ENCODING_INT_DELTA
+				|| columns[column].encoding == ColumnarFormat::ENCODING_INT_DELTA_SPARSE;
+		}
+		// integer values of an integer column, one per row (check HasValue for sparse columns)
+		const std::vector<int64_t>& GetInt64Column(const size_t column) const
+		{
+			return columns[column].ints;
+		}
+		bool HasValue(const size_t column, const size_t row) const
+		{
+			const Column& c = columns[column];
+			switch (c.encoding)
+			{
+			case ColumnarFormat::ENCODING_INT_DELTA:
+			case ColumnarFormat::ENCODING_INT_DELTA_SPARSE:
+				return c.present[row] != 0;
+			case ColumnarFormat::ENCODING_DICTIONARY:
+				return !c.dictionary[c.indexes[row]].empty();
+			default:
+				return false;
+			}
+		}
+		// value as text. Integers are formatted into scratch.
+		std::string_view GetString(const size_t column, const size_t row, std::string& scratch) const
+		{
+			const Column& c = columns[column];
+			switch (c.encoding)
+			{
+			case ColumnarFormat::ENCODING_INT_DELTA:
+			case ColumnarFormat::ENCODING_INT_DELTA_SPARSE:
+			{
+				if (!c.present[row])
+				{
+					return std::string_view();
+				}
+				char buffer[24];
+				auto result = std::to_chars(buffer, buffer + sizeof(buffer), c.ints[row]);
+				scratch.assign(buffer, result.ptr - buffer);
+				return scratch;
+			}
+			case ColumnarFormat::ENCODING_DICTIONARY:
+				return c.dictionary[c.indexes[row]];
+			default:
+				return std::string_view();
+			}
+		}
+	};
+
+private:
+	MappedFile file;
+	std::vector<std::string> fieldNames;
+	uint64_t firstBlockOffset = 0;
+	Block block;	// reused between blocks
+
+	// blocks are mapped in windows of this size, larger only for a block that doesn't fit
+	static const size_t MAP_WINDOW_SIZE = 64 * 1024 * 1024;
+
+	// parse a block header at offset. false if there isn't a complete block there.
+	bool ReadBlockHeader(const uint64_t offset, const uint64_t fileSize, uint64_t& rowCount, uint64_t& headerSize, uint64_t& payloadSize)
+	{
+		const size_t maxHeaderSize = 1 + 10 + 10;
+		const size_t window = static_cast<size_t>(fileSize - offset < MAP_WINDOW_SIZE ? fileSize - offset : MAP_WINDOW_SIZE);
+		const size_t length = window < maxHeaderSize ? window : maxHeaderSize;
+		const char* pHeader = file.Map(offset, length, window);
+		if (!pHeader)
+		{
+			return false;
+		}
+		ColumnarFormat::Decoder decoder(pHeader, length);
+		uint8_t marker = 0;
+		if (!decoder.ReadByte(marker) || marker != ColumnarFormat::BLOCK_MARKER
+			|| !decoder.ReadVarint(rowCount) || !decoder.ReadVarint(payloadSize))
+		{
+			return false;
+		}
+		headerSize = static_cast<uint64_t>(decoder.GetPosition() - pHeader);
+		return payloadSize <= fileSize - offset - headerSize;
+	}
+	bool DecodeBlock(const char* payload, const size_t payloadSize, const size_t rowCount)
+	{
+		ColumnarFormat::Decoder decoder(payload, payloadSize);
+		block.rowCount = rowCount;
+		block.columns.resize(fieldNames.size());
+		for (auto& column : block.columns)
+		{
+			uint8_t encoding = 0;
+			if (!decoder.ReadByte(encoding))
+			{
+				return false;
+			}
+			column.encoding = static_cast<ColumnarFormat::Encoding>(encoding);
+			switch (column.encoding)
+			{
+			case ColumnarFormat::ENCODING_EMPTY:
+				break;
+			case ColumnarFormat::ENCODING_INT_DELTA:
+			case ColumnarFormat::ENCODING_INT_DELTA_SPARSE:
+			{
+				column.present.assign(rowCount, 1);
+				column.ints.assign(rowCount, 0);
+				if (column.encoding == ColumnarFormat::ENCODING_INT_DELTA_SPARSE)
+				{
+					std::string_view bitmap;
+					if (!decoder.ReadBytes((rowCount + 7) / 8, bitmap))
+					{
+						return false;
+					}
+					for (size_t row = 0; row < rowCount; row++)
+					{
+						column.present[row] = (static_cast<uint8_t>(bitmap[row / 8]) >> (row % 8)) & 1;
+					}
+				}
+				int64_t value = 0;
+				for (size_t row = 0; row < rowCount; row++)
+				{
+					if (column.present[row])
+					{
+						uint64_t delta = 0;
+						if (!decoder.ReadVarint(delta))
+						{
+							return false;
+						}
+						value += ColumnarFormat::ZigZagDecode(delta);
+						column.ints[row] = value;
+					}
+				}
+				break;
+			}
+			case ColumnarFormat::ENCODING_DICTIONARY:
+			{
+				uint64_t entryCount = 0;
+				if (!decoder.ReadVarint(entryCount) || entryCount > decoder.GetRemaining() || !entryCount)
+				{
+					return false;
+				}
+				column.dictionary.resize(static_cast<size_t>(entryCount));
+				for (auto& entry : column.dictionary)
+				{
+					if (!decoder.ReadString(entry))
+					{
+						return false;
+					}
+				}
+				column.indexes.resize(rowCount);
+				for (size_t row = 0; row < rowCount; row++)
+				{
+					uint64_t index = 0;
+					if (!decoder.ReadVarint(index) || index >= entryCount)
+					{
+						return false;
+					}
+					column.indexes[row] = static_cast<uint32_t>(index);
+				}
+				break;
+			}
+			default:
+				return false;
+			}
+		}
+		return true;
+	}
+
+public:
+	// open and read the schema. false if the file can't be opened or isn't a columnar sampling file.
+	bool Open(const MappedFile::PathChar* path)
+	{
+		fieldNames.clear();
+		firstBlockOffset = 0;
+		uint64_t size = 0;
+		if (!file.Open(path) || !file.GetSize(size) || size < ColumnarFormat::MAGIC_SIZE)
+		{
+			file.Close();
+			return false;
+		}
+		// the schema is small, map enough to cover it
+		const size_t length = static_cast<size_t>(size < MAP_WINDOW_SIZE ? size : MAP_WINDOW_SIZE);
+		const char* pData = file.Map(0, length);
+		if (!pData || memcmp(pData, ColumnarFormat::MAGIC, ColumnarFormat::MAGIC_SIZE) != 0)
+		{
+			file.Close();
+			return false;
+		}
+		ColumnarFormat::Decoder decoder(pData + ColumnarFormat::MAGIC_SIZE, length - ColumnarFormat::MAGIC_SIZE);
+		uint64_t fieldCount = 0;
+		if (!decoder.ReadVarint(fieldCount) || fieldCount > decoder.GetRemaining())
+		{
+			file.Close();
+			return false;
+		}
+		for (uint64_t i = 0; i < fieldCount; i++)
+		{
+			std::string_view name;
+			if (!decoder.ReadString(name))
+			{
+				fieldNames.clear();
+				file.Close();
+				return false;
+			}
+			fieldNames.push_back(std::string(name));
+		}
+		firstBlockOffset = static_cast<uint64_t>(decoder.GetPosition() - pData);
+		return true;
+	}
+	void Close()
+	{
+		file.Close();
+		fieldNames.clear();
+	}
+	const std::vector<std::string>& GetFieldNames() const
+	{
+		return fieldNames;
+	}
+
+	// length of the file up to the end of its last complete block (a trailing partial block is excluded)
+	uint64_t GetValidLength()
+	{
+		uint64_t size = 0;
+		if (!file.IsOpen() || !file.GetSize(size))
+		{
+			return 0;
+		}
+		uint64_t offset = firstBlockOffset;
+		uint64_t rowCount = 0, headerSize = 0, payloadSize = 0;
+		while (offset < size && ReadBlockHeader(offset, size, rowCount, headerSize, payloadSize))
+		{
+			offset += headerSize + payloadSize;
+		}
+		return offset;
+	}
+
+	// decode each complete block in order, calling visitor(const ColumnarReader::Block&)
+	// the visitor returns false to stop. Returns the number of rows visited, stopping at a malformed block.
+	template <typename BlockVisitor>
+	size_t VisitBlocks(BlockVisitor&& visitor)
+	{
+		uint64_t size = 0;
+		if (!file.IsOpen() || !file.GetSize(size))
+		{
+			return 0;
+		}
+		size_t totalRows = 0;
+		uint64_t offset = firstBlockOffset;
+		uint64_t rowCount = 0, headerSize = 0, payloadSize = 0;
+		while (offset < size && ReadBlockHeader(offset, size, rowCount, headerSize, payloadSize))
+		{
+			const uint64_t blockSize = headerSize + payloadSize;
+			if (rowCount > ColumnarFormat::MAX_BLOCK_ROWS || blockSize != static_cast<size_t>(blockSize))
+			{
+				break;
+			}
+			uint64_t windowSize = size - offset < MAP_WINDOW_SIZE ? size - offset : MAP_WINDOW_SIZE;
+			const char* pBlock = file.Map(offset, static_cast<size_t>(blockSize), static_cast<size_t>(windowSize));
+			if (!pBlock
+				|| !DecodeBlock(pBlock + headerSize, static_cast<size_t>(payloadSize), static_cast<size_t>(rowCount)))
+			{
+				break;
+			}
+			totalRows += static_cast<size_t>(rowCount);
+			offset += blockSize;
+			if (!visitor(static_cast<const Block&>(block)))
+			{
+				break;
+			}
+		}
+		return totalRows;
+	}
+
+	// write sourcePath out as CSV at csvPath, in the format CSVEmitter writes. Returns the row count, or -1 on failure.
+	static long long ConvertToCSV(const MappedFile::PathChar* sourcePath, const MappedFile::PathChar* csvPath)
+	{
+		ColumnarReader reader;
+		BufferedFileWriter writer;
+		if (!reader.Open(sourcePath) || !writer.Open(csvPath, true))
+		{
+			return -1;
+		}
+		static const char bom[3] = { '\xEF','\xBB','\xBF' };
+		std::string row(bom, sizeof(bom));
+		for (auto& i : reader.GetFieldNames())
+		{
+			if (row.size() > sizeof(bom))
+			{
+				row += ',';
+			}
+			row += '"';
+			row += i;
+			row += '"';
+		}
+		row += "\r\n";
+		bool isWritten = writer.Append(row);
+		std::string scratch;
+		const long long rowCount = static_cast<long long>(reader.VisitBlocks([&](const Block& block)
+			{
+				for (size_t r = 0; r < block.GetRowCount() && isWritten; r++)
+				{
+					row.clear();
+					for (size_t c = 0; c < block.GetColumnCount(); c++)
+					{
+						if (c)
+						{
+							row += ',';
+						}
+						row += '"';
+						CSVTokenizer::AppendEscaped(row, block.GetString(c, r, scratch), true);
+						row += '"';
+					}
+					row += "\r\n";
+					isWritten = writer.Append(row);
+				}
+				return isWritten;
+			}));
+		if (!writer.Flush() || !isWritten)
+		{
+			return -1;
+		}
+		return rowCount;
+	}
+};
@@ -0,0 +1,440 @@
+#pragma once
+// LZ4Frame
+//  self-contained LZ4 block compressor/decompressor and LZ4 frame format (v1.6.x frame spec) support,
+//  so compressed output can be read by the standard lz4 tools without bundling the library.
+//  the compressor is the plain greedy single-hash variant (fast, ratio a little under the reference lz4 -1).
+//  the decoder handles frames written by other encoders too (linked blocks, checksums, content size,
+//  skippable frames), though checksums are not verified.
+//
+//  writers emit one frame per flush, so a reader following the file can always resume at the end
+//  of the last complete frame.
+//
+//  portable (no Windows dependencies)
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+class LZ4Frame
+{
+public:
+	enum FrameStatus
+	{
+		FRAME_COMPLETE,
+		FRAME_INCOMPLETE,	// more data needed (e.g. still being written)
+		FRAME_INVALID
+	};
+	static const size_t BLOCK_SIZE = 64 * 1024;	// block size frames are written with
+
+private:
+	static const uint32_t FRAME_MAGIC = 0x184D2204;
+	static const uint32_t SKIPPABLE_MAGIC_MASK = 0xFFFFFFF0;
+	static const uint32_t SKIPPABLE_MAGIC = 0x184D2A50;
+	static const uint32_t UNCOMPRESSED_BLOCK_FLAG = 0x80000000;
+	static const size_t MIN_MATCH = 4;
+	static const size_t LAST_LITERALS = 5;		// the last bytes of a block are always literals
+	static const size_t MFLIMIT = 12;			// a match can't start within this many bytes of the end
+	static const size_t MAX_OFFSET = 65535;
+	static const int HASH_BITS = 12;
+
+	static uint32_t Read32(const void* p)
+	{
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+	static uint32_t ReadLE32(const char* p)
+	{
+		const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+		return static_cast<uint32_t>(b[0]) | (static_cast<uint32_t>(b[1]) << 8) | (static_cast<uint32_t>(b[2]) << 16) | (static_cast<uint32_t>(b[3]) << 24);
+	}
+	static void WriteLE32(char* p, const uint32_t value)
+	{
+		p[0] = static_cast<char>(value);
+		p[1] = static_cast<char>(value >> 8);
+		p[2] = static_cast<char>(value >> 16);
+		p[3] = static_cast<char>(value >> 24);
+	}
+	static uint32_t Hash(const uint32_t sequence)
+	{
+		return (sequence * 2654435761U) >> (32 - HASH_BITS);
+	}
+	static char* WriteLength(char* op, size_t length)
+	{
+		while (length >= 255)
+		{
+			*op++ = static_cast<char>(255);
+			length -= 255;
+		}
+		*op++ = static_cast<char>(length);
+		return op;
+	}
+	static uint32_t RotateLeft(const uint32_t value, const int bits)
+	{
+		return (value << bits) | (value >> (32 - bits));
+	}
+
+public:
+	// xxHash32, used by the frame header checksum
+	static uint32_t XXH32(const void* input, const size_t length, const uint32_t seed)
+	{
+		const uint32_t PRIME1 = 2654435761U, PRIME2 = 2246822519U, PRIME3 = 3266489917U, PRIME4 = 668265263U, PRIME5 = 374761393U;
+		const char* p = static_cast<const char*>(input);
+		const char* end = p + length;
+		uint32_t h;
+		if (length >= 16)
+		{
+			uint32_t v1 = seed + PRIME1 + PRIME2, v2 = seed + PRIME2, v3 = seed, v4 = seed - PRIME1;
+			for (; p + 16 <= end; p += 16)
+			{
+				v1 = RotateLeft(v1 + ReadLE32(p) * PRIME2, 13) * PRIME1;
+				v2 = RotateLeft(v2 + ReadLE32(p + 4) * PRIME2, 13) * PRIME1;
+				v3 = RotateLeft(v3 + ReadLE32(p + 8) * PRIME2, 13) * PRIME1;
+				v4 = RotateLeft(v4 + ReadLE32(p + 12) * PRIME2, 13) * PRIME1;
+			}
+			h = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+		}
+		else
+		{
+			h = seed + PRIME5;
+		}
+		h += static_cast<uint32_t>(length);
+		for (; p + 4 <= end; p += 4)
+		{
+			h = RotateLeft(h + ReadLE32(p) * PRIME3, 17) * PRIME4;
+		}
+		for (; p < end; p++)
+		{
+			h = RotateLeft(h + static_cast<unsigned char>(*p) * PRIME5, 11) * PRIME1;
+		}
+		h ^= h >> 15;
+		h *= PRIME2;
+		h ^= h >> 13;
+		h *= PRIME3;
+		h ^= h >> 16;
+		return h;
+	}
+
+	// largest compressed size of a block of the given size
+	static size_t CompressBound(const size_t length)
+	{
+		return length + length / 255 + 16;
+	}
+	// compress one block into dst, which must hold CompressBound(length) bytes. Returns the compressed size.
+	static size_t CompressBlock(const char* src, const size_t length, char* dst)
+	{
+		uint32_t table[1 << HASH_BITS] = {};
+		size_t ip = 0, anchor = 0;
+		char* op = dst;
+		if (length >= MFLIMIT + 1)
+		{
+			const size_t matchLimit = length - LAST_LITERALS;
+			while (ip + MFLIMIT <= length)
+			{
+				const uint32_t sequence = Read32(src + ip);
+				const uint32_t h = Hash(sequence);
+				const size_t ref = table[h];
+				table[h] = static_cast<uint32_t>(ip);
+				if (ref >= ip || ip - ref > MAX_OFFSET || Read32(src + ref) != sequence)
+				{
+					// skip faster through data that doesn't compress
+					ip += 1 + ((ip - anchor) >> 6);
+					continue;
+				}
+				size_t matchLength = MIN_MATCH;
+				while (ip + matchLength < matchLimit && src[ip + matchLength] == src[ref + matchLength])
+				{
+					matchLength++;
+				}
+
+				// sequence: token, literal length, literals, offset, match length
+				const size_t literalLength = ip - anchor;
+				char* token = op++;
+				*token = static_cast<char>((literalLength >= 15 ? 15 : literalLength) << 4);
+				if (literalLength >= 15)
+				{
+					op = WriteLength(op, literalLength - 15);
+				}
+				memcpy(op, src + anchor, literalLength);
+				op += literalLength;
+				const size_t offset = ip - ref;
+				*op++ = static_cast<char>(offset);
+				*op++ = static_cast<char>(offset >> 8);
+				const size_t extraMatch = matchLength - MIN_MATCH;
+				*token |= static_cast<char>(extraMatch >= 15 ? 15 : extraMatch);
+				if (extraMatch >= 15)
+				{
+					op = WriteLength(op, extraMatch - 15);
+				}
+				ip += matchLength;
+				anchor = ip;
+				if (ip + MFLIMIT <= length)
+				{
+					table[Hash(Read32(src + ip - 2))] = static_cast<uint32_t>(ip - 2);
+				}
+			}
+		}
+		// last literals
+		const size_t literalLength = length - anchor;
+		*op++ = static_cast<char>((literalLength >= 15 ? 15 : literalLength) << 4);
+		if (literalLength >= 15)
+		{
+			op = WriteLength(op, literalLength - 15);
+		}
+		memcpy(op, src + anchor, literalLength);
+		op += literalLength;
+		return static_cast<size_t>(op - dst);
+	}
+	// decompress one block to dst. Matches may reach back into the prefixSize bytes before dst
+	// (previous blocks of a linked-block frame). Returns false on malformed input or overflow.
+	static bool DecompressBlock(const char* src, const size_t length, char* dst, const size_t capacity, const size_t prefixSize, size_t& decompressedSize)
+	{
+		const unsigned char* ip = reinterpret_cast<const unsigned char*>(src);
+		const unsigned char* const ipEnd = ip + length;
+		char* op = dst;
+		char* const opEnd = dst + capacity;
+		while (ip < ipEnd)
+		{
+			const unsigned token = *ip++;
+			size_t literalLength = token >> 4;
+			if (literalLength == 15)
+			{
+				unsigned char b;
+				do
+				{
+					if (ip >= ipEnd)
+					{
+						return false;
+					}
+					b = *ip++;
+					literalLength += b;
+				} while (b == 255);
+			}
+			if (literalLength > static_cast<size_t>(ipEnd - ip) || literalLength > static_cast<size_t>(opEnd - op))
+			{
+				return false;
+			}
+			memcpy(op, ip, literalLength);
+			ip += literalLength;
+			op += literalLength;
+			if (ip == ipEnd)
+			{
+				// last sequence has no match
+				break;
+			}
+			if (ipEnd - ip < 2)
+			{
+				return false;
+			}
+			const size_t offset = static_cast<size_t>(ip[0]) | (static_cast<size_t>(ip[1]) << 8);
+			ip += 2;
+			if (!offset || offset > static_cast<size_t>(op - dst) + prefixSize)
+			{
+				return false;
+			}
+			size_t matchLength = token & 15;
+			if (matchLength == 15)
+			{
+				unsigned char b;
+				do
+				{
+					if (ip >= ipEnd)
+					{
+						return false;
+					}
+					b = *ip++;
+					matchLength += b;
+				} while (b == 255);
+			}
+			matchLength += MIN_MATCH;
+			if (matchLength > static_cast<size_t>(opEnd - op))
+			{
+				return false;
+			}
+			const char* match = op - offset;
+			if (offset >= matchLength)
+			{
+				memcpy(op, match, matchLength);
+				op += matchLength;
+			}
+			else
+			{
+				// overlapping copy repeats the pattern
+				for (size_t i = 0; i < matchLength; i++)
+				{
+					*op++ = *match++;
+				}
+			}
+		}
+		decompressedSize = static_cast<size_t>(op - dst);
+		return true;
+	}
+
+	// compress data as one complete frame (independent 64KB blocks, no checksums) appended to out
+	static void AppendFrame(std::string& out, const char* data, const size_t length)
+	{
+		const char flg = 0x60;	// version 01, independent blocks
+		const char bd = 0x40;	// 64KB max block size
+		const char descriptor[2] = { flg, bd };
+		char header[7];
+		WriteLE32(header, FRAME_MAGIC);
+		header[4] = flg;
+		header[5] = bd;
+		header[6] = static_cast<char>((XXH32(descriptor, sizeof(descriptor), 0) >> 8) & 0xFF);
+		out.append(header, sizeof(header));
+		for (size_t offset = 0; offset < length; offset += BLOCK_SIZE)
+		{
+			const size_t blockLength = length - offset < BLOCK_SIZE ? length - offset : BLOCK_SIZE;
+			const size_t sizePosition = out.size();
+			out.resize(sizePosition + 4 + CompressBound(blockLength));
+			size_t compressedLength = CompressBlock(data + offset, blockLength, &out[sizePosition + 4]);
+			uint32_t sizeField = static_cast<uint32_t>(compressedLength);
+			if (compressedLength >= blockLength)
+			{
+				// didn't compress, store as is
+				memcpy(&out[sizePosition + 4], data + offset, blockLength);
+				compressedLength = blockLength;
+				sizeField = static_cast<uint32_t>(blockLength) | UNCOMPRESSED_BLOCK_FLAG;
+			}
+			WriteLE32(&out[sizePosition], sizeField);
+			out.resize(sizePosition + 4 + compressedLength);
+		}
+		char endMark[4] = {};
+		out.append(endMark, sizeof(endMark));
+	}
+	static bool IsFrameStart(const char* data, const size_t length)
+	{
+		return length >= 4 && (ReadLE32(data) == FRAME_MAGIC || (ReadLE32(data) & SKIPPABLE_MAGIC_MASK) == SKIPPABLE_MAGIC);
+	}
+
+	// parse the frame at the start of data. On FRAME_COMPLETE, frameSize is its size and, if out isn't
+	// null, its content is appended to out. Nothing is appended unless the frame is complete and valid.
+	static FrameStatus ReadFrame(const char* data, const size_t length, size_t& frameSize, std::string* out)
+	{
+		if (length < 4)
+		{
+			return FRAME_INCOMPLETE;
+		}
+		const uint32_t magic = ReadLE32(data);
+		if ((magic & SKIPPABLE_MAGIC_MASK) == SKIPPABLE_MAGIC)
+		{
+			if (length < 8)
+			{
+				return FRAME_INCOMPLETE;
+			}
+			const uint64_t size = 8 + static_cast<uint64_t>(ReadLE32(data + 4));
+			if (size > length)
+			{
+				return FRAME_INCOMPLETE;
+			}
+			frameSize = static_cast<size_t>(size);
+			return FRAME_COMPLETE;
+		}
+		if (magic != FRAME_MAGIC)
+		{
+			return FRAME_INVALID;
+		}
+		if (length < 7)
+		{
+			return FRAME_INCOMPLETE;
+		}
+		const unsigned flg = static_cast<unsigned char>(data[4]);
+		const unsigned bd = static_cast<unsigned char>(data[5]);
+		if ((flg >> 6) != 1 || (flg & 0x02) || (bd & 0x8F))
+		{
+			return FRAME_INVALID;
+		}
+		const bool hasBlockChecksum = (flg & 0x10) != 0;
+		const bool hasContentSize = (flg & 0x08) != 0;
+		const bool hasContentChecksum = (flg & 0x04) != 0;
+		const bool hasDictionaryId = (flg & 0x01) != 0;
+		const unsigned blockSizeId = (bd >> 4) & 7;
+		if (blockSizeId < 4)
+		{
+			return FRAME_INVALID;
+		}
+		const size_t maxBlockSize = static_cast<size_t>(1) << (8 + 2 * blockSizeId);
+		const size_t descriptorSize = 2 + (hasContentSize ? 8 : 0) + (hasDictionaryId ? 4 : 0);
+		if (length < 4 + descriptorSize + 1)
+		{
+			return FRAME_INCOMPLETE;
+		}
+		if (static_cast<unsigned char>(data[4 + descriptorSize]) != ((XXH32(data + 4, descriptorSize, 0) >> 8) & 0xFF))
+		{
+			return FRAME_INVALID;
+		}
+
+		// walk the blocks first, so nothing is decoded from a frame that isn't complete yet
+		size_t position = 4 + descriptorSize + 1;
+		size_t contentUpperBound = 0;
+		for (;;)
+		{
+			if (length - position < 4)
+			{
+				return FRAME_INCOMPLETE;
+			}
+			const uint32_t sizeField = ReadLE32(data + position);
+			position += 4;
+			if (!sizeField)
+			{
+				break;
+			}
+			const size_t blockLength = sizeField & ~UNCOMPRESSED_BLOCK_FLAG;
+			if (blockLength > maxBlockSize)
+			{
+				return FRAME_INVALID;
+			}
+			const size_t blockTotal = blockLength + (hasBlockChecksum ? 4 : 0);
+			if (length - position < blockTotal)
+			{
+				return FRAME_INCOMPLETE;
+			}
+			position += blockTotal;
+			contentUpperBound += maxBlockSize;
+		}
+		if (hasContentChecksum)
+		{
+			if (length - position < 4)
+			{
+				return FRAME_INCOMPLETE;
+			}
+			position += 4;
+		}
+		frameSize = position;
+		if (!out)
+		{
+			return FRAME_COMPLETE;
+		}
+
+		// decode. Matches may refer back to earlier blocks of the frame (linked blocks)
+		const size_t outStart = out->size();
+		out->resize(outStart + contentUpperBound);
+		size_t outPosition = outStart;
+		position = 4 + descriptorSize + 1;
+		for (;;)
+		{
+			const uint32_t sizeField = ReadLE32(data + position);
+			position += 4;
+			if (!sizeField)
+			{
+				break;
+			}
+			const size_t blockLength = sizeField & ~UNCOMPRESSED_BLOCK_FLAG;
+			size_t decompressedSize = blockLength;
+			if (sizeField & UNCOMPRESSED_BLOCK_FLAG)
+			{
+				memcpy(&(*out)[outPosition], data + position, blockLength);
+			}
+			else if (!DecompressBlock(data + position, blockLength, &(*out)[outPosition], maxBlockSize, outPosition - outStart, decompressedSize))
+			{
+				out->resize(outStart);
+				return FRAME_INVALID;
+			}
+			outPosition += decompressedSize;
+			position += blockLength + (hasBlockChecksum ? 4 : 0);
+		}
+		out->resize(outPosition);
+		return FRAME_COMPLETE;
+	}
+};
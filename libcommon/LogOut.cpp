@@ -3,7 +3,9 @@
 */
 #include "pch.h"
 #include <atlstr.h>
+#include <algorithm>
 #include "LogOut.h"
+#include "UTFConvert.h"
 
 LogOut::LogOut(const LOG_TARGET target) : logTarget(target)
 {
@@ -43,6 +45,32 @@ void LogOut::Write(LPCTSTR fmt, ...)
 	}
 }
 
+void LogOut::WriteUTF8(const std::string_view text)
+{
+	if (logTarget == LTARGET_NONE)
+	{
+		return;
+	}
+	// converted here rather than written as bytes, since stdout is also written wide by Write
+	std::wstring wide = UTFConvert::ToWide(text);
+	switch (logTarget)
+	{
+	case LTARGET_STDOUT:
+		wprintf(L"%s", wide.c_str());
+		break;
+	case LTARGET_FILE:
+		// fall-through until implemented
+		//break;
+	case LTARGET_DEBUG:
+		wide.erase(std::remove_if(wide.begin(), wide.end(), [](const wchar_t c) { return c == L'\n' || c == L'\r'; }), wide.end());
+		LIBCOMMON_DEBUG_PRINT(L"%s", wide.c_str());
+		break;
+	case LTARGET_NONE:
+	default:
+		break;
+	}
+}
+
 void LogOut::FormattedErrorOut(const WCHAR* msg)
 {
 	DWORD eNum;
@@ -2,6 +2,7 @@
 #include <windows.h>
 #include <iostream>
 #include <vector>
+#include <string_view>
 
 // output to log or debug
 class LogOut
@@ -21,6 +22,8 @@ public:
 	void SetTarget(const LOG_TARGET logTarget);
 
 	void Write(LPCTSTR fmt, ...);
+	// UTF-8 text, converted once and written as Write writes
+	void WriteUTF8(const std::string_view text);
 
 	void FormattedErrorOut(LPCTSTR msg);
 };
@@ -0,0 +1,97 @@
+#pragma once
+// MPSCRingBuffer
+//  bounded lock-free queue for many producer threads and a single consumer thread
+//  (D. Vyukov's bounded queue: each cell carries a sequence number telling producers and the consumer
+//  whether it is free or filled for the current lap). Push and pop never block; a full queue fails the push.
+//  Elements are exchanged by swap, so the caller gets the cell's previous object back and buffers such as
+//  std::string capacity circulate between producers and the consumer instead of being reallocated.
+//
+//  portable (no Windows dependencies)
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+template <typename T>
+class MPSCRingBuffer
+{
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		T data;
+	};
+	std::vector<Cell> cells;
+	size_t mask = 0;
+	alignas(64) std::atomic<size_t> enqueuePosition{ 0 };
+	alignas(64) size_t dequeuePosition = 0;	// consumer only
+
+public:
+	// capacity is rounded up to a power of 2
+	explicit MPSCRingBuffer(const size_t requestedCapacity)
+	{
+		size_t capacity = 2;
+		while (capacity < requestedCapacity)
+		{
+			capacity *= 2;
+		}
+		cells = std::vector<Cell>(capacity);
+		for (size_t i = 0; i < capacity; i++)
+		{
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		mask = capacity - 1;
+	}
+	MPSCRingBuffer(const MPSCRingBuffer&) = delete;
+	MPSCRingBuffer& operator = (const MPSCRingBuffer&) = delete;
+
+	size_t GetCapacity() const
+	{
+		return cells.size();
+	}
+
+	// any thread. Swaps value into the queue (value receives a recycled object). Returns false if full.
+	bool TryPush(T& value)
+	{
+		size_t position = enqueuePosition.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell& cell = cells[position & mask];
+			const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+			if (difference == 0)
+			{
+				if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					std::swap(cell.data, value);
+					cell.sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0)
+			{
+				return false;
+			}
+			else
+			{
+				position = enqueuePosition.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// consumer thread only. Swaps the oldest element into value. Returns false if empty.
+	bool TryPop(T& value)
+	{
+		Cell& cell = cells[dequeuePosition & mask];
+		const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+		if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(dequeuePosition + 1) < 0)
+		{
+			return false;
+		}
+		std::swap(cell.data, value);
+		cell.sequence.store(dequeuePosition + cells.size(), std::memory_order_release);
+		dequeuePosition++;
+		return true;
+	}
+};
@@ -0,0 +1,254 @@
+#pragma once
+// MappedFile
+//  read-only memory mapping of a file that may still be growing (e.g. a log being appended to)
+//  a view is kept over a byte range and only replaced when a range outside of it is requested,
+//  so callers that map [bookmark, size) on each poll only remap when the file has grown
+//
+//  Win32 backend uses file mapping objects, other platforms use POSIX mmap
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// a path literal of MappedFile::PathChar, e.g. MAPPED_FILE_PATH("samples.csv")
+#ifdef _WIN32
+#define MAPPED_FILE_PATH(literal) L##literal
+#else
+#define MAPPED_FILE_PATH(literal) literal
+#endif
+
+class MappedFile
+{
+public:
+#ifdef _WIN32
+	typedef wchar_t PathChar;
+#else
+	typedef char PathChar;
+#endif
+
+	// identifies a file independent of its name, to detect rotation (file replaced at the same path)
+	struct FileIdentity
+	{
+		uint64_t volume = 0;	// POSIX device, unused on Windows
+		uint64_t id = 0;		// creation time on Windows, inode on POSIX
+		bool operator == (const FileIdentity& o) const
+		{
+			return volume == o.volume && id == o.id;
+		}
+		bool operator != (const FileIdentity& o) const
+		{
+			return !(*this == o);
+		}
+	};
+
+private:
+#ifdef _WIN32
+	HANDLE hFile = INVALID_HANDLE_VALUE;
+	HANDLE hMapping = NULL;
+	uint64_t mappingSize = 0;	// file size the mapping object was created for
+#else
+	int fd = -1;
+#endif
+	void* pView = nullptr;
+	uint64_t viewOffset = 0;	// aligned file offset of pView
+	size_t viewSize = 0;
+
+	static uint64_t GetMapAlignment()
+	{
+#ifdef _WIN32
+		SYSTEM_INFO sysInfo;
+		GetSystemInfo(&sysInfo);
+		return sysInfo.dwAllocationGranularity;
+#else
+		return static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+	}
+
+public:
+	MappedFile() {}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator = (const MappedFile&) = delete;
+	~MappedFile()
+	{
+		Close();
+	}
+
+	bool Open(const PathChar* path)
+	{
+		Close();
+#ifdef _WIN32
+		// writers are expected to have the file open, and may rotate it out from under us
+		hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		return hFile != INVALID_HANDLE_VALUE;
+#else
+		fd = open(path, O_RDONLY);
+		return fd != -1;
+#endif
+	}
+	bool IsOpen() const
+	{
+#ifdef _WIN32
+		return hFile != INVALID_HANDLE_VALUE;
+#else
+		return fd != -1;
+#endif
+	}
+	void Close()
+	{
+		Unmap();
+#ifdef _WIN32
+		if (hMapping)
+		{
+			CloseHandle(hMapping);
+			hMapping = NULL;
+			mappingSize = 0;
+		}
+		if (hFile != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(hFile);
+			hFile = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (fd != -1)
+		{
+			close(fd);
+			fd = -1;
+		}
+#endif
+	}
+	void Unmap()
+	{
+		if (pView)
+		{
+#ifdef _WIN32
+			UnmapViewOfFile(pView);
+#else
+			munmap(pView, viewSize);
+#endif
+			pView = nullptr;
+			viewOffset = 0;
+			viewSize = 0;
+		}
+	}
+
+	// current size of the open file
+	bool GetSize(uint64_t& size) const
+	{
+#ifdef _WIN32
+		LARGE_INTEGER liSize;
+		if (!GetFileSizeEx(hFile, &liSize))
+		{
+			return false;
+		}
+		size = static_cast<uint64_t>(liSize.QuadPart);
+		return true;
+#else
+		struct stat st;
+		if (fstat(fd, &st) != 0)
+		{
+			return false;
+		}
+		size = static_cast<uint64_t>(st.st_size);
+		return true;
+#endif
+	}
+
+	// identity of whatever file is currently at path (without opening it)
+	static bool QueryIdentity(const PathChar* path, FileIdentity& identity)
+	{
+#ifdef _WIN32
+		WIN32_FILE_ATTRIBUTE_DATA attributes;
+		if (!GetFileAttributesEx(path, GetFileExInfoStandard, &attributes))
+		{
+			return false;
+		}
+		identity.volume = 0;
+		identity.id = (static_cast<uint64_t>(attributes.ftCreationTime.dwHighDateTime) << 32) | attributes.ftCreationTime.dwLowDateTime;
+		return true;
+#else
+		struct stat st;
+		if (stat(path, &st) != 0)
+		{
+			return false;
+		}
+		identity.volume = static_cast<uint64_t>(st.st_dev);
+		identity.id = static_cast<uint64_t>(st.st_ino);
+		return true;
+#endif
+	}
+
+	// map [offset, offset + length) and return a pointer to offset, or nullptr on failure
+	// the range must lie within the current file size. The existing view is reused if it covers the range.
+	// when a new view is needed it covers at least viewLength bytes from offset (also within the file size),
+	// so callers walking through the file in small steps don't remap on every step
+	const char* Map(const uint64_t offset, const size_t length, const size_t viewLength = 0)
+	{
+		if (!IsOpen() || !length)
+		{
+			return nullptr;
+		}
+		if (pView
+			&& offset >= viewOffset
+			&& offset + length <= viewOffset + viewSize)
+		{
+			return static_cast<const char*>(pView) + (offset - viewOffset);
+		}
+		Unmap();
+
+		const size_t mapLength = length > viewLength ? length : viewLength;
+		static const uint64_t alignment = GetMapAlignment();
+		const uint64_t alignedOffset = offset - (offset % alignment);
+		const uint64_t alignedLength = mapLength + (offset - alignedOffset);
+		if (alignedLength != static_cast<size_t>(alignedLength))
+		{
+			// range doesn't fit the address space
+			return nullptr;
+		}
+#ifdef _WIN32
+		// a mapping object can't extend past the size the file had when it was created, recreate it once the file grows
+		if (!hMapping || offset + mapLength > mappingSize)
+		{
+			if (hMapping)
+			{
+				CloseHandle(hMapping);
+				hMapping = NULL;
+			}
+			uint64_t fileSize = 0;
+			if (!GetSize(fileSize) || offset + mapLength > fileSize)
+			{
+				return nullptr;
+			}
+			hMapping = CreateFileMapping(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (!hMapping)
+			{
+				return nullptr;
+			}
+			mappingSize = fileSize;
+		}
+		pView = MapViewOfFile(hMapping, FILE_MAP_READ, static_cast<DWORD>(alignedOffset >> 32), static_cast<DWORD>(alignedOffset), static_cast<size_t>(alignedLength));
+		if (!pView)
+		{
+			return nullptr;
+		}
+#else
+		void* p = mmap(nullptr, static_cast<size_t>(alignedLength), PROT_READ, MAP_SHARED, fd, static_cast<off_t>(alignedOffset));
+		if (p == MAP_FAILED)
+		{
+			return nullptr;
+		}
+		pView = p;
+#endif
+		viewOffset = alignedOffset;
+		viewSize = static_cast<size_t>(alignedLength);
+		return static_cast<const char*>(pView) + (offset - viewOffset);
+	}
+};
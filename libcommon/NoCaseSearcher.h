@@ -0,0 +1,288 @@
+#pragma once
+// NoCaseSearcher
+//  case insensitive substring search for one needle, prepared once and reused across haystacks
+//  the needle is folded (CaseFold) at construction and haystack units are folded by table lookup as
+//  they are compared, so no locale work is done while searching.
+//  Short needles are found by comparing 8 haystack units at a time with SSE2 against every unit that
+//  folds to the needle's first and last characters, then checking only the positions where both hit.
+//  Long needles, where those checks could go quadratic on repetitive text, use Two-Way
+//  (Crochemore-Perrin), which is linear in the haystack with constant extra space.
+//
+//  searching is const, so one searcher can be used from several threads
+//
+//  portable (CaseFold provides the Win32 and POSIX folding tables, SSE2 is used where available)
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "CaseFold.h"
+
+#if (defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)) && (WCHAR_MAX == 0xFFFF)
+#define NOCASESEARCHER_SSE2
+#include <emmintrin.h>
+#endif
+
+class NoCaseSearcher
+{
+	static const size_t LONG_NEEDLE_LENGTH = 32;	// and up use Two-Way
+	static const size_t MAX_FILTER_UNITS = 4;		// per end, more and the filter is skipped
+
+	std::wstring needle;		// folded
+	// first/last character filter
+	std::vector<wchar_t> firstUnits;
+	std::vector<wchar_t> lastUnits;
+	bool useFilter = false;
+	// Two-Way factorization
+	bool useTwoWay = false;
+	bool isPeriodic = false;
+	ptrdiff_t criticalPosition = 0;
+	size_t period = 0;
+
+	bool MatchesAt(const wchar_t* str, const size_t from, const size_t to) const
+	{
+		for (size_t i = from; i < to; i++)
+		{
+			if (CaseFold::Fold(str[i]) != needle[i])
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// start of the maximal suffix of the needle under < (or > when isReversed), and its period
+	ptrdiff_t MaximalSuffix(const bool isReversed, size_t& suffixPeriod) const
+	{
+		const ptrdiff_t length = static_cast<ptrdiff_t>(needle.size());
+		ptrdiff_t suffix = -1;
+		ptrdiff_t j = 0;
+		ptrdiff_t k = 1;
+		ptrdiff_t p = 1;
+		while (j + k < length)
+		{
+			const wchar_t a = needle[j + k];
+			const wchar_t b = needle[suffix + k];
+			if (isReversed ? a > b : a < b)
+			{
+				j += k;
+				k = 1;
+				p = j - suffix;
+			}
+			else if (a == b)
+			{
+				if (k != p)
+				{
+					k++;
+				}
+				else
+				{
+					j += p;
+					k = 1;
+				}
+			}
+			else
+			{
+				suffix = j;
+				j = suffix + 1;
+				k = p = 1;
+			}
+		}
+		suffixPeriod = static_cast<size_t>(p);
+		return suffix;
+	}
+	void PrepareTwoWay()
+	{
+		size_t periodForward, periodReversed;
+		const ptrdiff_t suffixForward = MaximalSuffix(false, periodForward);
+		const ptrdiff_t suffixReversed = MaximalSuffix(true, periodReversed);
+		criticalPosition = suffixForward > suffixReversed ? suffixForward : suffixReversed;
+		period = suffixForward > suffixReversed ? periodForward : periodReversed;
+		// the needle is periodic when its prefix up to the critical position repeats at the period
+		isPeriodic = period + criticalPosition + 1 <= needle.size()
+			&& needle.compare(0, criticalPosition + 1, needle, period, criticalPosition + 1) == 0;
+		if (!isPeriodic)
+		{
+			const size_t left = static_cast<size_t>(criticalPosition + 1);
+			const size_t right = needle.size() - left;
+			period = (left > right ? left : right) + 1;
+		}
+	}
+	size_t FindTwoWay(const wchar_t* str, const size_t length, size_t position) const
+	{
+		const ptrdiff_t needleLength = static_cast<ptrdiff_t>(needle.size());
+		ptrdiff_t memory = -1;
+		while (position + needle.size() <= length)
+		{
+			const wchar_t* window = str + position;
+			// right half, left to right (skipping what a periodic shift already matched)
+			ptrdiff_t i = (isPeriodic && memory > criticalPosition ? memory : criticalPosition) + 1;
+			while (i < needleLength && needle[i] == CaseFold::Fold(window[i]))
+			{
+				i++;
+			}
+			if (i < needleLength)
+			{
+				position += static_cast<size_t>(i - criticalPosition);
+				memory = -1;
+				continue;
+			}
+			// then the left half, right to left
+			const ptrdiff_t stop = isPeriodic ? memory : -1;
+			i = criticalPosition;
+			while (i > stop && needle[i] == CaseFold::Fold(window[i]))
+			{
+				i--;
+			}
+			if (i <= stop)
+			{
+				return position;
+			}
+			position += period;
+			if (isPeriodic)
+			{
+				memory = needleLength - static_cast<ptrdiff_t>(period) - 1;
+			}
+		}
+		return std::wstring::npos;
+	}
+
+	size_t FindShort(const wchar_t* str, const size_t length, size_t position) const
+	{
+		const size_t last = needle.size() - 1;
+#ifdef NOCASESEARCHER_SSE2
+		if (useFilter)
+		{
+			__m128i first[MAX_FILTER_UNITS];
+			__m128i lastChar[MAX_FILTER_UNITS];
+			for (size_t i = 0; i < firstUnits.size(); i++)
+			{
+				first[i] = _mm_set1_epi16(static_cast<short>(firstUnits[i]));
+			}
+			for (size_t i = 0; i < lastUnits.size(); i++)
+			{
+				lastChar[i] = _mm_set1_epi16(static_cast<short>(lastUnits[i]));
+			}
+			while (position + last + 8 <= length)
+			{
+				const __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + position));
+				const __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + position + last));
+				__m128i isFirst = _mm_setzero_si128();
+				__m128i isLast = _mm_setzero_si128();
+				for (size_t i = 0; i < firstUnits.size(); i++)
+				{
+					isFirst = _mm_or_si128(isFirst, _mm_cmpeq_epi16(blockFirst, first[i]));
+				}
+				for (size_t i = 0; i < lastUnits.size(); i++)
+				{
+					isLast = _mm_or_si128(isLast, _mm_cmpeq_epi16(blockLast, lastChar[i]));
+				}
+				// two mask bits per unit
+				for (unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(isFirst, isLast))), offset = 0; mask; mask >>= 2, offset++)
+				{
+					if ((mask & 3) && MatchesAt(str + position + offset, 1, last))
+					{
+						return position + offset;
+					}
+				}
+				position += 8;
+			}
+		}
+#endif
+		const wchar_t first = needle[0];
+		for (; position + needle.size() <= length; position++)
+		{
+			if (CaseFold::Fold(str[position]) == first
+				&& CaseFold::Fold(str[position + last]) == needle[last]
+				&& MatchesAt(str + position, 1, last))
+			{
+				return position;
+			}
+		}
+		return std::wstring::npos;
+	}
+
+public:
+	NoCaseSearcher() {}
+	explicit NoCaseSearcher(const std::wstring_view needleText)
+	{
+		SetNeedle(needleText);
+	}
+
+	void SetNeedle(const std::wstring_view needleText)
+	{
+		needle = CaseFold::Folded(needleText);
+		useTwoWay = needle.size() >= LONG_NEEDLE_LENGTH;
+		useFilter = false;
+		firstUnits.clear();
+		lastUnits.clear();
+		if (useTwoWay)
+		{
+			PrepareTwoWay();
+		}
+		else if (!needle.empty())
+		{
+			CaseFold::GetUnfolded(needle.front(), firstUnits);
+			CaseFold::GetUnfolded(needle.back(), lastUnits);
+			useFilter = firstUnits.size() <= MAX_FILTER_UNITS && lastUnits.size() <= MAX_FILTER_UNITS;
+		}
+	}
+	const std::wstring& GetNeedle() const
+	{
+		return needle;
+	}
+
+	// index of the first occurrence at or after start, npos if none. An empty needle is found at start.
+	size_t Find(const wchar_t* str, const size_t length, const size_t start = 0) const
+	{
+		if (start > length || needle.size() > length - start)
+		{
+			return std::wstring::npos;
+		}
+		if (needle.empty())
+		{
+			return start;
+		}
+		return useTwoWay ? FindTwoWay(str, length, start) : FindShort(str, length, start);
+	}
+	size_t Find(const std::wstring_view str, const size_t start = 0) const
+	{
+		return Find(str.data(), str.size(), start);
+	}
+	bool IsFoundIn(const std::wstring_view str) const
+	{
+		return Find(str) != std::wstring::npos;
+	}
+
+	// the needle's position in each haystack (npos where absent). Returns how many contain it.
+	template <typename StringT>
+	size_t FindEach(const std::vector<StringT>& haystacks, std::vector<size_t>& positions) const
+	{
+		positions.resize(haystacks.size());
+		size_t found = 0;
+		for (size_t i = 0; i < haystacks.size(); i++)
+		{
+			positions[i] = Find(std::wstring_view(haystacks[i]));
+			if (positions[i] != std::wstring::npos)
+			{
+				found++;
+			}
+		}
+		return found;
+	}
+	// indexes of the haystacks that contain the needle, ascending. Returns the count.
+	template <typename StringT>
+	size_t FindAllContaining(const std::vector<StringT>& haystacks, std::vector<size_t>& matches) const
+	{
+		matches.clear();
+		for (size_t i = 0; i < haystacks.size(); i++)
+		{
+			if (IsFoundIn(std::wstring_view(haystacks[i])))
+			{
+				matches.push_back(i);
+			}
+		}
+		return matches.size();
+	}
+};
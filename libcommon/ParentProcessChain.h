@@ -1,6 +1,11 @@
 #pragma once
 // ParentProcessChain
 // tracks parent/child process relationships
+// each PID has one entry holding the process's creation time (its ProcessKey start time) with its basename,
+// parent and children, so telling a reused PID from the tracked process is a compare on the entry.
+// Entries are also kept for parents that aren't tracked themselves, for their creation times and children.
+// the ProcessKey overloads take start times the caller already has, instead of opening the processes, and
+// ignore keys of processes no longer tracked under their PID (the PID was reused)
 
 #include <map>
 #include <set>
@@ -9,6 +14,9 @@
 #include <atlstr.h>
 #include "libcommon.h"
 #include "DebugOutToggles.h"
+#include "WildcardSet.h"
+#include "WildcardMatchCache.h"
+#include "ProcessKey.h"
 
 // although we've ensured circular parent chain dependencies will not occur, they would result in an infinite loop, so we have this safety, intended for release builds.
 #define CIRCULAR_CHAIN_SAFETIES_ENABLED
@@ -16,11 +24,17 @@
 class ParentProcessChain
 {
 	static const DWORD INVALID_PID_VALUE = 0;	// use 0 (system idle process) instead of -1 to keep simple
+	struct Process
+	{
+		unsigned long long creationTime = 0;	// 0 until known
+		bool isTracked = false;					// added with AddPID, not only someone's parent
+		ATL::CString csBasename;				// lower case, tracked only
+		DWORD dwParentPid = INVALID_PID_VALUE;	// tracked only
+		std::set<DWORD> childPIDs;
+	};
 	std::mutex processMaps;
-	std::map<DWORD, ATL::CString> mapPIDtoBasenames;
-	std::map<DWORD, DWORD> mapPIDtoParentPID;
-	std::map<DWORD, std::set<DWORD>> mapPIDtoChildPIDs;
-	std::map<DWORD, unsigned long long> mapPIDToCreationTime;
+	std::map<DWORD, Process> mapPIDtoProcess;
+	size_t trackedCount = 0;
 #ifdef CIRCULAR_CHAIN_SAFETIES_ENABLED	
 	const int MAX_VALID_DEPTH = 256;		// set a max depth in case of some errant circular resolution (should never occur, but.. e.g. 4->0 0->4)
 #endif
@@ -31,63 +45,128 @@ class ParentProcessChain
 public:
 	size_t Size()
 	{
-		return mapPIDtoParentPID.size();
+		return trackedCount;
 	}
 	void AddPID(const DWORD dwPid, const WCHAR* pwszBasename, DWORD dwParentPid)
 	{
+		AddPID(ProcessKey(dwPid), pwszBasename, ProcessKey(dwParentPid));
+	}
+	void AddPID(const ProcessKey& key, const WCHAR* pwszBasename, const ProcessKey& parentKey)
+	{
+		const DWORD dwPid = key.pid;
+		DWORD dwParentPid = parentKey.pid;
 		std::lock_guard<std::mutex> lock(processMaps);
-		_ASSERT(mapPIDtoParentPID.find(dwPid) == mapPIDtoParentPID.end());
-		_ASSERT(mapPIDtoBasenames.find(dwPid) == mapPIDtoBasenames.end());
-		mapPIDtoBasenames[dwPid] = pwszBasename;
-		mapPIDtoBasenames[dwPid].MakeLower();
+		Process& process = mapPIDtoProcess[dwPid];
+		Process& parent = mapPIDtoProcess[dwParentPid];
+		// known start times save RecordCreationTimeLocked opening the processes. A parent already known keeps its own.
+		if (key.HasStartTime())
+		{
+			process.creationTime = key.startTime;
+		}
+		if (parentKey.HasStartTime() && !parent.creationTime)
+		{
+			parent.creationTime = parentKey.startTime;
+		}
+		_ASSERT(!process.isTracked);
+		process.csBasename = pwszBasename;
+		process.csBasename.MakeLower();
 
 		// get creation times to validate that it is the actual parent, and not a reused PID
 		// see https://devblogs.microsoft.com/oldnewthing/?p=44313	
 		unsigned long long timeCreateParent = 0;
 		unsigned long long timeCreateChild = 0;
-		RecordCreationTime(dwPid, timeCreateChild);
-		RecordCreationTime(dwParentPid, timeCreateParent);
+		RecordCreationTimeLocked(dwPid, timeCreateChild);
+		RecordCreationTimeLocked(dwParentPid, timeCreateParent);
 		if (timeCreateParent
 			&&
 			timeCreateParent > timeCreateChild)
 		{
+			// the PID's current process is younger, so not the parent; an entry made only for it isn't needed
+			if (!parent.isTracked && parent.childPIDs.empty() && dwParentPid != dwPid)
+			{
+				mapPIDtoProcess.erase(dwParentPid);
+			}
 			dwParentPid = 0;
 		}
-		mapPIDtoParentPID[dwPid] = dwParentPid;
+		process.dwParentPid = dwParentPid;
+		if (!process.isTracked)
+		{
+			process.isTracked = true;
+			trackedCount++;
+		}
 
-		// create an entry to track children of this process		
-		mapPIDtoChildPIDs[dwPid] = {};
+		// start tracking children of this process afresh
+		process.childPIDs.clear();
 		// then add it to its parent's children set
-		mapPIDtoChildPIDs[dwParentPid].insert(dwPid);
+		mapPIDtoProcess[dwParentPid].childPIDs.insert(dwPid);
 
 		// debug check for infinite map growth (leakage)
-		_ASSERT(mapPIDtoBasenames.size() < DEBUG_MAP_SIZE_MAX_CHECK && mapPIDtoParentPID.size() < DEBUG_MAP_SIZE_MAX_CHECK
-			&& mapPIDtoChildPIDs.size() < DEBUG_MAP_SIZE_MAX_CHECK && mapPIDtoChildPIDs[dwParentPid].size() < DEBUG_MAP_SIZE_MAX_CHECK
-			&& mapPIDToCreationTime.size() < DEBUG_MAP_SIZE_MAX_CHECK);
+		_ASSERT(mapPIDtoProcess.size() < DEBUG_MAP_SIZE_MAX_CHECK && mapPIDtoProcess[dwParentPid].childPIDs.size() < DEBUG_MAP_SIZE_MAX_CHECK);
 	}
 	void RemovePID(const DWORD dwPid)
 	{
 		std::lock_guard<std::mutex> lock(processMaps);
-		// erase from any occurrences in mapPIDToChildPIDs children sets
-		_ASSERT(mapPIDtoParentPID.find(dwPid) != mapPIDtoParentPID.end());
-		DWORD dwParentPID = mapPIDtoParentPID[dwPid];
-		// parent may no longer exist
-		if (mapPIDtoChildPIDs.find(dwParentPID) != mapPIDtoChildPIDs.end())
+		RemoveTrackedPID(dwPid);
+	}
+	// false if the key's process isn't the one tracked under its PID
+	bool RemovePID(const ProcessKey& key)
+	{
+		std::lock_guard<std::mutex> lock(processMaps);
+		if (!IsTrackedLocked(key))
 		{
-			mapPIDtoChildPIDs[dwParentPID].erase(dwPid);
+			return false;
 		}
-
-		// and its parent entry
-		if (mapPIDtoChildPIDs.find(dwPid) != mapPIDtoChildPIDs.end())
+		RemoveTrackedPID(key.pid);
+		return true;
+	}
+	// the tracked process's key (start time 0 if not tracked)
+	ProcessKey GetProcessKey(const DWORD dwPid)
+	{
+		std::lock_guard<std::mutex> lock(processMaps);
+		const Process* process = FindTracked(dwPid);
+		return ProcessKey(dwPid, process ? process->creationTime : 0);
+	}
+	// whether the key's process is the one tracked under its PID
+	bool IsTracked(const ProcessKey& key)
+	{
+		std::lock_guard<std::mutex> lock(processMaps);
+		return IsTrackedLocked(key);
+	}
+private:
+	const Process* FindTracked(const DWORD dwPid) const
+	{
+		auto it = mapPIDtoProcess.find(dwPid);
+		return (it != mapPIDtoProcess.end() && it->second.isTracked) ? &it->second : nullptr;
+	}
+	bool IsTrackedLocked(const ProcessKey& key) const
+	{
+		const Process* process = FindTracked(key.pid);
+		return process && ProcessKey(key.pid, process->creationTime).IsSameProcess(key);
+	}
+	void RemoveTrackedPID(const DWORD dwPid)
+	{
+		auto it = mapPIDtoProcess.find(dwPid);
+		_ASSERT(it != mapPIDtoProcess.end() && it->second.isTracked);
+		if (it == mapPIDtoProcess.end() || !it->second.isTracked)
 		{
-			mapPIDtoChildPIDs.erase(dwPid);
+			return;
 		}
-
-		// now erase from other maps
-		mapPIDtoParentPID.erase(dwPid);
-		mapPIDtoBasenames.erase(dwPid);
-		EraseCreationTime(dwPid);
+		// erase from its parent's children set. The parent may no longer exist, and once an untracked parent
+		// has no children left nothing needs its entry.
+		auto parent = mapPIDtoProcess.find(it->second.dwParentPid);
+		if (parent != mapPIDtoProcess.end() && parent != it)
+		{
+			parent->second.childPIDs.erase(dwPid);
+			if (!parent->second.isTracked && parent->second.childPIDs.empty())
+			{
+				mapPIDtoProcess.erase(parent);
+			}
+		}
+		// then the process itself, with its children set and creation time
+		mapPIDtoProcess.erase(it);
+		trackedCount--;
 	}
+public:
 	int GetNestLevelOfPID(const DWORD dwPID)
 	{
 		int nNestLevel = 0;
@@ -112,11 +191,11 @@ public:
 		vecOrderedByHierarchyPIDs.clear();
 
 		// must start with sort by ascending nest level, then PID --- PID done beforehand by std::map
-		std::vector<std::pair<int, std::set<DWORD>>> vPIDToChildPIDsSorted;
+		std::vector<std::pair<DWORD, std::set<DWORD>>> vPIDToChildPIDsSorted;
+		std::lock_guard<std::mutex> lock(processMaps);
 		{
-			std::lock_guard<std::mutex> lock(processMaps);
 			// sort ascending by nest level
-			for (auto i = mapPIDtoChildPIDs.begin(); i != mapPIDtoChildPIDs.end(); ++i)
+			for (auto i = mapPIDtoProcess.begin(); i != mapPIDtoProcess.end(); ++i)
 			{
 				// insert before the next highest nest level				
 				int nNestLevel = GetNestLevelOfPID(i->first);
@@ -132,7 +211,7 @@ public:
 						break;
 					}
 				}
-				vPIDToChildPIDsSorted.insert(iInsert, *i);
+				vPIDToChildPIDsSorted.emplace(iInsert, i->first, i->second.childPIDs);
 			}
 		}
 
@@ -156,7 +235,12 @@ private:
 		}
 
 		// then recursively insert all children
-		for (auto& i : mapPIDtoChildPIDs[dwPID])
+		auto process = mapPIDtoProcess.find(dwPID);
+		if (process == mapPIDtoProcess.end())
+		{
+			return nInsertedItems;
+		}
+		for (auto& i : process->second.childPIDs)
 		{
 			nInsertedItems += InsertChildPIDsToHierarchicalSort(vecOrderedByHierarchyPIDs, i);
 		}
@@ -167,47 +251,93 @@ public:
 	{
 		// don't acquire mutex due to SortHierarchically...GetNestLevelOfPID...GetParent
 		//std::lock_guard<std::mutex> lock(processMaps);
-		auto it = mapPIDtoParentPID.find(dwPid);
-		if (it != mapPIDtoParentPID.end())
+		const Process* process = FindTracked(dwPid);
+		if (!process)
 		{
-			// parent can be missing from maps if it terminated
-			// or it can be errantly present as a reused PID
-			if (mapPIDToCreationTime.find(it->second) == mapPIDToCreationTime.end()
-				||
-				mapPIDToCreationTime[dwPid] <= mapPIDToCreationTime[it->second])
-			{
-				LIBCOMMON_DEBUG_PRINT(L"Invalid parent PID for %u, parent %u", dwPid, it->second);
-				return INVALID_PID_VALUE;
-			}
-			auto parentname = mapPIDtoBasenames.find(it->second);
-			if (parentname != mapPIDtoBasenames.end())
-			{
-				if (pcsParentBasename)
-				{
-					*pcsParentBasename = parentname->second;
-				}
-				return it->second;
-			}
+			return INVALID_PID_VALUE;
+		}
+		// parent can be missing from the map if it terminated
+		// or it can be errantly present as a reused PID
+		const Process* parent = FindTracked(process->dwParentPid);
+		if (!parent)
+		{
+			return INVALID_PID_VALUE;
 		}
-		return INVALID_PID_VALUE;
+		if (process->creationTime <= parent->creationTime)
+		{
+			LIBCOMMON_DEBUG_PRINT(L"Invalid parent PID for %u, parent %u", dwPid, process->dwParentPid);
+			return INVALID_PID_VALUE;
+		}
+		if (pcsParentBasename)
+		{
+			*pcsParentBasename = parent->csBasename;
+		}
+		return process->dwParentPid;
+	}
+	// the parent of the key's process, with its start time. PID INVALID_PID_VALUE if there is none, or the
+	// key's process isn't the one tracked under its PID.
+	ProcessKey GetParent(const ProcessKey& key, ATL::CString* pcsParentBasename = nullptr)
+	{
+		std::lock_guard<std::mutex> lock(processMaps);
+		if (!IsTrackedLocked(key))
+		{
+			return ProcessKey(INVALID_PID_VALUE);
+		}
+		const DWORD dwParentPid = GetParent(key.pid, pcsParentBasename);
+		const Process* parent = FindTracked(dwParentPid);
+		return ProcessKey(dwParentPid, parent ? parent->creationTime : 0);
 	}
 	// check if PID a child of process matching given basename (wildcards accepted)
 	bool IsChildOf(const DWORD dwPid, const WCHAR* pwszParentBasenameMatch)
 	{
 		std::lock_guard<std::mutex> lock(processMaps);
+		return IsChildOfLocked(dwPid, [&](const ATL::CString& csParentBasename)
+			{
+				return wildcmpi(pwszParentBasenameMatch, csParentBasename);
+			});
+	}
+	// as above for a list of parent basename patterns, with each ancestor's result taken from the cache
+	bool IsChildOf(const DWORD dwPid, const WildcardSet& parentBasenameMatches, WildcardMatchCache& cache)
+	{
+		std::lock_guard<std::mutex> lock(processMaps);
+		return IsChildOfLocked(dwPid, [&](const ATL::CString& csParentBasename)
+			{
+				return cache.IsMatch(parentBasenameMatches, std::wstring_view(csParentBasename.GetString(), csParentBasename.GetLength()));
+			});
+	}
+	// as above, false if the key's process isn't the one tracked under its PID
+	bool IsChildOf(const ProcessKey& key, const WCHAR* pwszParentBasenameMatch)
+	{
+		std::lock_guard<std::mutex> lock(processMaps);
+		return IsTrackedLocked(key) && IsChildOfLocked(key.pid, [&](const ATL::CString& csParentBasename)
+			{
+				return wildcmpi(pwszParentBasenameMatch, csParentBasename);
+			});
+	}
+	bool IsChildOf(const ProcessKey& key, const WildcardSet& parentBasenameMatches, WildcardMatchCache& cache)
+	{
+		std::lock_guard<std::mutex> lock(processMaps);
+		return IsTrackedLocked(key) && IsChildOfLocked(key.pid, [&](const ATL::CString& csParentBasename)
+			{
+				return cache.IsMatch(parentBasenameMatches, std::wstring_view(csParentBasename.GetString(), csParentBasename.GetLength()));
+			});
+	}
+private:
+	// walks the ancestors of dwPid until isMatch(basename) holds for one (caller holds the lock)
+	template <typename MatchT>
+	bool IsChildOfLocked(const DWORD dwPid, MatchT isMatch)
+	{
 #ifdef CIRCULAR_CHAIN_SAFETIES_ENABLED		
 		int nNestLevel = 0;
 #endif
-		for (DWORD dwParentPID = GetParent(dwPid); dwParentPID != INVALID_PID_VALUE; dwParentPID = GetParent(dwParentPID))
+		ATL::CString csParentBasename;
+		for (DWORD dwParentPID = GetParent(dwPid, &csParentBasename); dwParentPID != INVALID_PID_VALUE; dwParentPID = GetParent(dwParentPID, &csParentBasename))
 		{
-			auto parentname = mapPIDtoBasenames.find(dwParentPID);
-			if (parentname != mapPIDtoBasenames.end()
+			if (!csParentBasename.IsEmpty()
 				&&
-				!parentname->second.IsEmpty()
-				&&
-				wildcmpi(pwszParentBasenameMatch, parentname->second))
+				isMatch(csParentBasename))
 			{
-				LIBCOMMON_DEBUG_PRINT(L"%u is child of %s", dwPid, pwszParentBasenameMatch);
+				LIBCOMMON_DEBUG_PRINT(L"%u is child of %s", dwPid, csParentBasename.GetString());
 				return true;
 			}
 #ifdef CIRCULAR_CHAIN_SAFETIES_ENABLED
@@ -221,13 +351,38 @@ public:
 		}
 		return false;
 	}
-	bool RecordCreationTime(DWORD dwPid, unsigned long long& creationTime)
+public:
+	// the PID's creation time, queried from the process unless its entry has one. Only AddPID makes entries,
+	// so for a PID without one the time is returned but not kept.
+	bool RecordCreationTime(const DWORD dwPid, unsigned long long& creationTime)
+	{
+		std::lock_guard<std::mutex> lock(processMaps);
+		return RecordCreationTimeLocked(dwPid, creationTime);
+	}
+	// forget the PID's creation time, so the next RecordCreationTime queries it again
+	void EraseCreationTime(const DWORD dwPid)
+	{
+		std::lock_guard<std::mutex> lock(processMaps);
+		auto it = mapPIDtoProcess.find(dwPid);
+		if (it == mapPIDtoProcess.end())
+		{
+			return;
+		}
+		it->second.creationTime = 0;
+		if (!it->second.isTracked && it->second.childPIDs.empty())
+		{
+			mapPIDtoProcess.erase(it);
+		}
+	}
+private:
+	// caller holds the lock
+	bool RecordCreationTimeLocked(const DWORD dwPid, unsigned long long& creationTime)
 	{
 		bool bR = false;
-		auto it = mapPIDToCreationTime.find(dwPid);
-		if (it != mapPIDToCreationTime.end())
+		auto it = mapPIDtoProcess.find(dwPid);
+		if (it != mapPIDtoProcess.end() && it->second.creationTime)
 		{
-			creationTime = it->second;
+			creationTime = it->second.creationTime;
 			return true;
 		}
 		HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, dwPid);
@@ -247,12 +402,10 @@ public:
 			LIBCOMMON_DEBUG_PRINT(L"No limited query access to PID %u, can't get creation time!", dwPid);
 			GetSystemTimeAsFileTime(reinterpret_cast<LPFILETIME>(&creationTime));
 		}
-		mapPIDToCreationTime[dwPid] = creationTime;
+		if (it != mapPIDtoProcess.end())
+		{
+			it->second.creationTime = creationTime;
+		}
 		return bR;
 	}
-	void EraseCreationTime(const DWORD dwPid)
-	{
-		_ASSERT(mapPIDToCreationTime.find(dwPid) != mapPIDToCreationTime.end());
-		mapPIDToCreationTime.erase(dwPid);
-	}
 };
\ No newline at end of file
@@ -1,160 +1,742 @@
 #pragma once
 // ProcessCache
-//  encapsulates associative arrays of various types for storage of process stats
+//  per process storage of the latest stats, shared by the sampling and consumer threads
 //
-// TODO: 
-//  template this if continued use (each datatype will have an instance)
-//  replace get/set methods referencing specifically named values with generic get/set_byName methods
+// ProcessCacheT<Schema>
+//  the metrics are a compile time list (ProcessCacheSchema of metric tags, each naming its value type), and
+//  each PID maps to one cache line aligned record holding all of them plus a mask of which have been set.
+//  PIDs are spread over shards, each with its own lock and map, so threads working on different
+//  processes rarely contend, and erase is a single removal from one shard.
+//  update and get_record give several metrics of a PID in one lock acquisition, and a consistent view of them.
+//  PIDs can be given as ProcessKeys: a record remembers the start time it was written with, a write with
+//  another start time (a reused PID) starts it over, and reads with another start time miss. A bare PID
+//  (start time unknown) matches whatever instance is recorded.
+//  apply_tick takes a sampling tick's records, sorted by PID, splits them by shard in one pass and merges each
+//  shard's part with the shard locked once, removing the PIDs the tick doesn't include (exited processes).
+//
+// ProcessCacheSnapshot, ProcessCacheSnapshotPublisher
+//  for consumers that read every PID on every pass (UI repaints): the sampler fills a snapshot once per
+//  tick (from the cache with fill_snapshot, or record by record) and publishes it by storing an atomic
+//  pointer, RCU style. Readers take a Reference to the current snapshot and iterate or look up the
+//  immutable, PID sorted records with no locks held, seeing every metric from the same tick.
+//  The publisher owns every snapshot it has handed out and never frees one while it exists, so a reader
+//  can't touch freed memory. A reference counts itself in the snapshot's reader count and then checks
+//  the snapshot is still current (retrying otherwise), and the sampler reuses an unpublished snapshot
+//  only once that count is zero, so steady state publishing doesn't allocate.
+//
+// ProcessCache
+//  the original interface (named getters and valueName slots) over a ProcessCacheT, taking PIDs or ProcessKeys
+//  with enable_history, CPU use and private bytes are also kept as a ProcessHistory of recent samples
 
 #include <unordered_map>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <utility>
 #include <mutex>
+#include <tuple>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+#include "ProcessKey.h"
+#include "ProcessHistory.h"
 
-class ProcessCache
+// metric tags are types with a 'type' typedef, e.g. struct CPUUse { typedef double type; };
+template <typename... Metrics>
+struct ProcessCacheSchema
 {
-public:
-	enum valueName {
-		CacheValThreadCount,
-		CacheValIODelta,
-		CacheRunningState,
-		CacheCPUTimeTotal
-	};
+	static const size_t METRIC_COUNT = sizeof...(Metrics);
+	static_assert(METRIC_COUNT <= 64, "set mask is 64 bits");
+	typedef std::tuple<typename Metrics::type...> Values;
+
 private:
-	std::mutex prot;
-	std::unordered_map<unsigned int, double> mapCPUUse;
-	std::unordered_map<unsigned int, double> mapAverageCPU;
-	std::unordered_map<unsigned int, unsigned __int64> mapPrivateWorkingSet;
-	std::unordered_map<unsigned int, std::unordered_map<valueName, unsigned long>> mapNamedULONGs;
-	std::unordered_map<unsigned int, std::unordered_map<valueName, unsigned __int64>> mapNamedULONGLONGs;
+	template <typename Metric, typename... List>
+	struct IndexIn;
+	template <typename Metric, typename... Rest>
+	struct IndexIn<Metric, Metric, Rest...> : std::integral_constant<size_t, 0> {};
+	template <typename Metric, typename First, typename... Rest>
+	struct IndexIn<Metric, First, Rest...> : std::integral_constant<size_t, 1 + IndexIn<Metric, Rest...>::value> {};
+
+public:
+	// position of Metric in the list (compile error if it isn't in the schema)
+	template <typename Metric>
+	static constexpr size_t IndexOf()
+	{
+		return IndexIn<Metric, Metrics...>::value;
+	}
+};
+
+template <typename Schema>
+class ProcessCacheSnapshot;
+
+template <typename Schema>
+class ProcessCacheT
+{
 public:
-	void erase(const unsigned int pid)
+	class alignas(64) Record
 	{
-		std::lock_guard<std::mutex> lock(prot);
-		mapCPUUse.erase(pid);
-		mapAverageCPU.erase(pid);
-		mapPrivateWorkingSet.erase(pid);
-		if (mapNamedULONGLONGs.find(pid) != mapNamedULONGLONGs.end())
+		typename Schema::Values values{};
+		uint64_t setMask = 0;
+		uint64_t startTime = 0;		// of the process the metrics belong to, 0 if unknown
+
+	public:
+		template <typename Metric>
+		bool has() const
+		{
+			return (setMask >> Schema::template IndexOf<Metric>()) & 1;
+		}
+		// the value, or a value initialized one if never set
+		template <typename Metric>
+		const typename Metric::type& get() const
+		{
+			return std::get<Schema::template IndexOf<Metric>()>(values);
+		}
+		template <typename Metric>
+		void set(const typename Metric::type& value)
+		{
+			std::get<Schema::template IndexOf<Metric>()>(values) = value;
+			setMask |= 1ULL << Schema::template IndexOf<Metric>();
+		}
+		bool empty() const
+		{
+			return !setMask;
+		}
+		uint64_t get_start_time() const
+		{
+			return startTime;
+		}
+		// binds the record to a process instance, dropping the metrics of a previous one with the PID
+		void set_start_time(const uint64_t processStartTime)
+		{
+			if (!processStartTime)
+			{
+				return;
+			}
+			if (startTime && startTime != processStartTime)
+			{
+				*this = Record();
+			}
+			startTime = processStartTime;
+		}
+		bool is_process(const ProcessKey& key) const
+		{
+			return !key.startTime || !startTime || key.startTime == startTime;
+		}
+		// the metrics set in other replace ours (all of ours if other is from a newer process with the PID)
+		void merge(const Record& other)
 		{
-			mapNamedULONGLONGs[pid].clear();
+			set_start_time(other.startTime);
+			MergeMetrics(other, std::make_index_sequence<Schema::METRIC_COUNT>());
+			setMask |= other.setMask;
 		}
-		mapNamedULONGLONGs.erase(pid);
-		if (mapNamedULONGs.find(pid) != mapNamedULONGs.end())
+
+	private:
+		template <size_t... Indexes>
+		void MergeMetrics(const Record& other, std::index_sequence<Indexes...>)
 		{
-			mapNamedULONGs[pid].clear();
+			((((other.setMask >> Indexes) & 1) ? (void)(std::get<Indexes>(values) = std::get<Indexes>(other.values)) : (void)0), ...);
 		}
-		mapNamedULONGs.erase(pid);
-		// safety check for map leakage
-		_ASSERT(mapCPUUse.size() < 4096 && mapAverageCPU.size() < 4096 && mapPrivateWorkingSet.size() < 4096
-			&& mapNamedULONGs.size() < 4096 && mapNamedULONGLONGs.size() < 4096);
+	};
+	typedef std::pair<unsigned int, Record> Entry;
+
+private:
+	static const size_t SHARD_COUNT = 16;
+	static const size_t MAX_EXPECTED_RECORDS = 4096;	// per shard, beyond this a client likely isn't calling erase
+
+	struct alignas(64) Shard
+	{
+		mutable std::mutex prot;
+		std::unordered_map<unsigned int, Record> records;
+	};
+	Shard shards[SHARD_COUNT];
+
+	static size_t ShardIndexOf(const unsigned int pid)
+	{
+		// Windows PIDs are multiples of 4
+		return (pid >> 2) % SHARD_COUNT;
+	}
+	Shard& ShardOf(const unsigned int pid)
+	{
+		return shards[ShardIndexOf(pid)];
+	}
+	const Shard& ShardOf(const unsigned int pid) const
+	{
+		return shards[ShardIndexOf(pid)];
+	}
+	// record for key, created or started over as needed (caller holds the shard lock)
+	static Record& AcquireRecord(Shard& shard, const ProcessKey& key)
+	{
+		Record& record = shard.records[key.pid];
+		record.set_start_time(key.startTime);
+		return record;
+	}
+	// record for key, NULL if there is none or it is another process's (caller holds the shard lock)
+	static const Record* FindRecord(const Shard& shard, const ProcessKey& key)
+	{
+		auto i = shard.records.find(key.pid);
+		return (i != shard.records.end() && i->second.is_process(key)) ? &i->second : nullptr;
 	}
 
-	void set_byName(const unsigned int pid, const valueName valName, const unsigned long nVal)
+public:
+	template <typename Metric>
+	void set(const ProcessKey& key, const typename Metric::type& value)
 	{
-		std::lock_guard<std::mutex> lock(prot);
-		mapNamedULONGs[pid][valName] = nVal;
+		Shard& shard = ShardOf(key.pid);
+		std::lock_guard<std::mutex> lock(shard.prot);
+		AcquireRecord(shard, key).template set<Metric>(value);
 		// a safety catch for infinite growth (client didn't call erase)
-		_ASSERT(mapNamedULONGs.size() < 1000 && mapNamedULONGs[pid].size() < 1000);
+		_ASSERT(shard.records.size() < MAX_EXPECTED_RECORDS);
+	}
+	// false (and value initialized) if the metric was never set for this process
+	template <typename Metric>
+	bool get(const ProcessKey& key, typename Metric::type& value) const
+	{
+		const Shard& shard = ShardOf(key.pid);
+		std::lock_guard<std::mutex> lock(shard.prot);
+		const Record* record = FindRecord(shard, key);
+		if (!record || !record->template has<Metric>())
+		{
+			value = typename Metric::type();
+			return false;
+		}
+		value = record->template get<Metric>();
+		return true;
+	}
+
+	// fn(Record&) under the PID's shard lock, creating the record if needed
+	template <typename FnT>
+	void update(const ProcessKey& key, FnT fn)
+	{
+		Shard& shard = ShardOf(key.pid);
+		std::lock_guard<std::mutex> lock(shard.prot);
+		fn(AcquireRecord(shard, key));
+		_ASSERT(shard.records.size() < MAX_EXPECTED_RECORDS);
+	}
+	// copy of all the process's metrics, false if there is no record
+	bool get_record(const ProcessKey& key, Record& record) const
+	{
+		const Shard& shard = ShardOf(key.pid);
+		std::lock_guard<std::mutex> lock(shard.prot);
+		const Record* found = FindRecord(shard, key);
+		if (!found)
+		{
+			return false;
+		}
+		record = *found;
+		return true;
 	}
-	bool get_byName(const unsigned int pid, const valueName valName, unsigned long& nVal)
+	// fn(pid, const Record&) for every record, a shard at a time
+	template <typename FnT>
+	void for_each(FnT fn) const
 	{
-		std::lock_guard<std::mutex> lock(prot);
-		auto& i = mapNamedULONGs.find(pid);
-		if (i != mapNamedULONGs.end())
+		for (auto& shard : shards)
 		{
-			auto i2 = i->second.find(valName);
-			if (i2 != i->second.end())
+			std::lock_guard<std::mutex> lock(shard.prot);
+			for (auto& i : shard.records)
 			{
-				nVal = i2->second;
-				return true;
+				fn(i.first, i.second);
 			}
 		}
-		nVal = 0;
-		return false;
 	}
 
-	void set_byName(const unsigned int pid, const valueName valName, const unsigned __int64 nVal)
+	// merges a tick's records (sorted by PID, one per PID, with start times if known) into the cache and,
+	// unless keepAbsent, erases every PID not in it, appending those to removed if given. Returns the count erased.
+	// The tick is bucketed by shard once (a stable counting sort, so each bucket stays PID sorted), then each
+	// shard is locked once and its sorted PIDs merged against its bucket.
+	size_t apply_tick(const std::vector<Entry>& tick, std::vector<unsigned int>* removed = nullptr, const bool keepAbsent = false)
 	{
-		std::lock_guard<std::mutex> lock(prot);
-		mapNamedULONGLONGs[pid][valName] = nVal;
-		// a safety catch for infinite growth (client didn't call erase)
-		_ASSERT(mapNamedULONGLONGs.size() < 1000 && mapNamedULONGLONGs[pid].size() < 1000);
+		_ASSERT(std::is_sorted(tick.begin(), tick.end(), [](const Entry& a, const Entry& b) { return a.first < b.first; }));
+		size_t bucketStart[SHARD_COUNT + 1] = {};
+		for (auto& entry : tick)
+		{
+			bucketStart[ShardIndexOf(entry.first) + 1]++;
+		}
+		for (size_t shardIndex = 0; shardIndex < SHARD_COUNT; shardIndex++)
+		{
+			bucketStart[shardIndex + 1] += bucketStart[shardIndex];
+		}
+		std::vector<const Entry*> buckets(tick.size());
+		{
+			size_t next[SHARD_COUNT];
+			std::copy(bucketStart, bucketStart + SHARD_COUNT, next);
+			for (auto& entry : tick)
+			{
+				buckets[next[ShardIndexOf(entry.first)]++] = &entry;
+			}
+		}
+
+		size_t erased = 0;
+		std::vector<unsigned int> pids;
+		for (size_t shardIndex = 0; shardIndex < SHARD_COUNT; shardIndex++)
+		{
+			const Entry* const* bucket = buckets.data() + bucketStart[shardIndex];
+			const Entry* const* bucketEnd = buckets.data() + bucketStart[shardIndex + 1];
+			Shard& shard = shards[shardIndex];
+			std::lock_guard<std::mutex> lock(shard.prot);
+			if (!keepAbsent)
+			{
+				pids.clear();
+				for (auto& i : shard.records)
+				{
+					pids.push_back(i.first);
+				}
+				std::sort(pids.begin(), pids.end());
+				const Entry* const* present = bucket;
+				for (const unsigned int pid : pids)
+				{
+					while (present != bucketEnd && (*present)->first < pid)
+					{
+						++present;
+					}
+					if (present == bucketEnd || (*present)->first != pid)
+					{
+						if (removed)
+						{
+							removed->push_back(pid);
+						}
+						shard.records.erase(pid);
+						erased++;
+					}
+				}
+			}
+			for (; bucket != bucketEnd; ++bucket)
+			{
+				shard.records[(*bucket)->first].merge((*bucket)->second);
+			}
+			_ASSERT(shard.records.size() < MAX_EXPECTED_RECORDS);
+		}
+		return erased;
 	}
 
-	bool get_byName(const unsigned int pid, const valueName valName, unsigned __int64& nVal)
+	// replaces the snapshot's records with a copy of every record (each shard is copied under its lock)
+	void fill_snapshot(ProcessCacheSnapshot<Schema>& snapshot) const
 	{
-		std::lock_guard<std::mutex> lock(prot);
-		auto& i = mapNamedULONGLONGs.find(pid);
-		if (i != mapNamedULONGLONGs.end())
+		snapshot.clear();
+		for (auto& shard : shards)
 		{
-			auto i2 = i->second.find(valName);
-			if (i2 != i->second.end())
+			std::lock_guard<std::mutex> lock(shard.prot);
+			for (auto& i : shard.records)
 			{
-				nVal = i2->second;
-				return true;
+				snapshot.add(i.first, i.second);
 			}
 		}
-		nVal = 0;
-		return false;
+		snapshot.finish();
 	}
 
-	// old specific methods, todo: switch to above
-	void set_CPUUse(const unsigned int pid, const double cpuUse)
+	// erases the process's record, leaving a newer process's with the same PID
+	void erase(const ProcessKey& key)
 	{
-		std::lock_guard<std::mutex> lock(prot);
-		mapCPUUse[pid] = cpuUse;
-		// a safety catch for infinite growth (client didn't call erase)
-		_ASSERT(mapCPUUse.size() < 1000);
+		Shard& shard = ShardOf(key.pid);
+		std::lock_guard<std::mutex> lock(shard.prot);
+		if (FindRecord(shard, key))
+		{
+			shard.records.erase(key.pid);
+		}
 	}
-	bool get_CPUUse(const unsigned int pid, double& cpuUse)
+	void clear()
 	{
-		std::lock_guard<std::mutex> lock(prot);
-		auto i = mapCPUUse.find(pid);
-		if (i == mapCPUUse.end())
+		for (auto& shard : shards)
 		{
-			cpuUse = 0;
-			return false;
+			std::lock_guard<std::mutex> lock(shard.prot);
+			shard.records.clear();
 		}
-		cpuUse = i->second;
-		return true;
 	}
+	size_t size() const
+	{
+		size_t count = 0;
+		for (auto& shard : shards)
+		{
+			std::lock_guard<std::mutex> lock(shard.prot);
+			count += shard.records.size();
+		}
+		return count;
+	}
+};
+
+template <typename Schema>
+class ProcessCacheSnapshot
+{
+public:
+	typedef typename ProcessCacheT<Schema>::Record Record;
+	typedef typename ProcessCacheT<Schema>::Entry Entry;
+
+private:
+	std::vector<Entry> entries;		// by PID once finished
+	unsigned long long tick = 0;
+	mutable std::atomic<unsigned int> readers{ 0 };	// References held, and acquires in progress
+
+	template <typename> friend class ProcessCacheSnapshotPublisher;
 
-	void set_AverageCPU(const unsigned int pid, const double cpu)
+public:
+	// building, by the sampler before publishing
+	void clear()
 	{
-		std::lock_guard<std::mutex> lock(prot);
-		mapAverageCPU[pid] = cpu;
-		// a safety catch for infinite growth (client didn't call erase)
-		_ASSERT(mapAverageCPU.size() < 1000);
+		entries.clear();
+	}
+	void add(const unsigned int pid, const Record& record)
+	{
+		entries.emplace_back(pid, record);
 	}
-	bool get_AverageCPU(const unsigned int pid, double& cpu)
+	void finish()
 	{
-		std::lock_guard<std::mutex> lock(prot);
-		auto i = mapAverageCPU.find(pid);
-		if (i == mapAverageCPU.end())
+		std::sort(entries.begin(), entries.end(),
+			[](const Entry& a, const Entry& b) { return a.first < b.first; });
+	}
+
+	// reading
+	const Record* find(const ProcessKey& key) const
+	{
+		auto i = std::lower_bound(entries.begin(), entries.end(), key.pid,
+			[](const Entry& entry, const unsigned int pid) { return entry.first < pid; });
+		return (i != entries.end() && i->first == key.pid && i->second.is_process(key)) ? &i->second : nullptr;
+	}
+	template <typename Metric>
+	bool get(const ProcessKey& key, typename Metric::type& value) const
+	{
+		const Record* record = find(key);
+		if (!record || !record->template has<Metric>())
 		{
-			cpu = 0;
+			value = typename Metric::type();
 			return false;
 		}
-		cpu = i->second;
+		value = record->template get<Metric>();
 		return true;
 	}
+	size_t size() const
+	{
+		return entries.size();
+	}
+	typename std::vector<Entry>::const_iterator begin() const
+	{
+		return entries.begin();
+	}
+	typename std::vector<Entry>::const_iterator end() const
+	{
+		return entries.end();
+	}
+	// publication count, 0 if never published
+	unsigned long long get_tick() const
+	{
+		return tick;
+	}
+};
+
+template <typename Schema>
+class ProcessCacheSnapshotPublisher
+{
+	typedef ProcessCacheSnapshot<Schema> Snapshot;
+
+	std::vector<std::unique_ptr<Snapshot>> snapshots;	// every snapshot handed out, sampler only
+	std::atomic<Snapshot*> current{ nullptr };
+	unsigned long long lastTick = 0;		// sampler only
+
+public:
+	// a reader's hold on a published snapshot, which stays unchanged until the reference is released
+	// references must be released before the publisher is destroyed
+	class Reference
+	{
+		const Snapshot* snapshot = nullptr;
+
+		friend class ProcessCacheSnapshotPublisher;
+		explicit Reference(const Snapshot* held) : snapshot(held) {}
+
+	public:
+		Reference() {}
+		Reference(Reference&& other) noexcept : snapshot(other.snapshot)
+		{
+			other.snapshot = nullptr;
+		}
+		Reference& operator = (Reference&& other) noexcept
+		{
+			if (this != &other)
+			{
+				reset();
+				snapshot = other.snapshot;
+				other.snapshot = nullptr;
+			}
+			return *this;
+		}
+		Reference(const Reference&) = delete;
+		Reference& operator = (const Reference&) = delete;
+		~Reference()
+		{
+			reset();
+		}
+
+		void reset()
+		{
+			if (snapshot)
+			{
+				// release: this reader's reads happen before the sampler's reuse
+				snapshot->readers.fetch_sub(1, std::memory_order_release);
+				snapshot = nullptr;
+			}
+		}
+		const Snapshot* get() const
+		{
+			return snapshot;
+		}
+		const Snapshot& operator * () const
+		{
+			return *snapshot;
+		}
+		const Snapshot* operator -> () const
+		{
+			return snapshot;
+		}
+		explicit operator bool () const
+		{
+			return snapshot != nullptr;
+		}
+	};
+
+	ProcessCacheSnapshotPublisher()
+	{
+		snapshots.push_back(std::make_unique<Snapshot>());
+		current = snapshots.back().get();
+	}
+	ProcessCacheSnapshotPublisher(const ProcessCacheSnapshotPublisher&) = delete;
+	ProcessCacheSnapshotPublisher& operator = (const ProcessCacheSnapshotPublisher&) = delete;
 
-	void set_PrivateBytes(const unsigned int pid, const unsigned __int64 nPrivateBytes)
+	// an empty snapshot for the sampler to fill and publish, an unpublished one no reader holds if any
+	Snapshot* begin_snapshot()
 	{
-		std::lock_guard<std::mutex> lock(prot);
-		mapPrivateWorkingSet[pid] = nPrivateBytes;
-		// a safety catch for infinite growth (client didn't call erase)
-		_ASSERT(mapPrivateWorkingSet.size() < 1000);
+		const Snapshot* published = current.load(std::memory_order_relaxed);	// only the sampler stores it
+		for (auto& snapshot : snapshots)
+		{
+			// seq_cst as in acquire: a reader whose increment this load misses then finds the snapshot is no
+			// longer current and backs off without reading it
+			if (snapshot.get() != published && !snapshot->readers.load(std::memory_order_seq_cst))
+			{
+				// pairs with the release in Reference::reset, so what readers read happens before the refill
+				std::atomic_thread_fence(std::memory_order_acquire);
+				snapshot->clear();
+				return snapshot.get();
+			}
+		}
+		snapshots.push_back(std::make_unique<Snapshot>());
+		return snapshots.back().get();
 	}
-	bool get_PrivateBytes(const unsigned int pid, unsigned __int64& nPrivateBytes)
+	// makes snapshot (finished) current, the sampler must not modify it afterwards
+	void publish(Snapshot* snapshot)
 	{
-		std::lock_guard<std::mutex> lock(prot);
-		auto i = mapPrivateWorkingSet.find(pid);
-		if (i == mapPrivateWorkingSet.end())
+		snapshot->tick = ++lastTick;
+		current.store(snapshot, std::memory_order_seq_cst);
+	}
+	// the current snapshot, unchanged for as long as the caller holds the reference. Lock free.
+	Reference acquire() const
+	{
+		for (;;)
 		{
-			nPrivateBytes = 0;
-			return false;
+			Snapshot* snapshot = current.load(std::memory_order_seq_cst);
+			snapshot->readers.fetch_add(1, std::memory_order_seq_cst);
+			// still current, so the sampler can't have started reusing it before the increment
+			if (current.load(std::memory_order_seq_cst) == snapshot)
+			{
+				return Reference(snapshot);
+			}
+			snapshot->readers.fetch_sub(1, std::memory_order_release);
 		}
-		nPrivateBytes = i->second;
-		return true;
+	}
+};
+
+class ProcessCache
+{
+public:
+	enum valueName {
+		CacheValThreadCount,
+		CacheValIODelta,
+		CacheRunningState,
+		CacheCPUTimeTotal
+	};
+
+	// metric tags of the original interface
+	struct CPUUse { typedef double type; };
+	struct AverageCPU { typedef double type; };
+	struct PrivateBytes { typedef unsigned __int64 type; };
+	template <valueName name> struct NamedULONG { typedef unsigned long type; };
+	template <valueName name> struct NamedULONGLONG { typedef unsigned __int64 type; };
+
+	typedef ProcessCacheSchema<CPUUse, AverageCPU, PrivateBytes,
+		NamedULONG<CacheValThreadCount>, NamedULONG<CacheValIODelta>, NamedULONG<CacheRunningState>, NamedULONG<CacheCPUTimeTotal>,
+		NamedULONGLONG<CacheValThreadCount>, NamedULONGLONG<CacheValIODelta>, NamedULONGLONG<CacheRunningState>, NamedULONGLONG<CacheCPUTimeTotal>> Schema;
+
+	typedef ProcessCacheSnapshot<Schema> Snapshot;
+	typedef ProcessCacheSnapshotPublisher<Schema>::Reference SnapshotReference;
+
+private:
+	ProcessCacheT<Schema> cache;
+	ProcessCacheSnapshotPublisher<Schema> publisher;
+	std::mutex publishing;	// in case more than one thread publishes
+	std::unique_ptr<ProcessHistory> history;
+
+	// runtime valueName to its metric tag
+	template <template <valueName> class MetricT, typename T>
+	void set_named(const ProcessKey& key, const valueName valName, const T nVal)
+	{
+		switch (valName)
+		{
+		case CacheValThreadCount:
+			cache.set<MetricT<CacheValThreadCount>>(key, nVal);
+			break;
+		case CacheValIODelta:
+			cache.set<MetricT<CacheValIODelta>>(key, nVal);
+			break;
+		case CacheRunningState:
+			cache.set<MetricT<CacheRunningState>>(key, nVal);
+			break;
+		case CacheCPUTimeTotal:
+			cache.set<MetricT<CacheCPUTimeTotal>>(key, nVal);
+			break;
+		}
+	}
+	template <template <valueName> class MetricT, typename T>
+	bool get_named(const ProcessKey& key, const valueName valName, T& nVal) const
+	{
+		switch (valName)
+		{
+		case CacheValThreadCount:
+			return cache.get<MetricT<CacheValThreadCount>>(key, nVal);
+		case CacheValIODelta:
+			return cache.get<MetricT<CacheValIODelta>>(key, nVal);
+		case CacheRunningState:
+			return cache.get<MetricT<CacheRunningState>>(key, nVal);
+		case CacheCPUTimeTotal:
+			return cache.get<MetricT<CacheCPUTimeTotal>>(key, nVal);
+		}
+		nVal = 0;
+		return false;
+	}
+
+public:
+	// the underlying cache, for multi-metric access (update, get_record)
+	ProcessCacheT<Schema>& get_cache()
+	{
+		return cache;
+	}
+
+	enum historyMetric {
+		HistoryCPUUse,
+		HistoryPrivateBytes,
+		HistoryMetricCount
+	};
+	// keep the last samplesPerSeries values of set_CPUUse and set_PrivateBytes. Call before sampling starts.
+	void enable_history(const size_t samplesPerSeries, const size_t maxProcessCount = 2048)
+	{
+		history = std::make_unique<ProcessHistory>(HistoryMetricCount, samplesPerSeries, maxProcessCount);
+	}
+	// NULL unless enable_history was called
+	const ProcessHistory* get_history() const
+	{
+		return history.get();
+	}
+
+	void erase(const ProcessKey& key)
+	{
+		cache.erase(key);
+		if (history)
+		{
+			history->erase(key);
+		}
+	}
+
+	typedef ProcessCacheT<Schema>::Entry TickEntry;
+	// sampler: a whole tick at once (see ProcessCacheT::apply_tick), PIDs absent from it are erased.
+	// Optionally publishes the result as the new snapshot.
+	size_t apply_tick(const std::vector<TickEntry>& tick, const bool publish = true)
+	{
+		std::vector<unsigned int> removed;
+		const size_t erased = cache.apply_tick(tick, &removed);
+		if (history)
+		{
+			for (auto pid : removed)
+			{
+				history->erase(pid);
+			}
+			for (auto& entry : tick)
+			{
+				if (entry.second.has<CPUUse>())
+				{
+					history->append(ProcessKey(entry.first, entry.second.get_start_time()), HistoryCPUUse, entry.second.get<CPUUse>());
+				}
+				if (entry.second.has<PrivateBytes>())
+				{
+					history->append(ProcessKey(entry.first, entry.second.get_start_time()), HistoryPrivateBytes, static_cast<double>(entry.second.get<PrivateBytes>()));
+				}
+			}
+		}
+		if (publish)
+		{
+			publish_snapshot();
+		}
+		return erased;
+	}
+
+	// sampler, after setting a tick's values: make them the snapshot readers see
+	void publish_snapshot()
+	{
+		std::lock_guard<std::mutex> lock(publishing);
+		Snapshot* snapshot = publisher.begin_snapshot();
+		cache.fill_snapshot(*snapshot);
+		publisher.publish(snapshot);
+	}
+	// readers: every PID's metrics as of the last publish_snapshot, without locking
+	SnapshotReference acquire_snapshot() const
+	{
+		return publisher.acquire();
+	}
+
+	void set_byName(const ProcessKey& key, const valueName valName, const unsigned long nVal)
+	{
+		set_named<NamedULONG>(key, valName, nVal);
+	}
+	bool get_byName(const ProcessKey& key, const valueName valName, unsigned long& nVal)
+	{
+		return get_named<NamedULONG>(key, valName, nVal);
+	}
+
+	void set_byName(const ProcessKey& key, const valueName valName, const unsigned __int64 nVal)
+	{
+		set_named<NamedULONGLONG>(key, valName, nVal);
+	}
+	bool get_byName(const ProcessKey& key, const valueName valName, unsigned __int64& nVal)
+	{
+		return get_named<NamedULONGLONG>(key, valName, nVal);
+	}
+
+	void set_CPUUse(const ProcessKey& key, const double cpuUse)
+	{
+		cache.set<CPUUse>(key, cpuUse);
+		if (history)
+		{
+			history->append(key, HistoryCPUUse, cpuUse);
+		}
+	}
+	bool get_CPUUse(const ProcessKey& key, double& cpuUse)
+	{
+		return cache.get<CPUUse>(key, cpuUse);
+	}
+
+	void set_AverageCPU(const ProcessKey& key, const double cpu)
+	{
+		cache.set<AverageCPU>(key, cpu);
+	}
+	bool get_AverageCPU(const ProcessKey& key, double& cpu)
+	{
+		return cache.get<AverageCPU>(key, cpu);
 	}
 
+	void set_PrivateBytes(const ProcessKey& key, const unsigned __int64 nPrivateBytes)
+	{
+		cache.set<PrivateBytes>(key, nPrivateBytes);
+		if (history)
+		{
+			history->append(key, HistoryPrivateBytes, static_cast<double>(nPrivateBytes));
+		}
+	}
+	bool get_PrivateBytes(const ProcessKey& key, unsigned __int64& nPrivateBytes)
+	{
+		return cache.get<PrivateBytes>(key, nPrivateBytes);
+	}
 };
@@ -0,0 +1,311 @@
+#pragma once
+// ProcessHistory
+//  the last N samples of each metric of each process, for averages and sparklines
+//  every PID gets a slot in an arena allocated once at construction, as struct-of-arrays: the samples of
+//  all series (slot x metric) are in one array, their window aggregates in others. Appending is O(1)
+//  and so are the window statistics: the mean from a running sum (re-summed once per lap of the ring to
+//  stop drift), the min and max from monotonic queues of sample positions, and an exponential moving
+//  average per series with a per metric smoothing factor.
+//  Samples are stored as float; e.g. 2048 processes x 4 metrics x 64 samples take about 4MB in all.
+//
+//  processes are ProcessKeys (or bare PIDs): a slot remembers the start time it was filled for, an append
+//  for another process with the PID starts it over and queries for another one miss
+//
+//  appends and queries take one lock, so a sampler and readers can share an instance
+//
+//  portable (no Windows dependencies)
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+#include "ProcessKey.h"
+
+class ProcessHistory
+{
+public:
+	static const size_t MAX_CAPACITY = 4096;	// queue positions are 16 bit sequence numbers
+
+	struct Stats
+	{
+		size_t count = 0;		// samples in the window, up to the capacity
+		double last = 0;
+		double mean = 0;
+		double min = 0;
+		double max = 0;
+		double ema = 0;
+	};
+
+private:
+	const size_t metricCount;
+	const size_t capacity;
+	const size_t maxProcesses;
+	mutable std::mutex prot;
+
+	std::unordered_map<unsigned int, uint32_t> mapPIDtoSlot;
+	std::vector<uint32_t> freeSlots;
+	std::vector<uint64_t> slotStartTime;	// 0 if unknown
+
+	// per metric
+	std::vector<double> emaAlpha;
+	// per series (slot * metricCount + metric)
+	std::vector<uint64_t> sampleCount;		// ever appended
+	std::vector<double> windowSum;
+	std::vector<double> ema;
+	std::vector<uint16_t> minHead, minSize;
+	std::vector<uint16_t> maxHead, maxSize;
+	// per series x capacity
+	std::vector<float> samples;			// ring, sample n at n % capacity
+	std::vector<uint16_t> minQueue;		// sequence numbers with increasing values
+	std::vector<uint16_t> maxQueue;		// and decreasing
+
+	size_t SeriesOf(const uint32_t slot, const size_t metric) const
+	{
+		return slot * metricCount + metric;
+	}
+	float SampleAt(const size_t series, const uint64_t newest, const uint16_t sequence) const
+	{
+		// the full sequence number is within capacity of the newest
+		const uint64_t full = newest - static_cast<uint16_t>(static_cast<uint16_t>(newest) - sequence);
+		return samples[series * capacity + full % capacity];
+	}
+	// push sequence (value) on a monotonic queue, dropping entries it supersedes and ones out of the window
+	template <typename CompareT>
+	void PushQueue(std::vector<uint16_t>& queue, uint16_t& head, uint16_t& size, const size_t series, const uint64_t sequence, const float value, CompareT isSuperseded)
+	{
+		uint16_t* ring = &queue[series * capacity];
+		// first drop what left the window, its ring cell now holds the new sample
+		while (size && static_cast<uint16_t>(static_cast<uint16_t>(sequence) - ring[head]) >= capacity)
+		{
+			head = static_cast<uint16_t>((head + 1) % capacity);
+			size--;
+		}
+		while (size && isSuperseded(SampleAt(series, sequence, ring[(head + size - 1) % capacity]), value))
+		{
+			size--;
+		}
+		ring[(head + size) % capacity] = static_cast<uint16_t>(sequence);
+		size++;
+	}
+	void AppendSeries(const size_t series, const size_t metric, const float value)
+	{
+		const uint64_t sequence = sampleCount[series];
+		const size_t position = sequence % capacity;
+		float& sample = samples[series * capacity + position];
+		if (sequence >= capacity)
+		{
+			windowSum[series] -= sample;
+		}
+		sample = value;
+		windowSum[series] += value;
+		if (position == capacity - 1)
+		{
+			// once per lap, re-sum so rounding error doesn't accumulate
+			double sum = 0;
+			for (size_t i = 0; i < capacity; i++)
+			{
+				sum += samples[series * capacity + i];
+			}
+			windowSum[series] = sum;
+		}
+		ema[series] = sequence ? ema[series] + emaAlpha[metric] * (value - ema[series]) : value;
+		PushQueue(minQueue, minHead[series], minSize[series], series, sequence, value, [](const float queued, const float v) { return queued >= v; });
+		PushQueue(maxQueue, maxHead[series], maxSize[series], series, sequence, value, [](const float queued, const float v) { return queued <= v; });
+		sampleCount[series] = sequence + 1;
+	}
+	// slot for key, allocating one (or starting over a reused PID's) if needed. Returns false when the arena is full.
+	bool GetSlot(const ProcessKey& key, uint32_t& slot)
+	{
+		auto i = mapPIDtoSlot.find(key.pid);
+		if (i != mapPIDtoSlot.end())
+		{
+			slot = i->second;
+			if (key.startTime && slotStartTime[slot] != key.startTime)
+			{
+				if (slotStartTime[slot])
+				{
+					ResetSlot(slot);
+				}
+				slotStartTime[slot] = key.startTime;
+			}
+			return true;
+		}
+		if (freeSlots.empty())
+		{
+			return false;
+		}
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+		mapPIDtoSlot[key.pid] = slot;
+		slotStartTime[slot] = key.startTime;
+		return true;
+	}
+	// existing slot of key's process, false if none
+	bool FindSlot(const ProcessKey& key, uint32_t& slot) const
+	{
+		auto i = mapPIDtoSlot.find(key.pid);
+		if (i == mapPIDtoSlot.end() || !ProcessKey(key.pid, slotStartTime[i->second]).IsSameProcess(key))
+		{
+			return false;
+		}
+		slot = i->second;
+		return true;
+	}
+	void ResetSlot(const uint32_t slot)
+	{
+		for (size_t metric = 0; metric < metricCount; metric++)
+		{
+			const size_t series = SeriesOf(slot, metric);
+			sampleCount[series] = 0;
+			windowSum[series] = 0;
+			ema[series] = 0;
+			minHead[series] = minSize[series] = 0;
+			maxHead[series] = maxSize[series] = 0;
+		}
+		slotStartTime[slot] = 0;
+	}
+
+public:
+	// capacity samples per series (at most MAX_CAPACITY), for up to maxProcessCount PIDs at a time
+	ProcessHistory(const size_t metrics, const size_t samplesPerSeries, const size_t maxProcessCount = 2048)
+		: metricCount(metrics), capacity(samplesPerSeries < 1 ? 1 : (samplesPerSeries > MAX_CAPACITY ? MAX_CAPACITY : samplesPerSeries)), maxProcesses(maxProcessCount)
+	{
+		const size_t seriesCount = maxProcesses * metricCount;
+		// by default the EMA's center of mass is half the window
+		emaAlpha.assign(metricCount, 2.0 / (capacity + 1));
+		sampleCount.assign(seriesCount, 0);
+		windowSum.assign(seriesCount, 0);
+		ema.assign(seriesCount, 0);
+		minHead.assign(seriesCount, 0);
+		minSize.assign(seriesCount, 0);
+		maxHead.assign(seriesCount, 0);
+		maxSize.assign(seriesCount, 0);
+		samples.assign(seriesCount * capacity, 0);
+		minQueue.assign(seriesCount * capacity, 0);
+		maxQueue.assign(seriesCount * capacity, 0);
+		slotStartTime.assign(maxProcesses, 0);
+		freeSlots.reserve(maxProcesses);
+		for (size_t i = maxProcesses; i > 0; i--)
+		{
+			freeSlots.push_back(static_cast<uint32_t>(i - 1));
+		}
+		mapPIDtoSlot.reserve(maxProcesses);
+	}
+
+	size_t get_capacity() const
+	{
+		return capacity;
+	}
+	size_t get_metric_count() const
+	{
+		return metricCount;
+	}
+	// weight of the newest sample in the metric's EMA, 0 < alpha <= 1
+	void set_ema_alpha(const size_t metric, const double alpha)
+	{
+		std::lock_guard<std::mutex> lock(prot);
+		emaAlpha[metric] = alpha;
+	}
+
+	// false if the arena has no free slot for a new PID
+	bool append(const ProcessKey& key, const size_t metric, const double value)
+	{
+		std::lock_guard<std::mutex> lock(prot);
+		uint32_t slot;
+		if (!GetSlot(key, slot))
+		{
+			return false;
+		}
+		AppendSeries(SeriesOf(slot, metric), metric, static_cast<float>(value));
+		return true;
+	}
+	// one sample of every metric (values has get_metric_count entries)
+	bool append_all(const ProcessKey& key, const double* values)
+	{
+		std::lock_guard<std::mutex> lock(prot);
+		uint32_t slot;
+		if (!GetSlot(key, slot))
+		{
+			return false;
+		}
+		for (size_t metric = 0; metric < metricCount; metric++)
+		{
+			AppendSeries(SeriesOf(slot, metric), metric, static_cast<float>(values[metric]));
+		}
+		return true;
+	}
+
+	// statistics over the window, false if the series has no samples
+	bool get_stats(const ProcessKey& key, const size_t metric, Stats& stats) const
+	{
+		std::lock_guard<std::mutex> lock(prot);
+		stats = Stats();
+		uint32_t slot;
+		if (!FindSlot(key, slot))
+		{
+			return false;
+		}
+		const size_t series = SeriesOf(slot, metric);
+		const uint64_t count = sampleCount[series];
+		if (!count)
+		{
+			return false;
+		}
+		const uint64_t newest = count - 1;
+		stats.count = static_cast<size_t>(count < capacity ? count : capacity);
+		stats.last = samples[series * capacity + newest % capacity];
+		stats.mean = windowSum[series] / stats.count;
+		stats.min = SampleAt(series, newest, minQueue[series * capacity + minHead[series]]);
+		stats.max = SampleAt(series, newest, maxQueue[series * capacity + maxHead[series]]);
+		stats.ema = ema[series];
+		return true;
+	}
+	// the window's samples, oldest first. Returns the count.
+	size_t get_samples(const ProcessKey& key, const size_t metric, std::vector<float>& window) const
+	{
+		std::lock_guard<std::mutex> lock(prot);
+		window.clear();
+		uint32_t slot;
+		if (!FindSlot(key, slot))
+		{
+			return 0;
+		}
+		const size_t series = SeriesOf(slot, metric);
+		const uint64_t count = sampleCount[series];
+		for (uint64_t sequence = count > capacity ? count - capacity : 0; sequence < count; sequence++)
+		{
+			window.push_back(samples[series * capacity + sequence % capacity]);
+		}
+		return window.size();
+	}
+
+	// erases the process's history, leaving a newer process's with the same PID
+	void erase(const ProcessKey& key)
+	{
+		std::lock_guard<std::mutex> lock(prot);
+		uint32_t slot;
+		auto i = mapPIDtoSlot.find(key.pid);
+		if (i != mapPIDtoSlot.end() && FindSlot(key, slot))
+		{
+			ResetSlot(i->second);
+			freeSlots.push_back(i->second);
+			mapPIDtoSlot.erase(i);
+		}
+	}
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(prot);
+		for (auto& i : mapPIDtoSlot)
+		{
+			ResetSlot(i.second);
+			freeSlots.push_back(i.second);
+		}
+		mapPIDtoSlot.clear();
+	}
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(prot);
+		return mapPIDtoSlot.size();
+	}
+};
@@ -6,11 +6,17 @@
 #include <atlstr.h>
 #include <map>
 #include <set>
+#include <unordered_map>
 #include <mutex>
 #include "WindowsConsts.h"
 #include "DebugOutToggles.h"
+#include "ProcessKey.h"
 
 // manages a process icon imagelist for a listview
+// icons are reference counted by filename. Tracking by process (AddTrackedProcess) remembers each process's
+// filename and start time under its PID, so removal needs only the key, and a process that isn't tracked (or a
+// reused PID) can't release another's reference. Keys match as ProcessKey::IsSameProcess, so a start time of 0
+// on either side matches whatever instance is tracked under the PID.
 class ProcessIconImageList
 {
 	const int _Imagelist_MaxSize = 256;
@@ -19,6 +25,23 @@ class ProcessIconImageList
 	std::mutex mutexMaps;
 	std::map<const int, int> mapImgIdxToRefCount;
 	std::map<const ATL::CString, int> mapFilenameToImgIdx;
+	struct TrackedProcess
+	{
+		uint64_t startTime;
+		ATL::CString csFilename;
+	};
+	std::unordered_map<uint32_t, TrackedProcess> mapPIDToTrackedProcess;
+
+	// the entry tracked for the key's process, end() if none (or the PID's is another process's)
+	std::unordered_map<uint32_t, TrackedProcess>::iterator FindTrackedProcess(const ProcessKey& key)
+	{
+		auto i = mapPIDToTrackedProcess.find(key.pid);
+		if (i != mapPIDToTrackedProcess.end() && !ProcessKey(key.pid, i->second.startTime).IsSameProcess(key))
+		{
+			return mapPIDToTrackedProcess.end();
+		}
+		return i;
+	}
 
 	HICON GetIconForFilename(const WCHAR* pwszFilename)
 	{
@@ -95,10 +118,72 @@ public:
 		return hImageList;
 	}
 	int GetImageListIndexForFilename(const WCHAR* pwszFile)
+	{
+		std::lock_guard<std::mutex> guard(mutexMaps);
+		return GetImageListIndexForFilenameLocked(pwszFile);
+	}
+	void AddTrackedFilename(const WCHAR* pwszFile, bool* pbOutWentToDisk = NULL)
+	{
+		std::lock_guard<std::mutex> guard(mutexMaps);
+		AddTrackedFilenameLocked(pwszFile, pbOutWentToDisk);
+	}
+	void RemoveTrackedFilename(const WCHAR* pwszFile)
+	{
+		std::lock_guard<std::mutex> guard(mutexMaps);
+		RemoveTrackedFilenameLocked(pwszFile);
+	}
+
+	// as above, per process instance. Adding a process already tracked does nothing.
+	int GetImageListIndexForProcess(const ProcessKey& key)
+	{
+		std::lock_guard<std::mutex> guard(mutexMaps);
+		auto i = FindTrackedProcess(key);
+		return i != mapPIDToTrackedProcess.end() ? GetImageListIndexForFilenameLocked(i->second.csFilename) : nFailsafeIconIndex;
+	}
+	void AddTrackedProcess(const ProcessKey& key, const WCHAR* pwszFile, bool* pbOutWentToDisk = NULL)
+	{
+		std::lock_guard<std::mutex> guard(mutexMaps);
+		auto i = mapPIDToTrackedProcess.find(key.pid);
+		if (i != mapPIDToTrackedProcess.end())
+		{
+			if (ProcessKey(key.pid, i->second.startTime).IsSameProcess(key))
+			{
+				if (!i->second.startTime)
+				{
+					i->second.startTime = key.startTime;
+				}
+				if (pbOutWentToDisk) *pbOutWentToDisk = false;
+				return;
+			}
+			// the PID was reused, so the process tracked under it has exited: release its reference
+			ICON_DEBUG_PRINT(L"AddTrackedProcess: %u reused, releasing %s", key.pid, i->second.csFilename.GetString());
+			const ATL::CString csPreviousFile = i->second.csFilename;
+			mapPIDToTrackedProcess.erase(i);
+			RemoveTrackedFilenameLocked(csPreviousFile);
+		}
+		mapPIDToTrackedProcess[key.pid] = TrackedProcess{ key.startTime, pwszFile };
+		AddTrackedFilenameLocked(pwszFile, pbOutWentToDisk);
+	}
+	// false if the process wasn't tracked
+	bool RemoveTrackedProcess(const ProcessKey& key)
+	{
+		std::lock_guard<std::mutex> guard(mutexMaps);
+		auto i = FindTrackedProcess(key);
+		if (i == mapPIDToTrackedProcess.end())
+		{
+			ICON_DEBUG_PRINT(L"RemoveTrackedProcess: %u not tracked", key.pid);
+			return false;
+		}
+		const ATL::CString csFile = i->second.csFilename;
+		mapPIDToTrackedProcess.erase(i);
+		RemoveTrackedFilenameLocked(csFile);
+		return true;
+	}
+private:
+	int GetImageListIndexForFilenameLocked(const WCHAR* pwszFile)
 	{
 		ATL::CString csFile = pwszFile;
 		csFile.MakeLower();
-		std::lock_guard<std::mutex> guard(mutexMaps);
 		auto i = mapFilenameToImgIdx.find(csFile);
 		if (i != mapFilenameToImgIdx.end())
 		{
@@ -108,12 +193,11 @@ public:
 		ICON_DEBUG_PRINT(L"\n ! WARNING: No icon for %s!", csFile);
 		return 0;
 	}
-	void AddTrackedFilename(const WCHAR* pwszFile, bool* pbOutWentToDisk = NULL)
+	void AddTrackedFilenameLocked(const WCHAR* pwszFile, bool* pbOutWentToDisk)
 	{
 		ATL::CString csFile = pwszFile;
 		csFile.MakeLower();
 		ICON_DEBUG_PRINT(L"\n AddTrackedFilename %s", csFile.GetString());
-		std::lock_guard<std::mutex> guard(mutexMaps);
 
 		auto i = mapFilenameToImgIdx.find(csFile);
 		if (i != mapFilenameToImgIdx.end())
@@ -144,12 +228,11 @@ public:
 		_ASSERT(mapImgIdxToRefCount.size() < 200 && mapImgIdxToRefCount.size() < 200);
 		//DumpMaps();
 	}
-	void RemoveTrackedFilename(const WCHAR* pwszFile)
+	void RemoveTrackedFilenameLocked(const WCHAR* pwszFile)
 	{
 		ATL::CString csFile = pwszFile;
 		csFile.MakeLower();
 		ICON_DEBUG_PRINT(L"\n RemoveTrackedFilename %s", csFile.GetString());
-		std::lock_guard<std::mutex> guard(mutexMaps);
 
 		// should be in the map
 		// TODO: this gets signalled, processes not always in the map
@@ -200,7 +283,6 @@ public:
 		ICON_DEBUG_PRINT(L"icon map sizes: %d %d", mapImgIdxToRefCount.size(), mapFilenameToImgIdx.size());
 		//DumpMaps();
 	}
-private:
 	void DumpMaps()
 	{
 		ICON_DEBUG_PRINT(L"map dump --------------");
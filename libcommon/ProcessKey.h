@@ -0,0 +1,81 @@
+#pragma once
+// ProcessKey
+//  identifies a process instance as (PID, start time), since Windows reuses PIDs
+//  the start time is the creation FILETIME (100ns units), or 0 when unknown, which matches any instance of
+//  the PID (IsSameProcess). Caches that store the start time with their per PID data can then tell a
+//  reused PID from the process they recorded with a compare, instead of a lookup in another map.
+//  A PID converts implicitly to a key with an unknown start time, so PID based callers keep working.
+//
+//  Win32 backend for FromPID, otherwise portable
+
+#include <cstdint>
+#include <cstddef>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+struct ProcessKey
+{
+	uint32_t pid = 0;
+	uint64_t startTime = 0;
+
+	ProcessKey() {}
+	ProcessKey(const uint32_t processId, const uint64_t processStartTime = 0) : pid(processId), startTime(processStartTime) {}
+
+	bool HasStartTime() const
+	{
+		return startTime != 0;
+	}
+	// same PID, and the same start time unless either is unknown
+	bool IsSameProcess(const ProcessKey& other) const
+	{
+		return pid == other.pid && (!startTime || !other.startTime || startTime == other.startTime);
+	}
+	bool operator == (const ProcessKey& other) const
+	{
+		return pid == other.pid && startTime == other.startTime;
+	}
+	bool operator != (const ProcessKey& other) const
+	{
+		return !(*this == other);
+	}
+	bool operator < (const ProcessKey& other) const
+	{
+		return pid != other.pid ? pid < other.pid : startTime < other.startTime;
+	}
+
+	struct Hash
+	{
+		size_t operator()(const ProcessKey& key) const
+		{
+			// fold the PID into the start time, then a 64 bit finalizer (murmur3 fmix64)
+			uint64_t hash = key.startTime ^ (static_cast<uint64_t>(key.pid) * 0x9E3779B97F4A7C15ULL);
+			hash ^= hash >> 33;
+			hash *= 0xFF51AFD7ED558CCDULL;
+			hash ^= hash >> 33;
+			hash *= 0xC4CEB9FE1A85EC53ULL;
+			hash ^= hash >> 33;
+			return static_cast<size_t>(hash);
+		}
+	};
+
+#ifdef _WIN32
+	// key of the running process with this PID, start time 0 if it can't be queried
+	static ProcessKey FromPID(const DWORD dwPid)
+	{
+		ProcessKey key(dwPid);
+		HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, dwPid);
+		if (hProcess)
+		{
+			FILETIME creationTime = {}, exitTime = {}, kernelTime = {}, userTime = {};
+			if (GetProcessTimes(hProcess, &creationTime, &exitTime, &kernelTime, &userTime))
+			{
+				key.startTime = (static_cast<uint64_t>(creationTime.dwHighDateTime) << 32) | creationTime.dwLowDateTime;
+			}
+			CloseHandle(hProcess);
+		}
+		return key;
+	}
+#endif
+};
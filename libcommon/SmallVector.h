@@ -0,0 +1,256 @@
+#pragma once
+// SmallVector
+//  vector that keeps its first N elements inside the object and only allocates beyond that
+//  for short lists built on hot paths (e.g. the fields of a split rule list), where a std::vector would
+//  allocate on every use. Once grown past N it behaves as a vector; clear keeps the capacity.
+//  Supports the common vector operations (push/emplace/pop_back, resize, reserve, indexing,
+//  contiguous iteration), not insertion or erasure in the middle.
+//
+//  portable (no Windows dependencies)
+
+#include <cstddef>
+#include <new>
+#include <memory>
+#include <utility>
+#include <initializer_list>
+#include <type_traits>
+
+template <typename T, size_t N>
+class SmallVector
+{
+	static_assert(N > 0, "SmallVector needs inline capacity");
+
+	typename std::aligned_storage<sizeof(T), alignof(T)>::type inlineStorage[N];
+	T* elements = reinterpret_cast<T*>(inlineStorage);
+	size_t count = 0;
+	size_t allocated = N;
+
+	bool IsInline() const
+	{
+		return elements == reinterpret_cast<const T*>(inlineStorage);
+	}
+	void Grow(const size_t minimumCapacity)
+	{
+		size_t newCapacity = allocated * 2;
+		if (newCapacity < minimumCapacity)
+		{
+			newCapacity = minimumCapacity;
+		}
+		T* newElements = static_cast<T*>(::operator new(newCapacity * sizeof(T)));
+		for (size_t i = 0; i < count; i++)
+		{
+			new (newElements + i) T(std::move_if_noexcept(elements[i]));
+			elements[i].~T();
+		}
+		ReleaseHeap();
+		elements = newElements;
+		allocated = newCapacity;
+	}
+	void ReleaseHeap()
+	{
+		if (!IsInline())
+		{
+			::operator delete(elements);
+		}
+	}
+	void MoveFrom(SmallVector& other)
+	{
+		if (other.IsInline())
+		{
+			for (size_t i = 0; i < other.count; i++)
+			{
+				new (elements + i) T(std::move(other.elements[i]));
+			}
+			count = other.count;
+			other.clear();
+		}
+		else
+		{
+			// take the heap block
+			elements = other.elements;
+			count = other.count;
+			allocated = other.allocated;
+			other.elements = reinterpret_cast<T*>(other.inlineStorage);
+			other.count = 0;
+			other.allocated = N;
+		}
+	}
+
+public:
+	typedef T value_type;
+	typedef T* iterator;
+	typedef const T* const_iterator;
+
+	SmallVector() {}
+	SmallVector(std::initializer_list<T> values)
+	{
+		reserve(values.size());
+		for (auto& i : values)
+		{
+			push_back(i);
+		}
+	}
+	SmallVector(const SmallVector& other)
+	{
+		*this = other;
+	}
+	SmallVector(SmallVector&& other) noexcept
+	{
+		MoveFrom(other);
+	}
+	~SmallVector()
+	{
+		clear();
+		ReleaseHeap();
+	}
+	SmallVector& operator = (const SmallVector& other)
+	{
+		if (this != &other)
+		{
+			clear();
+			reserve(other.count);
+			for (size_t i = 0; i < other.count; i++)
+			{
+				new (elements + i) T(other.elements[i]);
+			}
+			count = other.count;
+		}
+		return *this;
+	}
+	SmallVector& operator = (SmallVector&& other) noexcept
+	{
+		if (this != &other)
+		{
+			clear();
+			ReleaseHeap();
+			elements = reinterpret_cast<T*>(inlineStorage);
+			allocated = N;
+			MoveFrom(other);
+		}
+		return *this;
+	}
+
+	size_t size() const
+	{
+		return count;
+	}
+	bool empty() const
+	{
+		return !count;
+	}
+	size_t capacity() const
+	{
+		return allocated;
+	}
+	// whether the elements are still in the inline storage
+	bool is_inline() const
+	{
+		return IsInline();
+	}
+
+	T* data()
+	{
+		return elements;
+	}
+	const T* data() const
+	{
+		return elements;
+	}
+	T& operator[] (const size_t index)
+	{
+		return elements[index];
+	}
+	const T& operator[] (const size_t index) const
+	{
+		return elements[index];
+	}
+	T& front()
+	{
+		return elements[0];
+	}
+	const T& front() const
+	{
+		return elements[0];
+	}
+	T& back()
+	{
+		return elements[count - 1];
+	}
+	const T& back() const
+	{
+		return elements[count - 1];
+	}
+	iterator begin()
+	{
+		return elements;
+	}
+	iterator end()
+	{
+		return elements + count;
+	}
+	const_iterator begin() const
+	{
+		return elements;
+	}
+	const_iterator end() const
+	{
+		return elements + count;
+	}
+
+	void reserve(const size_t newCapacity)
+	{
+		if (newCapacity > allocated)
+		{
+			Grow(newCapacity);
+		}
+	}
+	template <typename... Args>
+	T& emplace_back(Args&&... args)
+	{
+		if (count == allocated)
+		{
+			Grow(count + 1);
+		}
+		T* element = new (elements + count) T(std::forward<Args>(args)...);
+		count++;
+		return *element;
+	}
+	void push_back(const T& value)
+	{
+		if (count == allocated)
+		{
+			// value may be one of the elements about to move
+			T copy(value);
+			emplace_back(std::move(copy));
+			return;
+		}
+		emplace_back(value);
+	}
+	void push_back(T&& value)
+	{
+		emplace_back(std::move(value));
+	}
+	void pop_back()
+	{
+		elements[--count].~T();
+	}
+	void resize(const size_t newCount)
+	{
+		reserve(newCount);
+		while (count > newCount)
+		{
+			pop_back();
+		}
+		while (count < newCount)
+		{
+			emplace_back();
+		}
+	}
+	void clear()
+	{
+		while (count)
+		{
+			pop_back();
+		}
+	}
+};
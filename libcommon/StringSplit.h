@@ -0,0 +1,154 @@
+#pragma once
+// StringSplit
+//  splitting a delimited string (e.g. a ; separated rule list) into fields without copying them
+//  SplitString returns a lazy range of string_views into the original text, so nothing is allocated and
+//  the text must outlive the fields. Empty fields (between adjacent delimiters, or at either end) are
+//  skipped by default, as CString::Tokenize does, or kept with SplitEmpty::Keep, in which case n delimiters
+//  always give n + 1 fields.
+//  The appending overload adds the fields to a caller's container; with a SmallVector sized for the
+//  usual field count, hot callers never allocate.
+//
+//  portable (no Windows dependencies)
+
+#include <string_view>
+#include <iterator>
+#include <cstddef>
+#include "SmallVector.h"
+
+enum class SplitEmpty
+{
+	Skip,
+	Keep
+};
+
+template <typename CharT>
+class BasicStringSplitter
+{
+	std::basic_string_view<CharT> text;
+	CharT delimiter;
+	bool keepEmpty;
+
+public:
+	class iterator
+	{
+		const BasicStringSplitter* splitter = nullptr;
+		size_t fieldStart = 0;
+		size_t fieldEnd = 0;
+		bool isDone = true;
+
+		void FindEnd()
+		{
+			fieldEnd = splitter->text.find(splitter->delimiter, fieldStart);
+			if (fieldEnd == std::basic_string_view<CharT>::npos)
+			{
+				fieldEnd = splitter->text.size();
+			}
+		}
+		void SkipEmpty()
+		{
+			while (!splitter->keepEmpty && !isDone && fieldStart == fieldEnd)
+			{
+				Advance();
+			}
+		}
+		void Advance()
+		{
+			if (fieldEnd >= splitter->text.size())
+			{
+				isDone = true;
+				return;
+			}
+			fieldStart = fieldEnd + 1;
+			FindEnd();
+		}
+
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef std::basic_string_view<CharT> value_type;
+		typedef ptrdiff_t difference_type;
+		typedef const value_type* pointer;
+		typedef value_type reference;
+
+		iterator() {}
+		explicit iterator(const BasicStringSplitter* owner) : splitter(owner), isDone(false)
+		{
+			FindEnd();
+			SkipEmpty();
+		}
+
+		value_type operator*() const
+		{
+			return splitter->text.substr(fieldStart, fieldEnd - fieldStart);
+		}
+		iterator& operator++()
+		{
+			Advance();
+			SkipEmpty();
+			return *this;
+		}
+		iterator operator++(int)
+		{
+			iterator previous = *this;
+			++*this;
+			return previous;
+		}
+		bool operator == (const iterator& other) const
+		{
+			return isDone == other.isDone && (isDone || fieldStart == other.fieldStart);
+		}
+		bool operator != (const iterator& other) const
+		{
+			return !(*this == other);
+		}
+	};
+
+	BasicStringSplitter(const std::basic_string_view<CharT> source, const CharT delim, const SplitEmpty empty = SplitEmpty::Skip)
+		: text(source), delimiter(delim), keepEmpty(empty == SplitEmpty::Keep)
+	{
+	}
+
+	iterator begin() const
+	{
+		return iterator(this);
+	}
+	iterator end() const
+	{
+		return iterator();
+	}
+};
+
+typedef BasicStringSplitter<wchar_t> StringSplitter;
+typedef BasicStringSplitter<char> StringSplitterA;
+
+inline StringSplitter SplitString(const std::wstring_view text, const wchar_t delim, const SplitEmpty empty = SplitEmpty::Skip)
+{
+	return StringSplitter(text, delim, empty);
+}
+inline StringSplitterA SplitString(const std::string_view text, const char delim, const SplitEmpty empty = SplitEmpty::Skip)
+{
+	return StringSplitterA(text, delim, empty);
+}
+
+// appends the fields to fields (a SmallVector, std::vector or anything with push_back), returns how many were added
+template <typename ContainerT>
+size_t SplitString(const std::wstring_view text, const wchar_t delim, ContainerT& fields, const SplitEmpty empty = SplitEmpty::Skip)
+{
+	size_t added = 0;
+	for (auto field : StringSplitter(text, delim, empty))
+	{
+		fields.push_back(field);
+		added++;
+	}
+	return added;
+}
+template <typename ContainerT>
+size_t SplitString(const std::string_view text, const char delim, ContainerT& fields, const SplitEmpty empty = SplitEmpty::Skip)
+{
+	size_t added = 0;
+	for (auto field : StringSplitterA(text, delim, empty))
+	{
+		fields.push_back(field);
+		added++;
+	}
+	return added;
+}
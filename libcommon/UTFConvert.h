@@ -0,0 +1,289 @@
+#pragma once
+// UTFConvert
+//  UTF-8 <-> UTF-16 transcoding without the Win32 converters or <codecvt>
+//  runs of ASCII are converted 16 code units at a time with SSE2 (the x64 baseline) and everything else
+//  by a scalar state machine that validates as it goes. Invalid input (overlong or truncated sequences,
+//  encoded or unpaired surrogates, code points past U+10FFFF) is replaced with U+FFFD, one per maximal
+//  invalid subpart, which is what MultiByteToWideChar and WideCharToMultiByte do without
+//  MB_ERR_INVALID_CHARS. Callers are told whether anything was replaced.
+//
+//  the pointer based converters write into a caller-sized buffer (see Max*Length), the Append ones
+//  into a string whose capacity is reused. Wide strings are UTF-16 where wchar_t is 16 bits (Windows)
+//  and UTF-32 where it is 32 bits, so the same calls work on POSIX.
+//  tests/UTFConvertTests.cpp fuzzes the SIMD paths against the scalar ones.
+//
+//  portable (no Windows dependencies)
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define UTFCONVERT_SSE2
+#include <emmintrin.h>
+#endif
+
+class UTFConvert
+{
+	static const char32_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+	template <typename UnitT>
+	static UnitT* PutCodePoint(UnitT* dest, const char32_t codePoint)
+	{
+		if (sizeof(UnitT) == 2 && codePoint >= 0x10000)
+		{
+			*dest++ = static_cast<UnitT>(0xD800 + ((codePoint - 0x10000) >> 10));
+			*dest++ = static_cast<UnitT>(0xDC00 + ((codePoint - 0x10000) & 0x3FF));
+			return dest;
+		}
+		*dest++ = static_cast<UnitT>(codePoint);
+		return dest;
+	}
+	static char* PutUTF8(char* dest, const char32_t codePoint)
+	{
+		if (codePoint < 0x80)
+		{
+			*dest++ = static_cast<char>(codePoint);
+		}
+		else if (codePoint < 0x800)
+		{
+			*dest++ = static_cast<char>(0xC0 | (codePoint >> 6));
+			*dest++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+		else if (codePoint < 0x10000)
+		{
+			*dest++ = static_cast<char>(0xE0 | (codePoint >> 12));
+			*dest++ = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+			*dest++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+		else
+		{
+			*dest++ = static_cast<char>(0xF0 | (codePoint >> 18));
+			*dest++ = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+			*dest++ = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+			*dest++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+		return dest;
+	}
+
+public:
+	// output buffer sizes that always suffice, in code units
+	static size_t MaxUTF16Length(const size_t utf8Length)
+	{
+		return utf8Length;
+	}
+	template <typename UnitT = wchar_t>
+	static size_t MaxUTF8Length(const size_t wideLength)
+	{
+		// 3 bytes per UTF-16 unit (a surrogate pair is 4 bytes for 2 units), 4 per UTF-32 unit
+		return wideLength * (sizeof(UnitT) == 2 ? 3 : 4);
+	}
+
+	// convert UTF-8 to UTF-16 (or UTF-32 for 4 byte units) into dest, which must hold MaxUTF16Length(length) units
+	// returns the number of units written. pIsValid, if given, is cleared if anything had to be replaced.
+	template <typename UnitT>
+	static size_t ConvertUTF8ToUTF16(const char* source, const size_t length, UnitT* dest, bool* pIsValid = nullptr, const bool useSIMD = true)
+	{
+		static_assert(sizeof(UnitT) == 2 || sizeof(UnitT) == 4, "UTF-16 or UTF-32 code units");
+		const uint8_t* p = reinterpret_cast<const uint8_t*>(source);
+		const uint8_t* end = p + length;
+		UnitT* out = dest;
+		bool isValid = true;
+		while (p < end)
+		{
+#ifdef UTFCONVERT_SSE2
+			if (sizeof(UnitT) == 2 && useSIMD)
+			{
+				// ASCII run, widened 16 bytes at a time
+				const __m128i zero = _mm_setzero_si128();
+				while (end - p >= 16)
+				{
+					const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+					if (_mm_movemask_epi8(bytes))
+					{
+						break;
+					}
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi8(bytes, zero));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_unpackhi_epi8(bytes, zero));
+					p += 16;
+					out += 16;
+				}
+				if (p >= end)
+				{
+					break;
+				}
+			}
+#endif
+			const uint8_t lead = *p;
+			if (lead < 0x80)
+			{
+				*out++ = static_cast<UnitT>(lead);
+				p++;
+				continue;
+			}
+			// expected continuation count, and the range the first continuation byte must be in to
+			// exclude overlong forms, surrogates and code points past U+10FFFF
+			int continuationCount = 0;
+			char32_t codePoint = 0;
+			uint8_t low = 0x80, high = 0xBF;
+			if (lead >= 0xC2 && lead <= 0xDF)
+			{
+				continuationCount = 1;
+				codePoint = lead & 0x1F;
+			}
+			else if (lead >= 0xE0 && lead <= 0xEF)
+			{
+				continuationCount = 2;
+				codePoint = lead & 0x0F;
+				low = lead == 0xE0 ? 0xA0 : 0x80;
+				high = lead == 0xED ? 0x9F : 0xBF;
+			}
+			else if (lead >= 0xF0 && lead <= 0xF4)
+			{
+				continuationCount = 3;
+				codePoint = lead & 0x07;
+				low = lead == 0xF0 ? 0x90 : 0x80;
+				high = lead == 0xF4 ? 0x8F : 0xBF;
+			}
+			else
+			{
+				out = PutCodePoint(out, REPLACEMENT_CHARACTER);
+				isValid = false;
+				p++;
+				continue;
+			}
+			const uint8_t* q = p + 1;
+			int i = 0;
+			for (; i < continuationCount && q < end && *q >= low && *q <= high; i++, q++)
+			{
+				codePoint = (codePoint << 6) | (*q & 0x3F);
+				low = 0x80;
+				high = 0xBF;
+			}
+			if (i != continuationCount)
+			{
+				// the bytes so far are one maximal invalid subpart, resume at the byte that didn't fit
+				out = PutCodePoint(out, REPLACEMENT_CHARACTER);
+				isValid = false;
+			}
+			else
+			{
+				out = PutCodePoint(out, codePoint);
+			}
+			p = q;
+		}
+		if (pIsValid && !isValid)
+		{
+			*pIsValid = false;
+		}
+		return static_cast<size_t>(out - dest);
+	}
+
+	// convert UTF-16 (or UTF-32 for 4 byte units) to UTF-8 into dest, which must hold MaxUTF8Length<UnitT>(length) bytes
+	// returns the number of bytes written. pIsValid, if given, is cleared if anything had to be replaced.
+	template <typename UnitT>
+	static size_t ConvertUTF16ToUTF8(const UnitT* source, const size_t length, char* dest, bool* pIsValid = nullptr, const bool useSIMD = true)
+	{
+		static_assert(sizeof(UnitT) == 2 || sizeof(UnitT) == 4, "UTF-16 or UTF-32 code units");
+		const UnitT* p = source;
+		const UnitT* end = source + length;
+		char* out = dest;
+		bool isValid = true;
+		while (p < end)
+		{
+#ifdef UTFCONVERT_SSE2
+			if (sizeof(UnitT) == 2 && useSIMD)
+			{
+				// ASCII run, narrowed 16 units at a time
+				const __m128i nonASCII = _mm_set1_epi16(static_cast<short>(0xFF80));
+				const __m128i zero = _mm_setzero_si128();
+				while (end - p >= 16)
+				{
+					const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+					const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 8));
+					const __m128i high = _mm_and_si128(_mm_or_si128(first, second), nonASCII);
+					if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) != 0xFFFF)
+					{
+						break;
+					}
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(first, second));
+					p += 16;
+					out += 16;
+				}
+				if (p >= end)
+				{
+					break;
+				}
+			}
+#endif
+			char32_t codePoint = static_cast<char32_t>(*p++);
+			if (codePoint < 0x80)
+			{
+				*out++ = static_cast<char>(codePoint);
+				continue;
+			}
+			if (sizeof(UnitT) == 2)
+			{
+				if (codePoint >= 0xD800 && codePoint <= 0xDBFF && p < end && *p >= 0xDC00 && *p <= 0xDFFF)
+				{
+					codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (static_cast<char32_t>(*p++) - 0xDC00);
+				}
+				else if (codePoint >= 0xD800 && codePoint <= 0xDFFF)
+				{
+					codePoint = REPLACEMENT_CHARACTER;
+					isValid = false;
+				}
+			}
+			else if ((codePoint >= 0xD800 && codePoint <= 0xDFFF) || codePoint > 0x10FFFF)
+			{
+				codePoint = REPLACEMENT_CHARACTER;
+				isValid = false;
+			}
+			out = PutUTF8(out, codePoint);
+		}
+		if (pIsValid && !isValid)
+		{
+			*pIsValid = false;
+		}
+		return static_cast<size_t>(out - dest);
+	}
+
+	// append the conversion to dest, reusing its capacity. Returns false if anything had to be replaced.
+	template <typename UnitT>
+	static bool AppendUTF8ToUTF16(std::basic_string<UnitT>& dest, const std::string_view source)
+	{
+		bool isValid = true;
+		const size_t start = dest.size();
+		dest.resize(start + MaxUTF16Length(source.size()));
+		dest.resize(start + ConvertUTF8ToUTF16(source.data(), source.size(), &dest[0] + start, &isValid));
+		return isValid;
+	}
+	template <typename UnitT>
+	static bool AppendUTF16ToUTF8(std::string& dest, const std::basic_string_view<UnitT> source)
+	{
+		bool isValid = true;
+		const size_t start = dest.size();
+		dest.resize(start + MaxUTF8Length<UnitT>(source.size()));
+		dest.resize(start + ConvertUTF16ToUTF8(source.data(), source.size(), &dest[0] + start, &isValid));
+		return isValid;
+	}
+	static bool AppendUTF16ToUTF8(std::string& dest, const wchar_t* source, const size_t length)
+	{
+		return AppendUTF16ToUTF8(dest, std::wstring_view(source, length));
+	}
+
+	static std::wstring ToWide(const std::string_view source)
+	{
+		std::wstring wide;
+		AppendUTF8ToUTF16(wide, source);
+		return wide;
+	}
+	static std::string ToUTF8(const std::wstring_view source)
+	{
+		std::string utf8;
+		AppendUTF16ToUTF8(utf8, source);
+		return utf8;
+	}
+};
@@ -0,0 +1,139 @@
+#pragma once
+// WildcardMatchCache
+//  remembers which pattern of a WildcardSet (if any) first matched a name, so names seen on every
+//  poll (process basenames) cost a hash lookup instead of a match against the rule list.
+//  Entries are keyed by the set's generation (see WildcardSet::GetGeneration) as well as the name, so
+//  recompiling the set invalidates the cache without the caller doing anything, and one cache can serve
+//  several sets without their entries displacing each other. Entries of an old generation are no longer
+//  found and go when their shard is next emptied.
+//
+//  names are hashed once per lookup with no allocation. The cache is split into shards with their own
+//  reader/writer lock so concurrent lookups rarely contend, and is bounded: a shard that fills up is
+//  emptied, and refills with the names still in use.
+//
+//  portable (no Windows dependencies)
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "WildcardSet.h"
+
+class WildcardMatchCache
+{
+	static const size_t SHARD_COUNT = 16;
+
+	struct Entry
+	{
+		std::wstring name;
+		uint64_t generation = 0;
+		size_t firstMatch = WildcardSet::NO_MATCH;
+	};
+	struct Shard
+	{
+		std::shared_mutex mutexEntries;
+		std::unordered_multimap<uint64_t, Entry> entries;	// by HashKey
+	};
+	Shard shards[SHARD_COUNT];
+	size_t maxEntriesPerShard;
+	std::atomic<unsigned long long> hitCount{ 0 };
+	std::atomic<unsigned long long> missCount{ 0 };
+
+	static uint64_t HashKey(const uint64_t generation, const std::wstring_view name)
+	{
+		// FNV-1a, over the generation then the name
+		uint64_t hash = (14695981039346656037ULL ^ generation) * 1099511628211ULL;
+		for (const wchar_t c : name)
+		{
+			hash = (hash ^ static_cast<uint64_t>(c)) * 1099511628211ULL;
+		}
+		return hash;
+	}
+
+public:
+	explicit WildcardMatchCache(const size_t maxEntries = 4096)
+		: maxEntriesPerShard(maxEntries / SHARD_COUNT ? maxEntries / SHARD_COUNT : 1)
+	{
+	}
+	WildcardMatchCache(const WildcardMatchCache&) = delete;
+	WildcardMatchCache& operator = (const WildcardMatchCache&) = delete;
+
+	// as WildcardSet::FindFirst, from the cache when the set's generation matches
+	size_t FindFirst(const WildcardSet& patterns, const std::wstring_view name)
+	{
+		const uint64_t generation = patterns.GetGeneration();
+		const uint64_t hash = HashKey(generation, name);
+		Shard& shard = shards[(hash >> 32) % SHARD_COUNT];
+		{
+			std::shared_lock<std::shared_mutex> lock(shard.mutexEntries);
+			auto range = shard.entries.equal_range(hash);
+			for (auto i = range.first; i != range.second; ++i)
+			{
+				if (i->second.generation == generation && i->second.name == name)
+				{
+					hitCount++;
+					return i->second.firstMatch;
+				}
+			}
+		}
+		missCount++;
+		const size_t firstMatch = patterns.FindFirst(name);
+
+		std::unique_lock<std::shared_mutex> lock(shard.mutexEntries);
+		auto range = shard.entries.equal_range(hash);
+		for (auto i = range.first; i != range.second; ++i)
+		{
+			if (i->second.generation == generation && i->second.name == name)
+			{
+				// another thread got here first
+				return i->second.firstMatch;
+			}
+		}
+		if (shard.entries.size() >= maxEntriesPerShard)
+		{
+			shard.entries.clear();
+		}
+		Entry entry;
+		entry.name.assign(name.data(), name.size());
+		entry.generation = generation;
+		entry.firstMatch = firstMatch;
+		shard.entries.emplace(hash, std::move(entry));
+		return firstMatch;
+	}
+	bool IsMatch(const WildcardSet& patterns, const std::wstring_view name)
+	{
+		return FindFirst(patterns, name) != WildcardSet::NO_MATCH;
+	}
+
+	void Clear()
+	{
+		for (auto& shard : shards)
+		{
+			std::unique_lock<std::shared_mutex> lock(shard.mutexEntries);
+			shard.entries.clear();
+		}
+	}
+	size_t Size()
+	{
+		size_t size = 0;
+		for (auto& shard : shards)
+		{
+			std::shared_lock<std::shared_mutex> lock(shard.mutexEntries);
+			size += shard.entries.size();
+		}
+		return size;
+	}
+	unsigned long long GetHitCount() const
+	{
+		return hitCount;
+	}
+	unsigned long long GetMissCount() const
+	{
+		return missCount;
+	}
+};
@@ -0,0 +1,243 @@
+#pragma once
+// WildcardPattern
+//  compiled form of the patterns wildcmpEx / wildicmpEx take: * matches any run (including none),
+//  ? any single character, and a leading ~ or ! inverts the result. As with wildicmpEx, an empty
+//  pattern or an empty string never matches (inverted or not).
+//  The pattern is split once into the literal segments between the *s (with ? positions marked),
+//  already case folded. A match then checks the first and last segments at the ends of the string
+//  and finds each middle one leftmost after the previous, which is always sufficient for *, so there is
+//  no recursion or backtracking. Middle segments without ? are found with Knuth-Morris-Pratt over the
+//  folded segment, so a match is a single pass over the string whatever it repeats; only segments
+//  containing ? fall back to checking each position (string length x segment length at worst).
+//  Strings are folded a unit at a time through the CaseFold table.
+//
+//  the recursive matchers treat a ? or * right after a * as a literal character, and a ~ there as a
+//  nested inversion. Names and paths can't contain ? or *, so such patterns could never match there; here
+//  they have their usual meaning.
+//
+//  portable (CaseFold provides the Win32 and POSIX folding tables)
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "CaseFold.h"
+
+class WildcardPattern
+{
+	friend class WildcardSet;	// indexes the segments
+
+	struct Segment
+	{
+		std::wstring text;		// folded when case insensitive, ? positions hold 0
+		std::vector<bool> isAny;	// per unit, true for ?
+		bool hasAny = false;
+		std::vector<size_t> border;	// without ?: length of the longest proper border of text[0..i], for KMP
+	};
+
+	std::wstring pattern;
+	std::vector<Segment> segments;
+	bool isCaseInsensitive = true;
+	bool isInverted = false;
+	bool isAnchoredStart = false;	// no leading *
+	bool isAnchoredEnd = false;		// no trailing *
+	bool hasStar = false;
+	size_t minLength = 0;			// units the string needs for the non-* parts
+
+	wchar_t FoldUnit(const wchar_t c) const
+	{
+		return isCaseInsensitive ? CaseFold::Fold(c) : c;
+	}
+	bool SegmentMatchesAt(const Segment& segment, const wchar_t* str, const size_t offset) const
+	{
+		const size_t length = segment.text.size();
+		for (size_t i = 0; i < length; i++)
+		{
+			if ((!segment.hasAny || !segment.isAny[i]) && FoldUnit(str[offset + i]) != segment.text[i])
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	static void BuildBorders(Segment& segment)
+	{
+		const std::wstring& text = segment.text;
+		segment.border.assign(text.size(), 0);
+		for (size_t i = 1, k = 0; i < text.size(); i++)
+		{
+			while (k && text[i] != text[k])
+			{
+				k = segment.border[k - 1];
+			}
+			if (text[i] == text[k])
+			{
+				k++;
+			}
+			segment.border[i] = k;
+		}
+	}
+	// leftmost offset in [from, limit - segment length] where segment matches, or SIZE_MAX
+	size_t FindSegment(const Segment& segment, const wchar_t* str, const size_t from, const size_t limit) const
+	{
+		const size_t length = segment.text.size();
+		if (limit < length)
+		{
+			return SIZE_MAX;
+		}
+		if (!segment.hasAny)
+		{
+			// KMP: each string unit is folded and compared once, plus the fallbacks it pays for
+			size_t matched = 0;
+			for (size_t offset = from; offset < limit && limit - offset >= length - matched; offset++)
+			{
+				const wchar_t c = FoldUnit(str[offset]);
+				while (matched && c != segment.text[matched])
+				{
+					matched = segment.border[matched - 1];
+				}
+				if (c == segment.text[matched] && ++matched == length)
+				{
+					return offset + 1 - length;
+				}
+			}
+			return SIZE_MAX;
+		}
+		const wchar_t first = segment.text[0];
+		const bool isFirstAny = segment.hasAny && segment.isAny[0];
+		for (size_t offset = from; offset + length <= limit; offset++)
+		{
+			if ((isFirstAny || FoldUnit(str[offset]) == first)
+				&& SegmentMatchesAt(segment, str, offset))
+			{
+				return offset;
+			}
+		}
+		return SIZE_MAX;
+	}
+	bool MatchSegments(const wchar_t* str, const size_t length) const
+	{
+		if (length < minLength)
+		{
+			return false;
+		}
+		if (!hasStar)
+		{
+			return length == minLength && (segments.empty() || SegmentMatchesAt(segments[0], str, 0));
+		}
+		size_t first = 0;
+		size_t last = segments.size();
+		size_t position = 0;
+		size_t limit = length;
+		if (isAnchoredStart)
+		{
+			if (!SegmentMatchesAt(segments[0], str, 0))
+			{
+				return false;
+			}
+			position = segments[0].text.size();
+			first++;
+		}
+		if (isAnchoredEnd)
+		{
+			const Segment& tail = segments[last - 1];
+			limit = length - tail.text.size();
+			if (limit < position || !SegmentMatchesAt(tail, str, limit))
+			{
+				return false;
+			}
+			last--;
+		}
+		for (size_t i = first; i < last; i++)
+		{
+			const size_t offset = FindSegment(segments[i], str, position, limit);
+			if (offset == SIZE_MAX)
+			{
+				return false;
+			}
+			position = offset + segments[i].text.size();
+		}
+		return true;
+	}
+
+public:
+	WildcardPattern() {}
+	explicit WildcardPattern(const std::wstring_view wild, const bool caseInsensitive = true)
+	{
+		Compile(wild, caseInsensitive);
+	}
+
+	void Compile(const std::wstring_view wild, const bool caseInsensitive = true)
+	{
+		pattern.assign(wild.data(), wild.size());
+		segments.clear();
+		isCaseInsensitive = caseInsensitive;
+		isInverted = false;
+		hasStar = false;
+		minLength = 0;
+
+		std::wstring_view body = wild;
+		// only the case insensitive matcher (wildicmpEx) supports inversion, any number of times
+		while (isCaseInsensitive && !body.empty() && (body[0] == L'~' || body[0] == L'!'))
+		{
+			isInverted = !isInverted;
+			body.remove_prefix(1);
+		}
+		isAnchoredStart = body.empty() || body.front() != L'*';
+		isAnchoredEnd = body.empty() || body.back() != L'*';
+		Segment segment;
+		for (size_t i = 0; i <= body.size(); i++)
+		{
+			if (i == body.size() || body[i] == L'*')
+			{
+				if (i < body.size())
+				{
+					hasStar = true;
+				}
+				if (!segment.text.empty())
+				{
+					if (!segment.hasAny)
+					{
+						BuildBorders(segment);
+					}
+					minLength += segment.text.size();
+					segments.push_back(std::move(segment));
+					segment = Segment();
+				}
+				continue;
+			}
+			const bool isAny = body[i] == L'?';
+			segment.text += isAny ? L'\0' : FoldUnit(body[i]);
+			segment.isAny.push_back(isAny);
+			segment.hasAny |= isAny;
+		}
+	}
+
+	const std::wstring& GetPattern() const
+	{
+		return pattern;
+	}
+	bool IsInverted() const
+	{
+		return isInverted;
+	}
+	bool IsCaseInsensitive() const
+	{
+		return isCaseInsensitive;
+	}
+
+	bool Match(const wchar_t* str, const size_t length) const
+	{
+		if (isCaseInsensitive && (!length || pattern.empty()))
+		{
+			// as wildicmpEx
+			return false;
+		}
+		return MatchSegments(str, length) != isInverted;
+	}
+	bool Match(const std::wstring_view str) const
+	{
+		return Match(str.data(), str.size());
+	}
+};
@@ -0,0 +1,234 @@
+#pragma once
+// WildcardSet
+//  a list of wildcard patterns (see WildcardPattern) matched against a string together
+//  each pattern contributes its longest literal run (no * or ?) as a key to one Aho-Corasick automaton,
+//  so a single pass over the string finds every pattern whose key occurs in it. Only those candidates
+//  get a full WildcardPattern match (anchors, ? positions, other segments). Patterns with no literal
+//  run (e.g. "*" or "???.exe" style) and inverted patterns, which match when their key is absent,
+//  are always checked. Match cost then depends on the string and the number of candidates, not on
+//  the number of patterns.
+//
+//  matching is const and uses no shared scratch, so one set can be used from several threads
+//  each Compile gives the set a new, process unique generation, which caches of match results
+//  (WildcardMatchCache) use to tell when their entries no longer apply
+//
+//  portable (CaseFold provides the Win32 and POSIX folding tables)
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "WildcardPattern.h"
+
+class WildcardSet
+{
+public:
+	static const size_t NO_MATCH = SIZE_MAX;
+
+private:
+	struct Node
+	{
+		std::vector<std::pair<wchar_t, uint32_t>> edges;	// sorted by unit
+		uint32_t fail = 0;
+		uint32_t outputLink = 0;	// nearest node on the fail chain with keys, 0 for none
+		std::vector<uint32_t> patterns;	// patterns whose key ends here
+	};
+	std::vector<WildcardPattern> patterns;
+	std::vector<uint32_t> alwaysChecked;	// patterns without a usable key, ascending
+	std::vector<Node> nodes;
+	bool isCaseInsensitive = true;
+	uint64_t generation = NextGeneration();
+
+	static uint64_t NextGeneration()
+	{
+		static std::atomic<uint64_t> lastGeneration{ 0 };
+		return ++lastGeneration;
+	}
+
+	uint32_t FindEdge(const uint32_t node, const wchar_t c) const
+	{
+		const auto& edges = nodes[node].edges;
+		auto i = std::lower_bound(edges.begin(), edges.end(), c,
+			[](const std::pair<wchar_t, uint32_t>& edge, const wchar_t unit) { return edge.first < unit; });
+		return (i != edges.end() && i->first == c) ? i->second : 0;
+	}
+	void AddKey(const std::wstring_view key, const uint32_t pattern)
+	{
+		uint32_t node = 0;
+		for (const wchar_t c : key)
+		{
+			uint32_t next = FindEdge(node, c);
+			if (!next)
+			{
+				next = static_cast<uint32_t>(nodes.size());
+				auto& edges = nodes[node].edges;
+				auto i = std::lower_bound(edges.begin(), edges.end(), c,
+					[](const std::pair<wchar_t, uint32_t>& edge, const wchar_t unit) { return edge.first < unit; });
+				edges.insert(i, std::make_pair(c, next));
+				nodes.emplace_back();
+			}
+			node = next;
+		}
+		nodes[node].patterns.push_back(pattern);
+	}
+	// fail and output links, breadth first so each node's fail target is already linked
+	void Link()
+	{
+		std::vector<uint32_t> queue;
+		for (auto& i : nodes[0].edges)
+		{
+			queue.push_back(i.second);
+		}
+		for (size_t head = 0; head < queue.size(); head++)
+		{
+			const uint32_t node = queue[head];
+			for (auto& edge : nodes[node].edges)
+			{
+				uint32_t fail = nodes[node].fail;
+				while (fail && !FindEdge(fail, edge.first))
+				{
+					fail = nodes[fail].fail;
+				}
+				const uint32_t target = FindEdge(fail, edge.first);
+				Node& child = nodes[edge.second];
+				child.fail = target != edge.second ? target : 0;
+				child.outputLink = !nodes[child.fail].patterns.empty() ? child.fail : nodes[child.fail].outputLink;
+				queue.push_back(edge.second);
+			}
+		}
+	}
+	// longest run of the pattern's segments without a ?, empty if there is none worth indexing
+	static std::wstring_view SelectKey(const WildcardPattern& pattern)
+	{
+		std::wstring_view best;
+		for (auto& segment : pattern.segments)
+		{
+			size_t runStart = 0;
+			for (size_t i = 0; i <= segment.text.size(); i++)
+			{
+				if (i == segment.text.size() || (segment.hasAny && segment.isAny[i]))
+				{
+					if (i - runStart > best.size())
+					{
+						best = std::wstring_view(segment.text).substr(runStart, i - runStart);
+					}
+					runStart = i + 1;
+				}
+			}
+		}
+		return best;
+	}
+	// candidate patterns for str, ascending and unique
+	void FindCandidates(const wchar_t* str, const size_t length, std::vector<uint32_t>& candidates) const
+	{
+		candidates = alwaysChecked;
+		uint32_t state = 0;
+		for (size_t i = 0; i < length && nodes.size() > 1; i++)
+		{
+			const wchar_t c = isCaseInsensitive ? CaseFold::Fold(str[i]) : str[i];
+			uint32_t next;
+			while (!(next = FindEdge(state, c)) && state)
+			{
+				state = nodes[state].fail;
+			}
+			state = next;
+			for (uint32_t output = nodes[state].patterns.empty() ? nodes[state].outputLink : state; output; output = nodes[output].outputLink)
+			{
+				candidates.insert(candidates.end(), nodes[output].patterns.begin(), nodes[output].patterns.end());
+			}
+		}
+		std::sort(candidates.begin(), candidates.end());
+		candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+	}
+
+public:
+	WildcardSet() : nodes(1) {}
+	template <typename StringT>
+	explicit WildcardSet(const std::vector<StringT>& patternList, const bool caseInsensitive = true)
+	{
+		Compile(patternList, caseInsensitive);
+	}
+
+	// patterns are matched as wildicmpEx (or wildcmpEx when case sensitive) would, indexes follow the list order
+	template <typename StringT>
+	void Compile(const std::vector<StringT>& patternList, const bool caseInsensitive = true)
+	{
+		patterns.clear();
+		alwaysChecked.clear();
+		nodes.assign(1, Node());
+		isCaseInsensitive = caseInsensitive;
+		generation = NextGeneration();
+		for (auto& i : patternList)
+		{
+			const std::wstring_view pattern(i);
+			const uint32_t index = static_cast<uint32_t>(patterns.size());
+			patterns.emplace_back(pattern, caseInsensitive);
+			const std::wstring_view key = SelectKey(patterns.back());
+			if (patterns.back().IsInverted() || key.empty())
+			{
+				alwaysChecked.push_back(index);
+			}
+			else
+			{
+				AddKey(key, index);
+			}
+		}
+		Link();
+	}
+
+	size_t GetPatternCount() const
+	{
+		return patterns.size();
+	}
+	const WildcardPattern& GetPattern(const size_t index) const
+	{
+		return patterns[index];
+	}
+	// changes on every Compile, copies share it
+	uint64_t GetGeneration() const
+	{
+		return generation;
+	}
+
+	// index of the first pattern in list order that matches, NO_MATCH if none
+	size_t FindFirst(const wchar_t* str, const size_t length) const
+	{
+		std::vector<uint32_t> candidates;
+		FindCandidates(str, length, candidates);
+		for (auto i : candidates)
+		{
+			if (patterns[i].Match(str, length))
+			{
+				return i;
+			}
+		}
+		return NO_MATCH;
+	}
+	size_t FindFirst(const std::wstring_view str) const
+	{
+		return FindFirst(str.data(), str.size());
+	}
+	bool IsMatch(const std::wstring_view str) const
+	{
+		return FindFirst(str) != NO_MATCH;
+	}
+
+	// indexes of every matching pattern, ascending. Returns the count.
+	size_t FindAll(const std::wstring_view str, std::vector<size_t>& matches) const
+	{
+		matches.clear();
+		std::vector<uint32_t> candidates;
+		FindCandidates(str.data(), str.size(), candidates);
+		for (auto i : candidates)
+		{
+			if (patterns[i].Match(str))
+			{
+				matches.push_back(i);
+			}
+		}
+		return matches.size();
+	}
+};
@@ -36,6 +36,7 @@ DWORD GetWindows10Build();
 bool IsWindows11OrGreater();
 bool IsEfficiencyModeSupported();
 
+// patterns matched repeatedly are better compiled once, see WildcardPattern.h
 bool wildcmpEx(const TCHAR* wild, const TCHAR* str);
 bool wildicmpEx(const TCHAR* wild, const TCHAR* str);
 #define wildcmp wildcmpEx
@@ -46,9 +47,17 @@ BOOL IsElevated();
 BOOL CreateMediumProcess(const WCHAR* pwszProcessName, WCHAR* pwszCommandLine, const WCHAR* pwszCWD, PROCESS_INFORMATION* pInfo);
 HANDLE LaunchProcessWithElevation(const WCHAR* pwszPath, const WCHAR* pwszCommandLine, const WCHAR* pwszWorkingDir);
 
+// appends the non-empty delim separated fields of str. StringSplit.h splits without copying.
 size_t ExplodeString(const ATL::CString& str, const WCHAR delim, std::vector<ATL::CString>& vecOut);
 bool IsStringMatchInVector(const WCHAR* string, const std::vector<ATL::CString>& vecPatterns);
-
+// as above with the patterns compiled once, for rule lists matched against many strings
+class WildcardSet;
+bool IsStringMatchInVector(const WCHAR* string, const WildcardSet& patterns);
+// and with the result remembered per string until the patterns are recompiled
+class WildcardMatchCache;
+bool IsStringMatchInVector(const WCHAR* string, const WildcardSet& patterns, WildcardMatchCache& cache);
+
+// index of strNeedle in strHaystack ignoring case, npos if absent. To search for one needle repeatedly, use NoCaseSearcher.
 size_t wstringFindNoCase(const std::wstring& strHaystack, const std::wstring& strNeedle);
 
 std::wstring convert_to_wstring(const std::string& str);
@@ -4,6 +4,11 @@
 #include "pch.h"
 #include "framework.h"
 #include "libCommon.h"
+#include "UTFConvert.h"
+#include "WildcardSet.h"
+#include "WildcardMatchCache.h"
+#include "NoCaseSearcher.h"
+#include "StringSplit.h"
 #include <shellapi.h>
 #include <shlobj.h>
 #include <sddl.h>
@@ -529,13 +534,10 @@ CleanExit:
 
 size_t ExplodeString(const ATL::CString& str, const WCHAR delim, std::vector<ATL::CString>& vecOut)
 {
-	int nPos = 0;
-	ATL::CString token = str.Tokenize(L";", nPos);
-	while (-1 != nPos)
+	for (auto field : SplitString(std::wstring_view(str.GetString(), str.GetLength()), delim))
 	{
-		vecOut.push_back(token);
-		token = str.Tokenize(L";", nPos);
-	};
+		vecOut.emplace_back(field.data(), static_cast<int>(field.size()));
+	}
 	return vecOut.size();
 }
 
@@ -551,18 +553,19 @@ bool IsStringMatchInVector(const WCHAR* string, const std::vector<ATL::CString>&
 	return false;
 }
 
+bool IsStringMatchInVector(const WCHAR* string, const WildcardSet& patterns)
+{
+	return patterns.IsMatch(string);
+}
+
+bool IsStringMatchInVector(const WCHAR* string, const WildcardSet& patterns, WildcardMatchCache& cache)
+{
+	return cache.IsMatch(patterns, string);
+}
+
 size_t wstringFindNoCase(const std::wstring& strHaystack, const std::wstring& strNeedle)
 {
-	auto it = std::search(
-		strHaystack.begin(), strHaystack.end(),
-		strNeedle.begin(), strNeedle.end(),
-		[](wchar_t ch1, wchar_t ch2) { return std::toupper(ch1) == std::toupper(ch2); }
-	);
-	if (it == strHaystack.end())
-	{
-		return std::wstring::npos;
-	}
-	return strHaystack.end() - it;
+	return NoCaseSearcher(strNeedle).Find(strHaystack);
 }
 
 std::wstring GetAppDataPath()
@@ -579,38 +582,12 @@ std::wstring GetAppDataPath()
 
 std::wstring convert_to_wstring(const std::string& str)
 {
-	_ASSERT(str.length() == static_cast<int>(str.length()));
-	// if the string size_t exceeds int max, then we can't fully convert it, so return empty string
-	if (str.length() != static_cast<int>(str.length()))
-	{
-		return std::wstring();
-	}
-	std::wstring wstrTo;
-	int ncch = MultiByteToWideChar(CP_UTF8, 0, str.c_str(), static_cast<int>(str.length()), NULL, 0);
-	if (ncch)
-	{
-		wstrTo.resize(ncch);
-		MultiByteToWideChar(CP_UTF8, 0, str.c_str(), static_cast<int>(str.length()), &wstrTo[0], ncch);
-	}
-	return wstrTo;
+	return UTFConvert::ToWide(str);
 }
 
 std::string convert_from_wstring(const std::wstring& wstr)
 {
-	_ASSERT(wstr.length() == static_cast<int>(wstr.length()));
-	// if the string size_t exceeds int max, then we can't fully convert it, so return empty string
-	if (wstr.length() != static_cast<int>(wstr.length()))
-	{
-		return std::string();
-	}
-	std::string strTo;
-	int ncch = WideCharToMultiByte(CP_UTF8, 0, wstr.c_str(), static_cast<int>(wstr.length()), NULL, 0, NULL, NULL);
-	if (ncch > 0)
-	{
-		strTo.resize(ncch);
-		WideCharToMultiByte(CP_UTF8, 0, wstr.c_str(), static_cast<int>(wstr.length()), &strTo[0], ncch, NULL, NULL);
-	}
-	return strTo;
+	return UTFConvert::ToUTF8(wstr);
 }
 
 bool GetBitmapSize(const HBITMAP hBitmap, __out SIZE& sizeOut)
@@ -0,0 +1,72 @@
+#include "TestHarness.h"
+#include "../CSVColumnarSink.h"
+#include <cmath>
+#include <cstring>
+
+static size_t AppendAll(CSVColumnarSink& sink, const char* text)
+{
+	CSVTokenizer tokenizer(text, strlen(text));
+	std::vector<CSVField> fields;
+	const auto visitor = sink.AsVisitor();
+	size_t rows = 0;
+	while (tokenizer.NextRow(fields))
+	{
+		CHECK(visitor(CSVRowView(fields)));
+		rows++;
+	}
+	return rows;
+}
+
+TEST(CSVColumnarSink_AppendsTypedColumns)
+{
+	CSVColumnarSink sink;
+	// fields out of order, and one field in two columns
+	CHECK(sink.AddColumn(2, CSVColumnarSink::COLUMN_DOUBLE) == 0);
+	CHECK(sink.AddColumn(0, CSVColumnarSink::COLUMN_STRING) == 1);
+	CHECK(sink.AddColumn(1, CSVColumnarSink::COLUMN_INT64) == 2);
+	CHECK(sink.AddColumn(1, CSVColumnarSink::COLUMN_STRING) == 3);
+	CHECK(sink.GetColumnCount() == 4);
+	CHECK(sink.GetColumnType(0) == CSVColumnarSink::COLUMN_DOUBLE);
+
+	CHECK(AppendAll(sink, "\"explorer.exe\",\"1234\",\"0.5\"\r\n"
+		"\"a \"\"quoted\"\", name\",+7,-1e3\n"
+		"\"\",-9223372036854775808,\"\"\n") == 3);
+	CHECK(sink.GetRowCount() == 3);
+	CHECK(sink.GetParseErrorCount() == 1);	// the empty double
+	CHECK((sink.GetInt64Column(2) == std::vector<int64_t>{ 1234, 7, INT64_MIN }));
+	const std::vector<double>& doubles = sink.GetDoubleColumn(0);
+	REQUIRE(doubles.size() == 3);
+	CHECK(doubles[0] == 0.5);
+	CHECK(doubles[1] == -1000);
+	CHECK(std::isnan(doubles[2]));
+	CHECK(sink.GetString(1, 0) == "explorer.exe");
+	CHECK(sink.GetString(1, 1) == "a \"quoted\", name");
+	CHECK(sink.GetString(1, 2) == "");
+	CHECK(sink.GetString(3, 1) == "+7");
+}
+
+TEST(CSVColumnarSink_MissingAndInvalidFieldsAreCounted)
+{
+	CSVColumnarSink sink;
+	sink.AddColumn(0, CSVColumnarSink::COLUMN_INT64);
+	sink.AddColumn(3, CSVColumnarSink::COLUMN_DOUBLE);
+	sink.AddColumn(3, CSVColumnarSink::COLUMN_STRING);
+	CHECK(AppendAll(sink, "12x,b,c\n99999999999999999999,b,c,2.5\n") == 2);
+	// 12x and the overflow as int64, both missing doubles
+	CHECK(sink.GetParseErrorCount() == 3);
+	CHECK((sink.GetInt64Column(0) == std::vector<int64_t>{ 0, 0 }));
+	CHECK(std::isnan(sink.GetDoubleColumn(1)[0]));
+	CHECK(sink.GetDoubleColumn(1)[1] == 2.5);
+	CHECK(sink.GetString(2, 0) == "");
+	CHECK(sink.GetString(2, 1) == "2.5");
+
+	// Clear drops the values and counts, keeping the columns
+	sink.Clear();
+	CHECK(sink.GetRowCount() == 0);
+	CHECK(sink.GetParseErrorCount() == 0);
+	CHECK(sink.GetColumnCount() == 3);
+	CHECK(AppendAll(sink, "5,,,x\n") == 1);
+	CHECK((sink.GetInt64Column(0) == std::vector<int64_t>{ 5 }));
+	CHECK(sink.GetString(2, 0) == "x");
+	CHECK(sink.GetParseErrorCount() == 1);
+}
@@ -0,0 +1,395 @@
+#include "TestHarness.h"
+#include <windows.h>
+#include "../CSVEmitter.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+static std::string ReadFileBytes(const char* path)
+{
+	std::ifstream in(path, std::ios::binary);
+	std::stringstream bytes;
+	bytes << in.rdbuf();
+	return bytes.str();
+}
+
+TEST(CSVEmitter_WritesHeaderAndRows)
+{
+	remove("emitter_test.csv");
+	remove("emitter_test.csv.hdr");
+	{
+		CSVEmitter emitter(L"emitter_test.csv", { CString(L"Name"), CString(L"Count") });
+		emitter.SetWriteBuffering(0);
+		emitter.AddValue(L"Name", L"a,\"b\"");
+		emitter.AddValue(L"Count", static_cast<DWORD>(5));
+		CHECK(emitter.WriteCurrentLine());
+		emitter.CloseOutputFile();
+	}
+	CHECK(ReadFileBytes("emitter_test.csv") == "\xEF\xBB\xBF\"Name\",\"Count\"\r\n\"a\\,\"\"b\"\"\",\"5\"\r\n");
+	remove("emitter_test.csv");
+	remove("emitter_test.csv.hdr");
+}
+
+TEST(CSVEmitter_UTF8FieldNamesAndValues)
+{
+	remove("emitter_utf8.csv");
+	remove("emitter_utf8.csv.hdr");
+	{
+		CSVEmitter emitter(L"emitter_utf8.csv", { CString(L"PID") });
+		emitter.AddFields(std::vector<std::string>{ "Caf\xC3\xA9", "Count" });
+		const size_t price = emitter.AddField(std::string_view("\xE2\x82\xAC"));
+		// the same field whichever form its name is given in
+		CHECK(emitter.FindField("Caf\xC3\xA9") == 1);
+		CHECK(emitter.FindField(L"Caf\x00E9") == 1);
+		CHECK(emitter.FindField(L"\x20AC") == price);
+		CHECK(emitter.FindField("caf") == SIZE_MAX);
+		emitter.SetWriteBuffering(0);
+		emitter.AddValue(std::string_view("PID"), static_cast<DWORD>(4));
+		emitter.AddValue(std::string_view("Caf\xC3\xA9"), std::string_view("cr\xC3\xA8me, \"br\xC3\xBBl\xC3\xA9e\""));
+		emitter.AddValue(std::string_view("Count"), static_cast<unsigned long long>(12345678901ULL));
+		emitter.AddValue(price, std::string_view("\xF0\x9F\x98\x80"));
+		emitter.AddValue(std::string_view("undefined"), std::string_view("ignored"));
+		CHECK(emitter.WriteCurrentLine());
+		emitter.CloseOutputFile();
+	}
+	const std::string header = "\xEF\xBB\xBF\"PID\",\"Caf\xC3\xA9\",\"Count\",\"\xE2\x82\xAC\"\r\n";
+	const std::string row = "\"4\",\"cr\xC3\xA8me\\, \"\"br\xC3\xBBl\xC3\xA9e\"\"\",\"12345678901\",\"\xF0\x9F\x98\x80\"\r\n";
+	CHECK(ReadFileBytes("emitter_utf8.csv") == header + row);
+
+	// the same schema given as wide names appends
+	{
+		CSVEmitter emitter(L"emitter_utf8.csv", { CString(L"PID"), CString(L"Caf\x00E9"), CString(L"Count"), CString(L"\x20AC") });
+		emitter.SetWriteBuffering(0);
+		emitter.AddValue(L"Caf\x00E9", L"\x00E9");
+		CHECK(emitter.WriteCurrentLine());
+		emitter.CloseOutputFile();
+	}
+	CHECK(ReadFileBytes("emitter_utf8.csv") == header + row + "\"\",\"\xC3\xA9\",\"\",\"\"\r\n");
+	remove("emitter_utf8.csv");
+	remove("emitter_utf8.csv.hdr");
+}
+
+TEST(CSVEmitter_ColumnHandlesAndNumericValues)
+{
+	remove("emitter_handles.csv");
+	remove("emitter_handles.csv.hdr");
+	{
+		CSVEmitter emitter(L"emitter_handles.csv", { CString(L"Name") });
+		emitter.SetWriteBuffering(0);
+		const size_t dword = emitter.AddField(L"DWORD");
+		const size_t unsigned64 = emitter.AddField(std::string_view("UInt64"));
+		const size_t signed64 = emitter.AddField(L"Int64");
+		CHECK(dword == 1);
+		CHECK(unsigned64 == 2);
+		CHECK(signed64 == 3);
+		CHECK(emitter.FindField(L"Int64") == signed64);
+		CHECK(emitter.FindField(std::string_view("UInt64")) == unsigned64);
+		CHECK(emitter.FindField(L"Missing") == SIZE_MAX);
+
+		emitter.AddValue(0, std::string_view("caf\xC3\xA9"));
+		emitter.AddValue(dword, static_cast<DWORD>(4294967295u));
+		emitter.AddValue(unsigned64, static_cast<unsigned long long>(18446744073709551615ULL));
+		emitter.AddValue(signed64, static_cast<long long>(INT64_MIN));
+		// an undefined name is ignored, the row is still written
+		emitter.AddValue(L"Missing", L"dropped");
+		CHECK(emitter.WriteCurrentLine());
+		// values don't carry over to the next row, and the last value for a column wins
+		emitter.AddValue(signed64, static_cast<long long>(-1));
+		emitter.AddValue(std::string_view("Name"), std::string_view("first"));
+		emitter.AddValue(L"Name", L"second");
+		CHECK(emitter.WriteCurrentLine());
+		emitter.CloseOutputFile();
+	}
+	CHECK(ReadFileBytes("emitter_handles.csv") == "\xEF\xBB\xBF\"Name\",\"DWORD\",\"UInt64\",\"Int64\"\r\n"
+		"\"caf\xC3\xA9\",\"4294967295\",\"18446744073709551615\",\"-9223372036854775808\"\r\n"
+		"\"second\",\"\",\"\",\"-1\"\r\n");
+	remove("emitter_handles.csv");
+	remove("emitter_handles.csv.hdr");
+}
+
+TEST(CSVEmitter_FlushTimerWritesIdleRows)
+{
+	remove("emitter_idle.csv");
+	remove("emitter_idle.csv.hdr");
+	CSVEmitter emitter(L"emitter_idle.csv", { CString(L"A") });
+	emitter.SetWriteBuffering(64 * 1024, 50);
+	emitter.AddValue(L"A", static_cast<DWORD>(1));
+	CHECK(emitter.WriteCurrentLine());
+	const std::string header = "\xEF\xBB\xBF\"A\"\r\n";
+	// nothing else is written, the timer has to flush the buffered row
+	std::string contents;
+	for (int i = 0; i < 100 && contents.size() <= header.size(); i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		contents = ReadFileBytes("emitter_idle.csv");
+	}
+	CHECK(contents == header + "\"1\"\r\n");
+	emitter.CloseOutputFile();
+	remove("emitter_idle.csv");
+	remove("emitter_idle.csv.hdr");
+}
+
+TEST(CSVEmitter_AsyncRestartWhileSubmitting)
+{
+	remove("emitter_async.csv");
+	remove("emitter_async.csv.hdr");
+	CSVEmitter emitter(L"emitter_async.csv", { CString(L"Thread"), CString(L"Row") });
+	HANDLE hFile = emitter.OpenOutputFile(true);
+	REQUIRE(hFile != INVALID_HANDLE_VALUE);
+	REQUIRE(emitter.StartAsyncWriter(hFile, 64));
+
+	// producers keep submitting while the writer is stopped and restarted under them
+	const int threadCount = 4, rowsPerThread = 5000;
+	atomic<unsigned long long> submitted{ 0 };
+	vector<thread> producers;
+	for (int t = 0; t < threadCount; t++)
+	{
+		producers.emplace_back([&, t]()
+			{
+				CSVEmitter::RowBuilder builder = emitter.CreateRowBuilder();
+				for (int i = 0; i < rowsPerThread; i++)
+				{
+					builder.AddValue(0, static_cast<DWORD>(t));
+					builder.AddValue(1, static_cast<DWORD>(i));
+					builder.Submit();
+					submitted++;
+				}
+			});
+	}
+	for (int i = 0; i < 50; i++)
+	{
+		emitter.StopAsyncWriter();
+		CHECK(emitter.StartAsyncWriter(hFile, 64));
+	}
+	for (auto& producer : producers)
+	{
+		producer.join();
+	}
+	// closes hFile too
+	emitter.CloseOutputFile(hFile);
+
+	const std::string contents = ReadFileBytes("emitter_async.csv");
+	const size_t lines = std::count(contents.begin(), contents.end(), '\n');
+	CHECK(submitted == threadCount * rowsPerThread);
+	CHECK(lines - 1 + emitter.GetDroppedRowCount() == submitted);
+	remove("emitter_async.csv");
+	remove("emitter_async.csv.hdr");
+}
+
+static bool FileExists(const char* path)
+{
+	return std::ifstream(path).good();
+}
+
+TEST(CSVEmitter_AgeRotationUsesRecordedStartTime)
+{
+	const char* rolled[] = { "emitter_age.1.csv", "emitter_age.2.csv" };
+	remove("emitter_age.csv");
+	remove("emitter_age.csv.hdr");
+	for (auto path : rolled)
+	{
+		remove(path);
+	}
+	{
+		CSVEmitter emitter(L"emitter_age.csv", { CString(L"A") });
+		emitter.SetWriteBuffering(0);
+		emitter.AddValue(L"A", static_cast<DWORD>(1));
+		CHECK(emitter.WriteCurrentLine());
+		emitter.CloseOutputFile();
+	}
+	// backdate the start time the sidecar recorded, keeping the header hash
+	std::string sidecar = ReadFileBytes("emitter_age.csv.hdr");
+	REQUIRE(sidecar.size() == 35);
+	sidecar.replace(17, 16, "0000000000000001");
+	std::ofstream("emitter_age.csv.hdr", std::ios::binary | std::ios::trunc) << sidecar;
+
+	CSVEmitter emitter(L"emitter_age.csv", { CString(L"A") });
+	emitter.SetWriteBuffering(0);
+	emitter.SetRotation(0, 3600);
+	emitter.AddValue(L"A", static_cast<DWORD>(2));
+	CHECK(emitter.WriteCurrentLine());
+	CHECK(FileExists(rolled[0]));
+	// the fresh file's age comes from when it was started, so later rows don't roll it again
+	emitter.AddValue(L"A", static_cast<DWORD>(3));
+	CHECK(emitter.WriteCurrentLine());
+	CHECK(!FileExists(rolled[1]));
+	emitter.CloseOutputFile();
+	CHECK(ReadFileBytes("emitter_age.csv") == "\xEF\xBB\xBF\"A\"\r\n\"2\"\r\n\"3\"\r\n");
+
+	remove("emitter_age.csv");
+	remove("emitter_age.csv.hdr");
+	for (auto path : rolled)
+	{
+		remove(path);
+	}
+}
+
+TEST(CSVEmitter_AsyncRowsRollAndKeepNewestRolledFiles)
+{
+	char path[64];
+	remove("emitter_roll.csv");
+	remove("emitter_roll.csv.hdr");
+	for (int i = 1; i <= 40; i++)
+	{
+		snprintf(path, sizeof(path), "emitter_roll.%d.csv", i);
+		remove(path);
+	}
+	// left by an earlier run that kept more rolled files
+	std::ofstream("emitter_roll.1.csv") << "old";
+	std::ofstream("emitter_roll.2.csv") << "old";
+	std::ofstream("emitter_roll.3.csv") << "old";
+
+	CSVEmitter emitter(L"emitter_roll.csv", { CString(L"A") });
+	emitter.SetWriteBuffering(0);
+	emitter.SetRotation(64, 0, 2);
+	REQUIRE(emitter.StartAsyncWriter(1024));
+	CSVEmitter::RowBuilder builder = emitter.CreateRowBuilder();
+	for (int i = 0; i < 100; i++)
+	{
+		builder.AddValue(0, static_cast<DWORD>(i));
+		CHECK(builder.Submit());
+	}
+	emitter.CloseOutputFile();
+
+	std::vector<int> kept;
+	for (int i = 1; i <= 40; i++)
+	{
+		snprintf(path, sizeof(path), "emitter_roll.%d.csv", i);
+		if (FileExists(path))
+		{
+			kept.push_back(i);
+			CHECK(ReadFileBytes(path).size() <= 64 + 8);
+		}
+		remove(path);
+	}
+	// rolled as the async writer wrote, with only the two newest rolled files left
+	REQUIRE(kept.size() == 2);
+	CHECK(kept[0] + 1 == kept[1]);
+	CHECK(kept[0] > 3);
+	remove("emitter_roll.csv");
+	remove("emitter_roll.csv.hdr");
+}
+
+// opened without FILE_SHARE_DELETE, as some readers do, so the file can't be moved while it's held
+static HANDLE HoldWithoutShareDelete(const WCHAR* path)
+{
+	return CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+TEST(CSVEmitter_SchemaChangeNeverOverwritesWhenRollFails)
+{
+	remove("emitter_schema.csv");
+	remove("emitter_schema.csv.hdr");
+	remove("emitter_schema.1.csv");
+	{
+		CSVEmitter emitter(L"emitter_schema.csv", { CString(L"A") });
+		emitter.AddValue(L"A", static_cast<DWORD>(1));
+		CHECK(emitter.WriteCurrentLine());
+		emitter.CloseOutputFile();
+	}
+	const std::string history = ReadFileBytes("emitter_schema.csv");
+	HANDLE hHeld = HoldWithoutShareDelete(L"emitter_schema.csv");
+	REQUIRE(hHeld != INVALID_HANDLE_VALUE);
+
+	CSVEmitter emitter(L"emitter_schema.csv", { CString(L"A"), CString(L"B") });
+	emitter.AddValue(L"A", static_cast<DWORD>(2));
+	CHECK(!emitter.WriteCurrentLine());
+	CHECK(emitter.OpenOutputFile() == INVALID_HANDLE_VALUE);
+	CHECK(ReadFileBytes("emitter_schema.csv") == history);
+	CHECK(!FileExists("emitter_schema.1.csv"));
+
+	// once it can be rolled, the new schema starts a fresh file
+	CloseHandle(hHeld);
+	emitter.AddValue(L"A", static_cast<DWORD>(3));
+	CHECK(emitter.WriteCurrentLine());
+	emitter.CloseOutputFile();
+	CHECK(ReadFileBytes("emitter_schema.1.csv") == history);
+	CHECK(ReadFileBytes("emitter_schema.csv") == "\xEF\xBB\xBF\"A\",\"B\"\r\n\"3\",\"\"\r\n");
+	remove("emitter_schema.csv");
+	remove("emitter_schema.csv.hdr");
+	remove("emitter_schema.1.csv");
+}
+
+TEST(CSVEmitter_FailedRollIsRetriedLater)
+{
+	remove("emitter_retry.csv");
+	remove("emitter_retry.csv.hdr");
+	remove("emitter_retry.1.csv");
+	CSVEmitter emitter(L"emitter_retry.csv", { CString(L"A") });
+	emitter.SetWriteBuffering(0);
+	emitter.SetRotation(32);
+	emitter.AddValue(L"A", static_cast<DWORD>(0));
+	CHECK(emitter.WriteCurrentLine());
+	HANDLE hHeld = HoldWithoutShareDelete(L"emitter_retry.csv");
+	REQUIRE(hHeld != INVALID_HANDLE_VALUE);
+	for (DWORD i = 1; i < 20; i++)
+	{
+		emitter.AddValue(L"A", i);
+		CHECK(emitter.WriteCurrentLine());
+	}
+	CloseHandle(hHeld);
+	// rows carried on into the file that couldn't be rolled, and the roll isn't retried on the next row
+	emitter.AddValue(L"A", static_cast<DWORD>(20));
+	CHECK(emitter.WriteCurrentLine());
+	emitter.CloseOutputFile();
+	CHECK(!FileExists("emitter_retry.1.csv"));
+	std::string expected = "\xEF\xBB\xBF\"A\"\r\n";
+	for (int i = 0; i <= 20; i++)
+	{
+		expected += "\"" + std::to_string(i) + "\"\r\n";
+	}
+	CHECK(ReadFileBytes("emitter_retry.csv") == expected);
+	remove("emitter_retry.csv");
+	remove("emitter_retry.csv.hdr");
+}
+
+TEST(CSVEmitter_CompressedReopenReadsOnlyTheTail)
+{
+	remove("emitter_tail.csv.lz4");
+	remove("emitter_tail.csv.lz4.hdr");
+	std::string text = "\xEF\xBB\xBF\"A\",\"B\"\r\n";
+	uint32_t seed = 1;
+	auto writeRows = [&](const int count)
+	{
+		CSVEmitter emitter(L"emitter_tail.csv.lz4", { CString(L"A"), CString(L"B") });
+		emitter.SetCompressedOutput(true);
+		emitter.SetWriteBuffering(16 * 1024);
+		for (int i = 0; i < count; i++)
+		{
+			seed = seed * 1664525 + 1013904223;
+			emitter.AddValue(L"A", static_cast<DWORD>(seed));
+			emitter.AddValue(L"B", static_cast<DWORD>(seed >> 7));
+			CHECK(emitter.WriteCurrentLine());
+			text += "\"" + std::to_string(seed) + "\",\"" + std::to_string(seed >> 7) + "\"\r\n";
+		}
+		emitter.CloseOutputFile();
+	};
+	// well past the tail that is read
+	writeRows(120000);
+	std::string bytes = ReadFileBytes("emitter_tail.csv.lz4");
+	REQUIRE(bytes.size() > 2 * 1024 * 1024);
+
+	// a frame cut short at the end, and a damaged first frame, which reading the whole file would stop at
+	std::string frame;
+	LZ4Frame::AppendFrame(frame, "\"1\",\"2\"\r\n", 9);
+	std::ofstream("emitter_tail.csv.lz4", std::ios::binary | std::ios::app) << frame.substr(0, frame.size() - 3);
+	{
+		std::fstream file("emitter_tail.csv.lz4", std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(0);
+		file.put('\0');
+	}
+	writeRows(1);
+	bytes = ReadFileBytes("emitter_tail.csv.lz4");
+	bytes[0] = '\x04';
+	std::string decoded;
+	size_t position = 0, frameSize = 0;
+	while (LZ4Frame::ReadFrame(bytes.data() + position, bytes.size() - position, frameSize, &decoded) == LZ4Frame::FRAME_COMPLETE)
+	{
+		position += frameSize;
+	}
+	CHECK(position == bytes.size());
+	CHECK(decoded == text);
+	remove("emitter_tail.csv.lz4");
+	remove("emitter_tail.csv.lz4.hdr");
+}
@@ -0,0 +1,228 @@
+#include "TestHarness.h"
+#include <windows.h>
+#include "../CSVParallelParser.h"
+// CSVReader logs through the including application's LOG_DEBUG_PRINT
+#define LOG_DEBUG_PRINT(...)
+#include "../CSVReader.h"
+#include <cstdio>
+#include <fstream>
+#include <random>
+
+static void WriteFileBytes(const char* path, const std::string& bytes, const bool append = false)
+{
+	std::ofstream out(path, std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+	out << bytes;
+}
+
+static std::string JoinFields(const CSVRowView& row)
+{
+	std::string joined;
+	for (auto& field : row)
+	{
+		joined += field.ToString();
+		joined += '|';
+	}
+	return joined;
+}
+
+// rows of text as a sequential CSVTokenizer read gives them
+static std::vector<std::string> TokenizeSequentially(const std::string& text)
+{
+	std::vector<std::string> rows;
+	CSVTokenizer tokenizer(text.data(), text.size());
+	std::vector<CSVField> fields;
+	while (tokenizer.NextRow(fields))
+	{
+		rows.push_back(JoinFields(CSVRowView(fields)));
+	}
+	return rows;
+}
+
+// about size bytes of rows with quoted commas, quotes and line breaks, mixed line ends, and optionally
+// a stray quote in an unquoted field, which breaks the quote parity the ranges are split by
+static std::string BuildRows(const size_t size, const bool hasStrayQuote)
+{
+	std::mt19937 random(11);
+	std::string rows;
+	for (int i = 0; rows.size() < size; i++)
+	{
+		rows += std::to_string(i) + ",";
+		switch (random() % 4)
+		{
+		case 0:
+			rows += "\"C:\\Windows\\explorer.exe, the shell\"";
+			break;
+		case 1:
+			rows += "\"a \"\"quoted\"\" name\"";
+			break;
+		case 2:
+			rows += "\"two\r\nlines\"";
+			break;
+		default:
+			rows += "plain";
+			break;
+		}
+		if (hasStrayQuote && i == 10)
+		{
+			rows += ",5\" monitor";
+		}
+		rows += "," + std::to_string(random() % 100000);
+		rows += (random() % 2) ? "\r\n" : "\n";
+	}
+	return rows;
+}
+
+TEST(CSVParallelParser_MatchesSequentialRead)
+{
+	const char* header = "\xEF\xBB\xBF" "Index,Name,Value\r\n";
+	for (const bool hasStrayQuote : { false, true })
+	{
+		const std::string rows = BuildRows(1024 * 1024, hasStrayQuote);
+		WriteFileBytes("parallel_test.csv", header + rows);
+		CSVParallelParser parser(4);
+		uint64_t position = 0;
+		std::vector<std::string> visited, headers;
+		const long long rowCount = parser.Parse(L"parallel_test.csv", position, [&](const CSVRowView& row)
+			{
+				visited.push_back(JoinFields(row));
+				return true;
+			}, [&](const CSVRowView& row)
+			{
+				headers.push_back(JoinFields(row));
+				return true;
+			});
+		const std::vector<std::string> expected = TokenizeSequentially(rows);
+		CHECK(expected.size() > 1000);
+		CHECK(rowCount == static_cast<long long>(expected.size()));
+		CHECK(visited == expected);
+		CHECK((headers == std::vector<std::string>{ "Index|Name|Value|" }));
+		CHECK(position == strlen(header) + rows.size());
+	}
+	remove("parallel_test.csv");
+}
+
+TEST(CSVParallelParser_ResumesAfterStopAndPartialRow)
+{
+	const std::string rows = BuildRows(512 * 1024, false);
+	WriteFileBytes("parallel_resume.csv", "A,B,C\n" + rows + "last,\"partial");
+	const std::vector<std::string> expected = TokenizeSequentially(rows);
+	CSVParallelParser parser(3);
+	std::vector<std::string> visited;
+	const auto noHeader = [](const CSVRowView&) { return true; };
+
+	// stop part way through, then carry on from where it stopped
+	uint64_t position = 0;
+	CHECK(parser.Parse(L"parallel_resume.csv", position, [&](const CSVRowView& row)
+		{
+			visited.push_back(JoinFields(row));
+			return visited.size() < 100;
+		}, noHeader) == 100);
+	CHECK(parser.Parse(L"parallel_resume.csv", position, [&](const CSVRowView& row)
+		{
+			visited.push_back(JoinFields(row));
+			return true;
+		}, [](const CSVRowView&) { CHECK(!"header visited again"); return true; }) == static_cast<long long>(expected.size() - 100));
+	CHECK(visited == expected);
+
+	// the partial trailing row is left until it is complete
+	CHECK(position == 6 + rows.size());
+	WriteFileBytes("parallel_resume.csv", " row\"\r\n", true);
+	visited.clear();
+	CHECK(parser.Parse(L"parallel_resume.csv", position, [&](const CSVRowView& row)
+		{
+			visited.push_back(JoinFields(row));
+			return true;
+		}, noHeader) == 1);
+	CHECK((visited == std::vector<std::string>{ "last|partial row|" }));
+	remove("parallel_resume.csv");
+}
+
+TEST(CSVParallelParser_RejectsCompressedAndMissingFiles)
+{
+	const std::string text = "A,B\r\n1,2\r\n";
+	std::string frame;
+	LZ4Frame::AppendFrame(frame, text.data(), text.size());
+	WriteFileBytes("parallel_test.csv.lz4", frame);
+	CSVParallelParser parser(2);
+	uint64_t position = 0;
+	const auto visitor = [](const CSVRowView&) { return true; };
+	CHECK(parser.Parse(L"parallel_test.csv.lz4", position, visitor, visitor) == -1);
+	remove("parallel_test.csv.lz4");
+	CHECK(parser.Parse(L"parallel_missing.csv", position, visitor, visitor) == -1);
+	CHECK(position == 0);
+}
+
+TEST(CSVReader_VisitRowsParallelSharesTheBookmark)
+{
+	const std::string rows = BuildRows(400 * 1024, false);
+	WriteFileBytes("parallel_reader.csv", "\xEF\xBB\xBF" "Index,Name,Value\r\n" + rows);
+	CSVReader reader;
+	reader.SetSourceFilePath(L"parallel_reader.csv");
+	std::vector<std::string> visited;
+	const auto collect = [&](const CSVRowView& row)
+	{
+		visited.push_back(JoinFields(row));
+		return true;
+	};
+	CHECK(reader.VisitRowsParallel(collect, 4) == static_cast<int>(TokenizeSequentially(rows).size()));
+	CHECK(visited == TokenizeSequentially(rows));
+	CHECK((reader.GetHeaderNames() == std::vector<std::string>{ "Index", "Name", "Value" }));
+
+	// a sequential read then picks up only what was appended
+	WriteFileBytes("parallel_reader.csv", "x,y,z\r\n", true);
+	visited.clear();
+	CHECK(reader.VisitRows(collect) == 1);
+	CHECK((visited == std::vector<std::string>{ "x|y|z|" }));
+	remove("parallel_reader.csv");
+}
+
+TEST(CSVParallelParser_RowStartSearchStopsAtItsRange)
+{
+	// every field quoted, as CSVEmitter writes them: from the wrong quote state no line end ever looks
+	// like the end of a row
+	std::string rows;
+	for (int i = 0; rows.size() < 2 * 1024 * 1024; i++)
+	{
+		rows += "\"" + std::to_string(i) + "\",\"C:\\Windows\\System32\\svchost.exe\",\"" + std::to_string(i * 7 % 1000) + "\"\r\n";
+	}
+	WriteFileBytes("parallel_quoted.csv", "\"Index\",\"Name\",\"Value\"\r\n" + rows);
+	CSVParallelParser parser(16);
+	uint64_t position = 0;
+	std::vector<std::string> visited;
+	const auto noHeader = [](const CSVRowView&) { return true; };
+	CHECK(parser.Parse(L"parallel_quoted.csv", position, [&](const CSVRowView& row)
+		{
+			visited.push_back(JoinFields(row));
+			return true;
+		}, noHeader) > 0);
+	CHECK(visited == TokenizeSequentially(rows));
+	// each range's searches read no further than the range, rather than on to the end of the window
+	CHECK(parser.GetRowStartScanSize() > 0);
+	CHECK(parser.GetRowStartScanSize() <= rows.size());
+	remove("parallel_quoted.csv");
+}
+
+TEST(CSVParallelParser_RowLongerThanARange)
+{
+	// a quoted field spanning whole ranges, which have no row start of their own
+	std::string rows = BuildRows(256 * 1024, false);
+	rows += "1,\"";
+	for (int i = 0; i < 40000; i++)
+	{
+		rows += "line " + std::to_string(i) + "\r\n";
+	}
+	rows += "\",2\r\n";
+	rows += BuildRows(256 * 1024, false);
+	WriteFileBytes("parallel_long.csv", "A,B,C\r\n" + rows);
+	CSVParallelParser parser(8);
+	uint64_t position = 0;
+	std::vector<std::string> visited;
+	CHECK(parser.Parse(L"parallel_long.csv", position, [&](const CSVRowView& row)
+		{
+			visited.push_back(JoinFields(row));
+			return true;
+		}, [](const CSVRowView&) { return true; }) == static_cast<long long>(TokenizeSequentially(rows).size()));
+	CHECK(visited == TokenizeSequentially(rows));
+	CHECK(position == 7 + rows.size());
+	remove("parallel_long.csv");
+}
@@ -0,0 +1,91 @@
+#include "TestHarness.h"
+#include "../CSVProjection.h"
+#include <cstring>
+
+static bool ProjectText(CSVProjection& projection, const char* text)
+{
+	CSVTokenizer tokenizer(text, strlen(text));
+	std::vector<CSVField> fields;
+	return tokenizer.NextRow(fields, true) && projection.Project(CSVRowView(fields));
+}
+
+TEST(CSVProjection_BindsSelectedColumnsByName)
+{
+	CSVProjection projection;
+	const size_t cpu = projection.Select("CPU", CSVProjection::VALUE_DOUBLE);
+	const size_t pid = projection.Select("pid", CSVProjection::VALUE_INT64);
+	CHECK(cpu == 0);
+	CHECK(pid == 1);
+	CHECK(!projection.IsBound());
+	CHECK(projection.GetFieldCountNeeded() == SIZE_MAX);
+	// nothing is projected until bound
+	CHECK(!ProjectText(projection, "1,2,3\n"));
+
+	// case insensitive, and only the fields up to the last selected one are needed
+	CHECK(projection.Bind(std::vector<std::string>{ "Name", "PID", "cpu", "Memory" }, 3));
+	CHECK(projection.IsBound());
+	CHECK(projection.GetBoundGeneration() == 3);
+	CHECK(projection.GetFieldCountNeeded() == 3);
+
+	// a missing column makes Bind return false, and its slot is never valid
+	const size_t missing = projection.Select("Handles", CSVProjection::VALUE_INT64);
+	CHECK(!projection.IsBound());
+	CHECK(!projection.Bind(std::vector<std::string>{ "cpu", "Name", "PID" }, 4));
+	CHECK(projection.GetFieldCountNeeded() == 3);
+	CHECK(ProjectText(projection, "0.5,x,42\n"));
+	CHECK(projection.GetDouble(cpu) == 0.5);
+	CHECK(projection.GetInt64(pid) == 42);
+	CHECK(!projection.IsValid(missing));
+	CHECK(projection.GetInt64(missing) == 0);
+}
+
+TEST(CSVProjection_ProjectsTypedValues)
+{
+	CSVProjection projection;
+	const size_t name = projection.Select("Name", CSVProjection::VALUE_STRING);
+	const size_t count = projection.Select("Count", CSVProjection::VALUE_INT64);
+	const size_t ratio = projection.Select("Ratio", CSVProjection::VALUE_DOUBLE);
+	const size_t time = projection.Select("Time", CSVProjection::VALUE_TIMESTAMP);
+	REQUIRE(projection.Bind(std::vector<std::string>{ "Name", "Count", "Ratio", "Time" }));
+
+	CHECK(ProjectText(projection, "\"a \"\"b\"\", c\",+12,-2.5e1,\"2024-03-01 12:34:56.789\"\n"));
+	CHECK(projection.GetString(name) == "a \"b\", c");
+	CHECK(projection.GetInt64(count) == 12);
+	CHECK(projection.GetDouble(ratio) == -25);
+	CHECK(projection.GetTimestamp(time) == 1709296496789LL);
+
+	// unparseable and missing fields aren't valid, and read back as 0 or empty
+	CHECK(ProjectText(projection, "x,12a,\n"));
+	CHECK(projection.IsValid(name));
+	CHECK(!projection.IsValid(count));
+	CHECK(projection.GetInt64(count) == 0);
+	CHECK(!projection.IsValid(ratio));
+	CHECK(!projection.IsValid(time));
+	CHECK(projection.GetTimestamp(time) == 0);
+}
+
+TEST(CSVProjection_ParseTimestamp)
+{
+	int64_t milliseconds = 0;
+	CHECK(CSVProjection::ParseTimestamp("1970-01-01", milliseconds) && milliseconds == 0);
+	CHECK(CSVProjection::ParseTimestamp("2000-02-29T23:59:59Z", milliseconds) && milliseconds == 951868799000LL);
+	CHECK(CSVProjection::ParseTimestamp("1969-12-31 23:59:59.5", milliseconds) && milliseconds == -500);
+	// fractions past milliseconds are ignored
+	CHECK(CSVProjection::ParseTimestamp("2024-01-02 03:04:05.1239", milliseconds) && milliseconds == 1704164645123LL);
+	CHECK(CSVProjection::ParseTimestamp("1704164645123", milliseconds) && milliseconds == 1704164645123LL);
+
+	// impossible dates and times, and malformed text, fail and leave the value alone
+	const char* invalid[] = { "2024-02-30", "2023-02-29", "1900-02-29", "2024-04-31", "2024-13-01", "2024-00-10", "2024-01-00",
+		"2024-01-02 24:00:00", "2024-01-02 23:60:00", "2024-01-02 23:59:60", "2024-01-02 3:04:05", "2024-01-02 03:04:05x",
+		"2024-01-02T03:04", "2024/01/02", "", "12ms" };
+	for (auto text : invalid)
+	{
+		milliseconds = 77;
+		CHECK(!CSVProjection::ParseTimestamp(text, milliseconds));
+		CHECK(milliseconds == 77);
+	}
+	int64_t n = 5;
+	double d = 5;
+	CHECK(!CSVProjection::ParseInt64("2024-01-02", n) && n == 5);
+	CHECK(!CSVProjection::ParseDouble("1.5x", d) && d == 5);
+}
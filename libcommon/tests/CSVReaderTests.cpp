@@ -0,0 +1,200 @@
+#include "TestHarness.h"
+#include <windows.h>
+// CSVReader logs through the including application's LOG_DEBUG_PRINT
+#define LOG_DEBUG_PRINT(...)
+#include "../CSVReader.h"
+#include "../CSVColumnarSink.h"
+#include <cstdio>
+#include <fstream>
+
+static void AppendToFile(const char* path, const std::string& bytes)
+{
+	std::ofstream out(path, std::ios::binary | std::ios::app);
+	out << bytes;
+}
+
+static std::vector<std::string> ReadFirstFields(CSVReader& reader)
+{
+	std::vector<std::string> values;
+	reader.VisitRows([&](const CSVRowView& row)
+		{
+			values.push_back(row[0].ToString());
+			return true;
+		});
+	return values;
+}
+
+TEST(CSVReader_ResumesAtBookmark)
+{
+	remove("reader_test.csv");
+	AppendToFile("reader_test.csv", "\xEF\xBB\xBF" "A,B\n1,2\n3,");
+	CSVReader reader;
+	reader.SetSourceFilePath(L"reader_test.csv");
+	CHECK((ReadFirstFields(reader) == std::vector<std::string>{ "1" }));
+	CHECK((reader.GetHeaderNames() == std::vector<std::string>{ "A", "B" }));
+	AppendToFile("reader_test.csv", "4\n5,6\n");
+	CHECK((ReadFirstFields(reader) == std::vector<std::string>{ "3", "5" }));
+	CHECK(ReadFirstFields(reader).empty());
+	remove("reader_test.csv");
+}
+
+TEST(CSVReader_SkipsRowLargerThanMaxBuffer)
+{
+	remove("reader_oversized.csv");
+	AppendToFile("reader_oversized.csv", "\xEF\xBB\xBF" "A,B\n1,2\n" + std::string(300, 'x'));
+	CSVReader reader;
+	reader.SetSourceFilePath(L"reader_oversized.csv");
+	reader.SetReadBufferSize(64, 256);
+	CHECK((ReadFirstFields(reader) == std::vector<std::string>{ "1" }));
+	CHECK(reader.GetSkippedCount() == 1);
+	// the rest of the oversized row arrives later, reading carries on after it
+	AppendToFile("reader_oversized.csv", std::string(100, 'y') + ",z\n7,8\n9,10\n");
+	CHECK((ReadFirstFields(reader) == std::vector<std::string>{ "7", "9" }));
+	CHECK(reader.GetSkippedCount() == 1);
+	remove("reader_oversized.csv");
+}
+
+TEST(CSVReader_CompressedSourceSkipsInvalidFrame)
+{
+	remove("reader_test.csv.lz4");
+	std::string frames;
+	const std::string first = "\xEF\xBB\xBF" "A,B\n1,2\n";
+	LZ4Frame::AppendFrame(frames, first.data(), first.size());
+	frames += "garbage between frames";
+	const std::string second = "3,4\n";
+	LZ4Frame::AppendFrame(frames, second.data(), second.size());
+	AppendToFile("reader_test.csv.lz4", frames);
+
+	CSVReader reader;
+	reader.SetSourceFilePath(L"reader_test.csv.lz4");
+	CHECK((ReadFirstFields(reader) == std::vector<std::string>{ "1", "3" }));
+	CHECK(reader.GetSkippedCount() == 1);
+	const std::string third = "5,6\n";
+	frames.clear();
+	LZ4Frame::AppendFrame(frames, third.data(), third.size());
+	AppendToFile("reader_test.csv.lz4", frames);
+	CHECK((ReadFirstFields(reader) == std::vector<std::string>{ "5" }));
+	remove("reader_test.csv.lz4");
+}
+
+TEST(CSVReader_CompressedSourceSkipsFrameLargerThanMaxBuffer)
+{
+	remove("reader_big_frame.csv.lz4");
+	std::string frames;
+	const std::string first = "A,B\n1,2\n";
+	LZ4Frame::AppendFrame(frames, first.data(), first.size());
+	// incompressible, so the frame is larger than the buffer can grow to
+	std::string large;
+	uint32_t seed = 7;
+	for (int i = 0; i < 1000; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		large += static_cast<char>('a' + (seed >> 24) % 26);
+	}
+	large += ",x\n";
+	LZ4Frame::AppendFrame(frames, large.data(), large.size());
+	const std::string last = "3,4\n";
+	LZ4Frame::AppendFrame(frames, last.data(), last.size());
+	AppendToFile("reader_big_frame.csv.lz4", frames);
+
+	CSVReader reader;
+	reader.SetSourceFilePath(L"reader_big_frame.csv.lz4");
+	reader.SetReadBufferSize(64, 256);
+	CHECK((ReadFirstFields(reader) == std::vector<std::string>{ "1", "3" }));
+	CHECK(reader.GetSkippedCount() == 1);
+	remove("reader_big_frame.csv.lz4");
+}
+
+TEST(CSVReader_VisitRowsStopsAfterTheVisitorsRow)
+{
+	remove("reader_visit.csv");
+	AppendToFile("reader_visit.csv", "\xEF\xBB\xBF" "Name,Count\r\n\"a,b\",1\r\nc,2\r\nd,3\r\n");
+	CSVReader reader;
+	reader.SetSourceFilePath(L"reader_visit.csv");
+	std::vector<std::string> values;
+	CHECK(reader.VisitRows([&](const CSVRowView& row)
+		{
+			values.push_back(row[0].ToString());
+			return values.size() < 2;
+		}) == 2);
+	CHECK((values == std::vector<std::string>{ "a,b", "c" }));
+	// the next read starts with the row after the one the visitor stopped at
+	CHECK((ReadFirstFields(reader) == std::vector<std::string>{ "d" }));
+	remove("reader_visit.csv");
+}
+
+TEST(CSVReader_ReadRowsAdapters)
+{
+	remove("reader_rows.csv");
+	AppendToFile("reader_rows.csv", "\xEF\xBB\xBF" "Name,Count\r\n\"caf\xC3\xA9 \"\"x\"\"\",1\r\n,2\r\n");
+	CSVReader reader;
+	reader.SetSourceFilePath(L"reader_rows.csv");
+	std::vector<std::vector<std::string>> rows;
+	CHECK(reader.ReadRows(rows) == 2);
+	CHECK((rows == std::vector<std::vector<std::string>>{ { "caf\xC3\xA9 \"x\"", "1" }, { "", "2" } }));
+
+	// the wide adapter converts the same rows, and appends to what the vector holds
+	AppendToFile("reader_rows.csv", "\xE2\x82\xAC,3\r\n");
+	std::vector<std::vector<std::wstring>> wideRows = { { L"kept" } };
+	CHECK(reader.ReadRows(wideRows) == 2);
+	CHECK((wideRows == std::vector<std::vector<std::wstring>>{ { L"kept" }, { L"\x20AC", L"3" } }));
+	remove("reader_rows.csv");
+}
+
+TEST(CSVReader_UTF8HeaderAndEscapedValues)
+{
+	remove("reader_utf8.csv");
+	// as CSVEmitter writes them: quotes and apostrophes doubled, commas backslash escaped
+	AppendToFile("reader_utf8.csv", "\xEF\xBB\xBF\"Caf\xC3\xA9\",\"\xE2\x82\xAC\"\r\n\"it''s \"\"\xF0\x9F\x98\x80\"\"\",\"a\\,b\"\r\n");
+	CSVReader reader;
+	reader.SetSourceFilePath(L"reader_utf8.csv");
+	std::vector<std::vector<std::string>> rows;
+	CHECK(reader.ReadRows(rows) == 1);
+	CHECK((reader.GetHeaderNames() == std::vector<std::string>{ "Caf\xC3\xA9", "\xE2\x82\xAC" }));
+	CHECK((rows == std::vector<std::vector<std::string>>{ { "it's \"\xF0\x9F\x98\x80\"", "a,b" } }));
+	remove("reader_utf8.csv");
+}
+
+TEST(CSVReader_VisitRowsIntoColumnarSink)
+{
+	remove("reader_sink.csv");
+	AppendToFile("reader_sink.csv", "\xEF\xBB\xBF" "Name,PID,CPU\r\n\"explorer.exe\",\"1234\",\"0.25\"\r\n\"cmd.exe\",\"88\",\"1.5\"\r\n");
+	CSVReader reader;
+	reader.SetSourceFilePath(L"reader_sink.csv");
+	CSVColumnarSink sink;
+	sink.AddColumn(1, CSVColumnarSink::COLUMN_INT64);
+	sink.AddColumn(2, CSVColumnarSink::COLUMN_DOUBLE);
+	sink.AddColumn(0, CSVColumnarSink::COLUMN_STRING);
+	CHECK(reader.VisitRows(sink.AsVisitor()) == 2);
+	CHECK((reader.GetHeaderNames() == std::vector<std::string>{ "Name", "PID", "CPU" }));
+	CHECK((sink.GetInt64Column(0) == std::vector<int64_t>{ 1234, 88 }));
+	CHECK((sink.GetDoubleColumn(1) == std::vector<double>{ 0.25, 1.5 }));
+	CHECK(sink.GetString(2, 1) == "cmd.exe");
+	CHECK(sink.GetParseErrorCount() == 0);
+	remove("reader_sink.csv");
+}
+
+TEST(CSVReader_VisitProjectedBindsToTheHeader)
+{
+	remove("reader_projected.csv");
+	AppendToFile("reader_projected.csv", "\xEF\xBB\xBF" "Time,Name,PID,CPU,Unused\r\n"
+		"\"2024-01-02 03:04:05\",\"a\",\"10\",\"0.5\",\"x\"\r\n\"bad\",\"b\",\"11\",\"1.5\",\"y\"\r\n");
+	CSVReader reader;
+	reader.SetSourceFilePath(L"reader_projected.csv");
+	CSVProjection projection;
+	const size_t pid = projection.Select("pid", CSVProjection::VALUE_INT64);
+	const size_t time = projection.Select("Time", CSVProjection::VALUE_TIMESTAMP);
+	std::vector<int64_t> pids, times;
+	const auto visitor = [&](const CSVProjection& values)
+	{
+		pids.push_back(values.GetInt64(pid));
+		times.push_back(values.IsValid(time) ? values.GetTimestamp(time) : -1);
+		return true;
+	};
+	CHECK(reader.VisitProjected(projection, visitor) == 2);
+	CHECK(projection.IsBound());
+	CHECK(projection.GetFieldCountNeeded() == 3);
+	CHECK((pids == std::vector<int64_t>{ 10, 11 }));
+	CHECK((times == std::vector<int64_t>{ 1704164645000LL, -1 }));
+	remove("reader_projected.csv");
+}
@@ -0,0 +1,70 @@
+#include "TestHarness.h"
+#include "../CSVScanner.h"
+#include <cstring>
+
+// random buffers biased towards structural bytes, checking every implementation available on this CPU
+// against the scalar path, block by block and via a Cursor from every offset
+TEST(CSVScanner_DifferentialFuzz)
+{
+	const char alphabet[] = { ',', '"', '\r', '\n', '\\', '\'', ' ', 'a', 'z', '\x7f', '\x80', '\xc3', '\xff', '\0', '-', '.' };
+	char buffer[CSVScanner::BLOCK_SIZE * 4 + 7];
+	uint32_t seed = 1;
+	for (int iteration = 0; iteration < 2000; iteration++)
+	{
+		// LCG, good enough to shake out lane and block boundary mistakes
+		seed = seed * 1664525 + 1013904223;
+		const size_t length = (seed >> 8) % sizeof(buffer);
+		for (size_t i = 0; i < length; i++)
+		{
+			seed = seed * 1664525 + 1013904223;
+			buffer[i] = (seed >> 24) & 1 ? alphabet[(seed >> 16) % sizeof(alphabet)] : static_cast<char>(seed >> 8);
+		}
+		for (int impl = CSVScanner::IMPL_SCALAR; impl <= CSVScanner::IMPL_AVX2; impl++)
+		{
+			if (!CSVScanner::IsImplementationAvailable(static_cast<CSVScanner::Implementation>(impl)))
+			{
+				continue;
+			}
+			CSVScanner::BlockMaskFn fn = CSVScanner::GetBlockMaskFn(static_cast<CSVScanner::Implementation>(impl));
+			for (size_t block = 0; block + CSVScanner::BLOCK_SIZE <= length; block += CSVScanner::BLOCK_SIZE)
+			{
+				REQUIRE(fn(buffer + block) == CSVScanner::BlockMaskScalar(buffer + block));
+			}
+			CSVScanner::Cursor cursor(buffer, length, fn);
+			for (size_t from = 0; from <= length; from++)
+			{
+				REQUIRE(cursor.Next(from) == from + CSVScanner::FindStructuralScalar(buffer + from, length - from));
+			}
+		}
+	}
+}
+
+TEST(CSVScanner_FindStructural)
+{
+	const char* text = "abc,def";
+	CHECK(CSVScanner::FindStructural(text, strlen(text)) == 3);
+	CHECK(CSVScanner::FindStructural("abcdef", 6) == 6);
+	CHECK(CSVScanner::FindStructural("", 0) == 0);
+
+	// past the first block, and in the padded final partial block
+	char longText[150];
+	memset(longText, 'x', sizeof(longText));
+	longText[130] = '\n';
+	CHECK(CSVScanner::FindStructural(longText, sizeof(longText)) == 130);
+	CHECK(CSVScanner::FindStructural(longText, 130) == 130);
+}
+
+TEST(CSVScanner_CursorWalksEveryStructural)
+{
+	const char* text = "a,\"b\"\r\nc\\d'e";
+	const size_t expected[] = { 1, 2, 4, 5, 6, 8, 10 };
+	CSVScanner::Cursor cursor(text, strlen(text));
+	size_t found = 0;
+	for (size_t position = cursor.Next(0); position < strlen(text); position = cursor.Next(position + 1))
+	{
+		REQUIRE(found < sizeof(expected) / sizeof(expected[0]));
+		CHECK(position == expected[found]);
+		found++;
+	}
+	CHECK(found == sizeof(expected) / sizeof(expected[0]));
+}
@@ -0,0 +1,88 @@
+#include "TestHarness.h"
+#include "../CSVTokenizer.h"
+#include <cstring>
+
+static std::vector<std::string> ToStrings(const std::vector<CSVField>& fields)
+{
+	std::vector<std::string> values;
+	for (auto& field : fields)
+	{
+		values.push_back(field.ToString());
+	}
+	return values;
+}
+
+TEST(CSVTokenizer_QuotedAndEscapedFields)
+{
+	const char* text = "\"a\",\"b\\,c\", d ,\"e\"\"f\"\r\n";
+	CSVTokenizer tokenizer(text, strlen(text));
+	std::vector<CSVField> fields;
+	REQUIRE(tokenizer.NextRow(fields));
+	CHECK((ToStrings(fields) == std::vector<std::string>{ "a", "b,c", "d", "e\"f" }));
+	CHECK(!fields[0].hasEscapes);
+	CHECK(fields[3].hasEscapes);
+	CHECK(tokenizer.GetPosition() == strlen(text));
+	CHECK(!tokenizer.NextRow(fields));
+}
+
+TEST(CSVTokenizer_FieldsAreViewsIntoSource)
+{
+	const char* text = "abc,def\n";
+	CSVTokenizer tokenizer(text, strlen(text));
+	std::vector<CSVField> fields;
+	REQUIRE(tokenizer.NextRow(fields));
+	REQUIRE(fields.size() == 2);
+	CHECK(fields[1].raw.data() == text + 4);
+	std::string scratch;
+	CHECK(fields[1].Value(scratch).data() == text + 4);
+}
+
+TEST(CSVTokenizer_EmbeddedLineBreaksAndBlankLines)
+{
+	const char* text = "\r\n\"multi\nline\",x\n\n  ,\n";
+	CSVTokenizer tokenizer(text, strlen(text));
+	std::vector<CSVField> fields;
+	REQUIRE(tokenizer.NextRow(fields));
+	CHECK((ToStrings(fields) == std::vector<std::string>{ "multi\nline", "x" }));
+	REQUIRE(tokenizer.NextRow(fields));
+	CHECK((ToStrings(fields) == std::vector<std::string>{ "", "" }));
+	CHECK(!tokenizer.NextRow(fields));
+	CHECK(tokenizer.IsAtEnd());
+}
+
+TEST(CSVTokenizer_PartialRowIsPendingUntilFinal)
+{
+	const char* text = "a,b\npartial,\"q";
+	CSVTokenizer tokenizer(text, strlen(text));
+	std::vector<CSVField> fields;
+	REQUIRE(tokenizer.NextRow(fields));
+	const size_t rowEnd = tokenizer.GetPosition();
+	CHECK(rowEnd == 4);
+	CHECK(!tokenizer.NextRow(fields));
+	CHECK(tokenizer.GetPosition() == rowEnd);
+	REQUIRE(tokenizer.NextRow(fields, true));
+	CHECK((ToStrings(fields) == std::vector<std::string>{ "partial", "q" }));
+}
+
+TEST(CSVTokenizer_MaxFieldsStillConsumesRow)
+{
+	const char* text = "1,2,3,4\n5,6\n";
+	CSVTokenizer tokenizer(text, strlen(text));
+	std::vector<CSVField> fields;
+	REQUIRE(tokenizer.NextRow(fields, false, 2));
+	CHECK((ToStrings(fields) == std::vector<std::string>{ "1", "2" }));
+	REQUIRE(tokenizer.NextRow(fields));
+	CHECK((ToStrings(fields) == std::vector<std::string>{ "5", "6" }));
+}
+
+TEST(CSVTokenizer_EscapeRoundTrip)
+{
+	const std::string values[] = { "plain", "it's", "say \"hi\"", "a,b", "" };
+	for (auto& value : values)
+	{
+		std::string escaped, unescaped;
+		CSVTokenizer::AppendEscaped(escaped, value, true);
+		CSVTokenizer::Unescape(escaped, unescaped);
+		CHECK(unescaped == value);
+	}
+}
@@ -0,0 +1,43 @@
+#include "TestHarness.h"
+#include <atlstr.h>
+#include "../CSVUtil.h"
+
+TEST(CSVUtil_ParseCSVRowUTF8)
+{
+	CSVUtil csvUtil;
+	std::vector<std::string> fields;
+	// only the first row is parsed, fields come back unescaped and as UTF-8
+	CHECK(csvUtil.ParseCSVRow("\"caf\xC3\xA9\",\"a \"\"b\"\"\",plain,\"x\\,y\",\r\nnext,row\r\n", fields) == 5);
+	CHECK((fields == std::vector<std::string>{ "caf\xC3\xA9", "a \"b\"", "plain", "x,y", "" }));
+	// fields are appended to what the vector holds
+	CHECK(csvUtil.ParseCSVRow("\xE2\x82\xAC", fields) == 6);
+	CHECK(fields.back() == "\xE2\x82\xAC");
+	fields.clear();
+	CHECK(csvUtil.ParseCSVRow("", fields) == 0);
+
+	// the wide parser gives the same fields, converted
+	std::vector<std::wstring> wideFields;
+	CHECK(csvUtil.ParseCSVRow(std::wstring(L"\"caf\x00E9\",\"\x20AC \"\"1\"\"\"\r\n"), wideFields) == 2);
+	CHECK((wideFields == std::vector<std::wstring>{ L"caf\x00E9", L"\x20AC \"1\"" }));
+}
+
+TEST(CSVUtil_EscapeRoundTripUTF8)
+{
+	CSVUtil csvUtil;
+	const std::string values[] = { "", "plain", "caf\xC3\xA9", "it's \"quoted\"", "a,b", "\xF0\x9F\x98\x80,'\"" };
+	for (auto& value : values)
+	{
+		for (const bool escapeCommas : { false, true })
+		{
+			std::string escaped = "kept";
+			csvUtil.AppendEscapedField(escaped, value, escapeCommas);
+			CHECK(escaped.compare(0, 4, "kept") == 0);
+			// matching the wide escaping
+			const std::wstring wideValue = UTFConvert::ToWide(value);
+			CHECK(UTFConvert::ToWide(escaped.substr(4)) == std::wstring(csvUtil.EscapeField(wideValue.c_str(), escapeCommas).GetString()));
+			std::string unescaped = "replaced";
+			csvUtil.UnescapeField(escaped.substr(4), unescaped);
+			CHECK(unescaped == value);
+		}
+	}
+}
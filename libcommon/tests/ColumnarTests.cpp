@@ -0,0 +1,253 @@
+#include "TestHarness.h"
+#include <windows.h>
+#include "../ColumnarEmitter.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+static std::string ReadFileBytes(const char* path)
+{
+	std::ifstream in(path, std::ios::binary);
+	std::stringstream bytes;
+	bytes << in.rdbuf();
+	return bytes.str();
+}
+
+// every value of the file as text, a row per entry with values separated by |
+static std::vector<std::string> ReadRows(const WCHAR* path, size_t* blockCount = nullptr)
+{
+	std::vector<std::string> rows;
+	ColumnarReader reader;
+	if (!reader.Open(path))
+	{
+		return rows;
+	}
+	std::string scratch;
+	size_t blocks = 0;
+	reader.VisitBlocks([&](const ColumnarReader::Block& block)
+		{
+			blocks++;
+			for (size_t r = 0; r < block.GetRowCount(); r++)
+			{
+				std::string row;
+				for (size_t c = 0; c < block.GetColumnCount(); c++)
+				{
+					row += (c ? "|" : "");
+					row += block.GetString(c, r, scratch);
+				}
+				rows.push_back(row);
+			}
+			return true;
+		});
+	if (blockCount)
+	{
+		*blockCount = blocks;
+	}
+	return rows;
+}
+
+TEST(ColumnarFormat_VarintsAndDecoderBounds)
+{
+	const uint64_t values[] = { 0, 1, 127, 128, 300, 0xFFFFFFFFULL, UINT64_MAX };
+	std::string encoded;
+	for (auto value : values)
+	{
+		ColumnarFormat::AppendVarint(encoded, value);
+	}
+	ColumnarFormat::AppendString(encoded, "name");
+	CHECK(encoded.size() == 1 + 1 + 1 + 2 + 2 + 5 + 10 + 5);
+
+	ColumnarFormat::Decoder decoder(encoded.data(), encoded.size());
+	for (auto value : values)
+	{
+		uint64_t decoded = 0;
+		CHECK(decoder.ReadVarint(decoded) && decoded == value);
+	}
+	std::string_view name;
+	CHECK(decoder.ReadString(name) && name == "name");
+	CHECK(decoder.GetRemaining() == 0);
+	uint8_t byte;
+	CHECK(!decoder.ReadByte(byte));
+	CHECK(!decoder.IsValid());
+
+	// a string longer than what is left, and a varint cut off, fail and keep failing
+	std::string truncated;
+	ColumnarFormat::AppendVarint(truncated, 10);
+	truncated += "abc";
+	ColumnarFormat::Decoder shortString(truncated.data(), truncated.size());
+	CHECK(!shortString.ReadString(name));
+	CHECK(!shortString.ReadByte(byte));
+	const char cutVarint[] = { '\x80', '\x80' };
+	ColumnarFormat::Decoder shortVarint(cutVarint, sizeof(cutVarint));
+	uint64_t decoded = 0;
+	CHECK(!shortVarint.ReadVarint(decoded));
+
+	for (const int64_t value : { int64_t(0), int64_t(-1), int64_t(1), int64_t(-123456789), INT64_MAX, INT64_MIN })
+	{
+		CHECK(ColumnarFormat::ZigZagDecode(ColumnarFormat::ZigZagEncode(value)) == value);
+	}
+	CHECK(ColumnarFormat::ZigZagEncode(-1) == 1);
+	CHECK(ColumnarFormat::ZigZagEncode(1) == 2);
+}
+
+TEST(ColumnarEmitter_ColumnsRoundTripThroughEachEncoding)
+{
+	remove("columnar_test.lcs");
+	{
+		ColumnarEmitter emitter(L"columnar_test.lcs", { CString(L"PID"), CString(L"Delta"), CString(L"Name"), CString(L"Mixed"), CString(L"Unset") });
+		emitter.SetBlockLimits(3);
+		CHECK(emitter.OpenOutputFile(true));
+		const long long deltas[] = { 5, -7, INT64_MAX, INT64_MIN, 0, 42, -1 };
+		const WCHAR* names[] = { L"explorer.exe", L"cmd.exe", L"explorer.exe", L"", L"café.exe", L"cmd.exe", L"explorer.exe" };
+		for (size_t i = 0; i < 7; i++)
+		{
+			emitter.AddValue(L"PID", static_cast<DWORD>(1000 + i * 4));
+			if (i % 2 == 0)
+			{
+				emitter.AddValue(1, deltas[i]);	// sparse: only even rows
+			}
+			emitter.AddValue(L"Name", names[i]);
+			if (i == 5)
+			{
+				emitter.AddValue(L"Mixed", static_cast<unsigned long long>(UINT64_MAX));	// too big for int64, kept as text
+			}
+			else if (i % 3 == 0)
+			{
+				emitter.AddValue(L"Mixed", L"text");
+			}
+			else
+			{
+				emitter.AddValue(L"Mixed", static_cast<DWORD>(i));
+			}
+			CHECK(emitter.WriteCurrentLine());
+		}
+		emitter.CloseOutputFile();
+	}
+
+	ColumnarReader reader;
+	REQUIRE(reader.Open(L"columnar_test.lcs"));
+	CHECK((reader.GetFieldNames() == std::vector<std::string>{ "PID", "Delta", "Name", "Mixed", "Unset" }));
+	std::vector<std::string> rows;
+	std::vector<int64_t> pids;
+	std::string scratch;
+	size_t blocks = 0;
+	const size_t rowCount = reader.VisitBlocks([&](const ColumnarReader::Block& block)
+		{
+			blocks++;
+			CHECK(block.GetColumnCount() == 5);
+			CHECK(block.IsIntColumn(0));
+			CHECK(block.IsIntColumn(1));
+			CHECK(!block.IsIntColumn(2));
+			CHECK(!block.IsIntColumn(4));
+			const std::vector<int64_t>& pidColumn = block.GetInt64Column(0);
+			pids.insert(pids.end(), pidColumn.begin(), pidColumn.begin() + block.GetRowCount());
+			for (size_t r = 0; r < block.GetRowCount(); r++)
+			{
+				CHECK(!block.HasValue(4, r));
+				std::string row;
+				for (size_t c = 0; c < block.GetColumnCount(); c++)
+				{
+					row += (c ? "|" : "");
+					row += block.GetString(c, r, scratch);
+				}
+				rows.push_back(row);
+			}
+			return true;
+		});
+	CHECK(rowCount == 7);
+	CHECK(blocks == 3);
+	CHECK((pids == std::vector<int64_t>{ 1000, 1004, 1008, 1012, 1016, 1020, 1024 }));
+	CHECK((rows == std::vector<std::string>{
+		"1000|5|explorer.exe|text|",
+		"1004||cmd.exe|1|",
+		"1008|9223372036854775807|explorer.exe|2|",
+		"1012|||text|",
+		"1016|0|caf\xC3\xA9.exe|4|",
+		"1020||cmd.exe|18446744073709551615|",
+		"1024|-1|explorer.exe|text|" }));
+	reader.Close();
+	remove("columnar_test.lcs");
+}
+
+TEST(ColumnarEmitter_AppendsAfterPartialBlockAndRestartsOnNewSchema)
+{
+	remove("columnar_append.lcs");
+	auto writeRows = [](const std::vector<CString>& fields, const DWORD first, const DWORD count)
+	{
+		ColumnarEmitter emitter(L"columnar_append.lcs", fields);
+		for (DWORD i = first; i < first + count; i++)
+		{
+			emitter.AddValue(L"A", i);
+			CHECK(emitter.WriteCurrentLine());
+		}
+		emitter.CloseOutputFile();
+	};
+	writeRows({ CString(L"A") }, 0, 2);
+	const std::string whole = ReadFileBytes("columnar_append.lcs");
+
+	// a block left half written by a writer that stopped is ignored by readers
+	std::ofstream("columnar_append.lcs", std::ios::binary | std::ios::app) << std::string("\xB7\x05\x40\x01", 4);
+	{
+		ColumnarReader reader;
+		REQUIRE(reader.Open(L"columnar_append.lcs"));
+		CHECK(reader.GetValidLength() == whole.size());
+	}
+	CHECK((ReadRows(L"columnar_append.lcs") == std::vector<std::string>{ "0", "1" }));
+
+	// and cut off by the next writer with the same schema, which appends
+	writeRows({ CString(L"A") }, 2, 2);
+	size_t blocks = 0;
+	CHECK((ReadRows(L"columnar_append.lcs", &blocks) == std::vector<std::string>{ "0", "1", "2", "3" }));
+	CHECK(blocks == 2);
+	CHECK(ReadFileBytes("columnar_append.lcs").compare(0, whole.size(), whole) == 0);
+
+	// a different schema starts the file over
+	writeRows({ CString(L"A"), CString(L"B") }, 7, 1);
+	CHECK((ReadRows(L"columnar_append.lcs") == std::vector<std::string>{ "7|" }));
+	remove("columnar_append.lcs");
+}
+
+TEST(ColumnarReader_ConvertsToEmitterCSV)
+{
+	remove("columnar_convert.lcs");
+	remove("columnar_convert.csv");
+	{
+		ColumnarEmitter emitter(L"columnar_convert.lcs", { CString(L"Name"), CString(L"Count") });
+		emitter.AddValue(L"Name", L"a,\"b\"");
+		emitter.AddValue(L"Count", static_cast<DWORD>(5));
+		CHECK(emitter.WriteCurrentLine());
+		emitter.AddValue(L"Name", L"c");
+		CHECK(emitter.WriteCurrentLine());
+		emitter.CloseOutputFile();
+	}
+	CHECK(ColumnarReader::ConvertToCSV(L"columnar_convert.lcs", L"columnar_convert.csv") == 2);
+	// as CSVEmitter writes it
+	CHECK(ReadFileBytes("columnar_convert.csv") == "\xEF\xBB\xBF\"Name\",\"Count\"\r\n\"a\\,\"\"b\"\"\",\"5\"\r\n\"c\",\"\"\r\n");
+
+	std::ofstream("columnar_convert.lcs", std::ios::binary | std::ios::trunc) << "not a sampling file";
+	CHECK(ColumnarReader::ConvertToCSV(L"columnar_convert.lcs", L"columnar_convert.csv") == -1);
+	remove("columnar_convert.lcs");
+	remove("columnar_convert.csv");
+}
+
+TEST(ColumnarEmitter_TimerWritesBlockWhenRowsStop)
+{
+	remove("columnar_timer.lcs");
+	ColumnarEmitter emitter(L"columnar_timer.lcs", { CString(L"A") });
+	emitter.SetBlockLimits(1000, 50);
+	emitter.AddValue(L"A", static_cast<DWORD>(1));
+	CHECK(emitter.WriteCurrentLine());
+	emitter.AddValue(L"A", static_cast<DWORD>(2));
+	CHECK(emitter.WriteCurrentLine());
+	// no more rows are written, the block still reaches the file once the interval has passed
+	std::vector<std::string> rows;
+	for (int i = 0; i < 100 && rows.size() < 2; i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		rows = ReadRows(L"columnar_timer.lcs");
+	}
+	CHECK((rows == std::vector<std::string>{ "1", "2" }));
+	emitter.CloseOutputFile();
+	remove("columnar_timer.lcs");
+}
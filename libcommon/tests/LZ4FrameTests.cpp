@@ -0,0 +1,220 @@
+#include "TestHarness.h"
+#include <windows.h>
+#include "../LZ4Frame.h"
+#define LOG_DEBUG_PRINT(...)
+#include "../CSVEmitter.h"
+#include "../CSVReader.h"
+#include <cstdio>
+#include <random>
+
+static std::string FromHex(const char* hex)
+{
+	std::string bytes;
+	for (; hex[0] && hex[1]; hex += 2)
+	{
+		bytes.push_back(static_cast<char>(std::stoi(std::string(hex, 2), nullptr, 16)));
+	}
+	return bytes;
+}
+
+// the rows the reference frame below holds
+static std::string ReferenceText()
+{
+	std::string text;
+	for (int i = 0; i < 4400; i++)
+	{
+		text += "row " + std::to_string(i % 7) + ",abcabcabc\n";
+	}
+	return text;
+}
+
+// ReferenceText() written by the lz4 1.9.4 tool: lz4 -B4 -BD --content-size
+// linked 64KB blocks (the second block's first match reaches back into the first), content size and
+// content checksum
+static const char* REFERENCE_FRAME_HEX =
+	"04224d184c400013010000000000863201000092726f7720302c6162630300100a10001b3110001b3210001b3310001b"
+	"3410001b3510001b3610000f7000ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff"
+	"ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff"
+	"ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff"
+	"ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff"
+	"ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff"
+	"ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff7450636162630a1c0000000ff0ffffffffff"
+	"fffffffffffffffffffffffffffffa50636162630a000000009526c404";
+
+static std::string RoundTrip(const std::string& text, LZ4Frame::FrameStatus& status, size_t& frameSize, size_t& written)
+{
+	std::string frame;
+	LZ4Frame::AppendFrame(frame, text.data(), text.size());
+	written = frame.size();
+	std::string decoded;
+	frameSize = 0;
+	status = LZ4Frame::ReadFrame(frame.data(), frame.size(), frameSize, &decoded);
+	return decoded;
+}
+
+TEST(LZ4Frame_XXH32KnownValues)
+{
+	CHECK(LZ4Frame::XXH32("", 0, 0) == 0x02CC5D05);
+	CHECK(LZ4Frame::XXH32("abc", 3, 0) == 0x32D153FF);
+	const char* text = "Nobody inspects the spammish repetition";
+	CHECK(LZ4Frame::XXH32(text, strlen(text), 0) == 0xE2293B2F);
+}
+
+TEST(LZ4Frame_RoundTripsBlocks)
+{
+	std::mt19937 random(7);
+	std::string randomText(200000, '\0');
+	for (auto& c : randomText)
+	{
+		c = static_cast<char>(random());
+	}
+	std::string rows;
+	for (int i = 0; rows.size() < 3 * LZ4Frame::BLOCK_SIZE + 123; i++)
+	{
+		rows += "\"explorer.exe\",\"" + std::to_string(i * 7919 % 1000) + "\",\"0.5\"\r\n";
+	}
+	// empty, shorter than a match can start in, stored blocks (random) and several compressed blocks
+	const std::string inputs[] = { "", "a", "abcabcabcabc", std::string(13, 'x'), std::string(LZ4Frame::BLOCK_SIZE, 'x'),
+		randomText.substr(0, 1000), randomText, rows };
+	for (auto& text : inputs)
+	{
+		LZ4Frame::FrameStatus status;
+		size_t frameSize, written;
+		CHECK(RoundTrip(text, status, frameSize, written) == text);
+		CHECK(status == LZ4Frame::FRAME_COMPLETE);
+		CHECK(frameSize == written);
+	}
+	std::string frame;
+	LZ4Frame::AppendFrame(frame, rows.data(), rows.size());
+	CHECK(frame.size() < rows.size() / 4);
+}
+
+TEST(LZ4Frame_PartialFrameIsIncomplete)
+{
+	std::string text;
+	for (int i = 0; i < 5000; i++)
+	{
+		text += std::to_string(i) + ",";
+	}
+	std::string frame;
+	LZ4Frame::AppendFrame(frame, text.data(), text.size());
+	// a frame still being written is incomplete at every length, and nothing is decoded from it
+	for (size_t length = 0; length < frame.size(); length++)
+	{
+		std::string decoded = "kept";
+		size_t frameSize = 0;
+		if (!CHECK(LZ4Frame::ReadFrame(frame.data(), length, frameSize, &decoded) == LZ4Frame::FRAME_INCOMPLETE))
+		{
+			break;
+		}
+		CHECK(decoded == "kept");
+	}
+	// two frames back to back are read one at a time
+	const std::string second = frame;
+	frame += second;
+	size_t frameSize = 0;
+	std::string decoded;
+	CHECK(LZ4Frame::ReadFrame(frame.data(), frame.size(), frameSize, &decoded) == LZ4Frame::FRAME_COMPLETE);
+	CHECK(frameSize == second.size());
+	CHECK(decoded == text);
+}
+
+TEST(LZ4Frame_ReadsReferenceEncoderFrames)
+{
+	const std::string frame = FromHex(REFERENCE_FRAME_HEX);
+	size_t frameSize = 0;
+	std::string decoded;
+	CHECK(LZ4Frame::IsFrameStart(frame.data(), frame.size()));
+	CHECK(LZ4Frame::ReadFrame(frame.data(), frame.size(), frameSize, &decoded) == LZ4Frame::FRAME_COMPLETE);
+	CHECK(frameSize == frame.size());
+	CHECK(decoded == ReferenceText());
+
+	// a skippable frame is stepped over without output
+	const std::string skippable = FromHex("5a2a4d1803000000616263");
+	decoded.clear();
+	CHECK(LZ4Frame::IsFrameStart(skippable.data(), skippable.size()));
+	CHECK(LZ4Frame::ReadFrame(skippable.data(), skippable.size(), frameSize, &decoded) == LZ4Frame::FRAME_COMPLETE);
+	CHECK(frameSize == skippable.size());
+	CHECK(decoded.empty());
+	CHECK(LZ4Frame::ReadFrame(skippable.data(), skippable.size() - 1, frameSize, &decoded) == LZ4Frame::FRAME_INCOMPLETE);
+}
+
+TEST(LZ4Frame_CorruptFrameIsInvalid)
+{
+	const std::string text(1000, 'q');
+	std::string frame;
+	LZ4Frame::AppendFrame(frame, text.data(), text.size());
+	size_t frameSize = 0;
+	std::string decoded;
+
+	std::string badMagic = frame;
+	badMagic[0] ^= 1;
+	CHECK(!LZ4Frame::IsFrameStart(badMagic.data(), badMagic.size()));
+	CHECK(LZ4Frame::ReadFrame(badMagic.data(), badMagic.size(), frameSize, &decoded) == LZ4Frame::FRAME_INVALID);
+
+	std::string badHeaderChecksum = frame;
+	badHeaderChecksum[6] ^= 1;
+	CHECK(LZ4Frame::ReadFrame(badHeaderChecksum.data(), badHeaderChecksum.size(), frameSize, &decoded) == LZ4Frame::FRAME_INVALID);
+
+	// the first match's offset (after the token and one literal) reaching before the start of the content
+	std::string badOffset = frame;
+	badOffset[13] = static_cast<char>(0xFF);
+	badOffset[14] = static_cast<char>(0xFF);
+	CHECK(LZ4Frame::ReadFrame(badOffset.data(), badOffset.size(), frameSize, &decoded) == LZ4Frame::FRAME_INVALID);
+	CHECK(decoded.empty());
+}
+
+TEST(LZ4Frame_EmitterFramesReadBackByReader)
+{
+	remove("lz4_test.csv.lz4");
+	remove("lz4_test.csv.lz4.hdr");
+	CSVReader reader;
+	reader.SetSourceFilePath(L"lz4_test.csv.lz4");
+	std::vector<std::string> values;
+	auto readValues = [&]()
+	{
+		values.clear();
+		reader.VisitRows([&](const CSVRowView& row)
+			{
+				values.push_back(row[0].ToString() + "|" + row[1].ToString());
+				return true;
+			});
+	};
+	{
+		CSVEmitter emitter(L"lz4_test.csv.lz4", { CString(L"Name"), CString(L"Count") });
+		emitter.SetCompressedOutput(true);
+		emitter.SetWriteBuffering(0);
+		emitter.AddValue(L"Name", L"a");
+		emitter.AddValue(L"Count", static_cast<DWORD>(1));
+		CHECK(emitter.WriteCurrentLine());
+		emitter.AddValue(L"Name", L"b");
+		emitter.AddValue(L"Count", static_cast<DWORD>(2));
+		CHECK(emitter.WriteCurrentLine());
+		readValues();
+		CHECK((values == std::vector<std::string>{ "a|1", "b|2" }));
+		CHECK((reader.GetHeaderNames() == std::vector<std::string>{ "Name", "Count" }));
+
+		// later frames are read from the bookmark
+		emitter.AddValue(L"Name", L"c");
+		emitter.AddValue(L"Count", static_cast<DWORD>(3));
+		CHECK(emitter.WriteCurrentLine());
+		emitter.CloseOutputFile();
+	}
+	readValues();
+	CHECK((values == std::vector<std::string>{ "c|3" }));
+
+	// a reopened emitter appends frames after the existing ones
+	{
+		CSVEmitter emitter(L"lz4_test.csv.lz4", { CString(L"Name"), CString(L"Count") });
+		emitter.SetCompressedOutput(true);
+		emitter.SetWriteBuffering(0);
+		emitter.AddValue(L"Name", L"d");
+		emitter.AddValue(L"Count", static_cast<DWORD>(4));
+		CHECK(emitter.WriteCurrentLine());
+		emitter.CloseOutputFile();
+	}
+	readValues();
+	CHECK((values == std::vector<std::string>{ "d|4" }));
+	remove("lz4_test.csv.lz4");
+	remove("lz4_test.csv.lz4.hdr");
+}
@@ -0,0 +1,129 @@
+#include "TestHarness.h"
+#include <windows.h>
+#include "../libCommon.h"
+#include "../NoCaseSearcher.h"
+#include <random>
+
+// first position at or after start where every unit folds equal, as the reference
+static size_t NaiveFind(const std::wstring& haystack, const std::wstring& needle, const size_t start)
+{
+	for (size_t position = start; position <= haystack.size() && needle.size() <= haystack.size() - position; position++)
+	{
+		size_t i = 0;
+		while (i < needle.size() && CaseFold::Fold(haystack[position + i]) == CaseFold::Fold(needle[i]))
+		{
+			i++;
+		}
+		if (i == needle.size())
+		{
+			return position;
+		}
+	}
+	return std::wstring::npos;
+}
+
+// small alphabet with case pairs, non-ASCII, and characters several units fold to (K, k and the Kelvin
+// sign; s and the long s), so both the SSE2 filter and the Two-Way shifts see near misses
+static const wchar_t alphabet[] = { L'a', L'A', L'b', L'k', L'K', L'\x212A', L's', L'\x017F', L'\x00E9', L'\x00C9' };
+
+static std::wstring RandomText(std::mt19937& random, const size_t length, const size_t alphabetSize)
+{
+	std::wstring text;
+	for (size_t i = 0; i < length; i++)
+	{
+		text += alphabet[random() % alphabetSize];
+	}
+	return text;
+}
+
+TEST(NoCaseSearcher_MatchesNaiveSearch)
+{
+	std::mt19937 random(3);
+	for (int iteration = 0; iteration < 3000; iteration++)
+	{
+		// short needles take the filter, 32 units and up Two-Way. Repetitive needles are the hard case
+		// for Two-Way's periodic shifts.
+		const size_t needleLength = (iteration % 3 == 0) ? 32 + random() % 40 : random() % 9;
+		const size_t alphabetSize = 2 + random() % (sizeof(alphabet) / sizeof(alphabet[0]) - 1);
+		std::wstring needle;
+		if (iteration % 5 == 0 && needleLength)
+		{
+			const std::wstring unit = RandomText(random, 1 + random() % 4, alphabetSize);
+			while (needle.size() < needleLength)
+			{
+				needle += unit;
+			}
+			needle.resize(needleLength);
+		}
+		else
+		{
+			needle = RandomText(random, needleLength, alphabetSize);
+		}
+		const NoCaseSearcher searcher(needle);
+
+		std::vector<std::wstring> haystacks;
+		for (int h = 0; h < 8; h++)
+		{
+			std::wstring haystack = RandomText(random, random() % 200, alphabetSize);
+			// plant the needle, case changed and sometimes with its last unit changed
+			if (needle.size() && random() % 2)
+			{
+				std::wstring planted = needle;
+				for (auto& c : planted)
+				{
+					c = (random() % 2) ? towupper(c) : c;
+				}
+				if (random() % 3 == 0)
+				{
+					planted.back() = alphabet[random() % alphabetSize];
+				}
+				haystack.insert(random() % (haystack.size() + 1), planted);
+			}
+			haystacks.push_back(haystack);
+		}
+
+		std::vector<size_t> expectedPositions, expectedContaining;
+		for (size_t h = 0; h < haystacks.size(); h++)
+		{
+			const std::wstring& haystack = haystacks[h];
+			const size_t expected = NaiveFind(haystack, needle, 0);
+			expectedPositions.push_back(expected);
+			if (expected != std::wstring::npos)
+			{
+				expectedContaining.push_back(h);
+			}
+			REQUIRE(searcher.Find(haystack) == expected);
+			REQUIRE(wstringFindNoCase(haystack, needle) == expected);
+			for (int s = 0; s < 4; s++)
+			{
+				// including starts at and past the end
+				const size_t start = random() % (haystack.size() + 3);
+				REQUIRE(searcher.Find(haystack, start) == NaiveFind(haystack, needle, start));
+			}
+		}
+		std::vector<size_t> positions, containing;
+		CHECK(searcher.FindEach(haystacks, positions) == expectedContaining.size());
+		CHECK(positions == expectedPositions);
+		CHECK(searcher.FindAllContaining(haystacks, containing) == expectedContaining.size());
+		CHECK(containing == expectedContaining);
+	}
+}
+
+TEST(NoCaseSearcher_EmptyAndLongRepetitiveText)
+{
+	const NoCaseSearcher empty(L"");
+	const std::wstring_view abc(L"abc");
+	CHECK(empty.Find(abc) == 0);
+	CHECK(empty.Find(abc, 3) == 3);
+	CHECK(empty.Find(abc, 4) == std::wstring::npos);
+	CHECK(wstringFindNoCase(L"", L"") == 0);
+	CHECK(wstringFindNoCase(L"", L"a") == std::wstring::npos);
+
+	// the needle only at the end of text that nearly matches it everywhere
+	const std::wstring needle = std::wstring(40, L'a') + L"b";
+	const std::wstring haystack = std::wstring(100000, L'A') + L"B";
+	const NoCaseSearcher searcher(needle);
+	CHECK(searcher.Find(haystack) == haystack.size() - needle.size());
+	CHECK(searcher.Find(haystack, haystack.size() - needle.size() + 1) == std::wstring::npos);
+	CHECK(wstringFindNoCase(haystack, needle) == haystack.size() - needle.size());
+}
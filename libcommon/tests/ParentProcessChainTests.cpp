@@ -0,0 +1,65 @@
+#include "TestHarness.h"
+#include <windows.h>
+#include "../ParentProcessChain.h"
+
+TEST(ParentProcessChain_ReusedParentPIDIsNotTheParent)
+{
+	ParentProcessChain chain;
+	chain.AddPID(ProcessKey(100, 1000), L"Explorer.exe", ProcessKey(4, 500));
+	chain.AddPID(ProcessKey(200, 2000), L"cmd.exe", ProcessKey(100, 1000));
+	ATL::CString csParent;
+	CHECK(chain.GetParent(200, &csParent) == 100);
+	CHECK(csParent.Compare(L"explorer.exe") == 0);
+	CHECK(chain.GetParent(ProcessKey(200, 2000)).startTime == 1000);
+	CHECK(chain.IsChildOf(ProcessKey(200, 2000), L"explorer*"));
+
+	// the parent exits and a younger process gets its PID
+	CHECK(chain.RemovePID(ProcessKey(100, 1000)));
+	chain.AddPID(ProcessKey(100, 3000), L"explorer.exe", ProcessKey(4, 500));
+	CHECK(chain.GetParent(200) == 0);
+	CHECK(!chain.IsChildOf(200, L"explorer*"));
+	CHECK(chain.Size() == 2);
+
+	// keys of the exited process are ignored
+	CHECK(!chain.IsTracked(ProcessKey(100, 1000)));
+	CHECK(chain.GetParent(ProcessKey(100, 1000)).pid == 0);
+	CHECK(!chain.IsChildOf(ProcessKey(100, 1000), L"*"));
+	CHECK(!chain.RemovePID(ProcessKey(100, 1000)));
+	CHECK(chain.IsTracked(ProcessKey(100, 3000)));
+	CHECK(chain.GetProcessKey(100).startTime == 3000);
+
+	// nor is the new process the parent of one started before it
+	chain.AddPID(ProcessKey(300, 2500), L"late.exe", ProcessKey(100, 1000));
+	CHECK(chain.GetParent(300) == 0);
+	chain.AddPID(ProcessKey(400, 3500), L"child.exe", ProcessKey(100, 3000));
+	CHECK(chain.GetParent(400) == 100);
+	CHECK(chain.GetNestLevelOfPID(400) == 1);
+}
+
+TEST(ParentProcessChain_CreationTimeQueriesMakeNoEntries)
+{
+	ParentProcessChain chain;
+	chain.AddPID(ProcessKey(100, 1000), L"a.exe", ProcessKey(4, 500));
+	std::vector<DWORD> pids;
+	CHECK(chain.SortHierarchically(pids) == 2);
+	CHECK((pids == std::vector<DWORD>{ 4, 100 }));
+
+	unsigned long long creationTime = 0;
+	CHECK(chain.RecordCreationTime(100, creationTime));
+	CHECK(creationTime == 1000);
+	// a PID without an entry is queried, and left without one
+	creationTime = 0;
+	chain.RecordCreationTime(999, creationTime);
+	CHECK(creationTime != 0);
+	chain.EraseCreationTime(998);
+	CHECK(chain.SortHierarchically(pids) == 2);
+	CHECK((pids == std::vector<DWORD>{ 4, 100 }));
+	CHECK(chain.Size() == 1);
+
+	// an erased time is queried again, and kept by the entry
+	chain.EraseCreationTime(100);
+	CHECK(chain.GetProcessKey(100).startTime == 0);
+	chain.RecordCreationTime(100, creationTime);
+	CHECK(creationTime != 1000);
+	CHECK(chain.GetProcessKey(100).startTime == creationTime);
+}
@@ -0,0 +1,158 @@
+#include "TestHarness.h"
+#include <windows.h>
+#include "../ProcessCache.h"
+#include <map>
+#include <thread>
+
+struct Tick { typedef unsigned long long type; };
+struct Name { typedef std::wstring type; };
+typedef ProcessCacheSchema<Tick, Name> TestSchema;
+typedef ProcessCacheT<TestSchema> TestCache;
+
+TEST(ProcessCacheSnapshot_ReadersSeeWholeTicks)
+{
+	ProcessCacheSnapshotPublisher<TestSchema> publisher;
+	CHECK(publisher.acquire()->size() == 0);
+	std::atomic<bool> isDone{ false };
+	std::atomic<unsigned long long> torn{ 0 }, reads{ 0 };
+	std::vector<std::thread> readers;
+	for (int r = 0; r < 4; r++)
+	{
+		readers.emplace_back([&]()
+			{
+				while (!isDone)
+				{
+					auto snapshot = publisher.acquire();
+					for (auto& entry : *snapshot)
+					{
+						// every record of a snapshot was written in the same tick
+						if (entry.second.get<Tick>() != snapshot->get_tick())
+						{
+							torn++;
+						}
+					}
+					reads++;
+				}
+			});
+	}
+	TestCache::Record record;
+	for (unsigned long long tick = 1; tick <= 2000; tick++)
+	{
+		auto* snapshot = publisher.begin_snapshot();
+		for (unsigned int pid = 4; pid <= 64; pid += 4)
+		{
+			record.set<Tick>(tick);
+			snapshot->add(pid, record);
+		}
+		snapshot->finish();
+		publisher.publish(snapshot);
+	}
+	isDone = true;
+	for (auto& reader : readers)
+	{
+		reader.join();
+	}
+	CHECK(torn == 0);
+	CHECK(reads > 0);
+	CHECK(publisher.acquire()->get_tick() == 2000);
+}
+
+TEST(ProcessCacheSnapshot_ReusesReleasedSnapshots)
+{
+	ProcessCacheSnapshotPublisher<TestSchema> publisher;
+	auto* first = publisher.begin_snapshot();
+	publisher.publish(first);
+	auto* second = publisher.begin_snapshot();
+	publisher.publish(second);
+	// first is unpublished and unheld, so it's filled again
+	CHECK(publisher.begin_snapshot() == first);
+
+	ProcessCacheSnapshotPublisher<TestSchema>::Reference held = publisher.acquire();
+	CHECK(held.get() == second);
+	publisher.publish(first);
+	// second is still held by a reader, so it isn't handed out
+	auto* third = publisher.begin_snapshot();
+	CHECK(third != second);
+	CHECK(third != first);
+	CHECK(held->get_tick() == 2);
+	held.reset();
+	publisher.publish(third);
+	CHECK(publisher.begin_snapshot() == second);
+}
+
+TEST(ProcessCache_ReusedPIDStartsOver)
+{
+	TestCache cache;
+	cache.set<Name>(ProcessKey(8, 100), L"first.exe");
+	cache.set<Tick>(ProcessKey(8, 100), 1);
+	std::wstring name;
+	CHECK(cache.get<Name>(ProcessKey(8), name) && name == L"first.exe");
+	CHECK(!cache.get<Name>(ProcessKey(8, 200), name));
+	// a write from the process now holding the PID drops the old metrics
+	cache.set<Name>(ProcessKey(8, 200), L"second.exe");
+	unsigned long long tick = 0;
+	CHECK(!cache.get<Tick>(ProcessKey(8, 200), tick));
+	CHECK(cache.get<Name>(ProcessKey(8, 200), name) && name == L"second.exe");
+	cache.erase(ProcessKey(8, 100));
+	CHECK(cache.size() == 1);
+	cache.erase(ProcessKey(8, 200));
+	CHECK(cache.size() == 0);
+}
+
+TEST(ProcessCache_ApplyTickMergesAndErases)
+{
+	TestCache cache;
+	std::map<unsigned int, unsigned long long> expected;
+	uint32_t seed = 5;
+	for (unsigned long long tick = 1; tick <= 50; tick++)
+	{
+		// a random subset of PIDs is running this tick
+		std::vector<TestCache::Entry> entries;
+		std::map<unsigned int, unsigned long long> running;
+		for (unsigned int pid = 4; pid <= 400; pid += 4)
+		{
+			seed = seed * 1664525 + 1013904223;
+			if ((seed >> 16) % 3)
+			{
+				TestCache::Record record;
+				record.set<Tick>(tick);
+				entries.emplace_back(pid, record);
+				running[pid] = tick;
+			}
+		}
+		std::vector<unsigned int> removed;
+		const size_t erased = cache.apply_tick(entries, &removed);
+
+		std::vector<unsigned int> expectedRemoved;
+		for (auto& i : expected)
+		{
+			if (!running.count(i.first))
+			{
+				expectedRemoved.push_back(i.first);
+			}
+		}
+		std::sort(removed.begin(), removed.end());
+		CHECK(removed == expectedRemoved);
+		CHECK(erased == expectedRemoved.size());
+		expected = running;
+
+		std::map<unsigned int, unsigned long long> actual;
+		cache.for_each([&](const unsigned int pid, const TestCache::Record& record) { actual[pid] = record.get<Tick>(); });
+		CHECK(actual == expected);
+	}
+}
+
+TEST(ProcessCache_ApplyTickKeepAbsentOnlyMerges)
+{
+	TestCache cache;
+	cache.set<Name>(ProcessKey(12), L"kept.exe");
+	TestCache::Record record;
+	record.set<Tick>(7);
+	const std::vector<TestCache::Entry> entries{ { 12, record }, { 16, record } };
+	CHECK(cache.apply_tick(entries, nullptr, true) == 0);
+	std::wstring name;
+	unsigned long long tick = 0;
+	CHECK(cache.get<Name>(ProcessKey(12), name) && name == L"kept.exe");
+	CHECK(cache.get<Tick>(ProcessKey(12), tick) && tick == 7);
+	CHECK(cache.size() == 2);
+}
@@ -0,0 +1,98 @@
+#include "TestHarness.h"
+#include "../ProcessHistory.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+static bool IsNear(const double a, const double b)
+{
+	return std::fabs(a - b) <= 1e-6 * (1 + std::fabs(b));
+}
+
+TEST(ProcessHistory_WindowStatsMatchBruteForce)
+{
+	// past 65536 samples, so the 16 bit queue positions wrap
+	const size_t capacities[] = { 1, 5, 64 };
+	for (const size_t capacity : capacities)
+	{
+		ProcessHistory history(2, capacity, 4);
+		history.set_ema_alpha(1, 0.25);
+		std::mt19937 random(static_cast<unsigned int>(capacity));
+		std::vector<float> all;
+		double ema = 0;
+		for (int i = 0; i < 70000; i++)
+		{
+			// runs of rising and falling values exercise the monotonic queues
+			const float value = static_cast<float>((i / 7) % 2 ? i % 7 : 100 - i % 7) + static_cast<float>(random() % 1000) / 1000;
+			const double values[2] = { 0, value };
+			REQUIRE(history.append_all(ProcessKey(42, 1000), values));
+			all.push_back(value);
+			ema = i ? ema + 0.25 * (value - ema) : value;
+			if (i % 997 != 0 && i < 69990)
+			{
+				continue;
+			}
+			const size_t count = all.size() < capacity ? all.size() : capacity;
+			const std::vector<float> window(all.end() - count, all.end());
+			ProcessHistory::Stats stats;
+			REQUIRE(history.get_stats(ProcessKey(42, 1000), 1, stats));
+			CHECK(stats.count == count);
+			CHECK(stats.last == window.back());
+			CHECK(stats.min == *std::min_element(window.begin(), window.end()));
+			CHECK(stats.max == *std::max_element(window.begin(), window.end()));
+			double sum = 0;
+			for (auto sample : window)
+			{
+				sum += sample;
+			}
+			CHECK(IsNear(stats.mean, sum / count));
+			CHECK(IsNear(stats.ema, ema));
+			std::vector<float> samples;
+			CHECK(history.get_samples(ProcessKey(42, 1000), 1, samples) == count);
+			CHECK(samples == window);
+		}
+	}
+}
+
+TEST(ProcessHistory_ReusedPIDStartsOver)
+{
+	ProcessHistory history(1, 4, 2);
+	ProcessHistory::Stats stats;
+	CHECK(!history.get_stats(ProcessKey(7, 100), 0, stats));
+	CHECK(history.append(ProcessKey(7, 100), 0, 1));
+	CHECK(history.append(ProcessKey(7, 100), 0, 3));
+	// a bare PID is the process tracked under it
+	CHECK(history.get_stats(ProcessKey(7), 0, stats) && stats.count == 2 && stats.mean == 2);
+	CHECK(!history.get_stats(ProcessKey(7, 200), 0, stats));
+
+	// another process with the PID starts the history over
+	CHECK(history.append(ProcessKey(7, 200), 0, 10));
+	CHECK(history.get_stats(ProcessKey(7, 200), 0, stats) && stats.count == 1 && stats.min == 10);
+	CHECK(!history.get_stats(ProcessKey(7, 100), 0, stats));
+
+	// erasing the older process leaves the newer one's history
+	history.erase(ProcessKey(7, 100));
+	CHECK(history.size() == 1);
+	history.erase(ProcessKey(7, 200));
+	CHECK(history.size() == 0);
+	CHECK(!history.get_stats(ProcessKey(7), 0, stats));
+}
+
+TEST(ProcessHistory_ArenaIsBounded)
+{
+	ProcessHistory history(1, 4, 2);
+	CHECK(history.append(ProcessKey(1, 1), 0, 1));
+	CHECK(history.append(ProcessKey(2, 1), 0, 2));
+	CHECK(!history.append(ProcessKey(3, 1), 0, 3));
+	CHECK(history.size() == 2);
+	// an erased process's slot is reused, without its samples
+	history.erase(ProcessKey(1, 1));
+	CHECK(history.append(ProcessKey(3, 1), 0, 3));
+	std::vector<float> samples;
+	CHECK(history.get_samples(ProcessKey(3, 1), 0, samples) == 1);
+	CHECK((samples == std::vector<float>{ 3 }));
+	history.clear();
+	CHECK(history.size() == 0);
+	CHECK(history.append(ProcessKey(4, 1), 0, 4));
+	CHECK(history.append(ProcessKey(5, 1), 0, 5));
+}
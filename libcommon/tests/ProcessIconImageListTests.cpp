@@ -0,0 +1,43 @@
+#include "TestHarness.h"
+#include <windows.h>
+// ProcessIconImageList logs through the including application's ICON_DEBUG_PRINT
+#define ICON_DEBUG_PRINT(...)
+#include "../ProcessIconImageList.h"
+
+TEST(ProcessIconImageList_ReusedPIDReleasesOnlyItsOwnIcon)
+{
+	ProcessIconImageList icons(reinterpret_cast<HICON>(1));
+	bool wentToDisk = false;
+	icons.AddTrackedProcess(ProcessKey(10, 100), L"C:\\a.exe", &wentToDisk);
+	CHECK(wentToDisk);
+	icons.AddTrackedProcess(ProcessKey(11, 100), L"C:\\b.exe");
+	icons.AddTrackedProcess(ProcessKey(12, 100), L"C:\\B.exe", &wentToDisk);
+	CHECK(!wentToDisk);
+	CHECK(icons.GetImageListIndexForProcess(ProcessKey(10, 100)) == 1);
+	CHECK(icons.GetImageListIndexForProcess(ProcessKey(11)) == 2);
+	// adding a tracked process again takes no reference
+	icons.AddTrackedProcess(ProcessKey(10), L"C:\\a.exe", &wentToDisk);
+	CHECK(!wentToDisk);
+
+	// another process with PID 10 releases a.exe's icon, and b.exe's moves down
+	icons.AddTrackedProcess(ProcessKey(10, 200), L"C:\\c.exe");
+	CHECK(icons.GetImageListIndexForFilename(L"c:\\A.EXE") == 0);
+	CHECK(icons.GetImageListIndexForProcess(ProcessKey(11, 100)) == 1);
+	CHECK(icons.GetImageListIndexForProcess(ProcessKey(10, 200)) == 2);
+	CHECK(icons.GetImageListIndexForProcess(ProcessKey(10, 100)) == 0);
+
+	// a reused PID releases the file's reference only for its own process
+	icons.AddTrackedProcess(ProcessKey(12, 200), L"C:\\d.exe");
+	CHECK(icons.GetImageListIndexForProcess(ProcessKey(11, 100)) == 1);
+	CHECK(icons.GetImageListIndexForProcess(ProcessKey(12)) == 3);
+
+	// the exited process's key removes nothing
+	CHECK(!icons.RemoveTrackedProcess(ProcessKey(10, 100)));
+	CHECK(icons.GetImageListIndexForProcess(ProcessKey(10, 200)) == 2);
+	CHECK(icons.RemoveTrackedProcess(ProcessKey(10, 200)));
+	CHECK(!icons.RemoveTrackedProcess(ProcessKey(10, 200)));
+	CHECK(icons.GetImageListIndexForProcess(ProcessKey(12, 200)) == 2);
+	CHECK(icons.RemoveTrackedProcess(ProcessKey(11)));
+	CHECK(icons.GetImageListIndexForFilename(L"C:\\b.exe") == 0);
+	CHECK(icons.RemoveTrackedProcess(ProcessKey(12, 200)));
+}
@@ -0,0 +1,108 @@
+#include "TestHarness.h"
+#include "../SmallVector.h"
+#include <string>
+
+// counts live instances, so leaks and double destruction show up
+struct Counted
+{
+	static int live;
+	std::string value;
+
+	Counted(const std::string& text = "") : value(text)
+	{
+		live++;
+	}
+	Counted(const Counted& other) : value(other.value)
+	{
+		live++;
+	}
+	Counted(Counted&& other) noexcept : value(std::move(other.value))
+	{
+		live++;
+	}
+	Counted& operator = (const Counted&) = default;
+	~Counted()
+	{
+		live--;
+	}
+};
+int Counted::live = 0;
+
+TEST(SmallVector_GrowsFromInlineToHeap)
+{
+	{
+		SmallVector<Counted, 3> v;
+		CHECK(v.is_inline() && v.capacity() == 3 && v.empty());
+		for (int i = 0; i < 3; i++)
+		{
+			v.emplace_back(std::to_string(i));
+		}
+		CHECK(v.is_inline());
+		// long enough that the strings are on the heap and have to be moved, not copied bytewise
+		v.push_back(Counted(std::string(40, 'x')));
+		CHECK(!v.is_inline());
+		CHECK(v.capacity() >= 4);
+		CHECK(v.size() == 4 && v[0].value == "0" && v[2].value == "2" && v.back().value == std::string(40, 'x'));
+		CHECK(Counted::live == 4);
+
+		// an element pushed while the storage is full is copied before the storage moves
+		SmallVector<Counted, 2> self;
+		self.push_back(Counted(std::string(30, 'a')));
+		self.push_back(Counted("b"));
+		self.push_back(self[0]);
+		CHECK(self.size() == 3 && self[2].value == std::string(30, 'a'));
+
+		v.pop_back();
+		CHECK(v.size() == 3);
+		v.resize(6);
+		CHECK(v.size() == 6 && v[5].value.empty());
+		v.resize(1);
+		CHECK(v.size() == 1 && v[0].value == "0");
+		const size_t capacity = v.capacity();
+		v.clear();
+		CHECK(v.empty() && v.capacity() == capacity);
+	}
+	CHECK(Counted::live == 0);
+}
+
+TEST(SmallVector_CopyAndMove)
+{
+	{
+		for (const size_t count : { 2, 5 })
+		{
+			SmallVector<Counted, 3> source;
+			for (size_t i = 0; i < count; i++)
+			{
+				source.emplace_back(std::string(20, static_cast<char>('a' + i)));
+			}
+			const bool wasInline = source.is_inline();
+
+			SmallVector<Counted, 3> copy(source);
+			CHECK(copy.size() == count && source.size() == count);
+			CHECK(copy[count - 1].value == source[count - 1].value);
+			CHECK(copy.data() != source.data());
+
+			// a heap block is taken over, inline elements are moved one by one
+			const Counted* heapData = source.data();
+			SmallVector<Counted, 3> moved(std::move(source));
+			CHECK(moved.size() == count && moved.is_inline() == wasInline);
+			CHECK(wasInline || moved.data() == heapData);
+			CHECK(source.empty() && source.is_inline());
+			CHECK(moved[0].value == std::string(20, 'a'));
+
+			// assigning over existing elements, either way
+			SmallVector<Counted, 3> target = { Counted("x"), Counted("y"), Counted("z"), Counted("w") };
+			target = copy;
+			CHECK(target.size() == count && target[0].value == copy[0].value);
+			target = std::move(moved);
+			CHECK(target.size() == count && moved.empty());
+			target = target;
+			CHECK(target.size() == count && target[count - 1].value == std::string(20, static_cast<char>('a' + count - 1)));
+
+			// the moved from vector is usable again
+			moved.emplace_back("again");
+			CHECK(moved.size() == 1 && moved.is_inline());
+		}
+	}
+	CHECK(Counted::live == 0);
+}
@@ -0,0 +1,69 @@
+#include "TestHarness.h"
+#include <windows.h>
+#include "../libCommon.h"
+#include "../StringSplit.h"
+#include <vector>
+
+static std::vector<std::wstring> Fields(const std::wstring_view text, const wchar_t delim, const SplitEmpty empty = SplitEmpty::Skip)
+{
+	std::vector<std::wstring> fields;
+	for (auto field : SplitString(text, delim, empty))
+	{
+		fields.emplace_back(field);
+	}
+	return fields;
+}
+
+TEST(StringSplit_SkipsOrKeepsEmptyFields)
+{
+	CHECK((Fields(L"a;b;c", L';') == std::vector<std::wstring>{ L"a", L"b", L"c" }));
+	CHECK((Fields(L";;a;;b;", L';') == std::vector<std::wstring>{ L"a", L"b" }));
+	CHECK(Fields(L"", L';').empty());
+	CHECK(Fields(L";;;", L';').empty());
+	// only the delimiter splits, other separators are part of the fields
+	CHECK((Fields(L"a,b;c d", L';') == std::vector<std::wstring>{ L"a,b", L"c d" }));
+
+	// n delimiters always give n + 1 fields when empty ones are kept
+	const std::wstring_view texts[] = { L"", L";", L";;", L"a", L"a;", L";a", L"a;;b", L";a;b;" };
+	for (auto text : texts)
+	{
+		size_t delimiters = 0;
+		for (auto c : text)
+		{
+			delimiters += (c == L';');
+		}
+		CHECK(Fields(text, L';', SplitEmpty::Keep).size() == delimiters + 1);
+	}
+	CHECK((Fields(L";a;;b;", L';', SplitEmpty::Keep) == std::vector<std::wstring>{ L"", L"a", L"", L"b", L"" }));
+
+	// fields are views into the text
+	const std::string text = "x|yy|";
+	std::vector<std::string_view> views;
+	CHECK(SplitString(text, '|', views) == 2);
+	CHECK(views[1].data() == text.data() + 2 && views[1] == "yy");
+	CHECK(SplitString(std::string_view(text), '|', views, SplitEmpty::Keep) == 3);
+	CHECK(views.size() == 5 && views.back().empty());
+}
+
+TEST(StringSplit_IntoSmallVector)
+{
+	SmallVector<std::wstring_view, 4> fields;
+	CHECK(SplitString(L"a;b;c", L';', fields) == 3);
+	CHECK(fields.is_inline());
+	// past the inline capacity the appended fields move to the heap
+	CHECK(SplitString(L"d;e;f", L';', fields) == 3);
+	CHECK(!fields.is_inline());
+	CHECK(fields.size() == 6 && fields[0] == L"a" && fields[5] == L"f");
+}
+
+TEST(StringSplit_ExplodeStringAppendsNonEmptyFields)
+{
+	std::vector<ATL::CString> fields = { ATL::CString(L"kept") };
+	CHECK(ExplodeString(ATL::CString(L";notepad.exe;;C:\\Tools\\*;"), L';', fields) == 3);
+	CHECK(fields.size() == 3);
+	CHECK(std::wstring(fields[1].GetString()) == L"notepad.exe");
+	CHECK(std::wstring(fields[2].GetString()) == L"C:\\Tools\\*");
+	CHECK(ExplodeString(ATL::CString(L""), L';', fields) == 3);
+	CHECK(ExplodeString(ATL::CString(L"a,b"), L',', fields) == 5);
+	CHECK(std::wstring(fields[4].GetString()) == L"b");
+}
@@ -0,0 +1,75 @@
+#pragma once
+// TestHarness
+//  minimal self-registering test cases for libcommon-tests
+//  TEST(Name) defines a case, CHECK(condition) records a failure (with file and line) and carries on,
+//  REQUIRE(condition) records it and leaves the case. RunAllTests runs every case, returns the failure count.
+//
+//  portable (no Windows dependencies)
+
+#include <cstdio>
+#include <vector>
+
+namespace TestHarness
+{
+	typedef void(*TestFn)();
+
+	struct TestCase
+	{
+		const char* name;
+		TestFn fn;
+	};
+
+	inline std::vector<TestCase>& GetTests()
+	{
+		static std::vector<TestCase> tests;
+		return tests;
+	}
+	inline int& GetFailureCount()
+	{
+		static int failures = 0;
+		return failures;
+	}
+
+	struct Registrar
+	{
+		Registrar(const char* name, const TestFn fn)
+		{
+			GetTests().push_back({ name, fn });
+		}
+	};
+
+	inline bool Check(const bool condition, const char* expression, const char* file, const int line)
+	{
+		if (!condition)
+		{
+			printf("  FAILED %s(%d): %s\n", file, line, expression);
+			GetFailureCount()++;
+		}
+		return condition;
+	}
+
+	inline int RunAllTests()
+	{
+		int failedTests = 0;
+		for (auto& test : GetTests())
+		{
+			const int failuresBefore = GetFailureCount();
+			printf("%s\n", test.name);
+			test.fn();
+			if (GetFailureCount() != failuresBefore)
+			{
+				failedTests++;
+			}
+		}
+		printf("%zu tests, %d failed\n", GetTests().size(), failedTests);
+		return failedTests;
+	}
+}
+
+#define TEST(name) \
+	static void name(); \
+	static TestHarness::Registrar name##_registrar(#name, name); \
+	static void name()
+
+#define CHECK(condition) TestHarness::Check((condition), #condition, __FILE__, __LINE__)
+#define REQUIRE(condition) do { if (!CHECK(condition)) return; } while (0)
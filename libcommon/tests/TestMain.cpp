@@ -0,0 +1,10 @@
+// libcommon-tests
+//  behaviour tests for the portable libcommon components, one file per component
+//  exit code is the number of failed tests
+
+#include "TestHarness.h"
+
+int main()
+{
+	return TestHarness::RunAllTests();
+}
@@ -0,0 +1,73 @@
+#include "TestHarness.h"
+#include "../UTFConvert.h"
+
+// differential fuzz of the SIMD paths against the scalar ones, plus UTF-8 -> UTF-16 -> UTF-8 round trips
+// of valid input. Random buffers are biased towards ASCII runs and sequence boundaries.
+TEST(UTFConvert_DifferentialFuzz)
+{
+	const char* pieces[] = { "a", "abcdefghijklmnop", "\x7f", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\xed\x9f\xbf",
+		"\xef\xbf\xbd", "\xc0\xaf", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xe2\x82", "\x80", "\xff", "\xf0\x9f" };
+	const size_t validPieces = 8;
+	std::string utf8;
+	std::u16string simd16, scalar16;
+	std::string simd8, scalar8;
+	uint32_t seed = 1;
+	for (int iteration = 0; iteration < 2000; iteration++)
+	{
+		// LCG, good enough to move sequences across the 16 unit lanes
+		seed = seed * 1664525 + 1013904223;
+		const bool isValidInput = (seed >> 20) & 1;
+		const size_t pieceCount = (seed >> 8) % 64;
+		utf8.clear();
+		for (size_t i = 0; i < pieceCount; i++)
+		{
+			seed = seed * 1664525 + 1013904223;
+			utf8 += pieces[(seed >> 16) % (isValidInput ? validPieces : sizeof(pieces) / sizeof(pieces[0]))];
+		}
+		bool isSIMDValid = true, isScalarValid = true;
+		simd16.assign(UTFConvert::MaxUTF16Length(utf8.size()), u'\0');
+		scalar16.assign(UTFConvert::MaxUTF16Length(utf8.size()), u'\0');
+		simd16.resize(UTFConvert::ConvertUTF8ToUTF16(utf8.data(), utf8.size(), &simd16[0], &isSIMDValid, true));
+		scalar16.resize(UTFConvert::ConvertUTF8ToUTF16(utf8.data(), utf8.size(), &scalar16[0], &isScalarValid, false));
+		REQUIRE(simd16 == scalar16);
+		REQUIRE(isSIMDValid == isScalarValid);
+		REQUIRE(!isValidInput || isSIMDValid);
+
+		simd8.assign(UTFConvert::MaxUTF8Length<char16_t>(simd16.size()), '\0');
+		scalar8.assign(UTFConvert::MaxUTF8Length<char16_t>(simd16.size()), '\0');
+		simd8.resize(UTFConvert::ConvertUTF16ToUTF8(simd16.data(), simd16.size(), &simd8[0], nullptr, true));
+		scalar8.resize(UTFConvert::ConvertUTF16ToUTF8(simd16.data(), simd16.size(), &scalar8[0], nullptr, false));
+		REQUIRE(simd8 == scalar8);
+		REQUIRE(!isValidInput || simd8 == utf8);
+	}
+}
+
+TEST(UTFConvert_ReplacesEachInvalidSubpart)
+{
+	bool isValid = true;
+	std::u16string utf16(16, u'\0');
+	// overlong, truncated 3 byte sequence, stray continuation byte, encoded surrogate
+	const char invalid[] = "\xc0\xaf" "x" "\xe2\x82" "y" "\x80" "\xed\xa0\x80";
+	utf16.resize(UTFConvert::ConvertUTF8ToUTF16(invalid, sizeof(invalid) - 1, &utf16[0], &isValid));
+	CHECK(!isValid);
+	CHECK(utf16 == u"\xfffd\xfffdx\xfffdy\xfffd\xfffd\xfffd\xfffd");
+
+	// unpaired surrogates going the other way
+	const char16_t unpaired[] = { u'a', 0xd800, u'b', 0xdc00 };
+	std::string utf8(16, '\0');
+	isValid = true;
+	utf8.resize(UTFConvert::ConvertUTF16ToUTF8(unpaired, 4, &utf8[0], &isValid));
+	CHECK(!isValid);
+	CHECK(utf8 == "a\xef\xbf\xbd" "b\xef\xbf\xbd");
+}
+
+TEST(UTFConvert_WideRoundTrip)
+{
+	const std::string utf8 = "plain \xc3\xa9t\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 and a run of ascii past sixteen units";
+	const std::wstring wide = UTFConvert::ToWide(utf8);
+	CHECK(wide.find(L'\x20ac') != std::wstring::npos);
+	CHECK(UTFConvert::ToUTF8(wide) == utf8);
+	std::string appended = "prefix:";
+	CHECK(UTFConvert::AppendUTF16ToUTF8(appended, wide.c_str(), wide.size()));
+	CHECK(appended == "prefix:" + utf8);
+}
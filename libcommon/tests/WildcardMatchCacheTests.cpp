@@ -0,0 +1,45 @@
+#include "TestHarness.h"
+#include "../WildcardMatchCache.h"
+
+TEST(WildcardMatchCache_SetsSharingACacheKeepTheirEntries)
+{
+	const WildcardSet exes(std::vector<std::wstring>{ L"*.exe" });
+	const WildcardSet services(std::vector<std::wstring>{ L"svc*", L"*host*" });
+	WildcardMatchCache cache;
+	const std::wstring names[] = { L"svchost.exe", L"notepad.exe", L"svc.dll", L"conhost" };
+	for (int round = 0; round < 100; round++)
+	{
+		for (auto& name : names)
+		{
+			CHECK(cache.FindFirst(exes, name) == exes.FindFirst(name));
+			CHECK(cache.FindFirst(services, name) == services.FindFirst(name));
+		}
+	}
+	// one miss per (set, name), every later lookup hits
+	CHECK(cache.GetMissCount() == 8);
+	CHECK(cache.GetHitCount() == 800 - 8);
+}
+
+TEST(WildcardMatchCache_RecompileInvalidates)
+{
+	WildcardSet patterns(std::vector<std::wstring>{ L"*.exe" });
+	WildcardMatchCache cache;
+	CHECK(cache.IsMatch(patterns, L"notepad.exe"));
+	CHECK(cache.IsMatch(patterns, L"notepad.exe"));
+	patterns.Compile(std::vector<std::wstring>{ L"*.dll" });
+	CHECK(!cache.IsMatch(patterns, L"notepad.exe"));
+	CHECK(cache.GetMissCount() == 2);
+	CHECK(cache.GetHitCount() == 1);
+}
+
+TEST(WildcardMatchCache_FullShardIsEmptied)
+{
+	const WildcardSet patterns(std::vector<std::wstring>{ L"a*" });
+	WildcardMatchCache cache(32);
+	for (int i = 0; i < 1000; i++)
+	{
+		const std::wstring name = L"a" + std::to_wstring(i);
+		CHECK(cache.IsMatch(patterns, name));
+	}
+	CHECK(cache.Size() <= 32);
+}
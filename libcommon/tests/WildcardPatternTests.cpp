@@ -0,0 +1,75 @@
+#include "TestHarness.h"
+#include "../WildcardPattern.h"
+
+// classic DP over (pattern, string) positions, as the reference for * and ?
+static bool ReferenceMatch(const std::wstring& pattern, const std::wstring& str)
+{
+	std::vector<std::vector<bool>> matches(pattern.size() + 1, std::vector<bool>(str.size() + 1, false));
+	matches[0][0] = true;
+	for (size_t p = 1; p <= pattern.size(); p++)
+	{
+		for (size_t s = 0; s <= str.size(); s++)
+		{
+			if (pattern[p - 1] == L'*')
+			{
+				matches[p][s] = matches[p - 1][s] || (s && matches[p][s - 1]);
+			}
+			else if (s)
+			{
+				matches[p][s] = matches[p - 1][s - 1]
+					&& (pattern[p - 1] == L'?' || CaseFold::Fold(pattern[p - 1]) == CaseFold::Fold(str[s - 1]));
+			}
+		}
+	}
+	return matches[pattern.size()][str.size()];
+}
+
+TEST(WildcardPattern_MatchesReference)
+{
+	// small alphabet so segments repeat and overlap, which is what the segment search has to get right
+	const wchar_t alphabet[] = { L'a', L'A', L'b', L'c', L'*', L'?' };
+	uint32_t seed = 3;
+	for (int iteration = 0; iteration < 20000; iteration++)
+	{
+		std::wstring pattern, str;
+		seed = seed * 1664525 + 1013904223;
+		const size_t patternLength = 1 + (seed >> 8) % 8;
+		const size_t strLength = 1 + (seed >> 16) % 16;
+		for (size_t i = 0; i < patternLength; i++)
+		{
+			seed = seed * 1664525 + 1013904223;
+			pattern += alphabet[(seed >> 16) % 6];
+		}
+		for (size_t i = 0; i < strLength; i++)
+		{
+			seed = seed * 1664525 + 1013904223;
+			str += alphabet[(seed >> 16) % 4];
+		}
+		const WildcardPattern compiled(pattern);
+		REQUIRE(compiled.Match(str) == ReferenceMatch(pattern, str));
+	}
+}
+
+TEST(WildcardPattern_CaseInversionAndEmpty)
+{
+	CHECK(WildcardPattern(L"*.EXE").Match(L"notepad.exe"));
+	CHECK(!WildcardPattern(L"*.EXE", false).Match(L"notepad.exe"));
+	CHECK(WildcardPattern(L"~*.exe").Match(L"notepad.dll"));
+	CHECK(!WildcardPattern(L"!*.exe").Match(L"notepad.exe"));
+	CHECK(WildcardPattern(L"~~*.exe").Match(L"notepad.exe"));
+	// as wildicmpEx, an empty string or pattern never matches, inverted or not
+	CHECK(!WildcardPattern(L"*").Match(L""));
+	CHECK(!WildcardPattern(L"~*.exe").Match(L""));
+	CHECK(!WildcardPattern(L"").Match(L"a"));
+	CHECK(WildcardPattern(L"note?ad*").Match(L"NotePad++.exe"));
+}
+
+TEST(WildcardPattern_RepetitiveStringIsOnePass)
+{
+	// the naive search would compare the whole segment at each of the string's positions
+	const std::wstring str = std::wstring(200000, L'a') + L"b";
+	const WildcardPattern found(L"*" + std::wstring(5000, L'a') + L"b*");
+	CHECK(found.Match(str));
+	const WildcardPattern missing(L"*" + std::wstring(5000, L'a') + L"c*");
+	CHECK(!missing.Match(str));
+}
@@ -0,0 +1,197 @@
+#include "TestHarness.h"
+#include <windows.h>
+#include "../libCommon.h"
+#include "../WildcardSet.h"
+#include <thread>
+
+static std::wstring RandomString(uint32_t& seed, const wchar_t* alphabet, const size_t alphabetSize, const size_t maxLength)
+{
+	seed = seed * 1664525 + 1013904223;
+	const size_t length = (seed >> 8) % (maxLength + 1);
+	std::wstring str;
+	for (size_t i = 0; i < length; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		str += alphabet[(seed >> 16) % alphabetSize];
+	}
+	return str;
+}
+
+TEST(WildcardSet_MatchesEachPatternAlone)
+{
+	// small alphabet so keys repeat, overlap and share prefixes, which the automaton's links have to get right
+	const wchar_t patternAlphabet[] = { L'a', L'B', L'b', L'c', L'*', L'*', L'?' };
+	const wchar_t strAlphabet[] = { L'a', L'A', L'b', L'c' };
+	uint32_t seed = 5;
+	for (const bool caseInsensitive : { true, false })
+	{
+		for (int iteration = 0; iteration < 300; iteration++)
+		{
+			std::vector<std::wstring> patternList;
+			seed = seed * 1664525 + 1013904223;
+			const size_t patternCount = (seed >> 12) % 12;
+			for (size_t i = 0; i < patternCount; i++)
+			{
+				std::wstring pattern = RandomString(seed, patternAlphabet, 7, 6);
+				if (seed % 9 == 0)
+				{
+					pattern.insert(0, L"~");
+				}
+				patternList.push_back(pattern);
+			}
+			const WildcardSet set(patternList, caseInsensitive);
+			REQUIRE(set.GetPatternCount() == patternCount);
+			for (int s = 0; s < 20; s++)
+			{
+				const std::wstring str = RandomString(seed, strAlphabet, 4, 12);
+				std::vector<size_t> expected;
+				for (size_t i = 0; i < patternCount; i++)
+				{
+					if (WildcardPattern(patternList[i], caseInsensitive).Match(str))
+					{
+						expected.push_back(i);
+					}
+				}
+				std::vector<size_t> matches;
+				CHECK(set.FindAll(str, matches) == expected.size());
+				REQUIRE(matches == expected);
+				REQUIRE(set.FindFirst(str) == (expected.empty() ? WildcardSet::NO_MATCH : expected[0]));
+			}
+		}
+	}
+}
+
+// whether wildicmpEx reads the pattern differently, as WildcardPattern.h describes: a ?, * or inversion
+// right after a *
+static bool IsDocumentedDivergence(const std::wstring& pattern)
+{
+	for (size_t i = 0; i + 1 < pattern.size(); i++)
+	{
+		if (pattern[i] == L'*' && wcschr(L"*?~!", pattern[i + 1]))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+TEST(WildcardSet_MatchesWildicmpEx)
+{
+	// ASCII only, wildicmpEx folds with tolower where the set uses CaseFold
+	const wchar_t patternAlphabet[] = { L'a', L'A', L'b', L'*', L'*', L'?' };
+	const wchar_t strAlphabet[] = { L'a', L'A', L'b', L'B' };
+	uint32_t seed = 17;
+	size_t compared = 0;
+	for (int iteration = 0; iteration < 400; iteration++)
+	{
+		std::vector<std::wstring> patternList;
+		std::vector<ATL::CString> patternStrings;
+		while (patternList.size() < 8)
+		{
+			std::wstring pattern = RandomString(seed, patternAlphabet, 6, 6);
+			if (seed % 7 == 0)
+			{
+				pattern.insert(0, (seed & 0x100) ? L"~" : L"!");
+			}
+			if (!IsDocumentedDivergence(pattern))
+			{
+				patternList.push_back(pattern);
+				patternStrings.push_back(ATL::CString(pattern.c_str()));
+			}
+		}
+		const WildcardSet set(patternList);
+		for (int s = 0; s < 20; s++)
+		{
+			const std::wstring str = RandomString(seed, strAlphabet, 4, 10);
+			size_t expectedFirst = WildcardSet::NO_MATCH;
+			for (size_t i = 0; i < patternList.size(); i++)
+			{
+				const bool isMatch = wildicmpEx(patternList[i].c_str(), str.c_str());
+				REQUIRE(WildcardPattern(patternList[i]).Match(str) == isMatch);
+				if (isMatch && expectedFirst == WildcardSet::NO_MATCH)
+				{
+					expectedFirst = i;
+				}
+				compared++;
+			}
+			REQUIRE(set.FindFirst(str) == expectedFirst);
+			CHECK(IsStringMatchInVector(str.c_str(), set) == IsStringMatchInVector(str.c_str(), patternStrings));
+		}
+	}
+	CHECK(compared == 400 * 20 * 8);
+}
+
+TEST(WildcardSet_OverlappingKeysAndListOrder)
+{
+	const WildcardSet keys(std::vector<std::wstring>{ L"*he*", L"*she*", L"*hers*", L"*his*" });
+	std::vector<size_t> matches;
+	CHECK(keys.FindAll(L"USHERS", matches) == 3);
+	CHECK((matches == std::vector<size_t>{ 0, 1, 2 }));
+	CHECK(keys.FindAll(L"this", matches) == 1);
+	CHECK(keys.FindFirst(L"hisher") == 0);
+	CHECK(!keys.IsMatch(L"hs"));
+
+	// rule lists are matched in list order, wherever the pattern's key is
+	const WildcardSet rules(std::vector<const wchar_t*>{ L"*\\system32\\svchost.exe", L"chrome*.exe", L"~*.exe", L"*", L"???.exe" });
+	CHECK(rules.FindFirst(L"C:\\Windows\\System32\\svchost.exe") == 0);
+	CHECK(rules.FindFirst(L"Chrome_Helper.EXE") == 1);
+	CHECK(rules.FindFirst(L"readme.txt") == 2);
+	CHECK(rules.FindFirst(L"cmd.exe") == 3);
+	rules.FindAll(L"cmd.exe", matches);
+	CHECK((matches == std::vector<size_t>{ 3, 4 }));
+	// as wildicmpEx, an empty string matches nothing
+	CHECK(rules.FindFirst(L"") == WildcardSet::NO_MATCH);
+
+	const WildcardSet caseSensitive(std::vector<std::wstring>{ L"*.EXE" }, false);
+	CHECK(!caseSensitive.IsMatch(L"notepad.exe"));
+	CHECK(caseSensitive.IsMatch(L"NOTEPAD.EXE"));
+}
+
+TEST(WildcardSet_GenerationChangesOnCompile)
+{
+	WildcardSet set;
+	CHECK(set.GetPatternCount() == 0);
+	CHECK(set.FindFirst(L"anything") == WildcardSet::NO_MATCH);
+	const std::vector<std::wstring> patternList = { L"a*" };
+	set.Compile(patternList);
+	const uint64_t generation = set.GetGeneration();
+	const WildcardSet copy = set;
+	CHECK(copy.GetGeneration() == generation);
+	CHECK(copy.IsMatch(L"abc"));
+	set.Compile(patternList);
+	CHECK(set.GetGeneration() != generation);
+	CHECK(WildcardSet(patternList).GetGeneration() != set.GetGeneration());
+}
+
+TEST(WildcardSet_SharedBetweenThreads)
+{
+	std::vector<std::wstring> patternList;
+	for (int i = 0; i < 200; i++)
+	{
+		patternList.push_back(L"*process" + std::to_wstring(i) + L".exe");
+	}
+	const WildcardSet set(patternList);
+	bool isCorrect[4] = {};
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++)
+	{
+		threads.emplace_back([&, t]()
+			{
+				bool correct = true;
+				for (int i = 0; i < 2000; i++)
+				{
+					const int index = (i * 7 + t) % 200;
+					correct &= set.FindFirst(L"C:\\Tools\\Process" + std::to_wstring(index) + L".exe") == static_cast<size_t>(index);
+				}
+				isCorrect[t] = correct;
+			});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	for (auto correct : isCorrect)
+	{
+		CHECK(correct);
+	}
+}